@@ -1,6 +1,6 @@
 /* bitmap.c - bitmap handling code
  *
- * API: bitmap 1.0
+ * API: bitmap 1.13
  * IMPLEMENTATION: reff-1
  *
  * This file is released into the public domain, and permission is granted
@@ -14,52 +14,163 @@
 #include "bitmap.h"
 
 res_bitmap_t* res_bitmap_create(size_t num_bits)
+{
+  return(res_bitmap_create_opts(num_bits, 0));
+}
+
+res_bitmap_t* res_bitmap_create_opts(size_t num_bits, ushort opts)
 {
   res_bitmap_t *handle;
   void* base;
-   /*allocate memory*/
-    base = malloc( _res_bitmap_size(num_bits) );
+   /*check options*/
+    if(0 != (opts & ~(RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK | RES_BITMAP_OPT_DELTA)))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+   /*allocate memory - already 0, and for a big map not even touched yet*/
+    base = _res_bitmap_mem_alloc( _res_bitmap_size(num_bits) );
     if(NULL == base)
       return(NULL);
 
     handle = malloc( sizeof(res_bitmap_t) );
     if(NULL == handle)
     {
-      free(base);
+      _res_bitmap_mem_free(base, _res_bitmap_size(num_bits));
       return(NULL);
     }
 
-   /*create bitmap and handle*/
-    _res_bitmap_set(base, num_bits);
+   /*create handle*/
     _res_bitmap_handle_set(handle, base, num_bits);
+    handle->file = NULL;
+    if(0 != _res_bitmap_handle_init(handle, opts))
+    {
+      res_bitmap_destroy(handle);
+      return(NULL);
+    }
+  return(handle);
+}
 
+res_bitmap_t* res_bitmap_create_file(const char* path, size_t num_bits, ushort opts)
+{
+  res_bitmap_file_t *file;
+    if(0 != (opts & ~(RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK | RES_BITMAP_OPT_DELTA)))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+    file = _res_bitmap_file_create(path, num_bits);
+    if(NULL == file)
+      return(NULL);
+  return(_res_bitmap_create_mapped(file, num_bits, opts));
+}
+
+res_bitmap_t* res_bitmap_open_file(const char* path, ushort opts)
+{
+  res_bitmap_t *handle;
+  res_bitmap_file_t *file;
+  size_t num_bits;
+    if(0 != (opts & ~(RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK | RES_BITMAP_OPT_DELTA)))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+    file = _res_bitmap_file_open(path, &num_bits);
+    if(NULL == file)
+      return(NULL);
+    handle = _res_bitmap_create_mapped(file, num_bits, opts);
+
+   /*whatever is in the file is news to a copy - the first export sends it all*/
+    if((NULL != handle) && (NULL != handle->delta))
+      _res_bitmap_delta_touch(handle->delta, 0, num_bits / BITS);
   return(handle);
 }
 
-size_t _res_bitmap_size(size_t num_bits)
+ushort res_bitmap_sync(res_bitmap_t* bitmap_handle)
 {
-  return(_res_bitmap_limit(num_bits) + 1);  /*num_bits starts at zero, so we need to add 1*/
+  if(NULL == bitmap_handle->file)
+    return(0);
+  return(_res_bitmap_file_sync(bitmap_handle->file));
 }
 
-void _res_bitmap_set(void *base, size_t num_bits)
+res_bitmap_t* _res_bitmap_create_mapped(res_bitmap_file_t* file, size_t num_bits, ushort opts)
 {
-  size_t limit;
+  res_bitmap_t *handle;
+  int e;
+    handle = malloc( sizeof(res_bitmap_t) );
+    if(NULL == handle)
+    {
+      e = errno;
+      _res_bitmap_file_close(file);
+      errno = e;
+      return(NULL);
+    }
+
+   /*the map is used where it is mapped*/
+    _res_bitmap_handle_set(handle, (uint8_t*)file->mapping + RES_BITMAP_FILE_HEADER, num_bits);
+    handle->file = file;
+    if(0 != _res_bitmap_handle_init(handle, opts))
+    {
+      e = errno;
+      res_bitmap_destroy(handle);
+      errno = e;
+      return(NULL);
+    }
+  return(handle);
+}
 
-  limit = _res_bitmap_limit(num_bits);
+ushort _res_bitmap_handle_init(res_bitmap_t* bitmap_handle, ushort opts)
+{
+  bitmap_handle->opts = opts;
+  bitmap_handle->summary = NULL;
+  bitmap_handle->policy = RES_BITMAP_FIRST_FIT;
+  bitmap_handle->rover = 0;
+  bitmap_handle->extents = NULL;
+  bitmap_handle->rank = NULL;
+  bitmap_handle->delta = NULL;
 
- /*fill bitmap with 0's*/
-  memset(base, 0x00, limit + 1);
+ /*optional indexes*/
+  if(0 != (opts & RES_BITMAP_OPT_SUMMARY))
+  {
+    bitmap_handle->summary = _res_bitmap_summary_create(bitmap_handle);
+    if(NULL == bitmap_handle->summary)
+      return(2);
+  }
+  if(0 != (opts & RES_BITMAP_OPT_EXTENTS))
+  {
+    bitmap_handle->extents = _res_bitmap_extents_create(bitmap_handle);
+    if(NULL == bitmap_handle->extents)
+      return(2);
+  }
+  if(0 != (opts & RES_BITMAP_OPT_RANK))
+  {
+    bitmap_handle->rank = _res_bitmap_rank_create(bitmap_handle);
+    if(NULL == bitmap_handle->rank)
+      return(2);
+  }
+  if(0 != (opts & RES_BITMAP_OPT_DELTA))
+  {
+    bitmap_handle->delta = _res_bitmap_delta_create(bitmap_handle->num_bits);
+    if(NULL == bitmap_handle->delta)
+      return(2);
+  }
+  return(0);
+}
+
+size_t _res_bitmap_size(size_t num_bits)
+{
+  return(_res_bitmap_limit(num_bits) + 1);  /*limit is the highest byte in the map, so we need to add 1*/
 }
 
 size_t _res_bitmap_limit(size_t num_bits)
 {
   size_t limit;
-   /*limit is in bytes, not bits...*/
-    limit = (num_bits + (BITS_IN_A_BYTE - 1)) / BITS_IN_A_BYTE;  /*round up*/
-   /*limit needs to be BITS aligned...*/
-    if(0 != limit%(BITS/BITS_IN_A_BYTE))
-      limit += (BITS/BITS_IN_A_BYTE) - limit%(BITS/BITS_IN_A_BYTE);
-  return(limit);
+   /*limit is in bytes, not bits, and needs to be BITS aligned - round up to whole words. num_bits starts at 0, so bit num_bits lives in word num_bits/BITS*/
+    limit = ((num_bits / BITS) + 1) * (BITS/BITS_IN_A_BYTE);
+  return(limit - 1);  /*limit is the highest byte in the map, not the size*/
 }
 
 void _res_bitmap_handle_set(res_bitmap_t *bitmap, void* base, size_t num_bits)
@@ -74,7 +185,18 @@ void _res_bitmap_handle_set(res_bitmap_t *bitmap, void* base, size_t num_bits)
 
 ushort res_bitmap_destroy(res_bitmap_t* bitmap_handle)
 {
-  free((bitmap_handle->base));
+  if(NULL != bitmap_handle->summary)
+    _res_bitmap_summary_destroy(bitmap_handle->summary);
+  if(NULL != bitmap_handle->extents)
+    _res_bitmap_extents_destroy(bitmap_handle->extents);
+  if(NULL != bitmap_handle->rank)
+    _res_bitmap_rank_destroy(bitmap_handle->rank);
+  if(NULL != bitmap_handle->delta)
+    _res_bitmap_delta_destroy(bitmap_handle->delta);
+  if(NULL != bitmap_handle->file)
+    _res_bitmap_file_close(bitmap_handle->file);
+  else
+    _res_bitmap_mem_free(bitmap_handle->base, _res_bitmap_size(bitmap_handle->num_bits));
   free(bitmap_handle);
   return(0);
 }
@@ -83,6 +205,7 @@ size_t res_bitmap_alloc(res_bitmap_t* bitmap_handle, size_t block_size)
 {
   size_t i;
   size_t num_bits;
+  ushort worst;
 
    /*get bitmap pointer & num_bits*/
     num_bits = bitmap_handle->num_bits;
@@ -94,84 +217,271 @@ size_t res_bitmap_alloc(res_bitmap_t* bitmap_handle, size_t block_size)
       return(RES_BITMAP_ERR);
     }
 
-   /*test loop*/
-    for(i=0; i<=(num_bits - block_size); i++)
-      if(0==res_bitmap_check(bitmap_handle, i, block_size))
+   /*the extent index knows the longest free run - no point looking for anything bigger*/
+    if((0 == _res_bitmap_extents_ready(bitmap_handle)) && (block_size >= _res_bitmap_extents_largest(bitmap_handle->extents)))
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*find a block of free bits big enough*/
+    if(RES_BITMAP_NEXT_FIT == bitmap_handle->policy)
+    {
+     /*next fit - carry on from the end of the last block, then wrap round to the start (including blocks that run over the cursor)*/
+      i = _res_bitmap_scan(bitmap_handle, bitmap_handle->rover, num_bits, block_size);
+      if((RES_BITMAP_ERR == i) && (0 != bitmap_handle->rover))
       {
-        res_bitmap_take(bitmap_handle, i, block_size);
-        return(i);
+        if(bitmap_handle->rover - 1 > num_bits - block_size)
+          i = _res_bitmap_scan(bitmap_handle, 0, num_bits, block_size);
+        else
+          i = _res_bitmap_scan(bitmap_handle, 0, bitmap_handle->rover - 1 + block_size, block_size);
       }
+    } else if((RES_BITMAP_BEST_FIT == bitmap_handle->policy) || (RES_BITMAP_WORST_FIT == bitmap_handle->policy)) {
+     /*best / worst fit - straight from the extent index if there is one, otherwise look at every free run*/
+      worst = (RES_BITMAP_WORST_FIT == bitmap_handle->policy) ? 1 : 0;
+      if(0 == _res_bitmap_extents_ready(bitmap_handle))
+        i = _res_bitmap_extents_fit(bitmap_handle, block_size + 1, worst);
+      else
+        i = _res_bitmap_fit(bitmap_handle, block_size, worst);
+    } else {
+     /*first fit - lowest block*/
+      i = _res_bitmap_scan(bitmap_handle, 0, num_bits, block_size);
+    }
+    if(RES_BITMAP_ERR == i)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);  /*nothing found :-(*/
+    }
+    _res_bitmap_apply(bitmap_handle, i, i + block_size, 1);
 
-  errno = RES_ERR_NO_MATCH;
-  return(RES_BITMAP_ERR);  /*nothing found :-(*/
+   /*move cursor to just after the block*/
+    if(i + block_size >= num_bits)
+      bitmap_handle->rover = 0;
+    else
+      bitmap_handle->rover = i + block_size + 1;
+  return(i);
 }
 
-ushort res_bitmap_free(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+size_t res_bitmap_alloc_aligned(res_bitmap_t* bitmap_handle, size_t block_size, ushort align_order)
+{
+  size_t i;
+   /*check parameters*/
+    if((block_size > bitmap_handle->num_bits) || (align_order >= sizeof(size_t) * BITS_IN_A_BYTE))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*lowest aligned block*/
+    i = _res_bitmap_scan_aligned(bitmap_handle, block_size, (size_t)1 << align_order);
+    if(RES_BITMAP_ERR == i)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+    _res_bitmap_apply(bitmap_handle, i, i + block_size, 1);
+  return(i);
+}
+
+size_t res_bitmap_alloc_many(res_bitmap_t* bitmap_handle, size_t block_size, size_t count, size_t* out)
 {
-  #ifdef BITS_64
-    uint64_t *bitmap;
-  #else
-    uint32_t *bitmap;
-  #endif
+  size_t n;
   size_t i;
+  size_t to;
+  size_t rover;
+  size_t num_bits;
+    num_bits = bitmap_handle->num_bits;
+
+   /*check if block_size valid*/
+    if(block_size > num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+    if((RES_BITMAP_BEST_FIT == bitmap_handle->policy) || (RES_BITMAP_WORST_FIT == bitmap_handle->policy))
+    {
+     /*best / worst fit pick each block from the whole map - there's no single pass, so one at a time*/
+      for(n=0; n<count; n++)
+      {
+        i = res_bitmap_alloc(bitmap_handle, block_size);
+        if(RES_BITMAP_ERR == i)
+          break;
+        out[n] = i;
+      }
+    } else if((RES_BITMAP_NEXT_FIT == bitmap_handle->policy) && (0 != bitmap_handle->rover)) {
+     /*next fit - one pass from the cursor to the end, then one from the start, as in res_bitmap_alloc*/
+      n = _res_bitmap_alloc_run(bitmap_handle, bitmap_handle->rover, num_bits, block_size, count, out);
+      if(n < count)
+      {
+       /*wrap round to the cursor as it is now, after the blocks just allocated*/
+        rover = bitmap_handle->rover;
+        if(0 != n)
+          rover = (out[n-1] + block_size >= num_bits) ? 0 : out[n-1] + block_size + 1;
+        if((0 == rover) || (rover - 1 > num_bits - block_size))
+          to = num_bits;
+        else
+          to = rover - 1 + block_size;
+        n += _res_bitmap_alloc_run(bitmap_handle, 0, to, block_size, count - n, &out[n]);
+      }
+    } else {
+     /*first fit - one pass from the start*/
+      n = _res_bitmap_alloc_run(bitmap_handle, 0, num_bits, block_size, count, out);
+    }
+
+   /*move cursor to just after the last block*/
+    if((0 != n) && (RES_BITMAP_BEST_FIT != bitmap_handle->policy) && (RES_BITMAP_WORST_FIT != bitmap_handle->policy))
+    {
+      if(out[n-1] + block_size >= num_bits)
+        bitmap_handle->rover = 0;
+      else
+        bitmap_handle->rover = out[n-1] + block_size + 1;
+    }
+
+    if(n < count)
+      errno = RES_ERR_NO_MATCH;
+  return(n);
+}
+
+ushort res_bitmap_free(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+{
    /*check base & limit*/
     if(base > bitmap_handle->num_bits)
       return(2);
     if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
       return(3);
 
-   /*get bitmap pointer*/
-    bitmap = bitmap_handle->base;
+   /*unmark bits - a word at a time*/
+    _res_bitmap_apply(bitmap_handle, base, base+limit, 0);
 
-   /*unmark bits - unoptimised, marks each bit in turn*/
-    for(i=base; i<=(base+limit); i++)
+   /*if this block ran up to the next fit cursor (eg it was the last one allocated), move the cursor back so the space is used again first*/
+    if((bitmap_handle->rover > base) && (bitmap_handle->rover <= base + limit + 1))
+      bitmap_handle->rover = base;
+  return(0);
+}
+
+ushort res_bitmap_free_many(res_bitmap_t* bitmap_handle, size_t* bits, size_t count, size_t block_size)
+{
+  res_bitmap_word_t mask = 0;
+  size_t word = RES_BITMAP_ERR;  /*word mask belongs to - none yet*/
+  size_t first;
+  size_t last;
+  size_t i;
+   /*check every block before freeing any of them*/
+    for(i=0; i<count; i++)
+    {
+      if(bits[i] > bitmap_handle->num_bits)
+        return(2);
+      if((bits[i] > (SIZE_MAX - block_size)) || ((bits[i]+block_size) > bitmap_handle->num_bits))
+        return(3);
+    }
+
+   /*sort them, unless they already are (eg straight from res_bitmap_alloc_many)*/
+    for(i=1; i<count; i++)
     {
-      #ifdef BITS_64
-        bitmap[i/BITS] &= ~(UINT64_C(1)<<(i%BITS));
-      #else
-        bitmap[i/BITS] &= ~(1<<(i%BITS));
-      #endif
+      if(bits[i] < bits[i-1])
+      {
+        qsort(bits, count, sizeof(size_t), _res_bitmap_compare);
+        break;
+      }
     }
+
+   /*join up blocks that touch or overlap, and gather runs that sit inside one word into a single update of that word*/
+    i = 0;
+    while(i < count)
+    {
+      first = bits[i];
+      last = bits[i] + block_size;
+      for(i++; (i < count) && (bits[i] <= last + 1); i++)
+        if(bits[i] + block_size > last)
+          last = bits[i] + block_size;
+
+      if((word != first/BITS) || (first/BITS != last/BITS))
+      {
+        if(RES_BITMAP_ERR != word)
+          _res_bitmap_apply_word(bitmap_handle, word, mask, 0);
+        word = RES_BITMAP_ERR;
+        mask = 0;
+      }
+      if(first/BITS == last/BITS)
+      {
+        word = first/BITS;
+        mask |= _res_bitmap_mask(first%BITS, last%BITS);
+      } else {
+        _res_bitmap_apply(bitmap_handle, first, last, 0);
+      }
+
+     /*as res_bitmap_free - a run up to the next fit cursor moves it back*/
+      if((bitmap_handle->rover > first) && (bitmap_handle->rover <= last + 1))
+        bitmap_handle->rover = first;
+    }
+    if(RES_BITMAP_ERR != word)
+      _res_bitmap_apply_word(bitmap_handle, word, mask, 0);
   return(0);
 }
 
 ushort res_bitmap_take(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
 {
-  #ifdef BITS_64
-    uint64_t *bitmap;
-  #else
-    uint32_t *bitmap;
-  #endif
-  size_t i;
    /*check base & limit*/
     if(base > bitmap_handle->num_bits)
       return(2);
     if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
       return(3);
 
-   /*get bitmap pointer*/
-    bitmap = bitmap_handle->base;
+   /*mark bits - a word at a time*/
+    _res_bitmap_apply(bitmap_handle, base, base+limit, 1);
+  return(0);
+}
 
-   /*mark bits - unoptimised, marks each bit in turn*/
-    for(i=base; i<=(base+limit); i++)
+ushort res_bitmap_reserve(res_bitmap_t* bitmap_handle, const res_bitmap_range_t* ranges, size_t count, size_t* failed)
+{
+  size_t i;
+  size_t j;
+  size_t conflict;
+   /*check every range before touching the map*/
+    for(i=0; i<count; i++)
     {
-      #ifdef BITS_64
-        bitmap[i/BITS] |= UINT64_C(1)<<(i%BITS);
-      #else
-        bitmap[i/BITS] |= 1<<(i%BITS);
-      #endif
+      if(ranges[i].base > bitmap_handle->num_bits)
+      {
+        if(NULL != failed)
+          *failed = i;
+        return(2);
+      }
+      if((ranges[i].base > (SIZE_MAX - ranges[i].limit)) || ((ranges[i].base+ranges[i].limit) > bitmap_handle->num_bits))
+      {
+        if(NULL != failed)
+          *failed = i;
+        return(3);
+      }
     }
+
+   /*test and mark each word in one go - the first taken bit puts back the ranges already in. They were all clear, so clearing them again leaves the map as it was*/
+    for(i=0; i<count; i++)
+    {
+      if(0 != _res_bitmap_claim(bitmap_handle->base, ranges[i].base, ranges[i].base+ranges[i].limit, &conflict))
+      {
+        for(j=0; j<i; j++)
+          _res_bitmap_mark(bitmap_handle->base, ranges[j].base, ranges[j].base+ranges[j].limit, 0);
+        if(NULL != failed)
+          *failed = i;
+        return(1);
+      }
+    }
+
+   /*only now tell the indexes, so a rollback never has to undo them*/
+    for(i=0; i<count; i++)
+      _res_bitmap_changed(bitmap_handle, ranges[i].base, ranges[i].base+ranges[i].limit, 1);
   return(0);
 }
 
 ushort res_bitmap_check(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
 {
-  #ifdef BITS_64
-    uint64_t *bitmap;
-  #else
-    uint32_t *bitmap;
-  #endif
+  res_bitmap_word_t *bitmap;
+  res_bitmap_word_t mask;
+  res_bitmap_word_t want;  /*what the bits under mask must look like - all 0's or all 1's*/
   size_t i;
+  size_t first_word;
+  size_t last_word;
   ushort up=0;  /*what kind of bit we're checking for*/
 
    /*check base & limit*/
@@ -180,68 +490,125 @@ ushort res_bitmap_check(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
     if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
       return(5);
 
-   /*get bitmap pointer*/
+   /*get bitmap pointer, words to test*/
     bitmap = bitmap_handle->base;
+    first_word = base / BITS;
+    last_word = (base + limit) / BITS;
 
-   /*test the first bit*/
-    #ifdef BITS_64
-      if(0 == (bitmap[base/BITS] & (UINT64_C(1)<<(base%BITS))))  /*filter out all bits apart from the one being checked*/
-    #else
-      if(0 == (bitmap[base/BITS] & (1<<(base%BITS))))  /*filter out all bits apart from the one being checked*/
-    #endif
+   /*the first bit decides what the rest must be*/
+    if(0 == (bitmap[first_word] & ((res_bitmap_word_t)1 << (base%BITS))))
       up = 0;
     else
       up = 1;
+    want = (0 == up) ? 0 : ~(res_bitmap_word_t)0;
 
-   /*test the rest*/
-    for(i=base+1; i<=(base+limit); i++)
-    {
-        #ifdef BITS_64
-          if(0 == (bitmap[i/BITS] & (UINT64_C(1)<<(i%BITS))))  /*filter out all bits apart from the one being checked. Check if it's 0*/
-        #else
-          if(0 == (bitmap[i/BITS] & (1<<(i%BITS))))  /*filter out all bits apart from the one being checked. Check if it's 0*/
-        #endif
-        {
-          if(1 == up)  /*i.e. if first bit is 1, and current bit is not*/
-            return(2);
-        } else {
-          if(0 == up)  /*i.e. if first bit is 0, and current bit is not*/
-            return(2);
-        }
+   /*test the first word - only the bits in range*/
+    if(first_word == last_word)
+      mask = _res_bitmap_mask(base%BITS, (base+limit)%BITS);
+    else
+      mask = _res_bitmap_mask(base%BITS, BITS-1);
+    if((bitmap[first_word] & mask) != (want & mask))
+      return(2);
+    if(first_word == last_word)
+      return(up);
+
+   /*test whole words in the middle*/
+    for(i=first_word+1; i<last_word; i++)
+      if(bitmap[i] != want)
+        return(2);
+
+   /*test the last word*/
+    mask = _res_bitmap_mask(0, (base+limit)%BITS);
+    if((bitmap[last_word] & mask) != (want & mask))
+      return(2);
 
-    }
   return(up);  /*bits all the same, so return either 1 or 0*/
 }
 
+ushort res_bitmap_set_policy(res_bitmap_t* bitmap_handle, ushort policy)
+{
+  if(policy > RES_BITMAP_WORST_FIT)
+    return(2);
+  bitmap_handle->policy = policy;
+  return(0);
+}
+
 ushort res_bitmap_resize(res_bitmap_t* bitmap_handle, size_t num_bits)
 {
   uint8_t* base;
   size_t limit;
   size_t old_limit;
+  size_t old_num_bits;
    /*calculate limit, old limit, etc*/
     limit = _res_bitmap_limit(num_bits);
     old_limit = _res_bitmap_limit(bitmap_handle->num_bits);
+    old_num_bits = bitmap_handle->num_bits;
 
-   /*re-alloc memory*/
-    base = realloc( bitmap_handle->base, _res_bitmap_size(num_bits) );
-    if(NULL == base)
-      return(2);
+   /*make room in any indexes first, so nothing has changed if that fails*/
+    if(NULL != bitmap_handle->summary)
+      if(0 != _res_bitmap_summary_reserve(bitmap_handle->summary, num_bits))
+        return(2);
+    if(NULL != bitmap_handle->rank)
+      if(0 != _res_bitmap_rank_reserve(bitmap_handle->rank, num_bits))
+        return(2);
+    if(NULL != bitmap_handle->delta)
+      if(0 != _res_bitmap_delta_reserve(bitmap_handle->delta, num_bits))
+        return(2);
 
-   /*zero-out any new memory*/
-    if(limit > old_limit)
-      memset(base + old_limit + 1, 0x00, limit - old_limit);
-     /*^^ better than using out _set - that one calculates limit from num_bits, already been done here*/
+   /*file-backed maps grow or shrink the file and map it again - new bytes in a file are already 0*/
+    if(NULL != bitmap_handle->file)
+    {
+      if(0 != _res_bitmap_file_resize(bitmap_handle->file, num_bits))
+        return(2);
+      base = (uint8_t*)bitmap_handle->file->mapping + RES_BITMAP_FILE_HEADER;
+    } else {
+     /*re-alloc memory - any new memory comes back 0, and big maps grow without copying*/
+      base = _res_bitmap_mem_realloc( bitmap_handle->base, old_limit + 1, limit + 1 );
+      if(NULL == base)
+        return(2);
+    }
+
+   /*when shrinking, clear bits cut off the end of the last word, so they don't come back on the next grow*/
+    if(num_bits < bitmap_handle->num_bits)
+    {
+      ((res_bitmap_word_t*)base)[num_bits/BITS] &= _res_bitmap_mask(0, num_bits%BITS);
+      if(NULL != bitmap_handle->file)
+        _res_bitmap_file_dirty(bitmap_handle->file, num_bits/BITS, num_bits/BITS);
+    }
+    if(NULL != bitmap_handle->file)
+      _res_bitmap_file_header(bitmap_handle->file, num_bits);
 
    /*update handle*/
     _res_bitmap_handle_set(bitmap_handle, base, num_bits);
 
+   /*update indexes*/
+    if(NULL != bitmap_handle->summary)
+      _res_bitmap_summary_commit(bitmap_handle, old_num_bits);
+    if(NULL != bitmap_handle->rank)
+      _res_bitmap_rank_resize(bitmap_handle->rank, old_num_bits, num_bits);
+    if(NULL != bitmap_handle->delta)
+      _res_bitmap_delta_resize(bitmap_handle->delta, old_num_bits, num_bits);
+    if(NULL != bitmap_handle->extents)
+    {
+      if(num_bits > old_num_bits)
+        _res_bitmap_extents_update(bitmap_handle, old_num_bits + 1, num_bits, 0);  /*new bits are free*/
+      else if(num_bits < old_num_bits)
+        _res_bitmap_extents_update(bitmap_handle, num_bits + 1, old_num_bits, 1);  /*cut off bits can't be allocated*/
+    }
+
+   /*next fit cursor off the end - wrap round*/
+    if(bitmap_handle->rover > num_bits)
+      bitmap_handle->rover = 0;
+
   return(0);
 }
 
 size_t res_bitmap_count(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
 {
-  size_t i;
-  size_t count=0;
+  res_bitmap_word_t *bitmap;
+  size_t first_word;
+  size_t last_word;
+  size_t count;
    /*check parameters*/
     if(base > bitmap_handle->num_bits)
     {
@@ -254,12 +621,19 @@ size_t res_bitmap_count(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
       return(RES_BITMAP_ERR);
     }
 
-  /*counting loop (horribly unoptimised!)*/
-    for(i=0; i<=limit; i++)
-    {
-      if(1 == res_bitmap_check(bitmap_handle, base + i, 0))
-        count++;
-    }
+   /*get bitmap pointer, words to count*/
+    bitmap = bitmap_handle->base;
+    first_word = base / BITS;
+    last_word = (base + limit) / BITS;
+
+   /*all in one word - mask both ends*/
+    if(first_word == last_word)
+      return(RES_BITMAP_POPCOUNT(bitmap[first_word] & _res_bitmap_mask(base%BITS, (base+limit)%BITS)));
+
+   /*masked head, whole words in the middle, masked tail*/
+    count = RES_BITMAP_POPCOUNT(bitmap[first_word] & _res_bitmap_mask(base%BITS, BITS-1));
+    count += _res_bitmap_popcount(&bitmap[first_word+1], last_word - first_word - 1);
+    count += RES_BITMAP_POPCOUNT(bitmap[last_word] & _res_bitmap_mask(0, (base+limit)%BITS));
   return(count);
 }
 
@@ -269,7 +643,650 @@ size_t res_bitmap_get_size(res_bitmap_t* bitmap_handle)
   return(bitmap_handle -> num_bits);
 }
 
-/**************************************************************************
-NOTE - alloc function is massively inefficient (uses test and take
-  functions), and should be treated as a placeholder only.
-**************************************************************************/
+size_t res_bitmap_largest_free(res_bitmap_t* bitmap_handle)
+{
+  size_t i;
+  size_t end;
+  size_t largest = 0;
+   /*kept up to date by the extent index, if there is one*/
+    if(0 == _res_bitmap_extents_ready(bitmap_handle))
+    {
+      largest = _res_bitmap_extents_largest(bitmap_handle->extents);
+    } else {
+     /*otherwise find the start of the largest run, then its end*/
+      i = _res_bitmap_fit(bitmap_handle, 0, 1);
+      if(RES_BITMAP_ERR != i)
+      {
+        end = _res_bitmap_find(bitmap_handle, i, bitmap_handle->num_bits, 1);
+        if(RES_BITMAP_ERR == end)
+          end = bitmap_handle->num_bits + 1;
+        largest = end - i;
+      }
+    }
+
+    if(0 == largest)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+  return(largest - 1);  /*a block_size*/
+}
+
+ushort res_bitmap_free_stats(res_bitmap_t* bitmap_handle, res_bitmap_free_stats_t* stats)
+{
+  res_bitmap_extents_t* extents;
+  ushort c;
+   /*the extent index counts runs as they change, so it's just a copy*/
+    if(0 == _res_bitmap_extents_ready(bitmap_handle))
+    {
+      extents = bitmap_handle->extents;
+      stats->free_bits = extents->free_bits;
+      stats->runs = extents->count;
+      stats->largest = _res_bitmap_extents_largest(extents);
+      for(c=0; c<BITS; c++)
+        stats->histogram[c] = extents->histogram[c];
+    } else {
+      _res_bitmap_free_runs(bitmap_handle->base, bitmap_handle->num_bits, stats);
+    }
+  return(0);
+}
+
+size_t res_bitmap_find_next_set(res_bitmap_t* bitmap_handle, size_t from)
+{
+  return(_res_bitmap_find_next(bitmap_handle, from, 1));
+}
+
+size_t res_bitmap_find_next_clear(res_bitmap_t* bitmap_handle, size_t from)
+{
+  return(_res_bitmap_find_next(bitmap_handle, from, 0));
+}
+
+size_t res_bitmap_find_prev_set(res_bitmap_t* bitmap_handle, size_t from)
+{
+  res_bitmap_word_t *bitmap;
+  res_bitmap_word_t word;
+  size_t w;
+   /*check parameters*/
+    if(from > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*bits after from don't count - then back a word at a time*/
+    bitmap = bitmap_handle->base;
+    w = from / BITS;
+    word = bitmap[w] & _res_bitmap_mask(0, from%BITS);
+    while(0 == word)
+    {
+      if(0 == w)
+      {
+        errno = RES_ERR_NO_MATCH;
+        return(RES_BITMAP_ERR);
+      }
+      w--;
+      word = bitmap[w];
+    }
+  return(w * BITS + (BITS - 1 - RES_BITMAP_CLZ(word)));
+}
+
+ushort res_bitmap_iter_init(res_bitmap_t* bitmap_handle, res_bitmap_iter_t* iter, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > bitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+    iter->bitmap = bitmap_handle->base;
+    iter->w = base / BITS;
+    iter->last = base + limit;
+    iter->word = iter->bitmap[iter->w] & _res_bitmap_mask(base%BITS, BITS-1);
+    if(iter->w == iter->last / BITS)
+      iter->word &= _res_bitmap_mask(0, iter->last%BITS);
+  return(0);
+}
+
+size_t res_bitmap_iter_next(res_bitmap_iter_t* iter)
+{
+  size_t bit;
+   /*next word with anything set - the last one only up to last*/
+    while(0 == iter->word)
+    {
+      if(iter->w >= iter->last / BITS)
+        return(RES_BITMAP_ERR);
+      iter->w++;
+      iter->word = iter->bitmap[iter->w];
+      if(iter->w == iter->last / BITS)
+        iter->word &= _res_bitmap_mask(0, iter->last%BITS);
+    }
+
+   /*lowest bit left, then knock it off*/
+    bit = iter->w * BITS + RES_BITMAP_CTZ(iter->word);
+    iter->word &= iter->word - 1;
+  return(bit);
+}
+
+size_t res_bitmap_rank(res_bitmap_t* bitmap_handle, size_t bit)
+{
+  res_bitmap_word_t *bitmap;
+  size_t r;
+   /*check bit - num_bits+1 is allowed, for the whole map*/
+    if(bit > bitmap_handle->num_bits + 1)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+    if(NULL != bitmap_handle->rank)
+      return(_res_bitmap_rank_get(bitmap_handle, bit));
+
+   /*no directory - whole words, then the part of bit's word below it*/
+    bitmap = bitmap_handle->base;
+    r = _res_bitmap_popcount(bitmap, bit / BITS);
+    if(0 != bit % BITS)
+      r += RES_BITMAP_POPCOUNT(bitmap[bit / BITS] & _res_bitmap_mask(0, bit % BITS - 1));
+  return(r);
+}
+
+size_t res_bitmap_select(res_bitmap_t* bitmap_handle, size_t k)
+{
+  res_bitmap_word_t *bitmap;
+  size_t words;
+  size_t w;
+  size_t n;
+    if(NULL != bitmap_handle->rank)
+    {
+      w = _res_bitmap_rank_select(bitmap_handle, k);
+      if(RES_BITMAP_ERR == w)
+        errno = RES_ERR_NO_MATCH;
+      return(w);
+    }
+
+   /*no directory - count word by word until the word holding it*/
+    bitmap = bitmap_handle->base;
+    words = bitmap_handle->num_bits / BITS + 1;
+    for(w=0; w<words; w++)
+    {
+      n = RES_BITMAP_POPCOUNT(bitmap[w]);
+      if(k < n)
+        return(w * BITS + _res_bitmap_select_word(bitmap[w], k));
+      k -= n;
+    }
+    errno = RES_ERR_NO_MATCH;
+  return(RES_BITMAP_ERR);
+}
+
+size_t res_bitmap_delta_size(res_bitmap_t* bitmap_handle)
+{
+  if(NULL == bitmap_handle->delta)
+  {
+    errno = RES_ERR_BAD_PARAMETER;
+    return(RES_BITMAP_ERR);
+  }
+  return(_res_bitmap_delta_size(bitmap_handle->delta, bitmap_handle->num_bits));
+}
+
+size_t res_bitmap_delta_export(res_bitmap_t* bitmap_handle, res_bitmap_word_t* buf, size_t size)
+{
+  if((NULL == bitmap_handle->delta) || (size < RES_BITMAP_DELTA_HEADER))
+  {
+    errno = RES_ERR_BAD_PARAMETER;
+    return(RES_BITMAP_ERR);
+  }
+  return(_res_bitmap_delta_export(bitmap_handle->delta, bitmap_handle->base, bitmap_handle->num_bits, buf, size));
+}
+
+ushort res_bitmap_delta_apply(res_bitmap_t* bitmap_handle, const res_bitmap_word_t* buf, size_t size)
+{
+  res_bitmap_word_t *bitmap;
+  res_bitmap_word_t word;
+  size_t i;
+  size_t w;
+  size_t n;
+    if(0 != _res_bitmap_delta_check(buf, size))
+      return(2);
+
+   /*down to the smallest size the source had, then up to its size now*/
+    if((size_t)buf[1] < bitmap_handle->num_bits)
+      if(0 != res_bitmap_resize(bitmap_handle, (size_t)buf[1]))
+        return(3);
+    if((size_t)buf[0] != bitmap_handle->num_bits)
+      if(0 != res_bitmap_resize(bitmap_handle, (size_t)buf[0]))
+        return(3);
+
+   /*each changed word as the bits that went up, then the bits that went down - so the indexes follow*/
+    bitmap = bitmap_handle->base;
+    for(i=RES_BITMAP_DELTA_HEADER; i<size; i+=n + 2)
+    {
+      n = (size_t)buf[i+1];
+      for(w=(size_t)buf[i]; w<(size_t)buf[i] + n; w++)
+      {
+        word = buf[i + 2 + w - (size_t)buf[i]];
+        if(0 != (word & ~bitmap[w]))
+          _res_bitmap_apply_word(bitmap_handle, w, word & ~bitmap[w], 1);
+        if(0 != (bitmap[w] & ~word))
+          _res_bitmap_apply_word(bitmap_handle, w, bitmap[w] & ~word, 0);
+      }
+    }
+  return(0);
+}
+
+ushort res_bitmap_combine(res_bitmap_t* dest_handle, res_bitmap_t* src_handle, ushort op)
+{
+  return(res_bitmap_combine_into(dest_handle, dest_handle, src_handle, op));
+}
+
+ushort res_bitmap_combine_into(res_bitmap_t* dest_handle, res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op)
+{
+    if(op > RES_BITMAP_ANDNOT)
+      return(2);
+
+    _res_bitmap_combine_map(dest_handle->base, dest_handle->num_bits, a_handle->base, a_handle->num_bits, b_handle->base, b_handle->num_bits, op);
+    if(NULL != dest_handle->file)
+      _res_bitmap_file_dirty(dest_handle->file, 0, dest_handle->num_bits/BITS);
+    if(NULL != dest_handle->delta)
+      _res_bitmap_delta_touch(dest_handle->delta, 0, dest_handle->num_bits/BITS);
+    _res_bitmap_reindex(dest_handle);
+  return(0);
+}
+
+size_t res_bitmap_combine_count(res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op)
+{
+    if(op > RES_BITMAP_ANDNOT)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+  return(_res_bitmap_combine_map_count(a_handle->base, a_handle->num_bits, b_handle->base, b_handle->num_bits, op));
+}
+
+/*-------------- Internals ----------------*/
+
+res_bitmap_word_t _res_bitmap_mask(size_t first, size_t last)
+{
+  return( (~(res_bitmap_word_t)0 >> (BITS - 1 - last)) & (~(res_bitmap_word_t)0 << first) );
+}
+
+void _res_bitmap_apply(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up)
+{
+  _res_bitmap_mark(bitmap_handle->base, first, last, up);
+  _res_bitmap_changed(bitmap_handle, first, last, up);
+}
+
+void _res_bitmap_changed(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up)
+{
+  if(NULL != bitmap_handle->file)
+    _res_bitmap_file_dirty(bitmap_handle->file, first/BITS, last/BITS);
+  if(NULL != bitmap_handle->delta)
+    _res_bitmap_delta_touch(bitmap_handle->delta, first/BITS, last/BITS);
+  if(NULL != bitmap_handle->summary)
+    _res_bitmap_summary_update(bitmap_handle, first/BITS, last/BITS, up);
+  if(NULL != bitmap_handle->extents)
+    _res_bitmap_extents_update(bitmap_handle, first, last, up);
+  if(NULL != bitmap_handle->rank)
+    _res_bitmap_rank_touch(bitmap_handle->rank, first);
+}
+
+void _res_bitmap_mark(res_bitmap_word_t* bitmap, size_t first, size_t last, ushort up)
+{
+  size_t first_word;
+  size_t last_word;
+  res_bitmap_word_t mask;
+    first_word = first / BITS;
+    last_word = last / BITS;
+
+   /*head word - only the bits from first upwards (and up to last, if that's in the same word)*/
+    if(first_word == last_word)
+      mask = _res_bitmap_mask(first%BITS, last%BITS);
+    else
+      mask = _res_bitmap_mask(first%BITS, BITS-1);
+    if(0 == up)
+      bitmap[first_word] &= ~mask;
+    else
+      bitmap[first_word] |= mask;
+    if(first_word == last_word)
+      return;
+
+   /*whole words in the middle*/
+    if(last_word - first_word > 1)
+      memset(&bitmap[first_word+1], (0 == up) ? 0x00 : 0xFF, (last_word - first_word - 1) * sizeof(res_bitmap_word_t));
+
+   /*tail word - bits up to and including last*/
+    mask = _res_bitmap_mask(0, last%BITS);
+    if(0 == up)
+      bitmap[last_word] &= ~mask;
+    else
+      bitmap[last_word] |= mask;
+}
+
+size_t _res_bitmap_scan(res_bitmap_t* bitmap_handle, size_t from, size_t to, size_t block_size)
+{
+  res_bitmap_word_t *bitmap;
+  res_bitmap_word_t word;
+  size_t w;
+  size_t last_word;
+  size_t bit;
+  size_t n;
+  size_t run_start = 0;
+  size_t run_len = 0;  /*length of the free run that ends where we've scanned up to*/
+  size_t need;
+    bitmap = bitmap_handle->base;
+    need = block_size + 1;
+    last_word = to / BITS;
+    if((to < from) || (to - from < block_size))
+      return(RES_BITMAP_ERR);
+
+    for(w = from / BITS; w <= last_word; w++)
+    {
+     /*not in a run - jump straight to the next word with free bits, if there's a summary to say where it is*/
+      if((0 == run_len) && (NULL != bitmap_handle->summary))
+      {
+        w = _res_bitmap_summary_next(bitmap_handle->summary, 0, w);
+        if(w > last_word)  /*includes RES_BITMAP_ERR*/
+          break;
+      }
+
+     /*bits outside from..to count as taken*/
+      word = bitmap[w];
+      if(w == from / BITS)
+        word |= ~_res_bitmap_mask(from%BITS, BITS-1);
+      if(w == last_word)
+        word |= ~_res_bitmap_mask(0, to%BITS);
+
+     /*full word - skip it in one go*/
+      if(~(res_bitmap_word_t)0 == word)
+      {
+        run_len = 0;
+        continue;
+      }
+
+     /*empty word - the whole thing adds to the run*/
+      if(0 == word)
+      {
+        if(0 == run_len)
+          run_start = w * BITS;
+        run_len += BITS;
+        if(run_len >= need)
+          return(run_start);
+        continue;
+      }
+
+     /*mixed word, big block - only the free bits at the bottom (continuing the run) and top (starting a new one) can be part of it*/
+      if(need > BITS)
+      {
+        n = RES_BITMAP_CTZ(word);
+        if((0 != run_len) && (run_len + n >= need))
+          return(run_start);
+        run_len = RES_BITMAP_CLZ(word);
+        run_start = (w + 1) * BITS - run_len;
+        continue;
+      }
+
+     /*mixed word, small block - walk the runs of 0's and 1's in it*/
+      bit = 0;
+      while(bit < BITS)
+      {
+        /*free bits from here*/
+        n = (0 == (word >> bit)) ? BITS - bit : RES_BITMAP_CTZ(word >> bit);
+        if(0 != n)
+        {
+          if(0 == run_len)
+            run_start = w * BITS + bit;
+          run_len += n;
+          if(run_len >= need)
+            return(run_start);
+          bit += n;
+          if(bit >= BITS)
+            break;
+        }
+
+        /*taken bits from here - jump past them*/
+        n = (0 == (~word >> bit)) ? BITS - bit : RES_BITMAP_CTZ(~word >> bit);
+        run_len = 0;
+        bit += n;
+      }
+    }
+  return(RES_BITMAP_ERR);
+}
+
+size_t _res_bitmap_find(res_bitmap_t* bitmap_handle, size_t from, size_t to, ushort up)
+{
+  res_bitmap_word_t *bitmap;
+  res_bitmap_word_t word;
+  size_t w;
+  size_t last_word;
+  size_t bit;
+    bitmap = bitmap_handle->base;
+    last_word = to / BITS;
+    if(from > to)
+      return(RES_BITMAP_ERR);
+
+   /*flip the word when looking for clear bits, so we're always after a set one. Bits before from don't count*/
+    w = from / BITS;
+    word = (0 == up) ? ~bitmap[w] : bitmap[w];
+    word &= _res_bitmap_mask(from%BITS, BITS-1);
+    while(0 == word)
+    {
+      w++;
+      if(w > last_word)
+        return(RES_BITMAP_ERR);
+      if((0 == up) && (NULL != bitmap_handle->summary))
+      {
+        w = _res_bitmap_summary_next(bitmap_handle->summary, 0, w);  /*next word with free bits*/
+        if(w > last_word)  /*includes RES_BITMAP_ERR*/
+          return(RES_BITMAP_ERR);
+      }
+      word = (0 == up) ? ~bitmap[w] : bitmap[w];
+    }
+
+   /*the last word is read whole - and bits past num_bits are 0, so may turn up when looking for clear bits*/
+    bit = w * BITS + RES_BITMAP_CTZ(word);
+    if(bit > to)
+      return(RES_BITMAP_ERR);
+  return(bit);
+}
+
+size_t _res_bitmap_fit(res_bitmap_t* bitmap_handle, size_t block_size, ushort worst)
+{
+  size_t start;
+  size_t end;
+  size_t len;
+  size_t need;
+  size_t best = RES_BITMAP_ERR;
+  size_t best_len = 0;
+    need = block_size + 1;
+
+   /*walk each free run - start is its first bit, end the first taken bit after it*/
+    start = _res_bitmap_find(bitmap_handle, 0, bitmap_handle->num_bits, 0);
+    while(RES_BITMAP_ERR != start)
+    {
+      end = _res_bitmap_find(bitmap_handle, start, bitmap_handle->num_bits, 1);
+      if(RES_BITMAP_ERR == end)
+        end = bitmap_handle->num_bits + 1;
+      len = end - start;
+
+      if(len >= need)
+      {
+        if(0 != worst)
+        {
+          if(len > best_len)
+          {
+            best = start;
+            best_len = len;
+          }
+        } else {
+          if(len == need)
+            return(start);  /*can't do better than an exact fit*/
+          if((RES_BITMAP_ERR == best) || (len < best_len))
+          {
+            best = start;
+            best_len = len;
+          }
+        }
+      }
+
+      if(end > bitmap_handle->num_bits)
+        break;
+      start = _res_bitmap_find(bitmap_handle, end, bitmap_handle->num_bits, 0);
+    }
+  return(best);
+}
+
+size_t _res_bitmap_scan_aligned(res_bitmap_t* bitmap_handle, size_t block_size, size_t align)
+{
+  size_t start;
+  size_t taken;
+  size_t num_bits;
+    num_bits = bitmap_handle->num_bits;
+
+   /*only starts on an alignment boundary are tried - round the next free bit up to one, and if the block there runs into a taken bit, carry on from the next free bit after that*/
+    start = _res_bitmap_find(bitmap_handle, 0, num_bits, 0);
+    while(RES_BITMAP_ERR != start)
+    {
+      if(0 != (start & (align - 1)))
+      {
+        if(start > SIZE_MAX - align)
+          return(RES_BITMAP_ERR);
+        start = (start | (align - 1)) + 1;
+      }
+      if((start > num_bits) || (num_bits - start < block_size))
+        return(RES_BITMAP_ERR);
+
+      taken = _res_bitmap_find(bitmap_handle, start, start + block_size, 1);
+      if(RES_BITMAP_ERR == taken)
+        return(start);
+      start = _res_bitmap_find(bitmap_handle, taken, num_bits, 0);
+    }
+  return(RES_BITMAP_ERR);
+}
+
+size_t _res_bitmap_alloc_run(res_bitmap_t* bitmap_handle, size_t from, size_t to, size_t block_size, size_t count, size_t* out)
+{
+  res_bitmap_word_t *bitmap;
+  res_bitmap_word_t free_bits;
+  res_bitmap_word_t claim;
+  size_t last_word;
+  size_t n = 0;
+  size_t w;
+  size_t i;
+    bitmap = bitmap_handle->base;
+    if((to < from) || (to - from < block_size))
+      return(0);
+
+   /*blocks - each scan carries on from the end of the block before*/
+    if(0 != block_size)
+    {
+      while(n < count)
+      {
+        i = _res_bitmap_scan(bitmap_handle, from, to, block_size);
+        if(RES_BITMAP_ERR == i)
+          break;
+        _res_bitmap_apply(bitmap_handle, i, i + block_size, 1);
+        out[n++] = i;
+        if(to - (i + block_size) <= block_size)
+          break;  /*no room for another*/
+        from = i + block_size + 1;
+      }
+      return(n);
+    }
+
+   /*single bits - claim as many free bits of each word as we still need, all in one go*/
+    last_word = to / BITS;
+    for(w = from / BITS; (n < count) && (w <= last_word); w++)
+    {
+      if(NULL != bitmap_handle->summary)
+      {
+        w = _res_bitmap_summary_next(bitmap_handle->summary, 0, w);  /*next word with free bits*/
+        if(w > last_word)  /*includes RES_BITMAP_ERR*/
+          break;
+      }
+
+     /*bits outside from..to don't count as free*/
+      free_bits = ~bitmap[w];
+      if(w == from / BITS)
+        free_bits &= _res_bitmap_mask(from%BITS, BITS-1);
+      if(w == last_word)
+        free_bits &= _res_bitmap_mask(0, to%BITS);
+
+      claim = 0;
+      while((0 != free_bits) && (n < count))
+      {
+        out[n++] = w * BITS + RES_BITMAP_CTZ(free_bits);
+        claim |= free_bits & (~free_bits + 1);  /*lowest free bit*/
+        free_bits &= free_bits - 1;
+      }
+      if(0 != claim)
+        _res_bitmap_apply_word(bitmap_handle, w, claim, 1);
+    }
+  return(n);
+}
+
+void _res_bitmap_apply_word(res_bitmap_t* bitmap_handle, size_t w, res_bitmap_word_t mask, ushort up)
+{
+  res_bitmap_word_t *bitmap;
+  size_t bit;
+  size_t len;
+    bitmap = bitmap_handle->base;
+    if(0 == up)
+      bitmap[w] &= ~mask;
+    else
+      bitmap[w] |= mask;
+    if(NULL != bitmap_handle->file)
+      _res_bitmap_file_dirty(bitmap_handle->file, w, w);
+    if(NULL != bitmap_handle->delta)
+      _res_bitmap_delta_touch(bitmap_handle->delta, w, w);
+    if(NULL != bitmap_handle->summary)
+      _res_bitmap_summary_update(bitmap_handle, w, w, up);
+    if(NULL != bitmap_handle->rank)
+      _res_bitmap_rank_touch(bitmap_handle->rank, w * BITS);
+
+   /*the extent index wants each run of bits in mask separately*/
+    if(NULL != bitmap_handle->extents)
+    {
+      while(0 != mask)
+      {
+        bit = RES_BITMAP_CTZ(mask);
+        len = (~(res_bitmap_word_t)0 == (mask >> bit)) ? BITS - bit : RES_BITMAP_CTZ(~(mask >> bit));
+        _res_bitmap_extents_update(bitmap_handle, w * BITS + bit, w * BITS + bit + len - 1, up);
+        mask &= ~_res_bitmap_mask(bit, bit + len - 1);
+      }
+    }
+}
+
+int _res_bitmap_compare(const void* a, const void* b)
+{
+  size_t x;
+  size_t y;
+    x = *(const size_t*)a;
+    y = *(const size_t*)b;
+  return((x > y) - (x < y));
+}
+
+size_t _res_bitmap_find_next(res_bitmap_t* bitmap_handle, size_t from, ushort up)
+{
+  size_t i;
+   /*check parameters*/
+    if(from > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+    i = _res_bitmap_find(bitmap_handle, from, bitmap_handle->num_bits, up);
+    if(RES_BITMAP_ERR == i)
+      errno = RES_ERR_NO_MATCH;
+  return(i);
+}
+
+void _res_bitmap_reindex(res_bitmap_t* bitmap_handle)
+{
+  if(NULL != bitmap_handle->summary)
+    _res_bitmap_summary_rebuild(bitmap_handle, bitmap_handle->summary);
+  if(NULL != bitmap_handle->extents)
+  {
+    _res_bitmap_extents_clear(bitmap_handle->extents);
+    bitmap_handle->extents->broken = 1;  /*rebuilt from the map when next needed, which may be never*/
+  }
+  if(NULL != bitmap_handle->rank)
+    bitmap_handle->rank->valid = 0;
+}
@@ -1,6 +1,6 @@
 /* bitmap.h - header for bitmap.c
  *
- * API: bitmap 1.0
+ * API: bitmap 1.13
  * IMPLEMENTATION: reff-1
  *
  * This file is released into the public domain, and permission is granted
@@ -9,37 +9,325 @@
  * authors be held liable for any damages arising from the use of this
  * software.
  */
+#ifdef RES_BITMAP_BUDDY
+ #include "bitmap_buddy.h"  /*buddy-1 implementation of the same API - defines H_RES_BITMAP, so nothing below is used*/
+#endif
+#ifdef RES_BITMAP_TREE
+ #include "bitmap_tree.h"  /*tree-1 implementation of the same API, as buddy-1*/
+#endif
 #ifndef H_RES_BITMAP
 #define H_RES_BITMAP
  #include "res_config.h"
  #include "res_types.h"
  #include "res_err.h"
 
+/*Types:*/
+ #ifdef BITS_64
+  typedef uint64_t res_bitmap_word_t;  /*bitmaps are read and written one machine word at a time*/
+ #else
+  typedef uint32_t res_bitmap_word_t;
+ #endif
+
+/*Options:*/
+ #define RES_BITMAP_OPT_SUMMARY 0x0001  /*keep a summary index of which words have free bits, so alloc can skip full parts of the map without reading them. Costs about 1/BITS extra memory*/
+ #define RES_BITMAP_OPT_EXTENTS 0x0002  /*keep an index of every run of free bits, by start and by size, so best / worst fit and res_bitmap_largest_free don't have to read the map. Costs a few words per free run*/
+ #define RES_BITMAP_OPT_RANK    0x0004  /*keep a rank / select directory - bits taken before each superblock and block - so res_bitmap_rank is O(1) and res_bitmap_select nearly so. Costs about 2.5% extra memory. take and free only mark it stale from where they changed the map, and it is recounted from there when next used*/
+ #define RES_BITMAP_OPT_DELTA   0x0008  /*track which words of the map change, so res_bitmap_delta_export can send just those to a copy of the map. Costs 1/BITS extra memory, and a bit set per word written*/
+
+/*Allocation policies:*/
+ #define RES_BITMAP_FIRST_FIT 0  /*lowest free block big enough. The default*/
+ #define RES_BITMAP_NEXT_FIT  1  /*first free block big enough after the end of the last one allocated, wrapping round to the start of the map*/
+ #define RES_BITMAP_BEST_FIT  2  /*start of the smallest free run big enough. Fast with RES_BITMAP_OPT_EXTENTS, scans the whole map without*/
+ #define RES_BITMAP_WORST_FIT 3  /*start of the largest free run. Fast with RES_BITMAP_OPT_EXTENTS, scans the whole map without*/
+
+/*Boolean operations, for res_bitmap_combine...:*/
+ #define RES_BITMAP_AND    0  /*taken in both*/
+ #define RES_BITMAP_OR     1  /*taken in either*/
+ #define RES_BITMAP_XOR    2  /*taken in one but not the other*/
+ #define RES_BITMAP_ANDNOT 3  /*taken in the first but not the second*/
+
+/*Files, for res_bitmap_create_file / _open_file:*/
+ #define RES_BITMAP_FILE_MAGIC "RESBMAP"  /*first 8 bytes of a bitmap file, NUL included*/
+ #define RES_BITMAP_FILE_VERSION 1
+ #define RES_BITMAP_FILE_HEADER 4096  /*bytes before the map - a whole page on most systems, so the map starts on a page boundary*/
+
+/*Deltas, from res_bitmap_delta_export:*/
+ #define RES_BITMAP_DELTA_HEADER 2  /*words before the first run - the map's num_bits, then the smallest num_bits since the last export*/
+
+/*Config:*/
+ #define RES_BITMAP_RANK_SUPER  65536  /*bits per rank superblock, each with a size_t count of the bits before it*/
+ #define RES_BITMAP_RANK_BLOCK  1024  /*bits per rank block, each with a uint16_t count from the start of its superblock*/
+ #define RES_BITMAP_RANK_SAMPLE 8192  /*select keeps the superblock of every RES_BITMAP_RANK_SAMPLE'th taken bit*/
+ #ifndef RES_BITMAP_MAP_MIN
+  #define RES_BITMAP_MAP_MIN 262144  /*maps of this many bytes or more are anonymous mappings rather than malloc'd - zeroed by the kernel as pages are first touched, and grown with mremap rather than copied*/
+ #endif
+ #ifndef RES_BITMAP_PARALLEL_MIN
+  #define RES_BITMAP_PARALLEL_MIN 4194304  /*fewest bits a worker of res_bitmap_..._parallel is given - 512KiB of map. Smaller ranges stay on the calling thread*/
+ #endif
+
 /*Structures:*/
+ #define RES_BITMAP_SUMMARY_LEVELS 12  /*enough for any size_t num_bits*/
+ typedef struct
+ {
+   res_bitmap_word_t *level[RES_BITMAP_SUMMARY_LEVELS];  /*level[0] has a bit per bitmap word, level[n+1] a bit per level[n] word. Bit set = at least one free bit below it. Unused levels are NULL*/
+   size_t words[RES_BITMAP_SUMMARY_LEVELS];  /*number of words in use in each level*/
+   size_t capacity[RES_BITMAP_SUMMARY_LEVELS];  /*number of words allocated for each level*/
+   ushort levels;  /*number of levels in use - the top one is a single word*/
+ } res_bitmap_summary_t;
+
+ typedef struct
+ {
+   size_t start;  /*first free bit*/
+   size_t len;  /*number of free bits - NOT a limit, never 0*/
+   size_t left;  /*treap children by start, node indexes*/
+   size_t right;
+   size_t smaller;  /*size class treap children by length then start, node indexes. smaller also links the free node list*/
+   size_t larger;
+   uint32_t priority;  /*heap key, for both treaps*/
+ } res_bitmap_extent_t;
+
+ typedef struct
+ {
+   res_bitmap_extent_t *node;  /*node array, nodes refer to each other by index. SIZE_MAX = none*/
+   size_t capacity;  /*nodes allocated*/
+   size_t used;  /*nodes handed out from the end of the array so far*/
+   size_t free_node;  /*list of nodes handed back*/
+   size_t root;  /*treap of free runs ordered by start*/
+   size_t count;  /*number of free runs*/
+   size_t free_bits;  /*bits in all of them*/
+   size_t bucket[BITS];  /*bucket[c] is the root of a treap of free runs with floor(log2(len)) = c*/
+   size_t histogram[BITS];  /*histogram[c] is the number of runs in bucket[c]*/
+   res_bitmap_word_t classes;  /*bit c set when bucket[c] isn't empty*/
+   size_t largest;  /*longest free run, only while largest_valid*/
+   ushort largest_valid;
+   ushort broken;  /*a node allocation failed - index is empty, and rebuilt when next needed*/
+   uint32_t seed;  /*for priorities*/
+ } res_bitmap_extents_t;
+
+ typedef struct
+ {
+   char magic[8];  /*RES_BITMAP_FILE_MAGIC*/
+   uint32_t version;  /*RES_BITMAP_FILE_VERSION*/
+   uint32_t checksum;  /*FNV-1a of the header with this field 0*/
+   uint64_t num_bits;
+   uint64_t word_bits;  /*BITS of the machine that wrote it - the map is stored as native words, so files only move between machines with the same word size and byte order*/
+ } res_bitmap_file_header_t;
+
+ typedef struct
+ {
+   int fd;
+   void *mapping;  /*the whole file, header and map, mapped shared*/
+   size_t length;  /*bytes mapped - the file's size, unless a shrink couldn't make the smaller mapping*/
+   size_t size;  /*the file's size - the next resize truncates the file to match if it is out of step*/
+   size_t page;  /*page size, the unit of dirty tracking and msync*/
+   res_bitmap_word_t *dirty;  /*bit per page of the mapping, set = written since the last sync*/
+   size_t dirty_words;  /*words allocated for dirty*/
+ } res_bitmap_file_t;
+
+ typedef struct
+ {
+   size_t *super;  /*super[s] = bits taken before superblock s, super[supers] = the whole map*/
+   uint16_t *block;  /*block[b] = bits taken from the start of b's superblock to the start of block b*/
+   size_t *sample;  /*sample[j] = superblock holding taken bit j*RES_BITMAP_RANK_SAMPLE*/
+   size_t samples;  /*samples worked out*/
+   size_t supers;  /*superblocks in the map*/
+   size_t capacity;  /*superblocks allocated for*/
+   size_t valid;  /*super[0..valid] and the blocks of superblocks before valid are right - take and free lower it, rank and select recount from it*/
+ } res_bitmap_rank_t;
+
+ typedef struct
+ {
+   res_bitmap_word_t *dirty;  /*bit w set = map word w written since the last export*/
+   size_t capacity;  /*words allocated for dirty*/
+   size_t low;  /*smallest num_bits the map has had since the last export*/
+ } res_bitmap_delta_t;
+
  typedef struct
  {
    void *base;
-   size_t limit; /*in bytes. limit of 0 = 1 byte big bitmap. base+limit = highest byte that is part of the map. Describes memory dimensions of bit map, and is not the *actual* bitmap size - should be a multiple of BITS/BITS_IN_A_BYTE*/
+   size_t limit; /*in bytes. limit of 0 = 1 byte big bitmap. base+limit = highest byte that is part of the map. Describes memory dimensions of bit map, and is not the *actual* bitmap size - limit+1 is always a multiple of BITS/BITS_IN_A_BYTE, so the map can be accessed one res_bitmap_word_t at a time. Bits above num_bits in the last word are always kept at 0*/
    size_t num_bits; /*num_bits of 0 = 1 bit in the map.*/
+   ushort opts;  /*RES_BITMAP_OPT_... flags given at create time*/
+   res_bitmap_summary_t *summary;  /*NULL unless created with RES_BITMAP_OPT_SUMMARY*/
+   ushort policy;  /*RES_BITMAP_..._FIT allocation policy*/
+   size_t rover;  /*next fit cursor - the bit after the end of the last block allocated*/
+   res_bitmap_extents_t *extents;  /*NULL unless created with RES_BITMAP_OPT_EXTENTS*/
+   res_bitmap_file_t *file;  /*NULL unless the map lives in a file - see res_bitmap_create_file*/
+   res_bitmap_rank_t *rank;  /*NULL unless created with RES_BITMAP_OPT_RANK*/
+   res_bitmap_delta_t *delta;  /*NULL unless created with RES_BITMAP_OPT_DELTA*/
   } res_bitmap_t;
 
+ typedef struct
+ {
+   res_bitmap_word_t *bitmap;  /*map being walked*/
+   size_t w;  /*word we're in*/
+   res_bitmap_word_t word;  /*set bits of word w not handed out yet*/
+   size_t last;  /*last bit of the range*/
+ } res_bitmap_iter_t;
+
+ typedef struct
+ {
+   size_t free_bits;  /*bits free in the whole map*/
+   size_t runs;  /*runs of free bits*/
+   size_t largest;  /*length of the longest run, in bits - 0 if none is free. One more than res_bitmap_largest_free*/
+   size_t histogram[BITS];  /*histogram[c] is the number of runs with floor(log2(length)) = c*/
+ } res_bitmap_free_stats_t;
+
+ typedef struct
+ {
+   size_t base;  /*first bit*/
+   size_t limit;  /*bits after base - 0 = just base, as take*/
+ } res_bitmap_range_t;
+
 /*External functions*/
- res_bitmap_t* res_bitmap_create(size_t num_bits); /*creates a bitmap of size num_bits and a handle for it. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail. NOTE - num_bits starts at 0. 0 implies a bitmap with 1 bit, etc.*/
- ushort res_bitmap_destroy(res_bitmap_t* bitmap_handle); /*frees bitmap and handle memory. Returns 0 on success, other non-zero on unknown error*/
+ res_bitmap_t* res_bitmap_create(size_t num_bits); /*creates a bitmap of size num_bits and a handle for it. Maps of RES_BITMAP_MAP_MIN bytes or more are anonymous mappings, so this is O(1) and memory is only used as the bits are. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail. NOTE - num_bits starts at 0. 0 implies a bitmap with 1 bit, etc.*/
+ res_bitmap_t* res_bitmap_create_opts(size_t num_bits, ushort opts); /*as res_bitmap_create, but with a set of RES_BITMAP_OPT_... flags ORed together. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER on unknown flags*/
+ res_bitmap_t* res_bitmap_create_file(const char* path, size_t num_bits, ushort opts); /*as res_bitmap_create_opts, but the map lives in the file at path, memory mapped, after a small header. Any existing file is truncated. Returns: pointer to handle on success, NULL on failure; errno preserved on system call or malloc fail, set to RES_ERR_BAD_PARAMETER on unknown flags*/
+ res_bitmap_t* res_bitmap_open_file(const char* path, ushort opts); /*maps a file made by res_bitmap_create_file, after checking its header. Nothing past the header is read, so this takes the same time whatever the size - unless opts asks for indexes, which are built from the map. Returns: pointer to handle on success, NULL on failure; errno preserved on system call or malloc fail, set to RES_ERR_BAD_PARAMETER on unknown flags, RES_ERR_INCOMPATIBLE_RESOURCE on a bad header or file size*/
+ ushort res_bitmap_sync(res_bitmap_t* bitmap_handle); /*writes the pages of a file-backed map changed since the last sync back to the file, and waits for them - only those pages, one msync per run of them. Does nothing for a map in memory. Returns 0 on success, 2 on failure; errno preserved, pages not written yet stay dirty*/
+ ushort res_bitmap_destroy(res_bitmap_t* bitmap_handle); /*frees bitmap and handle memory. A file-backed map is unmapped and closed without a sync - changes still reach the file, but aren't waited for. Returns 0 on success, other non-zero on unknown error*/
 
- size_t res_bitmap_alloc(res_bitmap_t* bitmap_handle, size_t block_size); /*finds and marks a continuous set of free bits, of amount block_size. block_size of 0 = 1 bit; Returns RES_BITMAP_ERR on failure, bit number of the start of the block allocated on success, starting at 0; errno is set to a corresponding res_err defined error on failure*/
+ size_t res_bitmap_alloc(res_bitmap_t* bitmap_handle, size_t block_size); /*finds and marks a continuous set of free bits, of amount block_size. block_size of 0 = 1 bit; Returns RES_BITMAP_ERR on failure, bit number of the start of the block allocated on success, starting at 0; errno is set to a corresponding res_err defined error on failure. With RES_BITMAP_OPT_EXTENTS, a block_size bigger than every free run fails at once, without reading the map*/
+ size_t res_bitmap_alloc_aligned(res_bitmap_t* bitmap_handle, size_t block_size, ushort align_order); /*as res_bitmap_alloc, but the block starts on a multiple of 2^align_order bits. Always the lowest such block, whatever the policy; Returns RES_BITMAP_ERR on failure, start bit on success; errno is set to a corresponding res_err defined error on failure*/
+ size_t res_bitmap_alloc_many(res_bitmap_t* bitmap_handle, size_t block_size, size_t count, size_t* out); /*allocates up to count blocks of block_size+1 bits in one pass over the map, as count calls to res_bitmap_alloc would, and writes their start bits to out. Single bits are claimed a word at a time. Returns number of blocks allocated (less than count only if the map ran out, errno then set to RES_ERR_NO_MATCH), RES_BITMAP_ERR on bad block_size; errno set to RES_ERR_BAD_PARAMETER*/
  ushort res_bitmap_free(res_bitmap_t* bitmap_handle, size_t base, size_t limit); /*unmarks bits from base to (base+limit). Limit of 0 = 1 bit. Does not check if they are already free. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_bitmap_free_many(res_bitmap_t* bitmap_handle, size_t* bits, size_t count, size_t block_size); /*frees count blocks of block_size+1 bits, starting at each of bits[], in any order. bits is sorted in place. Blocks in the same word are freed with one update of it. Returns 0 on success, 2 on a base out-of-range, 3 on a block running past the end - nothing is freed on error*/
  ushort res_bitmap_take(res_bitmap_t* bitmap_handle, size_t base, size_t limit); /*marks bits from base to (base+limit). Limit of 0 = 1 bit. Does not check if they are already free. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_bitmap_reserve(res_bitmap_t* bitmap_handle, const res_bitmap_range_t* ranges, size_t count, size_t* failed); /*takes count ranges all together or not at all. Every range is checked against the map size first, then each word is tested and marked in one go - the first bit found already taken (including by an earlier range) puts back everything marked so far. Indexes are only updated once all ranges are in. Returns 0 on success, 1 on a bit already taken, 2 on a base out-of-range, 3 on a limit out-of-range - the map is unchanged on error, and failed (if not NULL) is set to the index of the range at fault*/
  ushort res_bitmap_check(res_bitmap_t* bitmap_handle, size_t base, size_t limit); /*returns 0 if all bits from base to (base+limit) are 0, 1 if all bits in this range are 1, 2 if they vary, 4 on base-out-of-range, 5 on limit-out-of-range. Limit of 0 = 1 bit*/
 
- ushort res_bitmap_resize(res_bitmap_t* bitmap_handle, size_t num_bits);  /*re-sizes the bitmap to new total size num_bits. Returns: 0 on success, 2 on memory error; errno preserved on realloc fail*/
+ ushort res_bitmap_set_policy(res_bitmap_t* bitmap_handle, ushort policy);  /*sets the allocation policy used by res_bitmap_alloc to one of the RES_BITMAP_..._FIT values. Returns 0 on success, 2 on unknown policy*/
+
+ ushort res_bitmap_resize(res_bitmap_t* bitmap_handle, size_t num_bits);  /*re-sizes the bitmap to new total size num_bits. Big maps grow with mremap, without copying or clearing the new part, and a file-backed map grows or shrinks the file and maps it again. Returns: 0 on success, 2 on memory error; errno preserved on realloc, ftruncate or mmap fail*/
 
  size_t res_bitmap_count(res_bitmap_t* bitmap, size_t base, size_t limit);  /*counts bits taken from base to base+limit. Limit of 0 = 1 bit to count. Returns count on success, RES_BITMAP_ERR on failure; errno is set to a corresponding res_err defined error on failure*/
  size_t res_bitmap_get_size(res_bitmap_t* bitmap);  /*Returns: number of bits (taken and free) in bitmap on success, RES_BITMAP_ERR on failure; errno is set to a res_err.h error code*/
+ size_t res_bitmap_largest_free(res_bitmap_t* bitmap_handle);  /*finds the biggest block_size that res_bitmap_alloc could succeed with right now. O(1) with RES_BITMAP_OPT_EXTENTS. Returns block_size (0 = 1 free bit) on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_NO_MATCH if no bits are free*/
+ ushort res_bitmap_free_stats(res_bitmap_t* bitmap_handle, res_bitmap_free_stats_t* stats);  /*fills in stats with the free bits, the number of free runs, the longest and a histogram of their lengths by power of 2 - a measure of fragmentation. O(BITS) with RES_BITMAP_OPT_EXTENTS, which keeps them as runs change, one pass over the map's words without. Returns 0 on success*/
+ size_t res_bitmap_find_next_set(res_bitmap_t* bitmap_handle, size_t from);  /*finds the first taken bit at or after from. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on from out-of-range, RES_ERR_NO_MATCH if there isn't one*/
+ size_t res_bitmap_find_next_clear(res_bitmap_t* bitmap_handle, size_t from);  /*finds the first free bit at or after from. Uses the summary index, if there is one. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set as find_next_set*/
+ size_t res_bitmap_find_prev_set(res_bitmap_t* bitmap_handle, size_t from);  /*finds the last taken bit at or before from. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set as find_next_set*/
+ ushort res_bitmap_iter_init(res_bitmap_t* bitmap_handle, res_bitmap_iter_t* iter, size_t base, size_t limit);  /*sets up iter to walk the taken bits from base to (base+limit). Limit of 0 = 1 bit. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ size_t res_bitmap_iter_next(res_bitmap_iter_t* iter);  /*returns the next taken bit in the iterator's range, lowest first, or RES_BITMAP_ERR when there are no more. Each word is read when the iterator reaches it. The map MUST NOT be resized while iterating*/
+ size_t res_bitmap_rank(res_bitmap_t* bitmap_handle, size_t bit);  /*counts the bits taken below bit - from 0 to bit-1. bit may be num_bits+1, for the whole map. O(1) with RES_BITMAP_OPT_RANK, reads the map up to bit without. Returns count on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on bit out-of-range*/
+ size_t res_bitmap_select(res_bitmap_t* bitmap_handle, size_t k);  /*finds the k'th taken bit, counting from 0 - the bit b with res_bitmap_rank(b) == k that is taken. Near O(1) with RES_BITMAP_OPT_RANK, reads the map up to it without. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_NO_MATCH if k bits or fewer are taken*/
+ size_t res_bitmap_delta_size(res_bitmap_t* bitmap_handle);  /*words a res_bitmap_delta_export of every change so far would need. Reads the dirty map - 1/BITS of the size of the map. Returns size on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER if the map wasn't made with RES_BITMAP_OPT_DELTA*/
+ size_t res_bitmap_delta_export(res_bitmap_t* bitmap_handle, res_bitmap_word_t* buf, size_t size);  /*writes the map's size and runs of (word index, count, new values) for the words changed since the last export into buf, which holds size words, lowest first and as many as fit. Words written are no longer counted as changed, the rest stay for the next export. Returns words written on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER if the map wasn't made with RES_BITMAP_OPT_DELTA, or size is less than RES_BITMAP_DELTA_HEADER*/
+ ushort res_bitmap_delta_apply(res_bitmap_t* bitmap_handle, const res_bitmap_word_t* buf, size_t size);  /*applies a delta of size words from res_bitmap_delta_export to a copy of the map it came from, resizing it to match. The whole delta is checked first. Returns 0 on success, 2 on a bad delta (map unchanged), 3 on memory error resizing (errno preserved, the map may be resized but nothing else changed)*/
+ ushort res_bitmap_combine(res_bitmap_t* dest_handle, res_bitmap_t* src_handle, ushort op);  /*dest = dest op src, one of the RES_BITMAP_AND/OR/XOR/ANDNOT values, a vector of words at a time. Bits of src past dest's num_bits are ignored, bits dest has past src's num_bits are combined with 0 - as if src were resized to dest's size. Any indexes are rebuilt after. Returns 0 on success, 2 on unknown op*/
+ ushort res_bitmap_combine_into(res_bitmap_t* dest_handle, res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op);  /*dest = a op b, with a and b read as if resized to dest's size. dest may be a or b. Returns 0 on success, 2 on unknown op*/
+ size_t res_bitmap_combine_count(res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op);  /*counts the bits a op b would have, without writing anything - e.g. RES_BITMAP_ANDNOT counts bits taken in a but not in b. b is read as if resized to a's size. Returns count on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on unknown op*/
+ size_t res_bitmap_count_parallel(res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads);  /*as res_bitmap_count, but the range is split between threads workers (0 = one per online CPU), the calling thread one of them, and their counts added up. No worker gets less than RES_BITMAP_PARALLEL_MIN bits, so small ranges stay on the calling thread. bitmap_parallel.c. The map MUST NOT change until it returns. Returns as res_bitmap_count*/
+ ushort res_bitmap_check_parallel(res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads);  /*as res_bitmap_check, split between workers as res_bitmap_count_parallel. Every worker stops as soon as one finds the bits vary. Returns as res_bitmap_check*/
+ size_t res_bitmap_find_next_clear_parallel(res_bitmap_t* bitmap_handle, size_t from, ushort threads);  /*as res_bitmap_find_next_clear, split between workers as res_bitmap_count_parallel. Workers stop once one below them has found a free bit. Returns as res_bitmap_find_next_clear*/
 
 /*Internal Functions:*/
  size_t _res_bitmap_size(size_t num_bits);
- void _res_bitmap_set(void *base, size_t num_bits);
  size_t _res_bitmap_limit(size_t num_bits);
  void _res_bitmap_handle_set(res_bitmap_t *bitmap_handle, void* base, size_t num_bits);
+ ushort _res_bitmap_handle_init(res_bitmap_t* bitmap_handle, ushort opts);  /*sets up the rest of a handle whose map is in place, building any indexes opts asks for. Returns 0 on success, 2 on malloc fail (errno preserved, the handle can be destroyed)*/
+ res_bitmap_t* _res_bitmap_create_mapped(res_bitmap_file_t* file, size_t num_bits, ushort opts);  /*makes a handle for the map in file. Returns NULL on malloc fail, errno preserved - the file is closed*/
+ res_bitmap_word_t _res_bitmap_mask(size_t first, size_t last);  /*returns a word with bits first to last (inclusive, both < BITS) set*/
+ void _res_bitmap_mark(res_bitmap_word_t* bitmap, size_t first, size_t last, ushort up);  /*sets (up=1) or clears (up=0) bits first to last inclusive. Does NOT check range*/
+ void _res_bitmap_apply(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up);  /*marks bits like _res_bitmap_mark, then brings any indexes kept with the map up to date. Does NOT check range*/
+ void _res_bitmap_changed(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up);  /*brings any indexes kept with the map up to date, and marks file pages dirty, after bits first to last were all set (up=1) or cleared (up=0)*/
+ size_t _res_bitmap_popcount(const res_bitmap_word_t* words, size_t n);  /*counts set bits in n whole words. Implemented in bitmap_simd.c, uses the fastest kernel the CPU supports*/
+ size_t _res_bitmap_popcount_word(res_bitmap_word_t word);  /*portable single-word popcount*/
+ size_t _res_bitmap_ctz_word(res_bitmap_word_t word);  /*portable count trailing zeros, word MUST be non-zero*/
+ size_t _res_bitmap_clz_word(res_bitmap_word_t word);  /*portable count leading zeros, word MUST be non-zero*/
+ void _res_bitmap_combine(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);  /*dest[i] = a[i] op b[i] for n words. dest may be a or b. bitmap_simd.c, fastest kernel the CPU supports*/
+ size_t _res_bitmap_combine_count(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);  /*counts set bits in a[i] op b[i] over n words. bitmap_simd.c*/
+ res_bitmap_word_t _res_bitmap_combine_word(res_bitmap_word_t a, res_bitmap_word_t b, ushort op);  /*a op b for one word*/
+ void _res_bitmap_combine_map(res_bitmap_word_t* dest, size_t dest_bits, const res_bitmap_word_t* a, size_t a_bits, const res_bitmap_word_t* b, size_t b_bits, ushort op);  /*combines two whole maps of a_bits and b_bits into a map of dest_bits, missing bits read as 0 and bits past dest_bits cleared. bitmap_simd.c*/
+ size_t _res_bitmap_combine_map_count(const res_bitmap_word_t* a, size_t a_bits, const res_bitmap_word_t* b, size_t b_bits, ushort op);  /*counts the bits _res_bitmap_combine_map would set in a map of a_bits. bitmap_simd.c*/
+ res_bitmap_file_t* _res_bitmap_file_create(const char* path, size_t num_bits);  /*creates or truncates the file at path, sized for num_bits with the map all 0, and maps it. bitmap_file.c. Returns NULL on failure, errno preserved*/
+ res_bitmap_file_t* _res_bitmap_file_open(const char* path, size_t* num_bits);  /*checks the header and size of the file at path, maps it and sets num_bits. bitmap_file.c. Returns NULL on failure; errno preserved on system call fail, set to RES_ERR_INCOMPATIBLE_RESOURCE on a bad header or size*/
+ res_bitmap_file_t* _res_bitmap_file_map(int fd, size_t length);  /*maps length bytes of fd, with nothing dirty. bitmap_file.c. Returns NULL on failure, errno preserved - fd is left open*/
+ void _res_bitmap_file_close(res_bitmap_file_t* file);  /*unmaps and closes, without a sync*/
+ ushort _res_bitmap_file_resize(res_bitmap_file_t* file, size_t num_bits);  /*grows or shrinks the file to hold num_bits and maps it again, maybe somewhere else. The header is NOT updated. Returns 0 on success, 2 on failure (file and mapping as they were); errno preserved*/
+ void _res_bitmap_file_header(res_bitmap_file_t* file, size_t num_bits);  /*writes the header for num_bits, and marks its page dirty*/
+ uint32_t _res_bitmap_file_checksum(const res_bitmap_file_header_t* header);  /*checksum of a header, not counting its checksum field*/
+ void _res_bitmap_file_dirty(res_bitmap_file_t* file, size_t first_word, size_t last_word);  /*marks the pages holding map words first_word to last_word dirty*/
+ ushort _res_bitmap_file_sync(res_bitmap_file_t* file);  /*res_bitmap_sync for a file*/
+ size_t _res_bitmap_file_length(size_t num_bits);  /*bytes in a file for a map of num_bits, header included*/
+ size_t _res_bitmap_file_pages(res_bitmap_file_t* file, size_t length);  /*pages needed for length bytes*/
+ void* _res_bitmap_mem_alloc(size_t size);  /*size bytes of zeroed memory for a map - calloc'd below RES_BITMAP_MAP_MIN, an anonymous mapping from there up. bitmap_file.c. Returns NULL on failure, errno preserved*/
+ void* _res_bitmap_mem_realloc(void* base, size_t old_size, size_t size);  /*resizes memory from _res_bitmap_mem_alloc, new bytes 0. Mappings are moved with mremap where there is one, not copied. Returns the new base, NULL on failure (base untouched); errno preserved*/
+ void _res_bitmap_mem_free(void* base, size_t size);
+ void* _res_bitmap_remap(void* mapping, size_t old_length, size_t length, int fd);  /*resizes a mapping - of file fd, or anonymous if fd is -1 - moving it if need be. Returns the new address, NULL on failure (mapping untouched); errno preserved*/
+ size_t _res_bitmap_page_size(void);
+ size_t _res_bitmap_select_word(res_bitmap_word_t word, size_t r);  /*position of set bit r (from 0) of word, which MUST have more than r set. bitmap_simd.c*/
+ void _res_bitmap_free_runs(const res_bitmap_word_t* bitmap, size_t num_bits, res_bitmap_free_stats_t* stats);  /*fills in stats by walking the runs of free bits in a whole map, a word at a time. bitmap_simd.c*/
+ void _res_bitmap_free_run(res_bitmap_free_stats_t* stats, size_t len);  /*adds a free run of len (non-zero) bits to stats*/
+ ushort _res_bitmap_claim(res_bitmap_word_t* bitmap, size_t first, size_t last, size_t* conflict);  /*sets bits first to last a word at a time, as long as every one of them is clear. Does NOT check range. Returns 0 on success, or 1 having cleared any words already set, with the first bit found taken in conflict. bitmap_simd.c*/
+ res_bitmap_rank_t* _res_bitmap_rank_create(res_bitmap_t* bitmap_handle);  /*allocates a rank directory for the map, to be counted when first used. Returns NULL on malloc fail, errno preserved*/
+ void _res_bitmap_rank_destroy(res_bitmap_rank_t* rank);
+ size_t _res_bitmap_rank_supers(size_t num_bits);  /*superblocks in a map of num_bits*/
+ ushort _res_bitmap_rank_reserve(res_bitmap_rank_t* rank, size_t num_bits);  /*makes room for a map of num_bits, before a resize. Returns 0 on success, 2 on memory error; errno preserved*/
+ void _res_bitmap_rank_resize(res_bitmap_rank_t* rank, size_t old_num_bits, size_t num_bits);  /*updates the directory after a resize from old_num_bits*/
+ void _res_bitmap_rank_touch(res_bitmap_rank_t* rank, size_t bit);  /*marks the directory stale from bit's superblock on*/
+ void _res_bitmap_rank_rebuild(res_bitmap_t* bitmap_handle);  /*recounts any stale part of the directory*/
+ size_t _res_bitmap_rank_get(res_bitmap_t* bitmap_handle, size_t bit);  /*res_bitmap_rank from the directory. Does NOT check range*/
+ size_t _res_bitmap_rank_select(res_bitmap_t* bitmap_handle, size_t k);  /*res_bitmap_select from the directory. Returns RES_BITMAP_ERR if k bits or fewer are taken*/
+ res_bitmap_delta_t* _res_bitmap_delta_create(size_t num_bits);  /*allocates change tracking for a map of num_bits, nothing changed. bitmap_delta.c. Returns NULL on malloc fail, errno preserved*/
+ void _res_bitmap_delta_destroy(res_bitmap_delta_t* delta);
+ size_t _res_bitmap_delta_words(size_t num_bits);  /*words of dirty map for a map of num_bits*/
+ ushort _res_bitmap_delta_reserve(res_bitmap_delta_t* delta, size_t num_bits);  /*makes room for a map of num_bits, before a resize. Returns 0 on success, 2 on memory error; errno preserved*/
+ void _res_bitmap_delta_resize(res_bitmap_delta_t* delta, size_t old_num_bits, size_t num_bits);  /*updates tracking after a resize from old_num_bits*/
+ void _res_bitmap_delta_touch(res_bitmap_delta_t* delta, size_t first_word, size_t last_word);  /*marks map words first_word to last_word changed*/
+ size_t _res_bitmap_delta_size(res_bitmap_delta_t* delta, size_t num_bits);  /*res_bitmap_delta_size*/
+ size_t _res_bitmap_delta_export(res_bitmap_delta_t* delta, const res_bitmap_word_t* bitmap, size_t num_bits, res_bitmap_word_t* buf, size_t size);  /*res_bitmap_delta_export, size MUST be at least RES_BITMAP_DELTA_HEADER*/
+ size_t _res_bitmap_delta_next(res_bitmap_delta_t* delta, size_t from, size_t words, ushort up);  /*finds the first map word from from on that is changed (up=1) or not (up=0). Returns its index, or words if there isn't one*/
+ ushort _res_bitmap_delta_check(const res_bitmap_word_t* buf, size_t size);  /*checks a delta is well formed - runs inside it and the map, bits above num_bits 0. Returns 0 if it is, 2 if not*/
+ void _res_bitmap_reindex(res_bitmap_t* bitmap_handle);  /*brings any indexes up to date after the whole map changed - the summary now, the extents when next needed*/
+ size_t _res_bitmap_scan(res_bitmap_t* bitmap_handle, size_t from, size_t to, size_t block_size);  /*finds the lowest block of block_size+1 free bits lying within bits from to to (inclusive). Does NOT check range or mark the block. Returns start bit, or RES_BITMAP_ERR if there isn't one*/
+ ushort _res_bitmap_summary_levels(size_t num_bits, size_t* words);  /*works out how many summary levels a map of num_bits needs, and fills in words[] with the size of each. Returns number of levels*/
+ res_bitmap_summary_t* _res_bitmap_summary_create(res_bitmap_t* bitmap_handle);  /*allocates and fills in a summary for the map. Returns NULL on malloc fail, errno preserved*/
+ void _res_bitmap_summary_destroy(res_bitmap_summary_t* summary);
+ void _res_bitmap_summary_rebuild(res_bitmap_t* bitmap_handle, res_bitmap_summary_t* summary);  /*works out every level from scratch*/
+ ushort _res_bitmap_summary_bit(res_bitmap_t* bitmap_handle, res_bitmap_summary_t* summary, ushort level, size_t unit);  /*works out what bit unit of a level should be from the level below. Returns 1 if there are free bits under it, 0 if not*/
+ void _res_bitmap_summary_update(res_bitmap_t* bitmap_handle, size_t first_word, size_t last_word, ushort up);  /*updates the summary after bitmap words first_word to last_word changed. up=0 if the words between first_word and last_word are now all free, 1 if all taken, 2 if unknown*/
+ size_t _res_bitmap_summary_next(res_bitmap_summary_t* summary, ushort level, size_t unit);  /*finds the first set bit at or after unit in a level - for level 0, the first bitmap word from unit on with a free bit. Returns RES_BITMAP_ERR if there isn't one*/
+ ushort _res_bitmap_summary_reserve(res_bitmap_summary_t* summary, size_t num_bits);  /*makes room for a map of num_bits, before a resize. The summary stays valid for the old size. Returns 0 on success, 2 on memory error; errno preserved*/
+ void _res_bitmap_summary_commit(res_bitmap_t* bitmap_handle, size_t old_num_bits);  /*updates the summary after a resize from old_num_bits*/
+ size_t _res_bitmap_find(res_bitmap_t* bitmap_handle, size_t from, size_t to, ushort up);  /*finds the first bit from from to to (inclusive) that is set (up=1) or clear (up=0). Does NOT check range. Returns bit number, or RES_BITMAP_ERR if there isn't one*/
+ size_t _res_bitmap_find_next(res_bitmap_t* bitmap_handle, size_t from, ushort up);  /*res_bitmap_find_next_set (up=1) / _clear (up=0)*/
+ size_t _res_bitmap_scan_aligned(res_bitmap_t* bitmap_handle, size_t block_size, size_t align);  /*finds the lowest block of block_size+1 free bits starting on a multiple of align (a power of 2). Does NOT mark the block. Returns start bit, or RES_BITMAP_ERR if there isn't one*/
+ size_t _res_bitmap_fit(res_bitmap_t* bitmap_handle, size_t block_size, ushort worst);  /*finds the start of the smallest (worst=0) or largest (worst=1) free run of at least block_size+1 bits by scanning the map. Returns start bit, or RES_BITMAP_ERR if there isn't one*/
+ size_t _res_bitmap_alloc_run(res_bitmap_t* bitmap_handle, size_t from, size_t to, size_t block_size, size_t count, size_t* out);  /*allocates up to count blocks lying within bits from to to, lowest first, in one forward pass, writing their starts to out. Does NOT check range or move the next fit cursor. Returns number allocated*/
+ void _res_bitmap_apply_word(res_bitmap_t* bitmap_handle, size_t w, res_bitmap_word_t mask, ushort up);  /*sets (up=1) or clears (up=0) the bits of mask in word w, then brings any indexes up to date*/
+ int _res_bitmap_compare(const void* a, const void* b);  /*qsort comparison for size_t's*/
+ res_bitmap_extents_t* _res_bitmap_extents_create(res_bitmap_t* bitmap_handle);  /*allocates and fills in an extent index for the map. Returns NULL on malloc fail, errno preserved*/
+ void _res_bitmap_extents_destroy(res_bitmap_extents_t* extents);
+ void _res_bitmap_extents_clear(res_bitmap_extents_t* extents);  /*empties the index, keeping the node array*/
+ ushort _res_bitmap_extents_build(res_bitmap_t* bitmap_handle, res_bitmap_extents_t* extents);  /*fills in the index from scratch. Returns 0 on success, 2 on memory error (the index is left broken)*/
+ ushort _res_bitmap_extents_ready(res_bitmap_t* bitmap_handle);  /*makes sure the index can be used, rebuilding it if broken. Returns 0 if it can, 2 if not*/
+ void _res_bitmap_extents_update(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up);  /*updates the index after bits first to last were all set (up=1) or cleared (up=0)*/
+ size_t _res_bitmap_extents_fit(res_bitmap_t* bitmap_handle, size_t need, ushort worst);  /*as _res_bitmap_fit, but need is a real length, and uses the index. Index MUST be ready*/
+ size_t _res_bitmap_extents_largest(res_bitmap_extents_t* extents);  /*length of the longest free run, 0 if none*/
+ size_t _res_bitmap_extents_class(size_t len);  /*size class of a run - floor(log2(len)). len MUST be non-zero*/
+ size_t _res_bitmap_extents_insert(res_bitmap_extents_t* extents, size_t start, size_t len);  /*adds a run. Returns node index, or SIZE_MAX on memory error*/
+ void _res_bitmap_extents_erase(res_bitmap_extents_t* extents, size_t i);  /*removes node i*/
+ void _res_bitmap_extents_split(res_bitmap_extents_t* extents, size_t t, size_t start, size_t* left, size_t* right);  /*splits treap t into nodes starting below start, and the rest*/
+ size_t _res_bitmap_extents_merge(res_bitmap_extents_t* extents, size_t left, size_t right);  /*joins two treaps, everything in left starting before everything in right. Returns the new root*/
+ size_t _res_bitmap_extents_find_le(res_bitmap_extents_t* extents, size_t start);  /*node with the highest start <= start, SIZE_MAX if none*/
+ size_t _res_bitmap_extents_find_ge(res_bitmap_extents_t* extents, size_t start);  /*node with the lowest start >= start, SIZE_MAX if none*/
+ void _res_bitmap_extents_size_split(res_bitmap_extents_t* extents, size_t t, size_t len, size_t start, size_t* left, size_t* right);  /*splits size class treap t into nodes shorter than len or as long and starting below start, and the rest*/
+ size_t _res_bitmap_extents_size_merge(res_bitmap_extents_t* extents, size_t left, size_t right);  /*joins two size class treaps, everything in left before everything in right. Returns the new root*/
+ size_t _res_bitmap_extents_find_len(res_bitmap_extents_t* extents, size_t t, size_t len);  /*node in size class treap t with the lowest start of the shortest runs of len or more, SIZE_MAX if none*/
+
+/*Internal macros:*/
+ #if defined(__GNUC__) && defined(BITS_64)
+  #define RES_BITMAP_POPCOUNT(word) ((size_t)__builtin_popcountll(word))
+  #define RES_BITMAP_CTZ(word) ((size_t)__builtin_ctzll(word))  /*word MUST be non-zero*/
+  #define RES_BITMAP_CLZ(word) ((size_t)__builtin_clzll(word))  /*word MUST be non-zero*/
+ #elif defined(__GNUC__)
+  #define RES_BITMAP_POPCOUNT(word) ((size_t)__builtin_popcountl(word))
+  #define RES_BITMAP_CTZ(word) ((size_t)__builtin_ctzl(word))
+  #define RES_BITMAP_CLZ(word) ((size_t)__builtin_clzl(word) - (sizeof(long) * BITS_IN_A_BYTE - BITS))
+ #else
+  #define RES_BITMAP_POPCOUNT(word) _res_bitmap_popcount_word(word)
+  #define RES_BITMAP_CTZ(word) _res_bitmap_ctz_word(word)
+  #define RES_BITMAP_CLZ(word) _res_bitmap_clz_word(word)
+ #endif
 #endif
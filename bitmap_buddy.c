@@ -0,0 +1,1141 @@
+/* bitmap_buddy.c - binary buddy implementation of the bitmap API
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: buddy-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap_buddy.h"
+
+/* The map itself is kept exactly as in reff-1, and is always the final word on
+ * which bits are taken. On top of it, each order k has two bitmaps with a bit
+ * per 2^k bit block: 'full', set when the whole block is free, and level[0],
+ * set when the block is a free buddy - free, but not part of a bigger free
+ * block. level[0] has a summary above it (as bitmap_summary.c), so the lowest
+ * free buddy of an order is found in a few word reads.
+ *
+ * Rather than splitting and joining blocks one at a time, every change to the
+ * map re-works the words of each order that cover the bits changed, a word at
+ * a time - which splits and coalesces blocks for any take or free, not just
+ * ones that line up with buddies. For an alloc that is O(orders) words.*/
+
+res_bitmap_t* res_bitmap_create(size_t num_bits)
+{
+  return(res_bitmap_create_opts(num_bits, 0));
+}
+
+res_bitmap_t* res_bitmap_create_opts(size_t num_bits, ushort opts)
+{
+  res_bitmap_t *handle;
+  void* base;
+   /*check options - all known ones but RES_BITMAP_OPT_DELTA are no-ops here*/
+    if(0 != (opts & ~(RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK | RES_BITMAP_OPT_DELTA)))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+   /*allocate memory*/
+    base = _res_bitmap_mem_alloc( _res_bitmap_size(num_bits) );
+    if(NULL == base)
+      return(NULL);
+
+    handle = malloc( sizeof(res_bitmap_t) );
+    if(NULL == handle)
+    {
+      _res_bitmap_mem_free(base, _res_bitmap_size(num_bits));
+      return(NULL);
+    }
+
+   /*orders*/
+    handle->order = _res_bitmap_buddy_create(base, num_bits);
+    if(NULL == handle->order)
+    {
+      _res_bitmap_mem_free(base, _res_bitmap_size(num_bits));
+      free(handle);
+      return(NULL);
+    }
+
+    _res_bitmap_handle_set(handle, base, num_bits);
+    handle->orders = _res_bitmap_buddy_orders(num_bits);
+    handle->opts = opts;
+    handle->policy = RES_BITMAP_FIRST_FIT;
+    handle->file = NULL;
+    handle->delta = NULL;
+    if(0 != (opts & RES_BITMAP_OPT_DELTA))
+    {
+      handle->delta = _res_bitmap_delta_create(num_bits);
+      if(NULL == handle->delta)
+      {
+        res_bitmap_destroy(handle);
+        return(NULL);
+      }
+    }
+  return(handle);
+}
+
+res_bitmap_t* res_bitmap_create_file(const char* path, size_t num_bits, ushort opts)
+{
+  res_bitmap_file_t *file;
+    if(0 != (opts & ~(RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK | RES_BITMAP_OPT_DELTA)))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+    file = _res_bitmap_file_create(path, num_bits);
+    if(NULL == file)
+      return(NULL);
+  return(_res_bitmap_create_mapped(file, num_bits, opts));
+}
+
+res_bitmap_t* res_bitmap_open_file(const char* path, ushort opts)
+{
+  res_bitmap_t *handle;
+  res_bitmap_file_t *file;
+  size_t num_bits;
+    if(0 != (opts & ~(RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK | RES_BITMAP_OPT_DELTA)))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+    file = _res_bitmap_file_open(path, &num_bits);
+    if(NULL == file)
+      return(NULL);
+    handle = _res_bitmap_create_mapped(file, num_bits, opts);
+
+   /*as reff-1, the first export sends the whole file*/
+    if((NULL != handle) && (NULL != handle->delta))
+      _res_bitmap_delta_touch(handle->delta, 0, num_bits / BITS);
+  return(handle);
+}
+
+ushort res_bitmap_sync(res_bitmap_t* bitmap_handle)
+{
+  if(NULL == bitmap_handle->file)
+    return(0);
+  return(_res_bitmap_file_sync(bitmap_handle->file));
+}
+
+res_bitmap_t* _res_bitmap_create_mapped(res_bitmap_file_t* file, size_t num_bits, ushort opts)
+{
+  res_bitmap_t *handle;
+  void* base;
+  int e;
+    base = (uint8_t*)file->mapping + RES_BITMAP_FILE_HEADER;
+    handle = malloc( sizeof(res_bitmap_t) );
+    if(NULL != handle)
+    {
+      handle->order = _res_bitmap_buddy_create(base, num_bits);  /*reads the whole map*/
+      if(NULL == handle->order)
+      {
+        free(handle);
+        handle = NULL;
+      }
+    }
+    if(NULL == handle)
+    {
+      e = errno;
+      _res_bitmap_file_close(file);
+      errno = e;
+      return(NULL);
+    }
+
+    _res_bitmap_handle_set(handle, base, num_bits);
+    handle->orders = _res_bitmap_buddy_orders(num_bits);
+    handle->opts = opts;
+    handle->policy = RES_BITMAP_FIRST_FIT;
+    handle->file = file;
+    handle->delta = NULL;
+    if(0 != (opts & RES_BITMAP_OPT_DELTA))
+    {
+      handle->delta = _res_bitmap_delta_create(num_bits);
+      if(NULL == handle->delta)
+      {
+        e = errno;
+        res_bitmap_destroy(handle);
+        errno = e;
+        return(NULL);
+      }
+    }
+  return(handle);
+}
+
+size_t _res_bitmap_size(size_t num_bits)
+{
+  return(_res_bitmap_limit(num_bits) + 1);  /*limit is the highest byte in the map, so we need to add 1*/
+}
+
+size_t _res_bitmap_limit(size_t num_bits)
+{
+  size_t limit;
+   /*whole words, as reff-1*/
+    limit = ((num_bits / BITS) + 1) * (BITS/BITS_IN_A_BYTE);
+  return(limit - 1);  /*limit is the highest byte in the map, not the size*/
+}
+
+void _res_bitmap_handle_set(res_bitmap_t *bitmap, void* base, size_t num_bits)
+{
+  bitmap->base = base;
+  bitmap->limit = _res_bitmap_limit(num_bits);
+  bitmap->num_bits = num_bits;
+}
+
+ushort res_bitmap_destroy(res_bitmap_t* bitmap_handle)
+{
+  _res_bitmap_buddy_destroy(bitmap_handle->order, bitmap_handle->orders);
+  if(NULL != bitmap_handle->delta)
+    _res_bitmap_delta_destroy(bitmap_handle->delta);
+  if(NULL != bitmap_handle->file)
+    _res_bitmap_file_close(bitmap_handle->file);
+  else
+    _res_bitmap_mem_free(bitmap_handle->base, _res_bitmap_size(bitmap_handle->num_bits));
+  free(bitmap_handle);
+  return(0);
+}
+
+size_t res_bitmap_alloc(res_bitmap_t* bitmap_handle, size_t block_size)
+{
+  return(res_bitmap_alloc_aligned(bitmap_handle, block_size, 0));  /*every buddy is aligned to at least 2^0*/
+}
+
+size_t res_bitmap_alloc_aligned(res_bitmap_t* bitmap_handle, size_t block_size, ushort align_order)
+{
+  size_t need;
+  size_t j;
+  ushort k;
+  ushort o;
+   /*check parameters*/
+    if((block_size > bitmap_handle->num_bits) || (align_order >= sizeof(size_t) * BITS_IN_A_BYTE))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*smallest order that holds block_size+1 bits*/
+    need = block_size + 1;
+    k = (1 == need) ? 0 : (ushort)(BITS - RES_BITMAP_CLZ((res_bitmap_word_t)(need - 1)));
+
+   /*lowest free buddy of that order, or the next one up that has any. Below align_order, only every 2^(align_order-o)th block is aligned*/
+    j = RES_BITMAP_ERR;
+    for(o=k; o<bitmap_handle->orders; o++)
+    {
+      if(o >= align_order)
+        j = _res_bitmap_buddy_first(&bitmap_handle->order[o]);
+      else
+        j = _res_bitmap_buddy_aligned(&bitmap_handle->order[o], (size_t)1 << (align_order - o));
+      if(RES_BITMAP_ERR != j)
+        break;
+    }
+    if(RES_BITMAP_ERR == j)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*take the start of it - splitting off what's left happens in the update*/
+    j <<= o;
+    _res_bitmap_buddy_apply(bitmap_handle, j, j + block_size, 1);
+  return(j);
+}
+
+size_t res_bitmap_alloc_many(res_bitmap_t* bitmap_handle, size_t block_size, size_t count, size_t* out)
+{
+  size_t n;
+  size_t i;
+   /*check if block_size valid*/
+    if(block_size > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*each alloc is only O(orders) words already - nothing to gain from a pass over the map*/
+    for(n=0; n<count; n++)
+    {
+      i = res_bitmap_alloc_aligned(bitmap_handle, block_size, 0);
+      if(RES_BITMAP_ERR == i)
+        break;  /*errno already RES_ERR_NO_MATCH*/
+      out[n] = i;
+    }
+  return(n);
+}
+
+ushort res_bitmap_free(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > bitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+   /*unmark, then coalesce*/
+    _res_bitmap_buddy_apply(bitmap_handle, base, base+limit, 0);
+  return(0);
+}
+
+ushort res_bitmap_free_many(res_bitmap_t* bitmap_handle, size_t* bits, size_t count, size_t block_size)
+{
+  res_bitmap_word_t mask = 0;
+  size_t word = RES_BITMAP_ERR;  /*word mask belongs to - none yet*/
+  size_t first;
+  size_t last;
+  size_t i;
+   /*check every block before freeing any of them*/
+    for(i=0; i<count; i++)
+    {
+      if(bits[i] > bitmap_handle->num_bits)
+        return(2);
+      if((bits[i] > (SIZE_MAX - block_size)) || ((bits[i]+block_size) > bitmap_handle->num_bits))
+        return(3);
+    }
+
+   /*sort them, unless they already are*/
+    for(i=1; i<count; i++)
+    {
+      if(bits[i] < bits[i-1])
+      {
+        qsort(bits, count, sizeof(size_t), _res_bitmap_compare);
+        break;
+      }
+    }
+
+   /*join up blocks that touch or overlap, and coalesce once per word rather than once per block*/
+    i = 0;
+    while(i < count)
+    {
+      first = bits[i];
+      last = bits[i] + block_size;
+      for(i++; (i < count) && (bits[i] <= last + 1); i++)
+        if(bits[i] + block_size > last)
+          last = bits[i] + block_size;
+
+      if((word != first/BITS) || (first/BITS != last/BITS))
+      {
+        if(RES_BITMAP_ERR != word)
+          _res_bitmap_buddy_free_word(bitmap_handle, word, mask);
+        word = RES_BITMAP_ERR;
+        mask = 0;
+      }
+      if(first/BITS == last/BITS)
+      {
+        word = first/BITS;
+        mask |= _res_bitmap_mask(first%BITS, last%BITS);
+      } else {
+        _res_bitmap_buddy_apply(bitmap_handle, first, last, 0);
+      }
+    }
+    if(RES_BITMAP_ERR != word)
+      _res_bitmap_buddy_free_word(bitmap_handle, word, mask);
+  return(0);
+}
+
+ushort res_bitmap_take(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > bitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+   /*mark, then split*/
+    _res_bitmap_buddy_apply(bitmap_handle, base, base+limit, 1);
+  return(0);
+}
+
+ushort res_bitmap_reserve(res_bitmap_t* bitmap_handle, const res_bitmap_range_t* ranges, size_t count, size_t* failed)
+{
+  size_t i;
+  size_t j;
+  size_t conflict;
+   /*check every range before touching the map*/
+    for(i=0; i<count; i++)
+    {
+      if(ranges[i].base > bitmap_handle->num_bits)
+      {
+        if(NULL != failed)
+          *failed = i;
+        return(2);
+      }
+      if((ranges[i].base > (SIZE_MAX - ranges[i].limit)) || ((ranges[i].base+ranges[i].limit) > bitmap_handle->num_bits))
+      {
+        if(NULL != failed)
+          *failed = i;
+        return(3);
+      }
+    }
+
+   /*claim each range, putting back the ones already in at the first taken bit*/
+    for(i=0; i<count; i++)
+    {
+      if(0 != _res_bitmap_claim(bitmap_handle->base, ranges[i].base, ranges[i].base+ranges[i].limit, &conflict))
+      {
+        for(j=0; j<i; j++)
+          _res_bitmap_mark(bitmap_handle->base, ranges[j].base, ranges[j].base+ranges[j].limit, 0);
+        if(NULL != failed)
+          *failed = i;
+        return(1);
+      }
+    }
+
+   /*then split the buddies*/
+    for(i=0; i<count; i++)
+    {
+      if(NULL != bitmap_handle->file)
+        _res_bitmap_file_dirty(bitmap_handle->file, ranges[i].base/BITS, (ranges[i].base+ranges[i].limit)/BITS);
+      if(NULL != bitmap_handle->delta)
+        _res_bitmap_delta_touch(bitmap_handle->delta, ranges[i].base/BITS, (ranges[i].base+ranges[i].limit)/BITS);
+      _res_bitmap_buddy_update(bitmap_handle->base, bitmap_handle->num_bits, bitmap_handle->order, ranges[i].base, ranges[i].base+ranges[i].limit);
+    }
+  return(0);
+}
+
+ushort res_bitmap_check(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+{
+  res_bitmap_word_t *bitmap;
+  res_bitmap_word_t mask;
+  res_bitmap_word_t want;  /*what the bits under mask must look like - all 0's or all 1's*/
+  size_t i;
+  size_t first_word;
+  size_t last_word;
+  ushort up=0;  /*what kind of bit we're checking for*/
+
+   /*check base & limit*/
+    if(base > bitmap_handle->num_bits)
+      return(4);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(5);
+
+   /*get bitmap pointer, words to test*/
+    bitmap = bitmap_handle->base;
+    first_word = base / BITS;
+    last_word = (base + limit) / BITS;
+
+   /*the first bit decides what the rest must be*/
+    if(0 != (bitmap[first_word] & ((res_bitmap_word_t)1 << (base%BITS))))
+      up = 1;
+    want = (0 == up) ? 0 : ~(res_bitmap_word_t)0;
+
+   /*first word, whole words in the middle, last word*/
+    if(first_word == last_word)
+      mask = _res_bitmap_mask(base%BITS, (base+limit)%BITS);
+    else
+      mask = _res_bitmap_mask(base%BITS, BITS-1);
+    if((bitmap[first_word] & mask) != (want & mask))
+      return(2);
+    if(first_word == last_word)
+      return(up);
+
+    for(i=first_word+1; i<last_word; i++)
+      if(bitmap[i] != want)
+        return(2);
+
+    mask = _res_bitmap_mask(0, (base+limit)%BITS);
+    if((bitmap[last_word] & mask) != (want & mask))
+      return(2);
+
+  return(up);  /*bits all the same, so return either 1 or 0*/
+}
+
+ushort res_bitmap_set_policy(res_bitmap_t* bitmap_handle, ushort policy)
+{
+  if(policy > RES_BITMAP_WORST_FIT)
+    return(2);
+  bitmap_handle->policy = policy;
+  return(0);
+}
+
+ushort res_bitmap_resize(res_bitmap_t* bitmap_handle, size_t num_bits)
+{
+  res_bitmap_order_t* order;
+  uint8_t* base;
+  size_t limit;
+  size_t old_limit;
+  int e;
+    limit = _res_bitmap_limit(num_bits);
+    old_limit = bitmap_handle->limit;
+    base = bitmap_handle->base;
+
+   /*growing - make room first. Nothing else has changed if a later step fails, the map is just bigger than it needs to be*/
+    if(NULL != bitmap_handle->delta)
+      if(0 != _res_bitmap_delta_reserve(bitmap_handle->delta, num_bits))
+        return(2);
+    if(limit > old_limit)
+    {
+      if(NULL != bitmap_handle->file)
+      {
+        if(0 != _res_bitmap_file_resize(bitmap_handle->file, num_bits))  /*new bytes in a file are already 0*/
+          return(2);
+        base = (uint8_t*)bitmap_handle->file->mapping + RES_BITMAP_FILE_HEADER;
+      } else {
+        base = _res_bitmap_mem_realloc( base, old_limit + 1, limit + 1 );  /*new memory comes back 0*/
+        if(NULL == base)
+          return(2);
+      }
+      bitmap_handle->base = base;
+    }
+
+   /*new orders - worked out with bits past num_bits counted as taken, so this is fine before a shrink too*/
+    order = _res_bitmap_buddy_create((res_bitmap_word_t*)base, num_bits);
+    if(NULL == order)
+    {
+      e = errno;
+      if((limit > old_limit) && (NULL != bitmap_handle->file))
+        if(0 == _res_bitmap_file_resize(bitmap_handle->file, bitmap_handle->num_bits))  /*a file has to stay the size its header says*/
+          bitmap_handle->base = (uint8_t*)bitmap_handle->file->mapping + RES_BITMAP_FILE_HEADER;
+      errno = e;
+      return(2);
+    }
+
+   /*shrinking - cut the file or hand back memory before anything else changes, so this is the one step that can fail after the orders are made. The start of the map is kept, so the last word can be cleaned up after. Kind of memory follows from size, so the old block can't be kept on failure*/
+    if(limit < old_limit)
+    {
+      if(NULL != bitmap_handle->file)
+      {
+        if(0 == _res_bitmap_file_resize(bitmap_handle->file, num_bits))  /*the cut off bits are gone for good*/
+          base = (uint8_t*)bitmap_handle->file->mapping + RES_BITMAP_FILE_HEADER;
+        else
+          base = NULL;
+      } else
+        base = _res_bitmap_mem_realloc( base, old_limit + 1, limit + 1 );
+      if(NULL == base)
+      {
+        _res_bitmap_buddy_destroy(order, _res_bitmap_buddy_orders(num_bits));
+        return(2);
+      }
+    }
+
+   /*shrinking - clear bits cut off the end of the last word*/
+    if(num_bits < bitmap_handle->num_bits)
+    {
+      ((res_bitmap_word_t*)base)[num_bits/BITS] &= _res_bitmap_mask(0, num_bits%BITS);
+      if(NULL != bitmap_handle->file)
+        _res_bitmap_file_dirty(bitmap_handle->file, num_bits/BITS, num_bits/BITS);
+    }
+    if(NULL != bitmap_handle->file)
+      _res_bitmap_file_header(bitmap_handle->file, num_bits);
+
+   /*update handle*/
+    if(NULL != bitmap_handle->delta)
+      _res_bitmap_delta_resize(bitmap_handle->delta, bitmap_handle->num_bits, num_bits);
+    _res_bitmap_buddy_destroy(bitmap_handle->order, bitmap_handle->orders);
+    bitmap_handle->order = order;
+    bitmap_handle->orders = _res_bitmap_buddy_orders(num_bits);
+    _res_bitmap_handle_set(bitmap_handle, base, num_bits);
+  return(0);
+}
+
+size_t res_bitmap_count(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+{
+  res_bitmap_word_t *bitmap;
+  size_t first_word;
+  size_t last_word;
+  size_t count;
+   /*check parameters*/
+    if(base > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*masked head, whole words in the middle, masked tail*/
+    bitmap = bitmap_handle->base;
+    first_word = base / BITS;
+    last_word = (base + limit) / BITS;
+    if(first_word == last_word)
+      return(RES_BITMAP_POPCOUNT(bitmap[first_word] & _res_bitmap_mask(base%BITS, (base+limit)%BITS)));
+
+    count = RES_BITMAP_POPCOUNT(bitmap[first_word] & _res_bitmap_mask(base%BITS, BITS-1));
+    count += _res_bitmap_popcount(&bitmap[first_word+1], last_word - first_word - 1);
+    count += RES_BITMAP_POPCOUNT(bitmap[last_word] & _res_bitmap_mask(0, (base+limit)%BITS));
+  return(count);
+}
+
+size_t res_bitmap_get_size(res_bitmap_t* bitmap_handle)
+{
+  return(bitmap_handle->num_bits);
+}
+
+size_t res_bitmap_largest_free(res_bitmap_t* bitmap_handle)
+{
+  ushort k;
+   /*highest order with a free buddy*/
+    for(k=bitmap_handle->orders; k>0; k--)
+      if(RES_BITMAP_ERR != _res_bitmap_buddy_first(&bitmap_handle->order[k-1]))
+        return(((size_t)1 << (k-1)) - 1);
+
+    errno = RES_ERR_NO_MATCH;
+  return(RES_BITMAP_ERR);
+}
+
+ushort res_bitmap_free_stats(res_bitmap_t* bitmap_handle, res_bitmap_free_stats_t* stats)
+{
+  _res_bitmap_free_runs(bitmap_handle->base, bitmap_handle->num_bits, stats);
+  return(0);
+}
+
+size_t res_bitmap_find_next_set(res_bitmap_t* bitmap_handle, size_t from)
+{
+  return(_res_bitmap_find_next(bitmap_handle, from, 1));
+}
+
+size_t res_bitmap_find_next_clear(res_bitmap_t* bitmap_handle, size_t from)
+{
+  return(_res_bitmap_find_next(bitmap_handle, from, 0));
+}
+
+size_t res_bitmap_find_prev_set(res_bitmap_t* bitmap_handle, size_t from)
+{
+  res_bitmap_word_t *bitmap;
+  res_bitmap_word_t word;
+  size_t w;
+   /*check parameters*/
+    if(from > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*bits after from don't count - then back a word at a time*/
+    bitmap = bitmap_handle->base;
+    w = from / BITS;
+    word = bitmap[w] & _res_bitmap_mask(0, from%BITS);
+    while(0 == word)
+    {
+      if(0 == w)
+      {
+        errno = RES_ERR_NO_MATCH;
+        return(RES_BITMAP_ERR);
+      }
+      w--;
+      word = bitmap[w];
+    }
+  return(w * BITS + (BITS - 1 - RES_BITMAP_CLZ(word)));
+}
+
+ushort res_bitmap_iter_init(res_bitmap_t* bitmap_handle, res_bitmap_iter_t* iter, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > bitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+    iter->bitmap = bitmap_handle->base;
+    iter->w = base / BITS;
+    iter->last = base + limit;
+    iter->word = iter->bitmap[iter->w] & _res_bitmap_mask(base%BITS, BITS-1);
+    if(iter->w == iter->last / BITS)
+      iter->word &= _res_bitmap_mask(0, iter->last%BITS);
+  return(0);
+}
+
+size_t res_bitmap_iter_next(res_bitmap_iter_t* iter)
+{
+  size_t bit;
+   /*next word with anything set - the last one only up to last*/
+    while(0 == iter->word)
+    {
+      if(iter->w >= iter->last / BITS)
+        return(RES_BITMAP_ERR);
+      iter->w++;
+      iter->word = iter->bitmap[iter->w];
+      if(iter->w == iter->last / BITS)
+        iter->word &= _res_bitmap_mask(0, iter->last%BITS);
+    }
+
+   /*lowest bit left, then knock it off*/
+    bit = iter->w * BITS + RES_BITMAP_CTZ(iter->word);
+    iter->word &= iter->word - 1;
+  return(bit);
+}
+
+size_t res_bitmap_rank(res_bitmap_t* bitmap_handle, size_t bit)
+{
+  res_bitmap_word_t *bitmap;
+  size_t r;
+   /*check bit - num_bits+1 is allowed, for the whole map*/
+    if(bit > bitmap_handle->num_bits + 1)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*whole words, then the part of bit's word below it*/
+    bitmap = bitmap_handle->base;
+    r = _res_bitmap_popcount(bitmap, bit / BITS);
+    if(0 != bit % BITS)
+      r += RES_BITMAP_POPCOUNT(bitmap[bit / BITS] & _res_bitmap_mask(0, bit % BITS - 1));
+  return(r);
+}
+
+size_t res_bitmap_select(res_bitmap_t* bitmap_handle, size_t k)
+{
+  res_bitmap_word_t *bitmap;
+  size_t words;
+  size_t w;
+  size_t n;
+   /*count word by word until the word holding it*/
+    bitmap = bitmap_handle->base;
+    words = bitmap_handle->num_bits / BITS + 1;
+    for(w=0; w<words; w++)
+    {
+      n = RES_BITMAP_POPCOUNT(bitmap[w]);
+      if(k < n)
+        return(w * BITS + _res_bitmap_select_word(bitmap[w], k));
+      k -= n;
+    }
+    errno = RES_ERR_NO_MATCH;
+  return(RES_BITMAP_ERR);
+}
+
+size_t res_bitmap_delta_size(res_bitmap_t* bitmap_handle)
+{
+  if(NULL == bitmap_handle->delta)
+  {
+    errno = RES_ERR_BAD_PARAMETER;
+    return(RES_BITMAP_ERR);
+  }
+  return(_res_bitmap_delta_size(bitmap_handle->delta, bitmap_handle->num_bits));
+}
+
+size_t res_bitmap_delta_export(res_bitmap_t* bitmap_handle, res_bitmap_word_t* buf, size_t size)
+{
+  if((NULL == bitmap_handle->delta) || (size < RES_BITMAP_DELTA_HEADER))
+  {
+    errno = RES_ERR_BAD_PARAMETER;
+    return(RES_BITMAP_ERR);
+  }
+  return(_res_bitmap_delta_export(bitmap_handle->delta, bitmap_handle->base, bitmap_handle->num_bits, buf, size));
+}
+
+ushort res_bitmap_delta_apply(res_bitmap_t* bitmap_handle, const res_bitmap_word_t* buf, size_t size)
+{
+  size_t i;
+  size_t first;
+  size_t last;
+  size_t n;
+    if(0 != _res_bitmap_delta_check(buf, size))
+      return(2);
+
+   /*down to the smallest size the source had, then up to its size now*/
+    if((size_t)buf[1] < bitmap_handle->num_bits)
+      if(0 != res_bitmap_resize(bitmap_handle, (size_t)buf[1]))
+        return(3);
+    if((size_t)buf[0] != bitmap_handle->num_bits)
+      if(0 != res_bitmap_resize(bitmap_handle, (size_t)buf[0]))
+        return(3);
+
+   /*copy each run in, then re-work the orders over it*/
+    for(i=RES_BITMAP_DELTA_HEADER; i<size; i+=n + 2)
+    {
+      first = (size_t)buf[i];
+      n = (size_t)buf[i+1];
+      memcpy((res_bitmap_word_t*)bitmap_handle->base + first, buf + i + 2, n * sizeof(res_bitmap_word_t));
+      if(NULL != bitmap_handle->file)
+        _res_bitmap_file_dirty(bitmap_handle->file, first, first + n - 1);
+      if(NULL != bitmap_handle->delta)
+        _res_bitmap_delta_touch(bitmap_handle->delta, first, first + n - 1);
+      last = (first + n) * BITS - 1;
+      if(last > bitmap_handle->num_bits)
+        last = bitmap_handle->num_bits;
+      _res_bitmap_buddy_update(bitmap_handle->base, bitmap_handle->num_bits, bitmap_handle->order, first * BITS, last);
+    }
+  return(0);
+}
+
+ushort res_bitmap_combine(res_bitmap_t* dest_handle, res_bitmap_t* src_handle, ushort op)
+{
+  return(res_bitmap_combine_into(dest_handle, dest_handle, src_handle, op));
+}
+
+ushort res_bitmap_combine_into(res_bitmap_t* dest_handle, res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op)
+{
+    if(op > RES_BITMAP_ANDNOT)
+      return(2);
+
+    _res_bitmap_combine_map(dest_handle->base, dest_handle->num_bits, a_handle->base, a_handle->num_bits, b_handle->base, b_handle->num_bits, op);
+    if(NULL != dest_handle->file)
+      _res_bitmap_file_dirty(dest_handle->file, 0, dest_handle->num_bits/BITS);
+    if(NULL != dest_handle->delta)
+      _res_bitmap_delta_touch(dest_handle->delta, 0, dest_handle->num_bits/BITS);
+    _res_bitmap_buddy_update(dest_handle->base, dest_handle->num_bits, dest_handle->order, 0, dest_handle->num_bits);
+  return(0);
+}
+
+size_t res_bitmap_combine_count(res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op)
+{
+    if(op > RES_BITMAP_ANDNOT)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+  return(_res_bitmap_combine_map_count(a_handle->base, a_handle->num_bits, b_handle->base, b_handle->num_bits, op));
+}
+
+/*-------------- Internals ----------------*/
+
+res_bitmap_word_t _res_bitmap_mask(size_t first, size_t last)
+{
+  return( (~(res_bitmap_word_t)0 >> (BITS - 1 - last)) & (~(res_bitmap_word_t)0 << first) );
+}
+
+void _res_bitmap_mark(res_bitmap_word_t* bitmap, size_t first, size_t last, ushort up)
+{
+  size_t first_word;
+  size_t last_word;
+  res_bitmap_word_t mask;
+    first_word = first / BITS;
+    last_word = last / BITS;
+
+   /*head word, whole words in the middle, tail word*/
+    if(first_word == last_word)
+      mask = _res_bitmap_mask(first%BITS, last%BITS);
+    else
+      mask = _res_bitmap_mask(first%BITS, BITS-1);
+    if(0 == up)
+      bitmap[first_word] &= ~mask;
+    else
+      bitmap[first_word] |= mask;
+    if(first_word == last_word)
+      return;
+
+    if(last_word - first_word > 1)
+      memset(&bitmap[first_word+1], (0 == up) ? 0x00 : 0xFF, (last_word - first_word - 1) * sizeof(res_bitmap_word_t));
+
+    mask = _res_bitmap_mask(0, last%BITS);
+    if(0 == up)
+      bitmap[last_word] &= ~mask;
+    else
+      bitmap[last_word] |= mask;
+}
+
+ushort _res_bitmap_buddy_orders(size_t num_bits)
+{
+ /*floor(log2(num_bits+1)) + 1*/
+  return((ushort)(BITS - RES_BITMAP_CLZ((res_bitmap_word_t)num_bits + 1)));
+}
+
+ushort _res_bitmap_buddy_levels(size_t blocks, size_t* words)
+{
+  ushort levels = 0;
+  size_t units;
+    units = blocks;
+    do
+    {
+      words[levels] = ((units - 1) / BITS) + 1;
+      units = words[levels];
+      levels++;
+    } while((units > 1) && (levels < RES_BITMAP_BUDDY_LEVELS));
+  return(levels);
+}
+
+res_bitmap_order_t* _res_bitmap_buddy_create(const res_bitmap_word_t* map, size_t num_bits)
+{
+  res_bitmap_order_t* order;
+  res_bitmap_word_t* mem;
+  ushort orders;
+  ushort k;
+  ushort l;
+  size_t total;
+    orders = _res_bitmap_buddy_orders(num_bits);
+    order = calloc( orders, sizeof(res_bitmap_order_t) );
+    if(NULL == order)
+      return(NULL);
+
+   /*one zeroed block per order, for full (not order 0) then each level*/
+    for(k=0; k<orders; k++)
+    {
+      order[k].blocks = ((num_bits - (((size_t)1 << k) - 1)) >> k) + 1;  /*(num_bits+1) >> k, without overflow*/
+      order[k].levels = _res_bitmap_buddy_levels(order[k].blocks, order[k].words);
+      total = (0 == k) ? 0 : order[k].words[0];
+      for(l=0; l<order[k].levels; l++)
+        total += order[k].words[l];
+
+      mem = calloc( total, sizeof(res_bitmap_word_t) );
+      if(NULL == mem)
+      {
+        _res_bitmap_buddy_destroy(order, k);
+        return(NULL);
+      }
+      order[k].mem = mem;
+      if(0 != k)
+      {
+        order[k].full = mem;
+        mem += order[k].words[0];
+      }
+      for(l=0; l<order[k].levels; l++)
+      {
+        order[k].level[l] = mem;
+        mem += order[k].words[l];
+      }
+    }
+
+   /*fill in from the map*/
+    _res_bitmap_buddy_update(map, num_bits, order, 0, num_bits);
+  return(order);
+}
+
+void _res_bitmap_buddy_destroy(res_bitmap_order_t* order, ushort orders)
+{
+  ushort k;
+    for(k=0; k<orders; k++)
+      free(order[k].mem);
+    free(order);
+}
+
+res_bitmap_word_t _res_bitmap_buddy_full(const res_bitmap_word_t* map, size_t num_bits, res_bitmap_order_t* order, ushort k, size_t w)
+{
+  if(w >= order[k].words[0])
+    return(0);
+  if(0 != k)
+    return(order[k].full[w]);
+
+ /*order 0 - free bits of the map, not counting any past num_bits*/
+  if(w == num_bits / BITS)
+    return(~map[w] & _res_bitmap_mask(0, num_bits%BITS));
+  return(~map[w]);
+}
+
+res_bitmap_word_t _res_bitmap_buddy_even(res_bitmap_word_t word)
+{
+  word &= (res_bitmap_word_t)UINT64_C(0x5555555555555555);
+  word = (word | (word >> 1)) & (res_bitmap_word_t)UINT64_C(0x3333333333333333);
+  word = (word | (word >> 2)) & (res_bitmap_word_t)UINT64_C(0x0F0F0F0F0F0F0F0F);
+  word = (word | (word >> 4)) & (res_bitmap_word_t)UINT64_C(0x00FF00FF00FF00FF);
+  word = (word | (word >> 8)) & (res_bitmap_word_t)UINT64_C(0x0000FFFF0000FFFF);
+  #ifdef BITS_64
+  word = (word | (word >> 16)) & (res_bitmap_word_t)UINT64_C(0x00000000FFFFFFFF);
+  #endif
+  return(word);
+}
+
+res_bitmap_word_t _res_bitmap_buddy_pairs(res_bitmap_word_t lo, res_bitmap_word_t hi)
+{
+ /*a block is free when both halves are - AND each bit with the one above, then keep the even ones*/
+  return(_res_bitmap_buddy_even(lo & (lo >> 1)) | (_res_bitmap_buddy_even(hi & (hi >> 1)) << (BITS/2)));
+}
+
+res_bitmap_word_t _res_bitmap_buddy_spread(res_bitmap_word_t half)
+{
+  half &= _res_bitmap_mask(0, BITS/2 - 1);
+  #ifdef BITS_64
+  half = (half | (half << 16)) & (res_bitmap_word_t)UINT64_C(0x0000FFFF0000FFFF);
+  #endif
+  half = (half | (half << 8)) & (res_bitmap_word_t)UINT64_C(0x00FF00FF00FF00FF);
+  half = (half | (half << 4)) & (res_bitmap_word_t)UINT64_C(0x0F0F0F0F0F0F0F0F);
+  half = (half | (half << 2)) & (res_bitmap_word_t)UINT64_C(0x3333333333333333);
+  half = (half | (half << 1)) & (res_bitmap_word_t)UINT64_C(0x5555555555555555);
+  return(half | (half << 1));
+}
+
+void _res_bitmap_buddy_put(res_bitmap_order_t* order, size_t w, res_bitmap_word_t word)
+{
+  res_bitmap_word_t old;
+  res_bitmap_word_t bit;
+  ushort l;
+    old = order->level[0][w];
+    order->level[0][w] = word;
+
+   /*each level up only changes if the word below went between zero and non-zero*/
+    for(l=1; l<order->levels; l++)
+    {
+      if((0 == old) == (0 == word))
+        return;
+      bit = (res_bitmap_word_t)1 << (w%BITS);
+      w /= BITS;
+      old = order->level[l][w];
+      if(0 != word)
+        order->level[l][w] |= bit;
+      else
+        order->level[l][w] &= ~bit;
+      word = order->level[l][w];
+    }
+}
+
+size_t _res_bitmap_buddy_first(res_bitmap_order_t* order)
+{
+  size_t i;
+  ushort l;
+   /*down from the top word, lowest set bit each time*/
+    if(0 == order->level[order->levels-1][0])
+      return(RES_BITMAP_ERR);
+    i = RES_BITMAP_CTZ(order->level[order->levels-1][0]);
+    for(l=(ushort)(order->levels-1); l>0; l--)
+      i = i * BITS + RES_BITMAP_CTZ(order->level[l-1][i]);
+  return(i);
+}
+
+size_t _res_bitmap_buddy_next(res_bitmap_order_t* order, ushort level, size_t unit)
+{
+  res_bitmap_word_t word;
+  size_t w;
+    w = unit / BITS;
+    if(w >= order->words[level])
+      return(RES_BITMAP_ERR);
+
+   /*anything at or after unit in this word? If not, ask the level above for the next word with anything in it*/
+    word = order->level[level][w] & _res_bitmap_mask(unit%BITS, BITS-1);
+    if(0 != word)
+      return(w * BITS + RES_BITMAP_CTZ(word));
+    if(level + 1 >= order->levels)
+      return(RES_BITMAP_ERR);
+    w = _res_bitmap_buddy_next(order, (ushort)(level + 1), w + 1);
+    if(RES_BITMAP_ERR == w)
+      return(RES_BITMAP_ERR);
+  return(w * BITS + RES_BITMAP_CTZ(order->level[level][w]));
+}
+
+size_t _res_bitmap_buddy_aligned(res_bitmap_order_t* order, size_t stride)
+{
+  size_t j = 0;
+   /*next free buddy, rounded up to the stride - if that one's free too, it's the answer*/
+    while(RES_BITMAP_ERR != (j = _res_bitmap_buddy_next(order, 0, j)))
+    {
+      if(0 != (j & (stride - 1)))
+      {
+        if(j > SIZE_MAX - stride)
+          return(RES_BITMAP_ERR);
+        j = (j | (stride - 1)) + 1;
+      }
+      if(j >= order->blocks)
+        return(RES_BITMAP_ERR);
+      if(0 != (order->level[0][j/BITS] & ((res_bitmap_word_t)1 << (j%BITS))))
+        return(j);
+    }
+  return(RES_BITMAP_ERR);
+}
+
+void _res_bitmap_buddy_update(const res_bitmap_word_t* map, size_t num_bits, res_bitmap_order_t* order, size_t first, size_t last)
+{
+  res_bitmap_word_t word;
+  res_bitmap_word_t parent;
+  size_t w;
+  size_t last_word;
+  ushort orders;
+  ushort top;
+  ushort changed;
+  ushort k;
+    orders = _res_bitmap_buddy_orders(num_bits);
+
+   /*full, from the bottom up - only the words over first..last can have changed, and once an order doesn't change, none above it do*/
+    for(k=1; k<orders; k++)
+    {
+      changed = 0;
+      last_word = (last >> k) / BITS;
+      if(last_word >= order[k].words[0])
+        last_word = order[k].words[0] - 1;
+      for(w=(first >> k) / BITS; w<=last_word; w++)
+      {
+        word = _res_bitmap_buddy_pairs(_res_bitmap_buddy_full(map, num_bits, order, (ushort)(k-1), 2*w),
+                                       _res_bitmap_buddy_full(map, num_bits, order, (ushort)(k-1), 2*w + 1));
+        if(word != order[k].full[w])
+        {
+          order[k].full[w] = word;
+          changed = 1;
+        }
+      }
+      if(0 == changed)
+        break;
+    }
+    top = k;  /*free buddies of order k depend on full for k and k+1, so the orders from here up are as they were*/
+
+   /*free buddies - free blocks whose parent isn't. A changed parent only affects its two children, which share a word*/
+    for(k=0; k<top; k++)
+    {
+      last_word = (last >> k) / BITS;
+      if(last_word >= order[k].words[0])
+        last_word = order[k].words[0] - 1;
+      for(w=(first >> k) / BITS; w<=last_word; w++)
+      {
+        word = _res_bitmap_buddy_full(map, num_bits, order, k, w);
+        if(k + 1 < orders)
+        {
+          parent = _res_bitmap_buddy_full(map, num_bits, order, (ushort)(k+1), w/2);
+          if(0 != (w & 1))
+            parent >>= BITS/2;
+          word &= ~_res_bitmap_buddy_spread(parent);
+        }
+        _res_bitmap_buddy_put(&order[k], w, word);
+      }
+    }
+}
+
+void _res_bitmap_buddy_free_word(res_bitmap_t* bitmap_handle, size_t w, res_bitmap_word_t mask)
+{
+  ((res_bitmap_word_t*)bitmap_handle->base)[w] &= ~mask;
+  if(NULL != bitmap_handle->file)
+    _res_bitmap_file_dirty(bitmap_handle->file, w, w);
+  if(NULL != bitmap_handle->delta)
+    _res_bitmap_delta_touch(bitmap_handle->delta, w, w);
+  _res_bitmap_buddy_update(bitmap_handle->base, bitmap_handle->num_bits, bitmap_handle->order, w * BITS + RES_BITMAP_CTZ(mask), w * BITS + (BITS - 1 - RES_BITMAP_CLZ(mask)));
+}
+
+void _res_bitmap_buddy_apply(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up)
+{
+  _res_bitmap_mark(bitmap_handle->base, first, last, up);
+  if(NULL != bitmap_handle->file)
+    _res_bitmap_file_dirty(bitmap_handle->file, first/BITS, last/BITS);
+  if(NULL != bitmap_handle->delta)
+    _res_bitmap_delta_touch(bitmap_handle->delta, first/BITS, last/BITS);
+  _res_bitmap_buddy_update(bitmap_handle->base, bitmap_handle->num_bits, bitmap_handle->order, first, last);
+}
+
+int _res_bitmap_compare(const void* a, const void* b)
+{
+  size_t x;
+  size_t y;
+    x = *(const size_t*)a;
+    y = *(const size_t*)b;
+  return((x > y) - (x < y));
+}
+
+size_t _res_bitmap_find_next(res_bitmap_t* bitmap_handle, size_t from, ushort up)
+{
+  res_bitmap_word_t *bitmap;
+  res_bitmap_word_t word;
+  size_t w;
+  size_t last_word;
+  size_t bit;
+   /*check parameters*/
+    if(from > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*flip the word when looking for clear bits, so we're always after a set one. Bits before from don't count*/
+    bitmap = bitmap_handle->base;
+    last_word = bitmap_handle->num_bits / BITS;
+    w = from / BITS;
+    word = (0 == up) ? ~bitmap[w] : bitmap[w];
+    word &= _res_bitmap_mask(from%BITS, BITS-1);
+    while(0 == word)
+    {
+      w++;
+      if(w > last_word)
+        break;
+      word = (0 == up) ? ~bitmap[w] : bitmap[w];
+    }
+
+   /*bits past num_bits are 0, so may turn up when looking for clear bits*/
+    bit = (0 == word) ? RES_BITMAP_ERR : w * BITS + RES_BITMAP_CTZ(word);
+    if((RES_BITMAP_ERR == bit) || (bit > bitmap_handle->num_bits))
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+  return(bit);
+}
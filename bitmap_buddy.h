@@ -0,0 +1,263 @@
+/* bitmap_buddy.h - header for bitmap_buddy.c, a binary buddy implementation
+ *                  of the bitmap API
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: buddy-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+/* A drop-in replacement for bitmap.c - define RES_BITMAP_BUDDY when
+ * compiling, so that bitmap.h pulls in this header instead, and link
+ * bitmap_buddy.c, bitmap_simd.c and bitmap_file.c in place of the reff-1 files.
+ *
+ * alloc rounds block_size+1 up to a power of two, 2^k, and returns the
+ * lowest free buddy block of the smallest order >= k that has one. Only
+ * block_size+1 bits are marked - the rest of the block stays free, and is
+ * handed out as smaller buddies. take, free, check and count work on any
+ * range, exactly as in reff-1, and blocks coalesce as their buddies free up.*/
+#ifndef H_RES_BITMAP
+#define H_RES_BITMAP
+ #include "res_config.h"
+ #include "res_types.h"
+ #include "res_err.h"
+
+/*Types:*/
+ #ifdef BITS_64
+  typedef uint64_t res_bitmap_word_t;  /*bitmaps are read and written one machine word at a time*/
+ #else
+  typedef uint32_t res_bitmap_word_t;
+ #endif
+
+/*Options - the indexes are accepted for compatibility. The order maps already do the job of both:*/
+ #define RES_BITMAP_OPT_SUMMARY 0x0001
+ #define RES_BITMAP_OPT_EXTENTS 0x0002
+ #define RES_BITMAP_OPT_RANK    0x0004
+ #define RES_BITMAP_OPT_DELTA   0x0008  /*track changed words for res_bitmap_delta_export, as reff-1*/
+
+/*Allocation policies - accepted for compatibility. Blocks always come from the smallest order that has one, lowest first:*/
+ #define RES_BITMAP_FIRST_FIT 0
+ #define RES_BITMAP_NEXT_FIT  1
+ #define RES_BITMAP_BEST_FIT  2
+ #define RES_BITMAP_WORST_FIT 3
+
+/*Boolean operations, for res_bitmap_combine...:*/
+ #define RES_BITMAP_AND    0
+ #define RES_BITMAP_OR     1
+ #define RES_BITMAP_XOR    2
+ #define RES_BITMAP_ANDNOT 3
+
+/*Files, for res_bitmap_create_file / _open_file - the same format as reff-1, so either can open the other's files:*/
+ #define RES_BITMAP_FILE_MAGIC "RESBMAP"
+ #define RES_BITMAP_FILE_VERSION 1
+ #define RES_BITMAP_FILE_HEADER 4096
+
+/*Deltas, from res_bitmap_delta_export - the same format as reff-1, so either can apply the other's:*/
+ #define RES_BITMAP_DELTA_HEADER 2
+
+/*Config:*/
+ #ifndef RES_BITMAP_MAP_MIN
+  #define RES_BITMAP_MAP_MIN 262144  /*as reff-1*/
+ #endif
+ #ifndef RES_BITMAP_PARALLEL_MIN
+  #define RES_BITMAP_PARALLEL_MIN 4194304  /*as reff-1*/
+ #endif
+
+/*Structures:*/
+ #define RES_BITMAP_BUDDY_LEVELS 12  /*enough for any size_t number of blocks*/
+ typedef struct
+ {
+   res_bitmap_word_t *full;  /*bit j set = every bit in block j is free. NULL for order 0, which is worked out from the map*/
+   res_bitmap_word_t *level[RES_BITMAP_BUDDY_LEVELS];  /*level[0] bit j set = block j is a free buddy - free, but its parent isn't. level[n+1] bit set = level[n] word non-zero. Unused levels are NULL*/
+   size_t words[RES_BITMAP_BUDDY_LEVELS];  /*number of words in each level*/
+   ushort levels;  /*number of levels - the top one is a single word*/
+   size_t blocks;  /*number of whole blocks of this order in the map. Bits past the end of each array are always 0*/
+   res_bitmap_word_t *mem;  /*full and all the levels, in one allocation*/
+ } res_bitmap_order_t;
+
+ typedef struct
+ {
+   char magic[8];  /*RES_BITMAP_FILE_MAGIC*/
+   uint32_t version;  /*RES_BITMAP_FILE_VERSION*/
+   uint32_t checksum;  /*FNV-1a of the header with this field 0*/
+   uint64_t num_bits;
+   uint64_t word_bits;  /*BITS of the machine that wrote it*/
+ } res_bitmap_file_header_t;
+
+ typedef struct
+ {
+   int fd;
+   void *mapping;
+   size_t length;
+   size_t size;
+   size_t page;
+   res_bitmap_word_t *dirty;  /*bit per page of the mapping, set = written since the last sync*/
+   size_t dirty_words;
+ } res_bitmap_file_t;
+
+ typedef struct
+ {
+   res_bitmap_word_t *dirty;  /*bit w set = map word w written since the last export*/
+   size_t capacity;  /*words allocated for dirty*/
+   size_t low;  /*smallest num_bits the map has had since the last export*/
+ } res_bitmap_delta_t;
+
+ typedef struct
+ {
+   void *base;
+   size_t limit; /*in bytes. limit of 0 = 1 byte big bitmap. base+limit = highest byte that is part of the map. As reff-1, limit+1 is always a multiple of BITS/BITS_IN_A_BYTE and bits above num_bits are always 0*/
+   size_t num_bits; /*num_bits of 0 = 1 bit in the map.*/
+   ushort opts;  /*RES_BITMAP_OPT_... flags given at create time*/
+   ushort policy;  /*RES_BITMAP_..._FIT, not used*/
+   ushort orders;  /*number of orders - blocks of order k are 2^k bits, so 2^(orders-1) <= num_bits+1*/
+   res_bitmap_order_t *order;  /*one per order*/
+   res_bitmap_file_t *file;  /*NULL unless the map lives in a file, as reff-1*/
+   res_bitmap_delta_t *delta;  /*NULL unless created with RES_BITMAP_OPT_DELTA*/
+  } res_bitmap_t;
+
+ typedef struct
+ {
+   res_bitmap_word_t *bitmap;  /*map being walked*/
+   size_t w;  /*word we're in*/
+   res_bitmap_word_t word;  /*set bits of word w not handed out yet*/
+   size_t last;  /*last bit of the range*/
+ } res_bitmap_iter_t;
+
+ typedef struct
+ {
+   size_t free_bits;  /*bits free in the whole map*/
+   size_t runs;  /*runs of free bits*/
+   size_t largest;  /*length of the longest run, in bits - 0 if none is free*/
+   size_t histogram[BITS];  /*histogram[c] is the number of runs with floor(log2(length)) = c*/
+ } res_bitmap_free_stats_t;
+
+ typedef struct
+ {
+   size_t base;  /*first bit*/
+   size_t limit;  /*bits after base - 0 = just base, as take*/
+ } res_bitmap_range_t;
+
+/*External functions - see bitmap.h*/
+ res_bitmap_t* res_bitmap_create(size_t num_bits); /*creates a bitmap of size num_bits and a handle for it. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail. NOTE - num_bits starts at 0. 0 implies a bitmap with 1 bit, etc.*/
+ res_bitmap_t* res_bitmap_create_opts(size_t num_bits, ushort opts); /*as res_bitmap_create. Known options are ignored. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER on unknown flags*/
+ res_bitmap_t* res_bitmap_create_file(const char* path, size_t num_bits, ushort opts); /*as res_bitmap_create_opts, but the map lives in the file at path, memory mapped. Any existing file is truncated. Returns: pointer to handle on success, NULL on failure; errno preserved on system call or malloc fail, set to RES_ERR_BAD_PARAMETER on unknown flags*/
+ res_bitmap_t* res_bitmap_open_file(const char* path, ushort opts); /*maps a file made by res_bitmap_create_file, after checking its header. The orders are built from the map, so unlike reff-1 this reads the whole map. Returns: pointer to handle on success, NULL on failure; errno preserved on system call or malloc fail, set to RES_ERR_BAD_PARAMETER on unknown flags, RES_ERR_INCOMPATIBLE_RESOURCE on a bad header or file size*/
+ ushort res_bitmap_sync(res_bitmap_t* bitmap_handle); /*writes the pages of a file-backed map changed since the last sync back to the file, and waits for them. Does nothing for a map in memory. Returns 0 on success, 2 on failure; errno preserved, pages not written yet stay dirty*/
+ ushort res_bitmap_destroy(res_bitmap_t* bitmap_handle); /*frees bitmap and handle memory. A file-backed map is unmapped and closed without a sync. Returns 0 on success, other non-zero on unknown error*/
+
+ size_t res_bitmap_alloc(res_bitmap_t* bitmap_handle, size_t block_size); /*finds a free buddy block of at least block_size+1 bits, and marks the first block_size+1 of them. The block is aligned to its own (power of two) size. O(log num_bits). Returns RES_BITMAP_ERR on failure, bit number of the start of the block allocated on success, starting at 0; errno is set to a corresponding res_err defined error on failure*/
+ size_t res_bitmap_alloc_aligned(res_bitmap_t* bitmap_handle, size_t block_size, ushort align_order); /*as res_bitmap_alloc, but the block also starts on a multiple of 2^align_order bits - buddies of order align_order or more always do, smaller ones are only used when they happen to line up. Returns RES_BITMAP_ERR on failure, start bit on success; errno is set to a corresponding res_err defined error on failure*/
+ size_t res_bitmap_alloc_many(res_bitmap_t* bitmap_handle, size_t block_size, size_t count, size_t* out); /*allocates up to count blocks as count calls to res_bitmap_alloc would, writing their start bits to out. Returns number of blocks allocated (less than count only if the map ran out, errno then set to RES_ERR_NO_MATCH), RES_BITMAP_ERR on bad block_size; errno set to RES_ERR_BAD_PARAMETER*/
+ ushort res_bitmap_free(res_bitmap_t* bitmap_handle, size_t base, size_t limit); /*unmarks bits from base to (base+limit), joining buddies back together. Limit of 0 = 1 bit. Does not check if they are already free. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_bitmap_free_many(res_bitmap_t* bitmap_handle, size_t* bits, size_t count, size_t block_size); /*frees count blocks of block_size+1 bits, starting at each of bits[], in any order. bits is sorted in place. Blocks in the same word are freed, and coalesced, together. Returns 0 on success, 2 on a base out-of-range, 3 on a block running past the end - nothing is freed on error*/
+ ushort res_bitmap_take(res_bitmap_t* bitmap_handle, size_t base, size_t limit); /*marks bits from base to (base+limit). Limit of 0 = 1 bit. Does not check if they are already free. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_bitmap_reserve(res_bitmap_t* bitmap_handle, const res_bitmap_range_t* ranges, size_t count, size_t* failed); /*takes count ranges all together or not at all, testing and marking each word in one go and putting everything back at the first bit already taken. The buddy orders are only updated once all ranges are in. Returns 0 on success, 1 on a bit already taken, 2 on a base out-of-range, 3 on a limit out-of-range - the map is unchanged on error, and failed (if not NULL) is set to the index of the range at fault*/
+ ushort res_bitmap_check(res_bitmap_t* bitmap_handle, size_t base, size_t limit); /*returns 0 if all bits from base to (base+limit) are 0, 1 if all bits in this range are 1, 2 if they vary, 4 on base-out-of-range, 5 on limit-out-of-range. Limit of 0 = 1 bit*/
+
+ ushort res_bitmap_set_policy(res_bitmap_t* bitmap_handle, ushort policy);  /*accepts any RES_BITMAP_..._FIT value, but doesn't change how alloc works. Returns 0 on success, 2 on unknown policy*/
+
+ ushort res_bitmap_resize(res_bitmap_t* bitmap_handle, size_t num_bits);  /*re-sizes the bitmap to new total size num_bits, remapping a file-backed map as reff-1. Returns: 0 on success, 2 on memory error; errno preserved on realloc, ftruncate or mmap fail*/
+
+ size_t res_bitmap_count(res_bitmap_t* bitmap, size_t base, size_t limit);  /*counts bits taken from base to base+limit. Limit of 0 = 1 bit to count. Returns count on success, RES_BITMAP_ERR on failure; errno is set to a corresponding res_err defined error on failure*/
+ size_t res_bitmap_get_size(res_bitmap_t* bitmap);  /*Returns: number of bits (taken and free) in bitmap on success, RES_BITMAP_ERR on failure; errno is set to a res_err.h error code*/
+ size_t res_bitmap_largest_free(res_bitmap_t* bitmap_handle);  /*finds the biggest block_size that res_bitmap_alloc could succeed with right now - one less than the size of the biggest free buddy. O(log num_bits). Returns block_size on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_NO_MATCH if no bits are free*/
+ ushort res_bitmap_free_stats(res_bitmap_t* bitmap_handle, res_bitmap_free_stats_t* stats);  /*fills in stats with the free bits, the number of runs of them, the longest and a histogram of their lengths by power of 2. Runs are of free bits in the map, not buddies - a run may be several. One pass over the map's words. Returns 0 on success*/
+ size_t res_bitmap_find_next_set(res_bitmap_t* bitmap_handle, size_t from);  /*finds the first taken bit at or after from. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on from out-of-range, RES_ERR_NO_MATCH if there isn't one*/
+ size_t res_bitmap_find_next_clear(res_bitmap_t* bitmap_handle, size_t from);  /*finds the first free bit at or after from. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set as find_next_set*/
+ size_t res_bitmap_find_prev_set(res_bitmap_t* bitmap_handle, size_t from);  /*finds the last taken bit at or before from. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set as find_next_set*/
+ ushort res_bitmap_iter_init(res_bitmap_t* bitmap_handle, res_bitmap_iter_t* iter, size_t base, size_t limit);  /*sets up iter to walk the taken bits from base to (base+limit). Limit of 0 = 1 bit. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ size_t res_bitmap_iter_next(res_bitmap_iter_t* iter);  /*returns the next taken bit in the iterator's range, lowest first, or RES_BITMAP_ERR when there are no more. Each word is read when the iterator reaches it. The map MUST NOT be resized while iterating*/
+ size_t res_bitmap_rank(res_bitmap_t* bitmap_handle, size_t bit);  /*counts the bits taken below bit - from 0 to bit-1. bit may be num_bits+1, for the whole map. Reads the map up to bit. Returns count on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on bit out-of-range*/
+ size_t res_bitmap_select(res_bitmap_t* bitmap_handle, size_t k);  /*finds the k'th taken bit, counting from 0. Reads the map up to it. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_NO_MATCH if k bits or fewer are taken*/
+ size_t res_bitmap_delta_size(res_bitmap_t* bitmap_handle);  /*words a res_bitmap_delta_export of every change so far would need. Returns size on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER if the map wasn't made with RES_BITMAP_OPT_DELTA*/
+ size_t res_bitmap_delta_export(res_bitmap_t* bitmap_handle, res_bitmap_word_t* buf, size_t size);  /*writes the words changed since the last export into buf, as reff-1. Returns words written on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER if the map wasn't made with RES_BITMAP_OPT_DELTA, or size is less than RES_BITMAP_DELTA_HEADER*/
+ ushort res_bitmap_delta_apply(res_bitmap_t* bitmap_handle, const res_bitmap_word_t* buf, size_t size);  /*applies a delta from either implementation, resizing to match, then re-works the orders over each run. Returns 0 on success, 2 on a bad delta (map unchanged), 3 on memory error resizing*/
+ ushort res_bitmap_combine(res_bitmap_t* dest_handle, res_bitmap_t* src_handle, ushort op);  /*dest = dest op src, one of the RES_BITMAP_AND/OR/XOR/ANDNOT values, a vector of words at a time. Bits of src past dest's num_bits are ignored, bits dest has past src's num_bits are combined with 0 - as if src were resized to dest's size. The orders are rebuilt after. Returns 0 on success, 2 on unknown op*/
+ ushort res_bitmap_combine_into(res_bitmap_t* dest_handle, res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op);  /*dest = a op b, with a and b read as if resized to dest's size. dest may be a or b. Returns 0 on success, 2 on unknown op*/
+ size_t res_bitmap_combine_count(res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op);  /*counts the bits a op b would have, without writing anything - e.g. RES_BITMAP_ANDNOT counts bits taken in a but not in b. b is read as if resized to a's size. Returns count on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on unknown op*/
+ size_t res_bitmap_count_parallel(res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads);  /*as reff-1 - bitmap_parallel.c, shared by every implementation*/
+ ushort res_bitmap_check_parallel(res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads);  /*as reff-1*/
+ size_t res_bitmap_find_next_clear_parallel(res_bitmap_t* bitmap_handle, size_t from, ushort threads);  /*as reff-1*/
+
+/*Internal Functions:*/
+ size_t _res_bitmap_size(size_t num_bits);
+ size_t _res_bitmap_limit(size_t num_bits);
+ void _res_bitmap_handle_set(res_bitmap_t *bitmap_handle, void* base, size_t num_bits);
+ res_bitmap_word_t _res_bitmap_mask(size_t first, size_t last);  /*returns a word with bits first to last (inclusive, both < BITS) set*/
+ void _res_bitmap_mark(res_bitmap_word_t* bitmap, size_t first, size_t last, ushort up);  /*sets (up=1) or clears (up=0) bits first to last inclusive. Does NOT check range*/
+ size_t _res_bitmap_popcount(const res_bitmap_word_t* words, size_t n);  /*counts set bits in n whole words. Implemented in bitmap_simd.c, shared with reff-1*/
+ size_t _res_bitmap_popcount_word(res_bitmap_word_t word);  /*bitmap_simd.c, portable single-word popcount*/
+ size_t _res_bitmap_ctz_word(res_bitmap_word_t word);  /*bitmap_simd.c, portable count trailing zeros, word MUST be non-zero*/
+ size_t _res_bitmap_clz_word(res_bitmap_word_t word);  /*bitmap_simd.c, portable count leading zeros, word MUST be non-zero*/
+ size_t _res_bitmap_select_word(res_bitmap_word_t word, size_t r);  /*bitmap_simd.c, position of set bit r (from 0) of word, which MUST have more than r set*/
+ void _res_bitmap_free_runs(const res_bitmap_word_t* bitmap, size_t num_bits, res_bitmap_free_stats_t* stats);  /*bitmap_simd.c, fills in stats by walking the runs of free bits in a whole map*/
+ void _res_bitmap_free_run(res_bitmap_free_stats_t* stats, size_t len);  /*bitmap_simd.c, adds a free run of len (non-zero) bits to stats*/
+ ushort _res_bitmap_claim(res_bitmap_word_t* bitmap, size_t first, size_t last, size_t* conflict);  /*bitmap_simd.c, sets bits first to last as long as every one is clear. Returns 0 on success, or 1 having cleared any words already set, with the first bit found taken in conflict*/
+ void _res_bitmap_combine(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);  /*bitmap_simd.c, dest[i] = a[i] op b[i] for n words*/
+ size_t _res_bitmap_combine_count(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);  /*bitmap_simd.c, counts set bits in a[i] op b[i] over n words*/
+ res_bitmap_word_t _res_bitmap_combine_word(res_bitmap_word_t a, res_bitmap_word_t b, ushort op);  /*bitmap_simd.c, a op b for one word*/
+ void _res_bitmap_combine_map(res_bitmap_word_t* dest, size_t dest_bits, const res_bitmap_word_t* a, size_t a_bits, const res_bitmap_word_t* b, size_t b_bits, ushort op);  /*bitmap_simd.c, combines whole maps, as reff-1*/
+ size_t _res_bitmap_combine_map_count(const res_bitmap_word_t* a, size_t a_bits, const res_bitmap_word_t* b, size_t b_bits, ushort op);  /*bitmap_simd.c, as reff-1*/
+ res_bitmap_file_t* _res_bitmap_file_create(const char* path, size_t num_bits);  /*creates or truncates the file at path, sized for num_bits with the map all 0, and maps it. bitmap_file.c, shared with reff-1. Returns NULL on failure, errno preserved*/
+ res_bitmap_file_t* _res_bitmap_file_open(const char* path, size_t* num_bits);  /*checks the header and size of the file at path, maps it and sets num_bits. bitmap_file.c. Returns NULL on failure; errno preserved on system call fail, set to RES_ERR_INCOMPATIBLE_RESOURCE on a bad header or size*/
+ res_bitmap_file_t* _res_bitmap_file_map(int fd, size_t length);  /*maps length bytes of fd, with nothing dirty. bitmap_file.c. Returns NULL on failure, errno preserved - fd is left open*/
+ void _res_bitmap_file_close(res_bitmap_file_t* file);  /*unmaps and closes, without a sync*/
+ ushort _res_bitmap_file_resize(res_bitmap_file_t* file, size_t num_bits);  /*grows or shrinks the file to hold num_bits and maps it again, maybe somewhere else. The header is NOT updated. Returns 0 on success, 2 on failure (file and mapping as they were); errno preserved*/
+ void _res_bitmap_file_header(res_bitmap_file_t* file, size_t num_bits);  /*writes the header for num_bits, and marks its page dirty*/
+ uint32_t _res_bitmap_file_checksum(const res_bitmap_file_header_t* header);  /*checksum of a header, not counting its checksum field*/
+ void _res_bitmap_file_dirty(res_bitmap_file_t* file, size_t first_word, size_t last_word);  /*marks the pages holding map words first_word to last_word dirty*/
+ ushort _res_bitmap_file_sync(res_bitmap_file_t* file);  /*res_bitmap_sync for a file*/
+ size_t _res_bitmap_file_length(size_t num_bits);  /*bytes in a file for a map of num_bits, header included*/
+ size_t _res_bitmap_file_pages(res_bitmap_file_t* file, size_t length);  /*pages needed for length bytes*/
+ void* _res_bitmap_mem_alloc(size_t size);  /*size bytes of zeroed memory for a map - calloc'd below RES_BITMAP_MAP_MIN, an anonymous mapping from there up. bitmap_file.c. Returns NULL on failure, errno preserved*/
+ void* _res_bitmap_mem_realloc(void* base, size_t old_size, size_t size);  /*resizes memory from _res_bitmap_mem_alloc, new bytes 0. Mappings are moved with mremap where there is one, not copied. Returns the new base, NULL on failure (base untouched); errno preserved*/
+ void _res_bitmap_mem_free(void* base, size_t size);
+ void* _res_bitmap_remap(void* mapping, size_t old_length, size_t length, int fd);  /*resizes a mapping - of file fd, or anonymous if fd is -1 - moving it if need be. Returns the new address, NULL on failure (mapping untouched); errno preserved*/
+ size_t _res_bitmap_page_size(void);
+ res_bitmap_delta_t* _res_bitmap_delta_create(size_t num_bits);  /*bitmap_delta.c, shared with reff-1. Returns NULL on malloc fail, errno preserved*/
+ void _res_bitmap_delta_destroy(res_bitmap_delta_t* delta);
+ size_t _res_bitmap_delta_words(size_t num_bits);  /*words of dirty map for a map of num_bits*/
+ ushort _res_bitmap_delta_reserve(res_bitmap_delta_t* delta, size_t num_bits);  /*makes room for a map of num_bits, before a resize. Returns 0 on success, 2 on memory error; errno preserved*/
+ void _res_bitmap_delta_resize(res_bitmap_delta_t* delta, size_t old_num_bits, size_t num_bits);  /*updates tracking after a resize from old_num_bits*/
+ void _res_bitmap_delta_touch(res_bitmap_delta_t* delta, size_t first_word, size_t last_word);  /*marks map words first_word to last_word changed*/
+ size_t _res_bitmap_delta_size(res_bitmap_delta_t* delta, size_t num_bits);  /*res_bitmap_delta_size*/
+ size_t _res_bitmap_delta_export(res_bitmap_delta_t* delta, const res_bitmap_word_t* bitmap, size_t num_bits, res_bitmap_word_t* buf, size_t size);  /*res_bitmap_delta_export, size MUST be at least RES_BITMAP_DELTA_HEADER*/
+ size_t _res_bitmap_delta_next(res_bitmap_delta_t* delta, size_t from, size_t words, ushort up);  /*first map word from from on that is changed (up=1) or not (up=0), or words if there isn't one*/
+ ushort _res_bitmap_delta_check(const res_bitmap_word_t* buf, size_t size);  /*checks a delta is well formed. Returns 0 if it is, 2 if not*/
+ ushort _res_bitmap_buddy_orders(size_t num_bits);  /*number of orders a map of num_bits has*/
+ ushort _res_bitmap_buddy_levels(size_t blocks, size_t* words);  /*works out the level sizes for an order with this many blocks. Returns number of levels*/
+ res_bitmap_order_t* _res_bitmap_buddy_create(const res_bitmap_word_t* map, size_t num_bits);  /*allocates and fills in the orders for the map as if it had num_bits (bits past num_bits count as taken). Returns NULL on malloc fail, errno preserved*/
+ void _res_bitmap_buddy_destroy(res_bitmap_order_t* order, ushort orders);
+ res_bitmap_word_t _res_bitmap_buddy_full(const res_bitmap_word_t* map, size_t num_bits, res_bitmap_order_t* order, ushort k, size_t w);  /*word w of order k's full map, 0 past the end*/
+ res_bitmap_word_t _res_bitmap_buddy_pairs(res_bitmap_word_t lo, res_bitmap_word_t hi);  /*one word of full for order k+1 from two words of order k - bit j set when bits 2j and 2j+1 are*/
+ res_bitmap_word_t _res_bitmap_buddy_even(res_bitmap_word_t word);  /*packs the even bits of word into its low half*/
+ res_bitmap_word_t _res_bitmap_buddy_spread(res_bitmap_word_t half);  /*bits of the low half of half, each doubled - bit j goes to bits 2j and 2j+1*/
+ void _res_bitmap_buddy_put(res_bitmap_order_t* order, size_t w, res_bitmap_word_t word);  /*sets word w of an order's level 0, keeping the levels above in step*/
+ size_t _res_bitmap_buddy_first(res_bitmap_order_t* order);  /*finds the lowest free buddy of an order. Returns block number, or RES_BITMAP_ERR if there isn't one*/
+ size_t _res_bitmap_buddy_next(res_bitmap_order_t* order, ushort level, size_t unit);  /*finds the first set bit at or after unit in a level - for level 0, the next free buddy from block unit on. Returns RES_BITMAP_ERR if there isn't one*/
+ size_t _res_bitmap_buddy_aligned(res_bitmap_order_t* order, size_t stride);  /*finds the lowest free buddy of an order whose block number is a multiple of stride (a power of 2). Returns block number, or RES_BITMAP_ERR if there isn't one*/
+ void _res_bitmap_buddy_update(const res_bitmap_word_t* map, size_t num_bits, res_bitmap_order_t* order, size_t first, size_t last);  /*brings every order up to date after bits first to last of the map changed*/
+ void _res_bitmap_buddy_free_word(res_bitmap_t* bitmap_handle, size_t w, res_bitmap_word_t mask);  /*clears the bits of mask (MUST be non-zero) in word w of the map, and coalesces*/
+ void _res_bitmap_buddy_apply(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up);  /*marks bits like _res_bitmap_mark, then brings the orders and any file's dirty pages up to date. Does NOT check range*/
+ res_bitmap_t* _res_bitmap_create_mapped(res_bitmap_file_t* file, size_t num_bits, ushort opts);  /*makes a handle for the map in file. Returns NULL on malloc fail, errno preserved - the file is closed*/
+ int _res_bitmap_compare(const void* a, const void* b);  /*qsort comparison for size_t's*/
+ size_t _res_bitmap_find_next(res_bitmap_t* bitmap_handle, size_t from, ushort up);  /*res_bitmap_find_next_set (up=1) / _clear (up=0)*/
+
+/*Internal macros:*/
+ #if defined(__GNUC__) && defined(BITS_64)
+  #define RES_BITMAP_POPCOUNT(word) ((size_t)__builtin_popcountll(word))
+  #define RES_BITMAP_CTZ(word) ((size_t)__builtin_ctzll(word))  /*word MUST be non-zero*/
+  #define RES_BITMAP_CLZ(word) ((size_t)__builtin_clzll(word))  /*word MUST be non-zero*/
+ #elif defined(__GNUC__)
+  #define RES_BITMAP_POPCOUNT(word) ((size_t)__builtin_popcountl(word))
+  #define RES_BITMAP_CTZ(word) ((size_t)__builtin_ctzl(word))
+  #define RES_BITMAP_CLZ(word) ((size_t)__builtin_clzl(word) - (sizeof(long) * BITS_IN_A_BYTE - BITS))
+ #else
+  #define RES_BITMAP_POPCOUNT(word) _res_bitmap_popcount_word(word)
+  #define RES_BITMAP_CTZ(word) _res_bitmap_ctz_word(word)
+  #define RES_BITMAP_CLZ(word) _res_bitmap_clz_word(word)
+ #endif
+#endif
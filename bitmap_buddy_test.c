@@ -0,0 +1,534 @@
+/* bitmap_buddy_test.c - unit tests for bitmap_buddy.c
+ *
+ * REQUIRES: bitmap_1, buddy-1 implementation (compile with RES_BITMAP_BUDDY)
+ * TESTS: bitmap_1.13
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include "bitmap.h"
+#include "res_err.h"
+
+  int main(void);
+  int create_destroy(void);
+  int free_take_check_count(void);
+  int test_alloc(void);  /*named test_... because alloc is already a function name*/
+  int random_ops(void);
+  int file(void);
+  size_t buddy_alloc(unsigned char* shadow, size_t size, size_t block_size, size_t align);  /*reference buddy alloc on a byte-per-bit copy of a map of size bits, with the start a multiple of align. Returns start, or RES_BITMAP_ERR*/
+  int block_free(unsigned char* shadow, size_t size, size_t start, size_t len);  /*1 if len bits from start are all free and inside the map*/
+
+int main()
+{
+  srand((unsigned int)time(NULL));
+   /*create, destroy*/
+    printf("01 - create & destroy bitmaps\n");
+    if( 0 != create_destroy() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*free, take, check, count*/
+    printf("02 - free, take, check, & count operations\n");
+    if( 0 != free_take_check_count() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*alloc*/
+    printf("03 - buddy alloc\n");
+    if( 0 != test_alloc() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*everything at once*/
+    printf("04 - random operations against a reference\n");
+    if( 0 != random_ops() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*maps in memory mapped files*/
+    printf("05 - file-backed bitmaps\n");
+    if( 0 != file() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+  printf("ALL TESTS PASSED!\n");
+  return(EXIT_SUCCESS);
+}
+
+int create_destroy(void)
+{
+  res_bitmap_t* bitmap1;
+  res_bitmap_t* bitmap2;
+    printf("\tcreating bitmaps of size 1 and 1,000,000... ");
+    bitmap1 = res_bitmap_create(0);
+    bitmap2 = res_bitmap_create_opts(999999, RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS);
+    assert(NULL != bitmap1);
+    assert(NULL != bitmap2);
+    assert(0 == res_bitmap_largest_free(bitmap1));
+    assert(524287 == res_bitmap_largest_free(bitmap2));
+    printf("Good!\n");
+
+    printf("\tcreating bitmap with unknown option... ");
+    errno = 0;
+    assert(NULL == res_bitmap_create_opts(100, 0x8000));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\tdestroying bitmaps... ");
+    assert(0 == res_bitmap_destroy(bitmap1));
+    assert(0 == res_bitmap_destroy(bitmap2));
+    printf("Good!\n");
+  return(0);
+}
+
+int free_take_check_count(void)
+{
+  res_bitmap_t* bitmap1;
+  res_bitmap_t* bitmap2;
+  res_bitmap_iter_t iter;
+  res_bitmap_free_stats_t stats;
+  res_bitmap_range_t good[3] = {{0, 9}, {256, 255}, {990, 10}};  /*good[2] runs off the end*/
+  res_bitmap_range_t clash[2] = {{0, 9}, {105, 9}};
+  size_t i;
+    printf("\tcreating bitmap of size 1000... ");
+    bitmap1 = res_bitmap_create(999);
+    assert(NULL != bitmap1);
+    printf("Good!\n");
+
+    printf("\ttake, free & check over word boundaries... ");
+    assert(0 == res_bitmap_take(bitmap1, 60, 139));
+    assert(1 == res_bitmap_check(bitmap1, 60, 139));
+    assert(0 == res_bitmap_check(bitmap1, 0, 59));
+    assert(2 == res_bitmap_check(bitmap1, 59, 1));
+    assert(0 == res_bitmap_free(bitmap1, 100, 9));
+    assert(2 == res_bitmap_check(bitmap1, 60, 139));
+    assert(0 == res_bitmap_check(bitmap1, 100, 9));
+    printf("Good!\n");
+
+    printf("\tcount... ");
+    assert(130 == res_bitmap_count(bitmap1, 0, 999));
+    assert(40 == res_bitmap_count(bitmap1, 60, 39));
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    assert(2 == res_bitmap_take(bitmap1, 1000, 0));
+    assert(3 == res_bitmap_take(bitmap1, 999, 1));
+    assert(2 == res_bitmap_free(bitmap1, 1000, 0));
+    assert(3 == res_bitmap_free(bitmap1, 1, SIZE_MAX));
+    assert(4 == res_bitmap_check(bitmap1, 1000, 0));
+    assert(5 == res_bitmap_check(bitmap1, 999, 1));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_count(bitmap1, 999, 1));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(2 == res_bitmap_set_policy(bitmap1, 0xFF));
+    assert(0 == res_bitmap_set_policy(bitmap1, RES_BITMAP_BEST_FIT));
+    printf("Good!\n");
+
+    printf("\tfind & iterate... ");
+    assert(60 == res_bitmap_find_next_set(bitmap1, 0));
+    assert(110 == res_bitmap_find_next_set(bitmap1, 100));
+    assert(100 == res_bitmap_find_next_clear(bitmap1, 60));
+    assert(200 == res_bitmap_find_next_clear(bitmap1, 110));
+    assert(99 == res_bitmap_find_prev_set(bitmap1, 109));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_find_prev_set(bitmap1, 59));
+    assert(RES_ERR_NO_MATCH == errno);
+    assert(0 == res_bitmap_iter_init(bitmap1, &iter, 95, 20));
+    for(i=95; i<100; i++)
+      assert(i == res_bitmap_iter_next(&iter));
+    for(i=110; i<116; i++)
+      assert(i == res_bitmap_iter_next(&iter));
+    assert(RES_BITMAP_ERR == res_bitmap_iter_next(&iter));
+    assert(3 == res_bitmap_iter_init(bitmap1, &iter, 999, 1));
+    printf("Good!\n");
+
+    printf("\trank & select... ");
+    assert(0 == res_bitmap_rank(bitmap1, 60));
+    assert(40 == res_bitmap_rank(bitmap1, 110));
+    assert(80 == res_bitmap_rank(bitmap1, 150));
+    assert(60 == res_bitmap_select(bitmap1, 0));
+    assert(110 == res_bitmap_select(bitmap1, 40));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_select(bitmap1, res_bitmap_count(bitmap1, 0, res_bitmap_get_size(bitmap1))));
+    assert(RES_ERR_NO_MATCH == errno);
+    printf("Good!\n");
+
+    printf("\tfree run statistics... ");
+    assert(0 == res_bitmap_free_stats(bitmap1, &stats));
+    assert((870 == stats.free_bits) && (3 == stats.runs) && (800 == stats.largest));  /*0-59, 100-109 and 200-999*/
+    assert((1 == stats.histogram[3]) && (1 == stats.histogram[5]) && (1 == stats.histogram[9]));
+    printf("Good!\n");
+
+    printf("\tmulti-range reserve... ");
+    assert(1 == res_bitmap_reserve(bitmap1, clash, 2, &i));  /*105-114 runs into 110*/
+    assert(1 == i);
+    assert(0 == res_bitmap_check(bitmap1, 0, 9));
+    assert(0 == res_bitmap_check(bitmap1, 100, 9));
+    assert(3 == res_bitmap_reserve(bitmap1, good, 3, &i));
+    assert(2 == i);
+    assert(0 == res_bitmap_reserve(bitmap1, good, 2, NULL));
+    assert(1 == res_bitmap_check(bitmap1, 0, 9));
+    assert(1 == res_bitmap_check(bitmap1, 256, 255));
+    assert(396 == res_bitmap_count(bitmap1, 0, 999));
+    assert(0 == res_bitmap_free_stats(bitmap1, &stats));
+    assert(604 == stats.free_bits);
+    assert(255 == res_bitmap_largest_free(bitmap1));  /*512-767 - 256-511 is gone*/
+    printf("Good!\n");
+
+    printf("\tparallel count, check & find... ");
+    bitmap2 = res_bitmap_create(RES_BITMAP_PARALLEL_MIN * 4 - 1);
+    assert(NULL != bitmap2);
+    assert(0 == res_bitmap_take(bitmap2, 0, RES_BITMAP_PARALLEL_MIN * 3 + 5));
+    assert(RES_BITMAP_PARALLEL_MIN * 3 + 6 == res_bitmap_count_parallel(bitmap2, 0, RES_BITMAP_PARALLEL_MIN * 4 - 1, 4));
+    assert(1 == res_bitmap_check_parallel(bitmap2, 0, RES_BITMAP_PARALLEL_MIN * 3, 4));
+    assert(2 == res_bitmap_check_parallel(bitmap2, 0, RES_BITMAP_PARALLEL_MIN * 4 - 1, 4));
+    assert(RES_BITMAP_PARALLEL_MIN * 3 + 6 == res_bitmap_find_next_clear_parallel(bitmap2, 0, 4));
+    assert(0 == res_bitmap_free(bitmap2, RES_BITMAP_PARALLEL_MIN * 2 + 7, 0));
+    assert(RES_BITMAP_PARALLEL_MIN * 2 + 7 == res_bitmap_find_next_clear_parallel(bitmap2, 0, 0));
+    assert(0 == res_bitmap_destroy(bitmap2));
+    printf("Good!\n");
+
+    printf("\tdestroying bitmap... ");
+    assert(0 == res_bitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int test_alloc(void)
+{
+  res_bitmap_t* bitmap1;
+  size_t i;
+  size_t order[64];
+  size_t j;
+  size_t t;
+    printf("\tsplitting blocks... ");
+    bitmap1 = res_bitmap_create(63);
+    assert(NULL != bitmap1);
+    assert(0 == res_bitmap_alloc(bitmap1, 0));
+    assert(2 == res_bitmap_alloc(bitmap1, 1));  /*2 bits, the buddy of 0-1*/
+    assert(4 == res_bitmap_alloc(bitmap1, 2));  /*3 bits, rounded up to 4*/
+    assert(1 == res_bitmap_alloc(bitmap1, 0));  /*smallest free buddy is bit 1*/
+    assert(7 == res_bitmap_alloc(bitmap1, 0));  /*then the bit left over from the 4*/
+    assert(1 == res_bitmap_check(bitmap1, 0, 7));
+    assert(0 == res_bitmap_check(bitmap1, 8, 55));
+    assert(31 == res_bitmap_largest_free(bitmap1));
+    assert(32 == res_bitmap_alloc(bitmap1, 16));  /*17 bits needs a 32*/
+    assert(15 == res_bitmap_largest_free(bitmap1));
+    printf("Good!\n");
+
+    printf("\tcoalescing... ");
+    assert(0 == res_bitmap_free(bitmap1, 0, 63));
+    assert(63 == res_bitmap_largest_free(bitmap1));
+    for(i=0; i<64; i++)
+      assert(i == res_bitmap_alloc(bitmap1, 0));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_alloc(bitmap1, 0));
+    assert(RES_ERR_NO_MATCH == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_largest_free(bitmap1));
+    assert(RES_ERR_NO_MATCH == errno);
+    for(i=0; i<64; i++)  /*free in a random order*/
+      order[i] = i;
+    for(i=63; i>0; i--)
+    {
+      j = (unsigned)rand() % (i + 1);
+      t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+    for(i=0; i<64; i++)
+      assert(0 == res_bitmap_free(bitmap1, order[i], 0));
+    assert(0 == res_bitmap_alloc(bitmap1, 63));
+    assert(0 == res_bitmap_destroy(bitmap1));
+    printf("Good!\n");
+
+    printf("\tmap that isn't a power of two... ");
+    bitmap1 = res_bitmap_create(99);
+    assert(NULL != bitmap1);
+    assert(63 == res_bitmap_largest_free(bitmap1));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_alloc(bitmap1, 64));
+    assert(RES_ERR_NO_MATCH == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_alloc(bitmap1, 100));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(64 == res_bitmap_alloc(bitmap1, 31));
+    assert(96 == res_bitmap_alloc(bitmap1, 3));
+    assert(0 == res_bitmap_alloc(bitmap1, 63));
+    assert(RES_BITMAP_ERR == res_bitmap_alloc(bitmap1, 0));
+    printf("Good!\n");
+
+    printf("\tresize... ");
+    assert(0 == res_bitmap_free(bitmap1, 0, 99));
+    assert(0 == res_bitmap_take(bitmap1, 90, 9));
+    assert(0 == res_bitmap_resize(bitmap1, 127));
+    assert(0 == res_bitmap_check(bitmap1, 100, 27));
+    assert(63 == res_bitmap_largest_free(bitmap1));
+    assert(0 == res_bitmap_alloc(bitmap1, 63));
+    assert(64 == res_bitmap_alloc(bitmap1, 15));
+    assert(112 == res_bitmap_alloc(bitmap1, 15));
+    assert(0 == res_bitmap_resize(bitmap1, 40));
+    assert(1 == res_bitmap_check(bitmap1, 0, 40));
+    assert(0 == res_bitmap_free(bitmap1, 32, 8));
+    assert(7 == res_bitmap_largest_free(bitmap1));  /*32-39 has no buddy in a 41 bit map*/
+    assert(0 == res_bitmap_resize(bitmap1, 100));
+    assert(0 == res_bitmap_check(bitmap1, 32, 68));  /*bits cut off by the shrink don't come back*/
+    assert(0 == res_bitmap_destroy(bitmap1));
+    printf("Good!\n");
+
+    printf("\taligned alloc... ");
+    bitmap1 = res_bitmap_create(255);
+    assert(NULL != bitmap1);
+    assert(0 == res_bitmap_take(bitmap1, 0, 0));
+    assert(1 == res_bitmap_alloc_aligned(bitmap1, 0, 0));
+    assert(4 == res_bitmap_alloc_aligned(bitmap1, 0, 2));  /*order 0 bit 3 is free, but not aligned - 4-7 is split instead*/
+    assert(64 == res_bitmap_alloc_aligned(bitmap1, 1, 6));
+    assert(8 == res_bitmap_alloc_aligned(bitmap1, 0, 3));
+    assert(0 == res_bitmap_take(bitmap1, 128, 127));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_alloc_aligned(bitmap1, 0, 7));
+    assert(RES_ERR_NO_MATCH == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_alloc_aligned(bitmap1, 0, 200));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(0 == res_bitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int random_ops(void)
+{
+  res_bitmap_t* bitmap1;
+  unsigned char* shadow;
+  size_t i;
+  size_t j;
+  size_t base;
+  size_t limit;
+  size_t size;
+  size_t expected;
+  size_t n;
+  size_t t;
+  size_t bits[16];
+  size_t sizes[4] = {1000, 1024, 3000, 4096};
+  res_bitmap_t* other;
+  unsigned char* other_shadow;
+  ushort op;
+  res_bitmap_t* copy;
+  res_bitmap_word_t* delta;
+    shadow = calloc(4096, 1);
+    other_shadow = calloc(4096, 1);
+    assert((NULL != shadow) && (NULL != other_shadow));
+    size = 3000;
+    bitmap1 = res_bitmap_create_opts(size - 1, RES_BITMAP_OPT_DELTA);
+    copy = res_bitmap_create(0);
+    assert((NULL != bitmap1) && (NULL != copy));
+
+    printf("\tcomparing random take, free, alloc, batches, resize & combine, copying deltas... ");
+    for(i=0; i<30000; i++)
+    {
+      if(0 == i % 500)  /*bring the copy up to date - its orders too*/
+      {
+        n = res_bitmap_delta_size(bitmap1);
+        delta = malloc(n * sizeof(res_bitmap_word_t));
+        assert(NULL != delta);
+        assert(n == res_bitmap_delta_export(bitmap1, delta, n));
+        assert(0 == res_bitmap_delta_apply(copy, delta, n));
+        free(delta);
+        for(j=0; j<size; j++)
+          assert(shadow[j] == res_bitmap_check(copy, j, 0));
+        assert(4 == res_bitmap_check(copy, size, 0));
+        assert(res_bitmap_largest_free(bitmap1) == res_bitmap_largest_free(copy));
+      }
+
+      switch(rand() % 8)
+      {
+        case 0 :  /*take a range*/
+          base = (unsigned)rand() % size;
+          limit = (unsigned)rand() % 50;
+          if(limit > size - 1 - base)
+            limit = size - 1 - base;
+          assert(0 == res_bitmap_take(bitmap1, base, limit));
+          memset(shadow + base, 1, limit + 1);
+          break;
+        case 1 :  /*free a range, or a batch of blocks*/
+          n = 1 + (unsigned)rand() % 16;
+          limit = (unsigned)rand() % 4;
+          for(j=0; j<n; j++)
+          {
+            bits[j] = (unsigned)rand() % (size - limit);
+            memset(shadow + bits[j], 0, limit + 1);
+          }
+          assert(0 == res_bitmap_free_many(bitmap1, bits, n, limit));
+          break;
+        case 2 :
+          base = (unsigned)rand() % size;
+          limit = (unsigned)rand() % 200;
+          if(limit > size - 1 - base)
+            limit = size - 1 - base;
+          assert(0 == res_bitmap_free(bitmap1, base, limit));
+          memset(shadow + base, 0, limit + 1);
+          break;
+        case 3 :  /*alloc*/
+        case 4 :
+        case 5 :
+          limit = (0 == rand() % 2) ? (unsigned)rand() % 4 : (unsigned)rand() % 100;
+          if(0 == rand() % 4)
+          {
+            n = 1 + (unsigned)rand() % 16;
+            t = res_bitmap_alloc_many(bitmap1, limit, n, bits);
+            for(j=0; j<t; j++)
+            {
+              assert(bits[j] == buddy_alloc(shadow, size, limit, 1));
+              memset(shadow + bits[j], 1, limit + 1);
+            }
+            if(t < n)
+              assert(RES_BITMAP_ERR == buddy_alloc(shadow, size, limit, 1));
+            break;
+          }
+          if(0 == rand() % 2)
+          {
+            expected = buddy_alloc(shadow, size, limit, 1);
+            assert(expected == res_bitmap_alloc(bitmap1, limit));
+          } else {
+            j = (size_t)rand() % 8;
+            expected = buddy_alloc(shadow, size, limit, (size_t)1 << j);
+            assert(expected == res_bitmap_alloc_aligned(bitmap1, limit, (ushort)j));
+          }
+          if(RES_BITMAP_ERR != expected)
+            memset(shadow + expected, 1, limit + 1);
+          break;
+        case 6 :  /*largest free - biggest block alloc would manage*/
+          for(j=size; j>0; j--)
+            if(RES_BITMAP_ERR != buddy_alloc(shadow, size, j - 1, 1))
+              break;
+          if(0 == j)
+            assert(RES_BITMAP_ERR == res_bitmap_largest_free(bitmap1));
+          else
+            assert(j - 1 == res_bitmap_largest_free(bitmap1));
+          break;
+        default :  /*resize or combine with another map, now and again*/
+          t = (unsigned)rand() % 200;
+          if(1 == t)
+          {
+            n = sizes[(unsigned)rand() % 4];
+            other = res_bitmap_create(n - 1);
+            assert(NULL != other);
+            memset(other_shadow, 0, 4096);
+            for(j=0; j<20; j++)
+            {
+              base = (unsigned)rand() % n;
+              limit = (unsigned)rand() % 100;
+              if(limit > n - 1 - base)
+                limit = n - 1 - base;
+              assert(0 == res_bitmap_take(other, base, limit));
+              memset(other_shadow + base, 1, limit + 1);
+            }
+            op = (ushort)((unsigned)rand() % 4);
+            assert(0 == res_bitmap_combine(bitmap1, other, op));
+            for(j=0; j<size; j++)
+              shadow[j] = (RES_BITMAP_AND == op) ? (shadow[j] & other_shadow[j]) : (RES_BITMAP_OR == op) ? (shadow[j] | other_shadow[j])
+                        : (RES_BITMAP_XOR == op) ? (shadow[j] ^ other_shadow[j]) : (shadow[j] & !other_shadow[j]);  /*other_shadow is 0 past other's end*/
+            assert(0 == res_bitmap_destroy(other));
+          }
+          if(0 != t)
+            break;
+          j = sizes[(unsigned)rand() % 4];
+          assert(0 == res_bitmap_resize(bitmap1, j - 1));
+          if(j > size)
+            memset(shadow + size, 0, j - size);
+          size = j;
+      }
+    }
+    for(j=0; j<size; j++)
+      assert(shadow[j] == res_bitmap_check(bitmap1, j, 0));
+    assert(0 == res_bitmap_destroy(bitmap1));
+    assert(0 == res_bitmap_destroy(copy));
+    free(shadow);
+    free(other_shadow);
+    printf("Good!\n");
+  return(0);
+}
+
+int file(void)
+{
+  const char* path = "bitmap_buddy_test.bits";
+  res_bitmap_t* bitmap;
+  size_t i;
+    printf("\tcreate, alloc, sync & reopen... ");
+    bitmap = res_bitmap_create_file(path, 4095, 0);
+    assert(NULL != bitmap);
+    assert(0 == res_bitmap_alloc(bitmap, 99));  /*128 bit buddy, 100 to 127 left free*/
+    assert(100 == res_bitmap_alloc(bitmap, 0));
+    assert(0 == res_bitmap_sync(bitmap));
+    for(i=0; i<bitmap->file->dirty_words; i++)
+      assert(0 == bitmap->file->dirty[i]);
+    assert(0 == res_bitmap_destroy(bitmap));
+    bitmap = res_bitmap_open_file(path, 0);
+    assert(NULL != bitmap);
+    assert(4095 == res_bitmap_get_size(bitmap));
+    assert(101 == res_bitmap_count(bitmap, 0, 4095));
+    assert(101 == res_bitmap_alloc(bitmap, 0));  /*orders rebuilt from the map*/
+    printf("Good!\n");
+
+    printf("\tresizing the file... ");
+    assert(0 == res_bitmap_resize(bitmap, 8191));
+    assert(4096 == res_bitmap_alloc(bitmap, 4095));
+    assert(0 == res_bitmap_resize(bitmap, 255));
+    assert(0 == res_bitmap_destroy(bitmap));
+    bitmap = res_bitmap_open_file(path, 0);
+    assert(NULL != bitmap);
+    assert(255 == res_bitmap_get_size(bitmap));
+    assert(102 == res_bitmap_count(bitmap, 0, 255));
+    assert(0 == res_bitmap_resize(bitmap, 8191));
+    assert(102 == res_bitmap_count(bitmap, 0, 8191));
+    assert(0 == res_bitmap_destroy(bitmap));
+    assert(0 == remove(path));
+    printf("Good!\n");
+  return(0);
+}
+
+size_t buddy_alloc(unsigned char* shadow, size_t size, size_t block_size, size_t align)
+{
+  size_t len;
+  size_t j;
+   /*smallest power of two that fits, then up each order - the lowest free block whose parent isn't free (or doesn't fit in the map)*/
+    for(len=1; len<block_size+1; len*=2)
+      ;
+    for(; len<=size; len*=2)
+      for(j=0; j+len<=size; j+=len)
+        if((0 == (j & (align - 1))) && block_free(shadow, size, j, len) && !block_free(shadow, size, j & ~(2*len - 1), 2*len))
+          return(j);
+  return(RES_BITMAP_ERR);
+}
+
+int block_free(unsigned char* shadow, size_t size, size_t start, size_t len)
+{
+  size_t i;
+    if(start + len > size)
+      return(0);
+    for(i=start; i<start+len; i++)
+      if(0 != shadow[i])
+        return(0);
+  return(1);
+}
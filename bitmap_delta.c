@@ -0,0 +1,210 @@
+/* bitmap_delta.c - change tracking for bitmaps, and the deltas used to copy
+ *                  the changes to another map. Shared by the reff-1, buddy-1
+ *                  and tree-1 implementations
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: reff-1, buddy-1, tree-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+
+/* A map made with RES_BITMAP_OPT_DELTA has a second, much smaller map with a
+ * bit per word of it, set when that word is written. An export walks the set
+ * bits, copies out runs of changed words and clears their bits, so its cost
+ * is in the words changed since the last export (plus a read of the dirty
+ * map, 1/BITS of the size) rather than in the size of the map.
+ *
+ * A delta is an array of res_bitmap_word_t:
+ *   [0]  num_bits of the map at the export
+ *   [1]  the smallest num_bits it had since the export before
+ *   then any number of runs, each [first word][n >= 1][n new values]
+ * The receiving map is cut down to [1] before growing to [0], so bits that
+ * went with a shrink and came back with a grow are 0 there too, without the
+ * grown words having to be sent.
+ *
+ * As bitmap_file.c, only the handle's implementation knows how the map
+ * changed, so it calls _res_bitmap_delta_touch after each write and nothing
+ * here looks at a handle.*/
+
+res_bitmap_delta_t* _res_bitmap_delta_create(size_t num_bits)
+{
+  res_bitmap_delta_t* delta;
+    delta = malloc( sizeof(res_bitmap_delta_t) );
+    if(NULL == delta)
+      return(NULL);
+    delta->dirty = NULL;
+    delta->capacity = 0;
+    delta->low = num_bits;
+    if(0 != _res_bitmap_delta_reserve(delta, num_bits))
+    {
+      _res_bitmap_delta_destroy(delta);
+      return(NULL);
+    }
+  return(delta);
+}
+
+void _res_bitmap_delta_destroy(res_bitmap_delta_t* delta)
+{
+  free(delta->dirty);
+  free(delta);
+}
+
+size_t _res_bitmap_delta_words(size_t num_bits)
+{
+  return(num_bits / BITS / BITS + 1);
+}
+
+ushort _res_bitmap_delta_reserve(res_bitmap_delta_t* delta, size_t num_bits)
+{
+  res_bitmap_word_t *dirty;
+  size_t words;
+    words = _res_bitmap_delta_words(num_bits);
+    if(words <= delta->capacity)
+      return(0);
+
+    dirty = realloc( delta->dirty, words * sizeof(res_bitmap_word_t) );
+    if(NULL == dirty)
+      return(2);
+    memset(dirty + delta->capacity, 0, (words - delta->capacity) * sizeof(res_bitmap_word_t));
+    delta->dirty = dirty;
+    delta->capacity = words;
+  return(0);
+}
+
+void _res_bitmap_delta_resize(res_bitmap_delta_t* delta, size_t old_num_bits, size_t num_bits)
+{
+  size_t w;
+  size_t last;
+    if(num_bits < delta->low)
+      delta->low = num_bits;
+    if(num_bits >= old_num_bits)
+      return;
+
+   /*words cut off aren't sent - the receiver cuts them off too. Their bits must be clear for the next grow*/
+    w = num_bits / BITS + 1;
+    last = old_num_bits / BITS;
+    if(w > last)
+      return;
+    if(w / BITS == last / BITS)
+    {
+      delta->dirty[w / BITS] &= ~_res_bitmap_mask(w % BITS, last % BITS);
+      return;
+    }
+    delta->dirty[w / BITS] &= ~_res_bitmap_mask(w % BITS, BITS - 1);
+    memset(delta->dirty + w / BITS + 1, 0, (last / BITS - w / BITS) * sizeof(res_bitmap_word_t));
+}
+
+void _res_bitmap_delta_touch(res_bitmap_delta_t* delta, size_t first_word, size_t last_word)
+{
+  _res_bitmap_mark(delta->dirty, first_word, last_word, 1);
+}
+
+size_t _res_bitmap_delta_size(res_bitmap_delta_t* delta, size_t num_bits)
+{
+  res_bitmap_word_t word;
+  res_bitmap_word_t carry = 0;  /*top bit of the word before - a run going on into this one*/
+  size_t words;
+  size_t w;
+  size_t size;
+   /*a run starts at each set bit with a clear bit below it*/
+    size = RES_BITMAP_DELTA_HEADER;
+    words = _res_bitmap_delta_words(num_bits);
+    for(w=0; w<words; w++)
+    {
+      word = delta->dirty[w];
+      size += RES_BITMAP_POPCOUNT(word);
+      size += 2 * RES_BITMAP_POPCOUNT(word & ~((word << 1) | carry));
+      carry = word >> (BITS - 1);
+    }
+  return(size);
+}
+
+size_t _res_bitmap_delta_export(res_bitmap_delta_t* delta, const res_bitmap_word_t* bitmap, size_t num_bits, res_bitmap_word_t* buf, size_t size)
+{
+  size_t words;
+  size_t first;
+  size_t n;
+  size_t out;
+    buf[0] = (res_bitmap_word_t)num_bits;
+    buf[1] = (res_bitmap_word_t)delta->low;
+    delta->low = num_bits;  /*the receiver has been told*/
+    out = RES_BITMAP_DELTA_HEADER;
+
+   /*runs of dirty words, lowest first, for as long as there's room for a run header and a word*/
+    words = num_bits / BITS + 1;
+    first = _res_bitmap_delta_next(delta, 0, words, 1);
+    while((first < words) && (out + 3 <= size))
+    {
+      n = _res_bitmap_delta_next(delta, first, words, 0) - first;
+      if(n > size - out - 2)
+        n = size - out - 2;  /*the rest stays dirty for the next export*/
+      buf[out] = (res_bitmap_word_t)first;
+      buf[out + 1] = (res_bitmap_word_t)n;
+      memcpy(buf + out + 2, bitmap + first, n * sizeof(res_bitmap_word_t));
+      _res_bitmap_mark(delta->dirty, first, first + n - 1, 0);
+      out += n + 2;
+      first = _res_bitmap_delta_next(delta, first + n, words, 1);
+    }
+  return(out);
+}
+
+size_t _res_bitmap_delta_next(res_bitmap_delta_t* delta, size_t from, size_t words, ushort up)
+{
+  res_bitmap_word_t word;
+  size_t w;
+    if(from >= words)
+      return(words);
+    w = from / BITS;
+    word = (0 == up) ? ~delta->dirty[w] : delta->dirty[w];
+    word &= ~(res_bitmap_word_t)0 << (from % BITS);
+    while(0 == word)
+    {
+      w++;
+      if(w * BITS >= words)
+        return(words);
+      word = (0 == up) ? ~delta->dirty[w] : delta->dirty[w];
+    }
+    from = w * BITS + RES_BITMAP_CTZ(word);
+  return((from < words) ? from : words);
+}
+
+ushort _res_bitmap_delta_check(const res_bitmap_word_t* buf, size_t size)
+{
+  size_t num_bits;
+  size_t words;
+  size_t i;
+  size_t first;
+  size_t n;
+    if(size < RES_BITMAP_DELTA_HEADER)
+      return(2);
+    if((buf[0] >= (res_bitmap_word_t)RES_BITMAP_ERR) || (buf[1] > buf[0]))
+      return(2);
+    num_bits = (size_t)buf[0];
+    words = num_bits / BITS + 1;
+
+   /*every run inside the map and the delta*/
+    for(i=RES_BITMAP_DELTA_HEADER; i<size; i+=n + 2)
+    {
+      if(size - i < 2)
+        return(2);
+      if((buf[i] >= (res_bitmap_word_t)words) || (0 == buf[i+1]) || (buf[i+1] > (res_bitmap_word_t)(words - (size_t)buf[i])))
+        return(2);
+      first = (size_t)buf[i];
+      n = (size_t)buf[i+1];
+      if(n > size - i - 2)
+        return(2);
+
+     /*bits above num_bits are always 0*/
+      if((first + n == words) && (BITS - 1 != num_bits % BITS))
+        if(0 != (buf[i + 1 + n] & ~_res_bitmap_mask(0, num_bits % BITS)))
+          return(2);
+    }
+  return(0);
+}
@@ -0,0 +1,458 @@
+/* bitmap_extents.c - index of free extents for bitmap.c, used for best and
+ *                    worst fit allocation and largest free block queries
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+
+/* Every maximal run of free bits in the map is an extent. Extents are kept in
+ * a treap ordered by start bit, so take and free can find the ones they touch
+ * in O(log extents), and also in one treap per size class (floor(log2(len)))
+ * ordered by length then start, so a fit - the shortest long enough run, the
+ * lowest of equal ones, just as a scan of the map finds - is O(log extents)
+ * without looking at the bitmap at all. Each class's size and the total free
+ * bits are counted as runs come and go, so res_bitmap_free_stats is a copy of
+ * them.
+ *
+ * Nodes live in one array and refer to each other by index, so the whole
+ * index can grow with a single realloc. If that realloc ever fails the index
+ * is marked broken and thrown away, and is rebuilt the next time it is
+ * needed - callers fall back to scanning the map if even that fails.*/
+
+ #define RES_BITMAP_EXTENT_NIL SIZE_MAX
+
+res_bitmap_extents_t* _res_bitmap_extents_create(res_bitmap_t* bitmap_handle)
+{
+  res_bitmap_extents_t* extents;
+    extents = malloc( sizeof(res_bitmap_extents_t) );
+    if(NULL == extents)
+      return(NULL);
+    extents->node = NULL;
+    extents->capacity = 0;
+    extents->seed = 0x2545F491;
+    _res_bitmap_extents_clear(extents);
+
+    if(0 != _res_bitmap_extents_build(bitmap_handle, extents))
+    {
+      _res_bitmap_extents_destroy(extents);
+      return(NULL);
+    }
+  return(extents);
+}
+
+void _res_bitmap_extents_destroy(res_bitmap_extents_t* extents)
+{
+  free(extents->node);
+  free(extents);
+}
+
+void _res_bitmap_extents_clear(res_bitmap_extents_t* extents)
+{
+  ushort c;
+    extents->root = RES_BITMAP_EXTENT_NIL;
+    extents->free_node = RES_BITMAP_EXTENT_NIL;
+    extents->used = 0;
+    extents->count = 0;
+    extents->free_bits = 0;
+    extents->classes = 0;
+    extents->largest = 0;
+    extents->largest_valid = 1;
+    extents->broken = 0;
+    for(c=0; c<BITS; c++)
+    {
+      extents->bucket[c] = RES_BITMAP_EXTENT_NIL;
+      extents->histogram[c] = 0;
+    }
+}
+
+ushort _res_bitmap_extents_build(res_bitmap_t* bitmap_handle, res_bitmap_extents_t* extents)
+{
+  size_t start;
+  size_t end;
+   /*walk the free runs of the map, adding each one*/
+    _res_bitmap_extents_clear(extents);
+    start = _res_bitmap_find(bitmap_handle, 0, bitmap_handle->num_bits, 0);
+    while(RES_BITMAP_ERR != start)
+    {
+      end = _res_bitmap_find(bitmap_handle, start, bitmap_handle->num_bits, 1);
+      if(RES_BITMAP_ERR == end)
+        end = bitmap_handle->num_bits + 1;
+      if(RES_BITMAP_EXTENT_NIL == _res_bitmap_extents_insert(extents, start, end - start))
+      {
+        _res_bitmap_extents_clear(extents);
+        extents->broken = 1;
+        return(2);
+      }
+      if(end > bitmap_handle->num_bits)
+        break;
+      start = _res_bitmap_find(bitmap_handle, end, bitmap_handle->num_bits, 0);
+    }
+  return(0);
+}
+
+ushort _res_bitmap_extents_ready(res_bitmap_t* bitmap_handle)
+{
+  if(NULL == bitmap_handle->extents)
+    return(2);
+  if(0 != bitmap_handle->extents->broken)
+    return(_res_bitmap_extents_build(bitmap_handle, bitmap_handle->extents));
+  return(0);
+}
+
+void _res_bitmap_extents_update(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up)
+{
+  res_bitmap_extents_t* extents;
+  res_bitmap_extent_t* n;
+  size_t i;
+  size_t start;
+  size_t end;  /*NOT inclusive*/
+    extents = bitmap_handle->extents;
+    if(0 != extents->broken)
+      return;  /*rebuilt from scratch when next needed*/
+
+    if(0 != up)
+    {
+     /*take - an extent starting below first may run into the range, cut it short and keep any part after last*/
+      i = _res_bitmap_extents_find_le(extents, first);
+      if(RES_BITMAP_EXTENT_NIL != i)
+      {
+        n = &extents->node[i];
+        start = n->start;
+        end = n->start + n->len;
+        if(end > first)
+        {
+          _res_bitmap_extents_erase(extents, i);
+          if(start < first)
+            if(RES_BITMAP_EXTENT_NIL == _res_bitmap_extents_insert(extents, start, first - start))
+              goto broken;
+          if(end > last + 1)
+            if(RES_BITMAP_EXTENT_NIL == _res_bitmap_extents_insert(extents, last + 1, end - (last + 1)))
+              goto broken;
+        }
+      }
+
+     /*extents starting inside the range go, apart from any part after last*/
+      i = _res_bitmap_extents_find_ge(extents, first);
+      while((RES_BITMAP_EXTENT_NIL != i) && (extents->node[i].start <= last))
+      {
+        end = extents->node[i].start + extents->node[i].len;
+        _res_bitmap_extents_erase(extents, i);
+        if(end > last + 1)
+          if(RES_BITMAP_EXTENT_NIL == _res_bitmap_extents_insert(extents, last + 1, end - (last + 1)))
+            goto broken;
+        i = _res_bitmap_extents_find_ge(extents, first);
+      }
+    } else {
+     /*free - merge with an extent ending just before first, anything inside, and an extent starting just after last*/
+      start = first;
+      end = last + 1;
+      if(0 != first)
+      {
+        i = _res_bitmap_extents_find_le(extents, first - 1);
+        if((RES_BITMAP_EXTENT_NIL != i) && (extents->node[i].start + extents->node[i].len >= first))
+        {
+          start = extents->node[i].start;
+          if(extents->node[i].start + extents->node[i].len > end)
+            end = extents->node[i].start + extents->node[i].len;
+          _res_bitmap_extents_erase(extents, i);
+        }
+      }
+      i = _res_bitmap_extents_find_ge(extents, first);
+      while((RES_BITMAP_EXTENT_NIL != i) && (extents->node[i].start <= last + 1))
+      {
+        if(extents->node[i].start + extents->node[i].len > end)
+          end = extents->node[i].start + extents->node[i].len;
+        _res_bitmap_extents_erase(extents, i);
+        i = _res_bitmap_extents_find_ge(extents, first);
+      }
+      if(RES_BITMAP_EXTENT_NIL == _res_bitmap_extents_insert(extents, start, end - start))
+        goto broken;
+    }
+  return;
+
+ broken:
+  _res_bitmap_extents_clear(extents);
+  extents->broken = 1;
+}
+
+size_t _res_bitmap_extents_fit(res_bitmap_t* bitmap_handle, size_t need, ushort worst)
+{
+  res_bitmap_extents_t* extents;
+  res_bitmap_word_t classes;
+  size_t i;
+  size_t c;
+    extents = bitmap_handle->extents;
+
+    if(0 != worst)
+    {
+     /*worst fit - the lowest of the largest extents, if they're big enough*/
+      if(_res_bitmap_extents_largest(extents) < need)
+        return(RES_BITMAP_ERR);
+      c = _res_bitmap_extents_class(extents->largest);
+      i = _res_bitmap_extents_find_len(extents, extents->bucket[c], extents->largest);
+      return(extents->node[i].start);
+    }
+
+   /*best fit - the shortest big enough extent in need's own size class*/
+    c = _res_bitmap_extents_class(need);
+    i = _res_bitmap_extents_find_len(extents, extents->bucket[c], need);
+    if(RES_BITMAP_EXTENT_NIL != i)
+      return(extents->node[i].start);
+
+   /*otherwise the shortest extent in the next size class up that has any*/
+    if(c + 1 >= BITS)
+      return(RES_BITMAP_ERR);
+    classes = extents->classes & ~_res_bitmap_mask(0, c);
+    if(0 == classes)
+      return(RES_BITMAP_ERR);
+    c = RES_BITMAP_CTZ(classes);
+    i = _res_bitmap_extents_find_len(extents, extents->bucket[c], 0);
+  return(extents->node[i].start);
+}
+
+size_t _res_bitmap_extents_largest(res_bitmap_extents_t* extents)
+{
+  size_t i;
+  size_t c;
+   /*cached unless the largest extent has been removed since*/
+    if(0 != extents->largest_valid)
+      return(extents->largest);
+
+   /*the last node of the highest size class*/
+    extents->largest = 0;
+    if(0 != extents->classes)
+    {
+      c = BITS - 1 - RES_BITMAP_CLZ(extents->classes);
+      for(i=extents->bucket[c]; RES_BITMAP_EXTENT_NIL != extents->node[i].larger; i=extents->node[i].larger);
+      extents->largest = extents->node[i].len;
+    }
+    extents->largest_valid = 1;
+  return(extents->largest);
+}
+
+size_t _res_bitmap_extents_class(size_t len)
+{
+  return(BITS - 1 - RES_BITMAP_CLZ((res_bitmap_word_t)len));
+}
+
+/*-------------- Treaps ----------------*/
+
+size_t _res_bitmap_extents_insert(res_bitmap_extents_t* extents, size_t start, size_t len)
+{
+  res_bitmap_extent_t* node;
+  size_t i;
+  size_t c;
+  size_t left;
+  size_t right;
+   /*get a node - off the free list, or from the end of the array*/
+    if(RES_BITMAP_EXTENT_NIL != extents->free_node)
+    {
+      i = extents->free_node;
+      extents->free_node = extents->node[i].smaller;
+    } else {
+      if(extents->used == extents->capacity)
+      {
+        c = (0 == extents->capacity) ? 64 : extents->capacity * 2;
+        node = realloc( extents->node, c * sizeof(res_bitmap_extent_t) );
+        if(NULL == node)
+          return(RES_BITMAP_EXTENT_NIL);
+        extents->node = node;
+        extents->capacity = c;
+      }
+      i = extents->used++;
+    }
+
+   /*fill it in*/
+    node = &extents->node[i];
+    node->start = start;
+    node->len = len;
+    node->left = RES_BITMAP_EXTENT_NIL;
+    node->right = RES_BITMAP_EXTENT_NIL;
+    node->smaller = RES_BITMAP_EXTENT_NIL;
+    node->larger = RES_BITMAP_EXTENT_NIL;
+    extents->seed ^= extents->seed << 13;  /*xorshift*/
+    extents->seed ^= extents->seed >> 17;
+    extents->seed ^= extents->seed << 5;
+    node->priority = extents->seed;
+
+   /*into the treap*/
+    _res_bitmap_extents_split(extents, extents->root, start, &left, &right);
+    extents->root = _res_bitmap_extents_merge(extents, _res_bitmap_extents_merge(extents, left, i), right);
+
+   /*into its size class*/
+    c = _res_bitmap_extents_class(len);
+    _res_bitmap_extents_size_split(extents, extents->bucket[c], len, start, &left, &right);
+    extents->bucket[c] = _res_bitmap_extents_size_merge(extents, _res_bitmap_extents_size_merge(extents, left, i), right);
+    extents->classes |= (res_bitmap_word_t)1 << c;
+    extents->histogram[c]++;
+
+    extents->count++;
+    extents->free_bits += len;
+    if((0 != extents->largest_valid) && (len > extents->largest))
+      extents->largest = len;
+  return(i);
+}
+
+void _res_bitmap_extents_erase(res_bitmap_extents_t* extents, size_t i)
+{
+  res_bitmap_extent_t* node;
+  size_t c;
+  size_t left;
+  size_t middle;
+  size_t right;
+    node = &extents->node[i];
+
+   /*out of the treap*/
+    _res_bitmap_extents_split(extents, extents->root, node->start, &left, &middle);
+    _res_bitmap_extents_split(extents, middle, node->start + 1, &middle, &right);
+    extents->root = _res_bitmap_extents_merge(extents, left, right);
+
+   /*out of its size class*/
+    c = _res_bitmap_extents_class(node->len);
+    _res_bitmap_extents_size_split(extents, extents->bucket[c], node->len, node->start, &left, &middle);
+    _res_bitmap_extents_size_split(extents, middle, node->len, node->start + 1, &middle, &right);
+    extents->bucket[c] = _res_bitmap_extents_size_merge(extents, left, right);
+    if(RES_BITMAP_EXTENT_NIL == extents->bucket[c])
+      extents->classes &= ~((res_bitmap_word_t)1 << c);
+    extents->histogram[c]--;
+
+    extents->count--;
+    extents->free_bits -= node->len;
+    if(node->len == extents->largest)
+      extents->largest_valid = 0;
+
+   /*onto the free list*/
+    node->smaller = extents->free_node;
+    extents->free_node = i;
+}
+
+void _res_bitmap_extents_split(res_bitmap_extents_t* extents, size_t t, size_t start, size_t* left, size_t* right)
+{
+   /*left gets nodes starting below start, right the rest*/
+    if(RES_BITMAP_EXTENT_NIL == t)
+    {
+      *left = RES_BITMAP_EXTENT_NIL;
+      *right = RES_BITMAP_EXTENT_NIL;
+      return;
+    }
+    if(extents->node[t].start < start)
+    {
+      _res_bitmap_extents_split(extents, extents->node[t].right, start, &extents->node[t].right, right);
+      *left = t;
+    } else {
+      _res_bitmap_extents_split(extents, extents->node[t].left, start, left, &extents->node[t].left);
+      *right = t;
+    }
+}
+
+size_t _res_bitmap_extents_merge(res_bitmap_extents_t* extents, size_t left, size_t right)
+{
+   /*everything in left starts before everything in right - highest priority ends up on top*/
+    if(RES_BITMAP_EXTENT_NIL == left)
+      return(right);
+    if(RES_BITMAP_EXTENT_NIL == right)
+      return(left);
+    if(extents->node[left].priority > extents->node[right].priority)
+    {
+      extents->node[left].right = _res_bitmap_extents_merge(extents, extents->node[left].right, right);
+      return(left);
+    }
+    extents->node[right].left = _res_bitmap_extents_merge(extents, left, extents->node[right].left);
+  return(right);
+}
+
+size_t _res_bitmap_extents_find_le(res_bitmap_extents_t* extents, size_t start)
+{
+  size_t t;
+  size_t found = RES_BITMAP_EXTENT_NIL;
+    t = extents->root;
+    while(RES_BITMAP_EXTENT_NIL != t)
+    {
+      if(extents->node[t].start <= start)
+      {
+        found = t;
+        t = extents->node[t].right;
+      } else {
+        t = extents->node[t].left;
+      }
+    }
+  return(found);
+}
+
+size_t _res_bitmap_extents_find_ge(res_bitmap_extents_t* extents, size_t start)
+{
+  size_t t;
+  size_t found = RES_BITMAP_EXTENT_NIL;
+    t = extents->root;
+    while(RES_BITMAP_EXTENT_NIL != t)
+    {
+      if(extents->node[t].start >= start)
+      {
+        found = t;
+        t = extents->node[t].left;
+      } else {
+        t = extents->node[t].right;
+      }
+    }
+  return(found);
+}
+
+void _res_bitmap_extents_size_split(res_bitmap_extents_t* extents, size_t t, size_t len, size_t start, size_t* left, size_t* right)
+{
+   /*as _res_bitmap_extents_split, for a size class - left gets nodes shorter than len, or as long and starting below start*/
+    if(RES_BITMAP_EXTENT_NIL == t)
+    {
+      *left = RES_BITMAP_EXTENT_NIL;
+      *right = RES_BITMAP_EXTENT_NIL;
+      return;
+    }
+    if((extents->node[t].len < len) || ((extents->node[t].len == len) && (extents->node[t].start < start)))
+    {
+      _res_bitmap_extents_size_split(extents, extents->node[t].larger, len, start, &extents->node[t].larger, right);
+      *left = t;
+    } else {
+      _res_bitmap_extents_size_split(extents, extents->node[t].smaller, len, start, left, &extents->node[t].smaller);
+      *right = t;
+    }
+}
+
+size_t _res_bitmap_extents_size_merge(res_bitmap_extents_t* extents, size_t left, size_t right)
+{
+   /*as _res_bitmap_extents_merge, for a size class*/
+    if(RES_BITMAP_EXTENT_NIL == left)
+      return(right);
+    if(RES_BITMAP_EXTENT_NIL == right)
+      return(left);
+    if(extents->node[left].priority > extents->node[right].priority)
+    {
+      extents->node[left].larger = _res_bitmap_extents_size_merge(extents, extents->node[left].larger, right);
+      return(left);
+    }
+    extents->node[right].smaller = _res_bitmap_extents_size_merge(extents, left, extents->node[right].smaller);
+  return(right);
+}
+
+size_t _res_bitmap_extents_find_len(res_bitmap_extents_t* extents, size_t t, size_t len)
+{
+  size_t found = RES_BITMAP_EXTENT_NIL;
+    while(RES_BITMAP_EXTENT_NIL != t)
+    {
+      if(extents->node[t].len >= len)
+      {
+        found = t;
+        t = extents->node[t].smaller;
+      } else {
+        t = extents->node[t].larger;
+      }
+    }
+  return(found);
+}
@@ -0,0 +1,374 @@
+/* bitmap_file.c - memory mapped storage for bitmaps - files, and anonymous
+ *                 mappings for big maps in memory. Shared by the reff-1 and
+ *                 buddy-1 implementations
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: reff-1, buddy-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#define _GNU_SOURCE  /*for mremap where there is one, and mmap, pread, ftruncate and friends under -std=c11*/
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bitmap.h"
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+ #define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* A bitmap file is RES_BITMAP_FILE_HEADER bytes of header, then the map
+ * exactly as it is kept in memory - whole native words, bits above num_bits
+ * 0. The whole file is mapped MAP_SHARED, so the map is used in place and
+ * nothing is read or written up front. Every change to the map marks the
+ * pages it touched in a dirty bitmap, and a sync only msyncs those.
+ *
+ * The header is only rewritten on create and resize. Only the handle's
+ * implementation knows how the map changed, so it calls
+ * _res_bitmap_file_dirty after each write; nothing here looks at a handle,
+ * which is why one copy of this file does for both implementations.
+ *
+ * Maps kept in memory come from _res_bitmap_mem_alloc. Small ones are
+ * calloc'd, but from RES_BITMAP_MAP_MIN bytes up they are anonymous
+ * mappings: the kernel hands out zeroed pages on first touch, so creating a
+ * huge map costs nothing until bits are used, and growing one is an mremap
+ * that moves page tables rather than copying - the new pages are zero
+ * without a memset. Which kind a map is follows from its size, so nothing
+ * needs to be kept in the handle.*/
+
+res_bitmap_file_t* _res_bitmap_file_create(const char* path, size_t num_bits)
+{
+  res_bitmap_file_t *file;
+  int fd;
+  int e;
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if(-1 == fd)
+      return(NULL);
+
+   /*a new file is all 0's - the map is ready as soon as it is the right length*/
+    file = NULL;
+    if(0 == ftruncate(fd, (off_t)_res_bitmap_file_length(num_bits)))
+      file = _res_bitmap_file_map(fd, _res_bitmap_file_length(num_bits));
+    if(NULL == file)
+    {
+      e = errno;
+      close(fd);
+      errno = e;
+      return(NULL);
+    }
+
+    _res_bitmap_file_header(file, num_bits);
+  return(file);
+}
+
+res_bitmap_file_t* _res_bitmap_file_open(const char* path, size_t* num_bits)
+{
+  res_bitmap_file_header_t header;
+  res_bitmap_file_t *file;
+  struct stat st;
+  int fd;
+  int e;
+    fd = open(path, O_RDWR);
+    if(-1 == fd)
+      return(NULL);
+
+   /*header and size only - the map itself isn't touched until it's used*/
+    errno = 0;
+    if(((ssize_t)sizeof(header) != pread(fd, &header, sizeof(header), 0)) || (0 != fstat(fd, &st)))
+    {
+      e = (0 == errno) ? RES_ERR_INCOMPATIBLE_RESOURCE : errno;  /*a short read doesn't set errno*/
+      close(fd);
+      errno = e;
+      return(NULL);
+    }
+    if((0 != memcmp(header.magic, RES_BITMAP_FILE_MAGIC, sizeof(header.magic))) || (RES_BITMAP_FILE_VERSION != header.version) || (BITS != header.word_bits)
+        || (_res_bitmap_file_checksum(&header) != header.checksum) || (header.num_bits >= RES_BITMAP_ERR)
+        || ((off_t)_res_bitmap_file_length((size_t)header.num_bits) != st.st_size))
+    {
+      close(fd);
+      errno = RES_ERR_INCOMPATIBLE_RESOURCE;
+      return(NULL);
+    }
+
+    file = _res_bitmap_file_map(fd, (size_t)st.st_size);
+    if(NULL == file)
+    {
+      e = errno;
+      close(fd);
+      errno = e;
+      return(NULL);
+    }
+    *num_bits = (size_t)header.num_bits;
+  return(file);
+}
+
+res_bitmap_file_t* _res_bitmap_file_map(int fd, size_t length)
+{
+  res_bitmap_file_t *file;
+    file = malloc( sizeof(res_bitmap_file_t) );
+    if(NULL == file)
+      return(NULL);
+
+    file->page = _res_bitmap_page_size();
+    file->dirty_words = _res_bitmap_file_pages(file, length) / BITS + 1;
+    file->dirty = calloc( file->dirty_words, sizeof(res_bitmap_word_t) );
+    if(NULL == file->dirty)
+    {
+      free(file);
+      return(NULL);
+    }
+
+    file->mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(MAP_FAILED == file->mapping)
+    {
+      free(file->dirty);
+      free(file);
+      return(NULL);
+    }
+    file->fd = fd;
+    file->length = length;
+    file->size = length;
+  return(file);
+}
+
+void _res_bitmap_file_close(res_bitmap_file_t* file)
+{
+  munmap(file->mapping, file->length);
+  close(file->fd);
+  free(file->dirty);
+  free(file);
+}
+
+ushort _res_bitmap_file_resize(res_bitmap_file_t* file, size_t num_bits)
+{
+  res_bitmap_word_t *dirty;
+  void *mapping;
+  size_t length;
+  size_t old_size;
+  size_t words;
+  int e;
+    length = _res_bitmap_file_length(num_bits);
+    if((length == file->length) && (length == file->size))
+      return(0);
+
+   /*room to track every page of the new mapping*/
+    words = _res_bitmap_file_pages(file, length) / BITS + 1;
+    if(words > file->dirty_words)
+    {
+      dirty = realloc( file->dirty, words * sizeof(res_bitmap_word_t) );
+      if(NULL == dirty)
+        return(2);
+      memset(dirty + file->dirty_words, 0x00, (words - file->dirty_words) * sizeof(res_bitmap_word_t));
+      file->dirty = dirty;
+      file->dirty_words = words;
+    }
+
+   /*the file first - growing, so the new mapping has something under it (new bytes read as 0), shrinking, so the cut off bytes are gone for good and come back as 0 on a later grow*/
+    old_size = file->size;
+    if(length != file->size)
+    {
+      if(0 != ftruncate(file->fd, (off_t)length))
+        return(2);
+      file->size = length;
+    }
+
+    if(length != file->length)
+    {
+      mapping = _res_bitmap_remap(file->mapping, file->length, length, file->fd);
+      if(NULL != mapping)
+      {
+        file->mapping = mapping;
+        file->length = length;
+      } else if(length > file->length) {
+       /*the old mapping doesn't cover the file - put the file back to the length the header says*/
+        e = errno;
+        if(0 == ftruncate(file->fd, (off_t)old_size))
+        {
+          file->size = old_size;
+          errno = e;
+        }
+        return(2);
+      }
+     /*a smaller mapping that can't be made is no matter - the old one still covers the whole file, and the next resize truncates the file to match whatever length it has*/
+    }
+  return(0);
+}
+
+void _res_bitmap_file_header(res_bitmap_file_t* file, size_t num_bits)
+{
+  res_bitmap_file_header_t header;
+    memset(&header, 0x00, sizeof(header));
+    memcpy(header.magic, RES_BITMAP_FILE_MAGIC, sizeof(header.magic));
+    header.version = RES_BITMAP_FILE_VERSION;
+    header.num_bits = num_bits;
+    header.word_bits = BITS;
+    header.checksum = _res_bitmap_file_checksum(&header);
+    memcpy(file->mapping, &header, sizeof(header));
+    _res_bitmap_mark(file->dirty, 0, 0, 1);
+}
+
+uint32_t _res_bitmap_file_checksum(const res_bitmap_file_header_t* header)
+{
+  res_bitmap_file_header_t copy;
+  const uint8_t *p;
+  uint32_t hash = 2166136261u;  /*FNV-1a*/
+  size_t i;
+    copy = *header;
+    copy.checksum = 0;
+    p = (const uint8_t*)&copy;
+    for(i=0; i<sizeof(copy); i++)
+    {
+      hash ^= p[i];
+      hash *= 16777619u;
+    }
+  return(hash);
+}
+
+void _res_bitmap_file_dirty(res_bitmap_file_t* file, size_t first_word, size_t last_word)
+{
+  size_t first;
+  size_t last;
+    first = RES_BITMAP_FILE_HEADER + first_word * sizeof(res_bitmap_word_t);
+    last = RES_BITMAP_FILE_HEADER + last_word * sizeof(res_bitmap_word_t) + sizeof(res_bitmap_word_t) - 1;
+    _res_bitmap_mark(file->dirty, first / file->page, last / file->page, 1);
+}
+
+ushort _res_bitmap_file_sync(res_bitmap_file_t* file)
+{
+  res_bitmap_word_t word;
+  size_t pages;
+  size_t p;
+  size_t first;
+  size_t len;
+  size_t end;
+   /*only what is both mapped and in the file can be synced*/
+    end = (file->size < file->length) ? file->size : file->length;
+    pages = _res_bitmap_file_pages(file, end);
+    p = 0;
+    while(p < pages)
+    {
+     /*skip clean words whole*/
+      word = file->dirty[p/BITS] >> (p%BITS);
+      if(0 == word)
+      {
+        p = (p/BITS + 1) * BITS;
+        continue;
+      }
+      p += RES_BITMAP_CTZ(word);
+      if(p >= pages)
+        break;
+
+     /*one msync per run of dirty pages*/
+      first = p;
+      while((p < pages) && (0 != (file->dirty[p/BITS] & ((res_bitmap_word_t)1 << (p%BITS)))))
+        p++;
+      len = (p - first) * file->page;
+      if(first * file->page + len > end)
+        len = end - first * file->page;
+      if(0 != msync((uint8_t*)file->mapping + first * file->page, len, MS_SYNC))
+        return(2);
+      _res_bitmap_mark(file->dirty, first, p - 1, 0);
+    }
+  return(0);
+}
+
+size_t _res_bitmap_file_length(size_t num_bits)
+{
+  return(RES_BITMAP_FILE_HEADER + _res_bitmap_size(num_bits));
+}
+
+size_t _res_bitmap_file_pages(res_bitmap_file_t* file, size_t length)
+{
+  return((length + file->page - 1) / file->page);
+}
+
+void* _res_bitmap_mem_alloc(size_t size)
+{
+  void* base;
+    if(size < RES_BITMAP_MAP_MIN)
+      return(calloc(1, size));
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(MAP_FAILED == base)
+      return(NULL);
+  return(base);
+}
+
+void* _res_bitmap_mem_realloc(void* base, size_t old_size, size_t size)
+{
+  void* new_base;
+  size_t end;
+   /*small to small - realloc, and clear anything new*/
+    if((old_size < RES_BITMAP_MAP_MIN) && (size < RES_BITMAP_MAP_MIN))
+    {
+      new_base = realloc(base, size);
+      if((NULL != new_base) && (size > old_size))
+        memset((uint8_t*)new_base + old_size, 0x00, size - old_size);
+      return(new_base);
+    }
+
+   /*mapping to mapping - nothing copied, and grown pages are already 0. A shrink leaves the old bytes in the rest of the last page, so they are cleared, or a later grow would bring them back*/
+    if((old_size >= RES_BITMAP_MAP_MIN) && (size >= RES_BITMAP_MAP_MIN))
+    {
+      new_base = _res_bitmap_remap(base, old_size, size, -1);
+      if((NULL != new_base) && (size < old_size))
+      {
+        end = (size + _res_bitmap_page_size() - 1) / _res_bitmap_page_size() * _res_bitmap_page_size();
+        memset((uint8_t*)new_base + size, 0x00, ((end < old_size) ? end : old_size) - size);
+      }
+      return(new_base);
+    }
+
+   /*crossing RES_BITMAP_MAP_MIN - a copy, but of less than RES_BITMAP_MAP_MIN bytes*/
+    new_base = _res_bitmap_mem_alloc(size);
+    if(NULL == new_base)
+      return(NULL);
+    memcpy(new_base, base, (size < old_size) ? size : old_size);
+    _res_bitmap_mem_free(base, old_size);
+  return(new_base);
+}
+
+void _res_bitmap_mem_free(void* base, size_t size)
+{
+  if(size < RES_BITMAP_MAP_MIN)
+    free(base);
+  else
+    munmap(base, size);
+}
+
+void* _res_bitmap_remap(void* mapping, size_t old_length, size_t length, int fd)
+{
+  void* new_mapping;
+  #ifdef MREMAP_MAYMOVE
+   /*Linux - the pages are moved, not copied*/
+    (void)fd;
+    new_mapping = mremap(mapping, old_length, length, MREMAP_MAYMOVE);
+    if(MAP_FAILED == new_mapping)
+      return(NULL);
+  #else
+   /*elsewhere, a new mapping. A file's pages are shared, but anonymous ones have to be copied across*/
+    if(-1 == fd)
+      new_mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    else
+      new_mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(MAP_FAILED == new_mapping)
+      return(NULL);
+    if(-1 == fd)
+      memcpy(new_mapping, mapping, (length < old_length) ? length : old_length);
+    munmap(mapping, old_length);
+  #endif
+  return(new_mapping);
+}
+
+size_t _res_bitmap_page_size(void)
+{
+  long page;
+    page = sysconf(_SC_PAGESIZE);
+  return((page > 0) ? (size_t)page : RES_BITMAP_FILE_HEADER);
+}
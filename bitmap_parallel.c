@@ -0,0 +1,267 @@
+/* bitmap_parallel.c - count, check and find the first free bit of a big
+ *                     range using several threads. Only uses the external
+ *                     API, so is shared by every implementation
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: reff-1, buddy-1, tree-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#define _POSIX_C_SOURCE 200809L  /*for sysconf under -std=c11*/
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "bitmap.h"
+
+ #define RES_BITMAP_SCAN_COUNT 0  /*what each worker does with its slice*/
+ #define RES_BITMAP_SCAN_CHECK 1
+ #define RES_BITMAP_SCAN_FIND  2
+ #define RES_BITMAP_PARALLEL_STEPS 64  /*pieces a worker cuts its slice into for check and find, seeing between them whether it can stop*/
+
+/*File-local structures, kept out of the headers so users of bitmap.h don't need C11 atomics:*/
+ typedef struct
+ {
+   res_bitmap_t *bitmap;  /*map being read*/
+   size_t base;  /*first bit of the range*/
+   size_t first;  /*base rounded down to a word - slices are counted from here*/
+   size_t last;  /*last bit of the range*/
+   size_t slice;  /*bits per worker, a multiple of BITS*/
+   size_t workers;
+   ushort op;  /*RES_BITMAP_SCAN_...*/
+   atomic_size_t done;  /*check: non-zero once the bits are known to vary. find: lowest worker to have found a free bit, SIZE_MAX till one has*/
+ } res_bitmap_scan_t;
+
+ typedef struct
+ {
+   res_bitmap_scan_t *scan;
+   size_t worker;  /*slice number, from 0*/
+   size_t result;  /*count, check result, or bit found - RES_BITMAP_ERR if none*/
+   ushort started;  /*1 if on a thread of its own, 0 if done by the caller*/
+ } res_bitmap_job_t;
+
+/*File-local functions:*/
+ ushort _res_bitmap_parallel_init(res_bitmap_scan_t* scan, res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads, ushort op);  /*works out the workers and slices for a scan of base to base+limit. Returns 0 on success, 1 if the range is too small to split, 2 if it is out of range*/
+ res_bitmap_job_t* _res_bitmap_parallel_run(res_bitmap_scan_t* scan);  /*runs a job per worker, on threads of their own where they can be started, and waits for them all. Returns the jobs (to be freed), NULL on malloc fail*/
+ void* _res_bitmap_parallel_worker(void* job);  /*pthread entry point*/
+ void _res_bitmap_parallel_slice(res_bitmap_job_t* job);  /*does one worker's slice*/
+
+/* The range is cut into one slice per worker, each a whole number of words
+ * so no two workers read the same one. Worker 0 is the calling thread, the
+ * rest are started for the call and joined before it returns. A slice is
+ * only read through the normal read-only functions - res_bitmap_count,
+ * _check and _find_next_clear - so any implementation's maps can be used,
+ * and the map MUST NOT be changed until the call returns.
+ *
+ * check and find walk their slice a piece at a time, so they can stop early:
+ * check once any worker has seen the bits vary, find once a worker below
+ * them has found a free bit - which is then lower than anything they could.
+ */
+
+size_t res_bitmap_count_parallel(res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads)
+{
+  res_bitmap_scan_t scan;
+  res_bitmap_job_t* job;
+  size_t count;
+  size_t i;
+   /*small or bad ranges stay on this thread - res_bitmap_count checks them*/
+    if(0 != _res_bitmap_parallel_init(&scan, bitmap_handle, base, limit, threads, RES_BITMAP_SCAN_COUNT))
+      return(res_bitmap_count(bitmap_handle, base, limit));
+
+    job = _res_bitmap_parallel_run(&scan);
+    if(NULL == job)
+      return(res_bitmap_count(bitmap_handle, base, limit));
+    for(i=0, count=0; i<scan.workers; i++)
+      count += job[i].result;
+    free(job);
+  return(count);
+}
+
+ushort res_bitmap_check_parallel(res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads)
+{
+  res_bitmap_scan_t scan;
+  res_bitmap_job_t* job;
+  ushort up;
+  size_t i;
+    if(0 != _res_bitmap_parallel_init(&scan, bitmap_handle, base, limit, threads, RES_BITMAP_SCAN_CHECK))
+      return(res_bitmap_check(bitmap_handle, base, limit));
+
+    job = _res_bitmap_parallel_run(&scan);
+    if(NULL == job)
+      return(res_bitmap_check(bitmap_handle, base, limit));
+
+   /*every slice all 0's or all 1's, and all the same, or they vary*/
+    up = (ushort)job[0].result;
+    for(i=1; i<scan.workers; i++)
+      if(job[i].result != up)
+        up = 2;
+    free(job);
+  return(up);
+}
+
+size_t res_bitmap_find_next_clear_parallel(res_bitmap_t* bitmap_handle, size_t from, ushort threads)
+{
+  res_bitmap_scan_t scan;
+  res_bitmap_job_t* job;
+  size_t num_bits;
+  size_t bit;
+    num_bits = res_bitmap_get_size(bitmap_handle);
+    if((from > num_bits) || (0 != _res_bitmap_parallel_init(&scan, bitmap_handle, from, num_bits - from, threads, RES_BITMAP_SCAN_FIND)))
+      return(res_bitmap_find_next_clear(bitmap_handle, from));
+
+    job = _res_bitmap_parallel_run(&scan);
+    if(NULL == job)
+      return(res_bitmap_find_next_clear(bitmap_handle, from));
+
+   /*the lowest worker to find one has the answer*/
+    bit = RES_BITMAP_ERR;
+    if(atomic_load(&scan.done) < scan.workers)
+      bit = job[atomic_load(&scan.done)].result;
+    free(job);
+    if(RES_BITMAP_ERR == bit)
+      errno = RES_ERR_NO_MATCH;
+  return(bit);
+}
+
+ushort _res_bitmap_parallel_init(res_bitmap_scan_t* scan, res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads, ushort op)
+{
+  size_t num_bits;
+  size_t first;
+  size_t bits;
+  size_t workers;
+  long cpus;
+   /*bad ranges are left to the single threaded functions to report*/
+    num_bits = res_bitmap_get_size(bitmap_handle);
+    if((base > num_bits) || (base > (SIZE_MAX - limit)) || ((base+limit) > num_bits))
+      return(2);
+
+   /*as many workers as asked for (or CPUs), but not so many that any has less than RES_BITMAP_PARALLEL_MIN bits*/
+    workers = threads;
+    if(0 == workers)
+    {
+      cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      workers = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    first = base - base%BITS;
+    bits = base + limit - first + 1;
+    if(workers > bits / RES_BITMAP_PARALLEL_MIN)
+      workers = bits / RES_BITMAP_PARALLEL_MIN;
+    if(workers < 2)
+      return(1);
+
+   /*slices of whole words, which may need fewer workers*/
+    scan->slice = bits / workers + ((0 == bits % workers) ? 0 : 1);
+    scan->slice += (BITS - scan->slice%BITS) % BITS;
+    scan->workers = bits / scan->slice + ((0 == bits % scan->slice) ? 0 : 1);
+    scan->bitmap = bitmap_handle;
+    scan->base = base;
+    scan->first = first;
+    scan->last = base + limit;
+    scan->op = op;
+    atomic_init(&scan->done, (RES_BITMAP_SCAN_FIND == op) ? SIZE_MAX : 0);
+  return(0);
+}
+
+res_bitmap_job_t* _res_bitmap_parallel_run(res_bitmap_scan_t* scan)
+{
+  res_bitmap_job_t* job;
+  pthread_t* thread;
+  size_t i;
+    job = malloc(scan->workers * sizeof(res_bitmap_job_t));
+    thread = malloc(scan->workers * sizeof(pthread_t));
+    if((NULL == job) || (NULL == thread))
+    {
+      free(job);
+      free(thread);
+      return(NULL);
+    }
+
+   /*start a thread per slice but the first. Any that can't be started are done here, after the first*/
+    for(i=0; i<scan->workers; i++)
+    {
+      job[i].scan = scan;
+      job[i].worker = i;
+      job[i].started = 0;
+      if((0 != i) && (0 == pthread_create(&thread[i], NULL, _res_bitmap_parallel_worker, &job[i])))
+        job[i].started = 1;
+    }
+    for(i=0; i<scan->workers; i++)
+      if(0 == job[i].started)
+        _res_bitmap_parallel_slice(&job[i]);
+    for(i=1; i<scan->workers; i++)
+      if(0 != job[i].started)
+        pthread_join(thread[i], NULL);
+    free(thread);
+  return(job);
+}
+
+void* _res_bitmap_parallel_worker(void* job)
+{
+  _res_bitmap_parallel_slice(job);
+  return(NULL);
+}
+
+void _res_bitmap_parallel_slice(res_bitmap_job_t* job)
+{
+  res_bitmap_scan_t* scan;
+  size_t first;
+  size_t last;
+  size_t step;
+  size_t seen;
+  ushort up;
+    scan = job->scan;
+
+   /*this worker's bits - the first slice starts at base, the last ends at last*/
+    first = scan->first + job->worker * scan->slice;
+    last = ((scan->last - first) < scan->slice) ? scan->last : first + scan->slice - 1;
+    if(0 == job->worker)
+      first = scan->base;
+
+    if(RES_BITMAP_SCAN_COUNT == scan->op)
+    {
+      job->result = res_bitmap_count(scan->bitmap, first, last - first);
+      return;
+    }
+
+   /*check and find go a piece at a time, in case they can stop*/
+    step = scan->slice / RES_BITMAP_PARALLEL_STEPS;
+    step += BITS - step%BITS;
+    job->result = (RES_BITMAP_SCAN_FIND == scan->op) ? RES_BITMAP_ERR : res_bitmap_check(scan->bitmap, first, 0);
+    for(;;)
+    {
+      seen = atomic_load(&scan->done);
+      if(RES_BITMAP_SCAN_CHECK == scan->op)
+      {
+        if(0 != seen)
+        {
+          job->result = 2;  /*someone else found them varying*/
+          return;
+        }
+        up = res_bitmap_check(scan->bitmap, first, ((last - first) < step) ? last - first : step - 1);
+        if(up != job->result)
+        {
+          job->result = 2;
+          atomic_store(&scan->done, 1);
+          return;
+        }
+      } else {
+        if(seen < job->worker)
+          return;  /*a lower slice has one*/
+        if(1 != res_bitmap_check(scan->bitmap, first, ((last - first) < step) ? last - first : step - 1))
+        {
+         /*a free bit in this piece, so the first from here on is in it. Tell the workers above*/
+          job->result = res_bitmap_find_next_clear(scan->bitmap, first);
+          while((job->worker < seen) && (0 == atomic_compare_exchange_weak(&scan->done, &seen, job->worker)))
+            ;
+          return;
+        }
+      }
+      if((last - first) < step)
+        return;
+      first += step;
+    }
+}
@@ -0,0 +1,229 @@
+/* bitmap_rank.c - rank / select directory for bitmap.c, used to count the
+ *                 bits taken below a bit, and find the k-th taken bit,
+ *                 without reading the map up to it
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+
+/* The map is cut into superblocks of RES_BITMAP_RANK_SUPER bits, each cut
+ * into blocks of RES_BITMAP_RANK_BLOCK bits. super[s] is the number of bits
+ * taken before superblock s (super[supers] is the whole map), and block[b]
+ * the number taken between the start of b's superblock and the start of b -
+ * small enough for a uint16_t. rank is then two lookups and a popcount of
+ * less than a block. sample[j] is the superblock holding taken bit number
+ * j*RES_BITMAP_RANK_SAMPLE, which narrows select's search of super to a few
+ * superblocks.
+ *
+ * super[s] only depends on the superblocks before s, so a take or free just
+ * lowers valid to the superblock it touched - everything before that is
+ * still right. The next rank or select recounts from valid to the end, a
+ * vector popcount of each block, so a batch of changes costs one recount
+ * from the lowest of them.*/
+
+res_bitmap_rank_t* _res_bitmap_rank_create(res_bitmap_t* bitmap_handle)
+{
+  res_bitmap_rank_t* rank;
+    rank = malloc( sizeof(res_bitmap_rank_t) );
+    if(NULL == rank)
+      return(NULL);
+    rank->super = NULL;
+    rank->block = NULL;
+    rank->sample = NULL;
+    rank->capacity = 0;
+    rank->supers = 0;
+    if(0 != _res_bitmap_rank_reserve(rank, bitmap_handle->num_bits))
+    {
+      _res_bitmap_rank_destroy(rank);
+      return(NULL);
+    }
+
+   /*nothing counted yet - the first rank or select does it*/
+    rank->supers = _res_bitmap_rank_supers(bitmap_handle->num_bits);
+    rank->super[0] = 0;
+    rank->valid = 0;
+    rank->samples = 0;
+  return(rank);
+}
+
+void _res_bitmap_rank_destroy(res_bitmap_rank_t* rank)
+{
+  free(rank->super);
+  free(rank->block);
+  free(rank->sample);
+  free(rank);
+}
+
+size_t _res_bitmap_rank_supers(size_t num_bits)
+{
+  return(num_bits / RES_BITMAP_RANK_SUPER + 1);
+}
+
+ushort _res_bitmap_rank_reserve(res_bitmap_rank_t* rank, size_t num_bits)
+{
+  size_t *super;
+  uint16_t *block;
+  size_t *sample;
+  size_t supers;
+    supers = _res_bitmap_rank_supers(num_bits);
+    if(supers <= rank->capacity)
+      return(0);
+
+   /*super has one more entry than there are superblocks, for the total. There can't be more samples than superblocks*RES_BITMAP_RANK_SUPER/RES_BITMAP_RANK_SAMPLE*/
+    super = realloc( rank->super, (supers + 1) * sizeof(size_t) );
+    if(NULL == super)
+      return(2);
+    rank->super = super;
+    block = realloc( rank->block, supers * (RES_BITMAP_RANK_SUPER / RES_BITMAP_RANK_BLOCK) * sizeof(uint16_t) );
+    if(NULL == block)
+      return(2);
+    rank->block = block;
+    sample = realloc( rank->sample, (supers * (RES_BITMAP_RANK_SUPER / RES_BITMAP_RANK_SAMPLE) + 1) * sizeof(size_t) );
+    if(NULL == sample)
+      return(2);
+    rank->sample = sample;
+    rank->capacity = supers;
+  return(0);
+}
+
+void _res_bitmap_rank_resize(res_bitmap_rank_t* rank, size_t old_num_bits, size_t num_bits)
+{
+  rank->supers = _res_bitmap_rank_supers(num_bits);
+  _res_bitmap_rank_touch(rank, (num_bits < old_num_bits) ? num_bits : old_num_bits);  /*the superblock either size ends in changed, and any after it come or go*/
+}
+
+void _res_bitmap_rank_touch(res_bitmap_rank_t* rank, size_t bit)
+{
+  if(bit / RES_BITMAP_RANK_SUPER < rank->valid)
+    rank->valid = bit / RES_BITMAP_RANK_SUPER;
+}
+
+void _res_bitmap_rank_rebuild(res_bitmap_t* bitmap_handle)
+{
+  res_bitmap_rank_t *rank;
+  res_bitmap_word_t *bitmap;
+  size_t words;
+  size_t s;
+  size_t b;
+  size_t w;
+  size_t n;
+  size_t local;
+    rank = bitmap_handle->rank;
+    if(rank->valid > rank->supers)
+      rank->valid = rank->supers;
+    if(rank->valid == rank->supers)
+      return;
+    bitmap = bitmap_handle->base;
+    words = bitmap_handle->num_bits / BITS + 1;
+
+   /*samples at or past super[valid] may have moved*/
+    rank->samples = (rank->super[rank->valid] + RES_BITMAP_RANK_SAMPLE - 1) / RES_BITMAP_RANK_SAMPLE;
+
+    for(s=rank->valid; s<rank->supers; s++)
+    {
+      local = 0;
+      for(b=0; b<RES_BITMAP_RANK_SUPER / RES_BITMAP_RANK_BLOCK; b++)
+      {
+        rank->block[s * (RES_BITMAP_RANK_SUPER / RES_BITMAP_RANK_BLOCK) + b] = (uint16_t)local;
+        w = (s * RES_BITMAP_RANK_SUPER + b * RES_BITMAP_RANK_BLOCK) / BITS;
+        if(w >= words)
+          continue;  /*past the end of the map - nothing to count, but the entry keeps select's search of the blocks right*/
+        n = RES_BITMAP_RANK_BLOCK / BITS;
+        if(w + n > words)
+          n = words - w;
+        local += _res_bitmap_popcount(&bitmap[w], n);
+      }
+      rank->super[s + 1] = rank->super[s] + local;
+      while(rank->samples * RES_BITMAP_RANK_SAMPLE < rank->super[s + 1])
+        rank->sample[rank->samples++] = s;
+    }
+    rank->valid = rank->supers;
+}
+
+size_t _res_bitmap_rank_get(res_bitmap_t* bitmap_handle, size_t bit)
+{
+  res_bitmap_rank_t *rank;
+  res_bitmap_word_t *bitmap;
+  size_t b;
+  size_t w;
+  size_t r;
+    rank = bitmap_handle->rank;
+    _res_bitmap_rank_rebuild(bitmap_handle);
+    if(bit > bitmap_handle->num_bits)
+      return(rank->super[rank->supers]);
+
+   /*superblock, block, then whole words, then the part of bit's word below it*/
+    bitmap = bitmap_handle->base;
+    b = bit / RES_BITMAP_RANK_BLOCK;
+    r = rank->super[bit / RES_BITMAP_RANK_SUPER] + rank->block[b];
+    w = b * (RES_BITMAP_RANK_BLOCK / BITS);
+    r += _res_bitmap_popcount(&bitmap[w], bit / BITS - w);
+    if(0 != bit % BITS)
+      r += RES_BITMAP_POPCOUNT(bitmap[bit / BITS] & _res_bitmap_mask(0, bit % BITS - 1));
+  return(r);
+}
+
+size_t _res_bitmap_rank_select(res_bitmap_t* bitmap_handle, size_t k)
+{
+  res_bitmap_rank_t *rank;
+  res_bitmap_word_t *bitmap;
+  size_t lo;
+  size_t hi;
+  size_t mid;
+  size_t first;
+  size_t b;
+  size_t w;
+  size_t n;
+    rank = bitmap_handle->rank;
+    _res_bitmap_rank_rebuild(bitmap_handle);
+    if(k >= rank->super[rank->supers])
+      return(RES_BITMAP_ERR);
+
+   /*the samples either side of k bound its superblock - then the last superblock starting at or below k*/
+    lo = rank->sample[k / RES_BITMAP_RANK_SAMPLE];
+    hi = (k / RES_BITMAP_RANK_SAMPLE + 1 < rank->samples) ? rank->sample[k / RES_BITMAP_RANK_SAMPLE + 1] : rank->supers - 1;
+    while(lo < hi)
+    {
+      mid = lo + (hi - lo + 1) / 2;
+      if(rank->super[mid] <= k)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    k -= rank->super[lo];
+
+   /*same again for the blocks of that superblock*/
+    first = lo * (RES_BITMAP_RANK_SUPER / RES_BITMAP_RANK_BLOCK);
+    lo = 0;
+    hi = RES_BITMAP_RANK_SUPER / RES_BITMAP_RANK_BLOCK - 1;
+    while(lo < hi)
+    {
+      mid = lo + (hi - lo + 1) / 2;
+      if(rank->block[first + mid] <= k)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    b = first + lo;
+    k -= rank->block[b];
+
+   /*then word by word - k is now less than a block's worth*/
+    bitmap = bitmap_handle->base;
+    for(w=b * (RES_BITMAP_RANK_BLOCK / BITS); ; w++)
+    {
+      n = RES_BITMAP_POPCOUNT(bitmap[w]);
+      if(k < n)
+        break;
+      k -= n;
+    }
+  return(w * BITS + _res_bitmap_select_word(bitmap[w], k));
+}
@@ -0,0 +1,631 @@
+/* bitmap_simd.c - word-array kernels for bitmap.c, with run-time selection
+ *                of SIMD versions where the CPU supports them
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include "bitmap.h"
+
+/*SIMD kernels are only built for gcc-compatible compilers on x86-64, and can
+ * be turned off by defining RES_BITMAP_NO_SIMD. Everything else uses the
+ * portable versions*/
+#if defined(__GNUC__) && defined(__x86_64__) && defined(BITS_64) && !defined(RES_BITMAP_NO_SIMD)
+  #define RES_BITMAP_X86_DISPATCH
+  #include <immintrin.h>
+#endif
+
+ #define RES_BITMAP_SIMD_MIN_WORDS 16  /*below this many words, SIMD set-up costs more than it saves*/
+
+/*File-local kernels:*/
+ size_t _res_bitmap_popcount_generic(const res_bitmap_word_t* words, size_t n);
+#ifdef RES_BITMAP_X86_DISPATCH
+ __attribute__((target("popcnt"))) size_t _res_bitmap_popcount_popcnt(const res_bitmap_word_t* words, size_t n);
+ __attribute__((target("avx2"))) __m256i _res_bitmap_popcount_m256(__m256i v);
+ __attribute__((target("avx2"))) size_t _res_bitmap_popcount_avx2(const res_bitmap_word_t* words, size_t n);
+ __attribute__((target("avx512f,avx512vpopcntdq"))) size_t _res_bitmap_popcount_avx512(const res_bitmap_word_t* words, size_t n);
+ __attribute__((target("sse2"))) void _res_bitmap_combine_sse2(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);
+ __attribute__((target("avx2"))) void _res_bitmap_combine_avx2(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);
+ __attribute__((target("avx512f"))) void _res_bitmap_combine_avx512(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);
+ __attribute__((target("popcnt"))) size_t _res_bitmap_combine_count_popcnt(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);
+ __attribute__((target("avx2"))) size_t _res_bitmap_combine_count_avx2(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);
+ __attribute__((target("avx512f,avx512vpopcntdq"))) size_t _res_bitmap_combine_count_avx512(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);
+#endif
+ void _res_bitmap_combine_generic(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);
+ size_t _res_bitmap_combine_count_generic(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op);
+
+size_t _res_bitmap_popcount(const res_bitmap_word_t* words, size_t n)
+{
+  #ifdef RES_BITMAP_X86_DISPATCH
+   /*pick the widest kernel the CPU (and OS) supports - __builtin_cpu_supports is just a flag test*/
+    if(n >= RES_BITMAP_SIMD_MIN_WORDS)
+    {
+      if(__builtin_cpu_supports("avx512vpopcntdq"))
+        return(_res_bitmap_popcount_avx512(words, n));
+      if(__builtin_cpu_supports("avx2"))
+        return(_res_bitmap_popcount_avx2(words, n));
+    }
+    if(__builtin_cpu_supports("popcnt"))
+      return(_res_bitmap_popcount_popcnt(words, n));
+  #endif
+  return(_res_bitmap_popcount_generic(words, n));
+}
+
+void _res_bitmap_combine(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  #ifdef RES_BITMAP_X86_DISPATCH
+    if(n >= RES_BITMAP_SIMD_MIN_WORDS)
+    {
+      if(__builtin_cpu_supports("avx512f"))
+      {
+        _res_bitmap_combine_avx512(dest, a, b, n, op);
+        return;
+      }
+      if(__builtin_cpu_supports("avx2"))
+      {
+        _res_bitmap_combine_avx2(dest, a, b, n, op);
+        return;
+      }
+      _res_bitmap_combine_sse2(dest, a, b, n, op);  /*every x86-64 has SSE2*/
+      return;
+    }
+  #endif
+  _res_bitmap_combine_generic(dest, a, b, n, op);
+}
+
+size_t _res_bitmap_combine_count(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  #ifdef RES_BITMAP_X86_DISPATCH
+    if(n >= RES_BITMAP_SIMD_MIN_WORDS)
+    {
+      if(__builtin_cpu_supports("avx512vpopcntdq"))
+        return(_res_bitmap_combine_count_avx512(a, b, n, op));
+      if(__builtin_cpu_supports("avx2"))
+        return(_res_bitmap_combine_count_avx2(a, b, n, op));
+    }
+    if(__builtin_cpu_supports("popcnt"))
+      return(_res_bitmap_combine_count_popcnt(a, b, n, op));
+  #endif
+  return(_res_bitmap_combine_count_generic(a, b, n, op));
+}
+
+void _res_bitmap_combine_map(res_bitmap_word_t* dest, size_t dest_bits, const res_bitmap_word_t* a, size_t a_bits, const res_bitmap_word_t* b, size_t b_bits, ushort op)
+{
+  size_t last;
+  size_t n;
+  size_t i;
+   /*words every map has go through the kernel - but never dest's last, which may need masking*/
+    last = dest_bits / BITS;
+    n = last;
+    if(n > a_bits / BITS + 1)
+      n = a_bits / BITS + 1;
+    if(n > b_bits / BITS + 1)
+      n = b_bits / BITS + 1;
+    _res_bitmap_combine(dest, a, b, n, op);
+
+   /*past the end of a shorter map its bits are 0, as if resized up to dest's size. Longer ones are cut short*/
+    for(i=n; i<=last; i++)
+      dest[i] = _res_bitmap_combine_word((i <= a_bits / BITS) ? a[i] : 0, (i <= b_bits / BITS) ? b[i] : 0, op);
+    dest[last] &= (~(res_bitmap_word_t)0 >> (BITS - 1 - dest_bits%BITS));
+}
+
+size_t _res_bitmap_combine_map_count(const res_bitmap_word_t* a, size_t a_bits, const res_bitmap_word_t* b, size_t b_bits, ushort op)
+{
+  size_t last;
+  size_t n;
+  size_t i;
+  size_t count;
+    last = a_bits / BITS;
+    n = last;
+    if(n > b_bits / BITS + 1)
+      n = b_bits / BITS + 1;
+    count = _res_bitmap_combine_count(a, b, n, op);
+
+    for(i=n; i<last; i++)
+      count += RES_BITMAP_POPCOUNT(_res_bitmap_combine_word(a[i], (i <= b_bits / BITS) ? b[i] : 0, op));
+    count += RES_BITMAP_POPCOUNT(_res_bitmap_combine_word(a[last], (last <= b_bits / BITS) ? b[last] : 0, op) & (~(res_bitmap_word_t)0 >> (BITS - 1 - a_bits%BITS)));
+  return(count);
+}
+
+res_bitmap_word_t _res_bitmap_combine_word(res_bitmap_word_t a, res_bitmap_word_t b, ushort op)
+{
+  switch(op)
+  {
+    case RES_BITMAP_AND :
+      return(a & b);
+    case RES_BITMAP_OR :
+      return(a | b);
+    case RES_BITMAP_XOR :
+      return(a ^ b);
+    default :
+      return(a & ~b);  /*RES_BITMAP_ANDNOT*/
+  }
+}
+
+size_t _res_bitmap_popcount_word(res_bitmap_word_t word)
+{
+  /*SWAR popcount, for compilers without a builtin*/
+  word = word - ((word >> 1) & (res_bitmap_word_t)UINT64_C(0x5555555555555555));
+  word = (word & (res_bitmap_word_t)UINT64_C(0x3333333333333333)) + ((word >> 2) & (res_bitmap_word_t)UINT64_C(0x3333333333333333));
+  word = (word + (word >> 4)) & (res_bitmap_word_t)UINT64_C(0x0F0F0F0F0F0F0F0F);
+  return((size_t)((res_bitmap_word_t)(word * (res_bitmap_word_t)UINT64_C(0x0101010101010101)) >> (BITS - 8)));
+}
+
+size_t _res_bitmap_ctz_word(res_bitmap_word_t word)
+{
+  size_t n = 0;
+   /*skip a byte at a time, then a bit at a time*/
+    while(0 == (word & (res_bitmap_word_t)0xFF))
+    {
+      word >>= 8;
+      n += 8;
+    }
+    while(0 == (word & 1))
+    {
+      word >>= 1;
+      n++;
+    }
+  return(n);
+}
+
+size_t _res_bitmap_clz_word(res_bitmap_word_t word)
+{
+  size_t n = 0;
+  const res_bitmap_word_t top = (res_bitmap_word_t)1 << (BITS - 1);
+    while(0 == (word & ((res_bitmap_word_t)0xFF << (BITS - 8))))
+    {
+      word <<= 8;
+      n += 8;
+    }
+    while(0 == (word & top))
+    {
+      word <<= 1;
+      n++;
+    }
+  return(n);
+}
+
+size_t _res_bitmap_select_word(res_bitmap_word_t word, size_t r)
+{
+  size_t n = 0;
+  size_t c;
+   /*skip whole bytes holding r set bits or fewer, then knock off the r lowest set bits left*/
+    for(;;)
+    {
+      c = RES_BITMAP_POPCOUNT(word & (res_bitmap_word_t)0xFF);
+      if(c > r)
+        break;
+      r -= c;
+      word >>= 8;
+      n += 8;
+    }
+    for(; r>0; r--)
+      word &= word - 1;
+  return(n + RES_BITMAP_CTZ(word));
+}
+
+void _res_bitmap_free_runs(const res_bitmap_word_t* bitmap, size_t num_bits, res_bitmap_free_stats_t* stats)
+{
+  res_bitmap_word_t word;
+  size_t words;
+  size_t w;
+  size_t n;  /*bits of word w in the map*/
+  size_t pos;
+  size_t len;
+  size_t run = 0;  /*free bits so far in the run we're in*/
+    stats->free_bits = 0;
+    stats->runs = 0;
+    stats->largest = 0;
+    for(w=0; w<BITS; w++)
+      stats->histogram[w] = 0;
+
+    words = num_bits / BITS + 1;
+    for(w=0; w<words; w++)
+    {
+      n = (w == words - 1) ? num_bits % BITS + 1 : BITS;
+      word = ~bitmap[w];  /*free bits set*/
+      if(n < BITS)
+        word &= ~(res_bitmap_word_t)0 >> (BITS - n);
+
+     /*whole words free or taken are common - and a run may go on through many*/
+      if(0 == word)
+      {
+        if(0 != run)
+          _res_bitmap_free_run(stats, run);
+        run = 0;
+        continue;
+      }
+      if((n == BITS) && (~(res_bitmap_word_t)0 == word))
+      {
+        run += BITS;
+        continue;
+      }
+
+     /*otherwise hop from edge to edge*/
+      for(pos=0; pos<n; pos+=len)
+      {
+        if(0 != (word & 1))
+        {
+          len = RES_BITMAP_CTZ(~word);  /*word isn't all 1s - that was caught above, and the top bits are 0 once shifted*/
+          run += len;
+        } else {
+          if(0 != run)
+            _res_bitmap_free_run(stats, run);
+          run = 0;
+          len = (0 == word) ? n - pos : RES_BITMAP_CTZ(word);
+        }
+        if(len < BITS)
+          word >>= len;
+      }
+    }
+    if(0 != run)
+      _res_bitmap_free_run(stats, run);
+}
+
+void _res_bitmap_free_run(res_bitmap_free_stats_t* stats, size_t len)
+{
+  stats->free_bits += len;
+  stats->runs++;
+  stats->histogram[BITS - 1 - RES_BITMAP_CLZ((res_bitmap_word_t)len)]++;
+  if(len > stats->largest)
+    stats->largest = len;
+}
+
+ushort _res_bitmap_claim(res_bitmap_word_t* bitmap, size_t first, size_t last, size_t* conflict)
+{
+  res_bitmap_word_t mask;
+  size_t w;
+  size_t first_word;
+  size_t last_word;
+    first_word = first / BITS;
+    last_word = last / BITS;
+    for(w=first_word; w<=last_word; w++)
+    {
+      mask = ~(res_bitmap_word_t)0;
+      if(w == first_word)
+        mask &= ~(res_bitmap_word_t)0 << (first % BITS);
+      if(w == last_word)
+        mask &= ~(res_bitmap_word_t)0 >> (BITS - 1 - last % BITS);
+
+      if(0 != (bitmap[w] & mask))
+      {
+        *conflict = w * BITS + RES_BITMAP_CTZ(bitmap[w] & mask);
+       /*put back the words already set - all of them from first up*/
+        for(; w>first_word; w--)
+          bitmap[w-1] &= (w-1 == first_word) ? ~(~(res_bitmap_word_t)0 << (first % BITS)) : 0;
+        return(1);
+      }
+      bitmap[w] |= mask;
+    }
+  return(0);
+}
+
+size_t _res_bitmap_popcount_generic(const res_bitmap_word_t* words, size_t n)
+{
+  size_t i;
+  size_t count = 0;
+    for(i=0; i<n; i++)
+      count += RES_BITMAP_POPCOUNT(words[i]);
+  return(count);
+}
+
+void _res_bitmap_combine_generic(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  size_t i;
+   /*one loop per op, so the compiler can vectorise each on its own*/
+    switch(op)
+    {
+      case RES_BITMAP_AND :
+        for(i=0; i<n; i++)
+          dest[i] = a[i] & b[i];
+        break;
+      case RES_BITMAP_OR :
+        for(i=0; i<n; i++)
+          dest[i] = a[i] | b[i];
+        break;
+      case RES_BITMAP_XOR :
+        for(i=0; i<n; i++)
+          dest[i] = a[i] ^ b[i];
+        break;
+      default :
+        for(i=0; i<n; i++)
+          dest[i] = a[i] & ~b[i];
+    }
+}
+
+size_t _res_bitmap_combine_count_generic(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  size_t i;
+  size_t count = 0;
+    for(i=0; i<n; i++)
+      count += RES_BITMAP_POPCOUNT(_res_bitmap_combine_word(a[i], b[i], op));
+  return(count);
+}
+
+#ifdef RES_BITMAP_X86_DISPATCH
+
+/*the vector kernels below are all written the same way: one loop per op, a vector (2, 4 or 8 words) at a time, then the last few words one at a time.
+ * dest may be the same array as a or b - each vector is loaded before its result is stored*/
+#define RES_BITMAP_COMBINE_LOOP(width, load, store, expr) \
+  for(; i + (width) <= n; i += (width)) \
+  { \
+    va = load(a + i); \
+    vb = load(b + i); \
+    store(dest + i, expr); \
+  }
+
+__attribute__((target("sse2"))) void _res_bitmap_combine_sse2(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  __m128i va;
+  __m128i vb;
+  size_t i = 0;
+  #define RES_BITMAP_LOAD(p) _mm_loadu_si128((const __m128i*)(const void*)(p))
+  #define RES_BITMAP_STORE(p, v) _mm_storeu_si128((__m128i*)(void*)(p), (v))
+    switch(op)
+    {
+      case RES_BITMAP_AND :
+        RES_BITMAP_COMBINE_LOOP(2, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm_and_si128(va, vb));
+        break;
+      case RES_BITMAP_OR :
+        RES_BITMAP_COMBINE_LOOP(2, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm_or_si128(va, vb));
+        break;
+      case RES_BITMAP_XOR :
+        RES_BITMAP_COMBINE_LOOP(2, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm_xor_si128(va, vb));
+        break;
+      default :
+        RES_BITMAP_COMBINE_LOOP(2, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm_andnot_si128(vb, va));  /*andnot is ~first & second*/
+    }
+  #undef RES_BITMAP_LOAD
+  #undef RES_BITMAP_STORE
+    for(; i<n; i++)
+      dest[i] = _res_bitmap_combine_word(a[i], b[i], op);
+}
+
+__attribute__((target("avx2"))) void _res_bitmap_combine_avx2(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  __m256i va;
+  __m256i vb;
+  size_t i = 0;
+  #define RES_BITMAP_LOAD(p) _mm256_loadu_si256((const __m256i*)(const void*)(p))
+  #define RES_BITMAP_STORE(p, v) _mm256_storeu_si256((__m256i*)(void*)(p), (v))
+    switch(op)
+    {
+      case RES_BITMAP_AND :
+        RES_BITMAP_COMBINE_LOOP(4, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm256_and_si256(va, vb));
+        break;
+      case RES_BITMAP_OR :
+        RES_BITMAP_COMBINE_LOOP(4, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm256_or_si256(va, vb));
+        break;
+      case RES_BITMAP_XOR :
+        RES_BITMAP_COMBINE_LOOP(4, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm256_xor_si256(va, vb));
+        break;
+      default :
+        RES_BITMAP_COMBINE_LOOP(4, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm256_andnot_si256(vb, va));
+    }
+  #undef RES_BITMAP_LOAD
+  #undef RES_BITMAP_STORE
+    for(; i<n; i++)
+      dest[i] = _res_bitmap_combine_word(a[i], b[i], op);
+}
+
+__attribute__((target("avx512f"))) void _res_bitmap_combine_avx512(res_bitmap_word_t* dest, const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  __m512i va;
+  __m512i vb;
+  size_t i = 0;
+  #define RES_BITMAP_LOAD(p) _mm512_loadu_si512((const void*)(p))
+  #define RES_BITMAP_STORE(p, v) _mm512_storeu_si512((void*)(p), (v))
+    switch(op)
+    {
+      case RES_BITMAP_AND :
+        RES_BITMAP_COMBINE_LOOP(8, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm512_and_si512(va, vb));
+        break;
+      case RES_BITMAP_OR :
+        RES_BITMAP_COMBINE_LOOP(8, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm512_or_si512(va, vb));
+        break;
+      case RES_BITMAP_XOR :
+        RES_BITMAP_COMBINE_LOOP(8, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm512_xor_si512(va, vb));
+        break;
+      default :
+        RES_BITMAP_COMBINE_LOOP(8, RES_BITMAP_LOAD, RES_BITMAP_STORE, _mm512_andnot_si512(vb, va));
+    }
+  #undef RES_BITMAP_LOAD
+  #undef RES_BITMAP_STORE
+    for(; i<n; i++)
+      dest[i] = _res_bitmap_combine_word(a[i], b[i], op);
+}
+
+#undef RES_BITMAP_COMBINE_LOOP
+
+__attribute__((target("popcnt"))) size_t _res_bitmap_combine_count_popcnt(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  size_t i;
+  size_t count = 0;
+    for(i=0; i<n; i++)
+      count += (size_t)__builtin_popcountll(_res_bitmap_combine_word(a[i], b[i], op));
+  return(count);
+}
+
+__attribute__((target("avx2"))) size_t _res_bitmap_combine_count_avx2(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  __m256i total = _mm256_setzero_si256();
+  __m256i va;
+  __m256i vb;
+  __m256i v;
+  size_t i;
+  size_t count;
+   /*combine a vector, then count it with the nibble lookup - nothing is written back*/
+    for(i=0; i + 4 <= n; i += 4)
+    {
+      va = _mm256_loadu_si256((const __m256i*)(const void*)(a + i));
+      vb = _mm256_loadu_si256((const __m256i*)(const void*)(b + i));
+      switch(op)
+      {
+        case RES_BITMAP_AND :
+          v = _mm256_and_si256(va, vb);
+          break;
+        case RES_BITMAP_OR :
+          v = _mm256_or_si256(va, vb);
+          break;
+        case RES_BITMAP_XOR :
+          v = _mm256_xor_si256(va, vb);
+          break;
+        default :
+          v = _mm256_andnot_si256(vb, va);
+      }
+      total = _mm256_add_epi64(total, _res_bitmap_popcount_m256(v));
+    }
+    count = (size_t)_mm256_extract_epi64(total, 0) + (size_t)_mm256_extract_epi64(total, 1)
+          + (size_t)_mm256_extract_epi64(total, 2) + (size_t)_mm256_extract_epi64(total, 3);
+    for(; i<n; i++)
+      count += (size_t)__builtin_popcountll(_res_bitmap_combine_word(a[i], b[i], op));
+  return(count);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) size_t _res_bitmap_combine_count_avx512(const res_bitmap_word_t* a, const res_bitmap_word_t* b, size_t n, ushort op)
+{
+  __m512i total = _mm512_setzero_si512();
+  __m512i va;
+  __m512i vb;
+  __m512i v;
+  size_t i;
+  size_t count;
+    for(i=0; i + 8 <= n; i += 8)
+    {
+      va = _mm512_loadu_si512((const void*)(a + i));
+      vb = _mm512_loadu_si512((const void*)(b + i));
+      switch(op)
+      {
+        case RES_BITMAP_AND :
+          v = _mm512_and_si512(va, vb);
+          break;
+        case RES_BITMAP_OR :
+          v = _mm512_or_si512(va, vb);
+          break;
+        case RES_BITMAP_XOR :
+          v = _mm512_xor_si512(va, vb);
+          break;
+        default :
+          v = _mm512_andnot_si512(vb, va);
+      }
+      total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+    }
+    count = (size_t)_mm512_reduce_add_epi64(total);
+    for(; i<n; i++)
+      count += (size_t)__builtin_popcountll(_res_bitmap_combine_word(a[i], b[i], op));
+  return(count);
+}
+
+__attribute__((target("popcnt"))) size_t _res_bitmap_popcount_popcnt(const res_bitmap_word_t* words, size_t n)
+{
+  size_t i;
+  size_t count = 0;
+   /*same as the generic loop, but compiled so that the builtin becomes a single POPCNT*/
+    for(i=0; i<n; i++)
+      count += (size_t)__builtin_popcountll(words[i]);
+  return(count);
+}
+
+__attribute__((target("avx2"))) __m256i _res_bitmap_popcount_m256(__m256i v)
+{
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0F);
+  __m256i lo;
+  __m256i hi;
+   /*count each nibble with a table lookup, then sum the bytes into four 64-bit counts*/
+    lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+    hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+  return(_mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+}
+
+/*carry-save adder: h:l = a + b + c, bitwise*/
+#define RES_BITMAP_CSA(h, l, a, b, c) \
+  do { \
+    __m256i u_ = _mm256_xor_si256((a), (b)); \
+    (h) = _mm256_or_si256(_mm256_and_si256((a), (b)), _mm256_and_si256(u_, (c))); \
+    (l) = _mm256_xor_si256(u_, (c)); \
+  } while(0)
+
+__attribute__((target("avx2"))) size_t _res_bitmap_popcount_avx2(const res_bitmap_word_t* words, size_t n)
+{
+  const __m256i* v = (const __m256i*)(const void*)words;
+  size_t num_v;
+  size_t i;
+  size_t count;
+  __m256i total = _mm256_setzero_si256();
+  __m256i ones = _mm256_setzero_si256();
+  __m256i twos = _mm256_setzero_si256();
+  __m256i fours = _mm256_setzero_si256();
+  __m256i eights = _mm256_setzero_si256();
+  __m256i sixteens;
+  __m256i twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+    num_v = n / 4;  /*4 words per vector*/
+
+   /*Harley-Seal - 16 vectors at a time through a tree of carry-save adders, so only 1 in 16 vectors needs a full popcount*/
+    for(i=0; i + 16 <= num_v; i += 16)
+    {
+      RES_BITMAP_CSA(twos_a, ones, ones, _mm256_loadu_si256(v + i + 0), _mm256_loadu_si256(v + i + 1));
+      RES_BITMAP_CSA(twos_b, ones, ones, _mm256_loadu_si256(v + i + 2), _mm256_loadu_si256(v + i + 3));
+      RES_BITMAP_CSA(fours_a, twos, twos, twos_a, twos_b);
+      RES_BITMAP_CSA(twos_a, ones, ones, _mm256_loadu_si256(v + i + 4), _mm256_loadu_si256(v + i + 5));
+      RES_BITMAP_CSA(twos_b, ones, ones, _mm256_loadu_si256(v + i + 6), _mm256_loadu_si256(v + i + 7));
+      RES_BITMAP_CSA(fours_b, twos, twos, twos_a, twos_b);
+      RES_BITMAP_CSA(eights_a, fours, fours, fours_a, fours_b);
+      RES_BITMAP_CSA(twos_a, ones, ones, _mm256_loadu_si256(v + i + 8), _mm256_loadu_si256(v + i + 9));
+      RES_BITMAP_CSA(twos_b, ones, ones, _mm256_loadu_si256(v + i + 10), _mm256_loadu_si256(v + i + 11));
+      RES_BITMAP_CSA(fours_a, twos, twos, twos_a, twos_b);
+      RES_BITMAP_CSA(twos_a, ones, ones, _mm256_loadu_si256(v + i + 12), _mm256_loadu_si256(v + i + 13));
+      RES_BITMAP_CSA(twos_b, ones, ones, _mm256_loadu_si256(v + i + 14), _mm256_loadu_si256(v + i + 15));
+      RES_BITMAP_CSA(fours_b, twos, twos, twos_a, twos_b);
+      RES_BITMAP_CSA(eights_b, fours, fours, fours_a, fours_b);
+      RES_BITMAP_CSA(sixteens, eights, eights, eights_a, eights_b);
+      total = _mm256_add_epi64(total, _res_bitmap_popcount_m256(sixteens));
+    }
+
+   /*weight the partial sums*/
+    total = _mm256_slli_epi64(total, 4);
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(_res_bitmap_popcount_m256(eights), 3));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(_res_bitmap_popcount_m256(fours), 2));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(_res_bitmap_popcount_m256(twos), 1));
+    total = _mm256_add_epi64(total, _res_bitmap_popcount_m256(ones));
+
+   /*left-over vectors*/
+    for(; i<num_v; i++)
+      total = _mm256_add_epi64(total, _res_bitmap_popcount_m256(_mm256_loadu_si256(v + i)));
+
+    count = (size_t)_mm256_extract_epi64(total, 0) + (size_t)_mm256_extract_epi64(total, 1)
+          + (size_t)_mm256_extract_epi64(total, 2) + (size_t)_mm256_extract_epi64(total, 3);
+
+   /*left-over words*/
+    for(i=num_v*4; i<n; i++)
+      count += (size_t)__builtin_popcountll(words[i]);
+  return(count);
+}
+
+#undef RES_BITMAP_CSA
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) size_t _res_bitmap_popcount_avx512(const res_bitmap_word_t* words, size_t n)
+{
+  __m512i total = _mm512_setzero_si512();
+  size_t i;
+  __mmask8 tail;
+   /*VPOPCNTQ counts each 64-bit lane directly - 8 words per instruction*/
+    for(i=0; i + 8 <= n; i += 8)
+      total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512((const void*)(words + i))));
+
+   /*masked load for the last few words, so there's no scalar tail*/
+    if(i < n)
+    {
+      tail = (__mmask8)((1u << (n - i)) - 1);
+      total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(tail, (const void*)(words + i))));
+    }
+  return((size_t)_mm512_reduce_add_epi64(total));
+}
+
+#endif
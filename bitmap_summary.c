@@ -0,0 +1,245 @@
+/* bitmap_summary.c - hierarchical summary index for bitmap.c, used to find
+ *                    free bits in huge, mostly-full maps without reading
+ *                    every word
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+
+/* Level 0 of the summary has one bit per bitmap word, level 1 has one bit per
+ * level 0 word, and so on up to a level that fits in a single word. A bit is
+ * set when there is at least one free bit somewhere below it. Bits past the
+ * end of a level are always 0, and bits past num_bits in the map itself count
+ * as taken.*/
+
+ushort _res_bitmap_summary_levels(size_t num_bits, size_t* words)
+{
+  ushort levels = 0;
+  size_t units;
+   /*units at level 0 are bitmap words*/
+    units = (num_bits / BITS) + 1;
+    do
+    {
+      words[levels] = ((units - 1) / BITS) + 1;
+      units = words[levels];
+      levels++;
+    } while((units > 1) && (levels < RES_BITMAP_SUMMARY_LEVELS));
+  return(levels);
+}
+
+res_bitmap_summary_t* _res_bitmap_summary_create(res_bitmap_t* bitmap_handle)
+{
+  res_bitmap_summary_t* summary;
+  ushort l;
+    summary = malloc( sizeof(res_bitmap_summary_t) );
+    if(NULL == summary)
+      return(NULL);
+
+   /*allocate each level*/
+    summary->levels = _res_bitmap_summary_levels(bitmap_handle->num_bits, summary->words);
+    for(l=0; l<summary->levels; l++)
+    {
+      summary->level[l] = calloc( summary->words[l], sizeof(res_bitmap_word_t) );
+      summary->capacity[l] = summary->words[l];
+      if(NULL == summary->level[l])
+      {
+        summary->levels = l;
+        _res_bitmap_summary_destroy(summary);
+        return(NULL);
+      }
+    }
+    for(; l<RES_BITMAP_SUMMARY_LEVELS; l++)
+    {
+      summary->level[l] = NULL;
+      summary->capacity[l] = 0;
+    }
+
+   /*fill in from the map*/
+    _res_bitmap_summary_rebuild(bitmap_handle, summary);
+  return(summary);
+}
+
+void _res_bitmap_summary_destroy(res_bitmap_summary_t* summary)
+{
+  ushort l;
+    for(l=0; l<RES_BITMAP_SUMMARY_LEVELS; l++)
+      free(summary->level[l]);  /*unused levels are NULL*/
+    free(summary);
+}
+
+void _res_bitmap_summary_rebuild(res_bitmap_t* bitmap_handle, res_bitmap_summary_t* summary)
+{
+  ushort l;
+  size_t i;
+  size_t units;
+    units = (bitmap_handle->num_bits / BITS) + 1;
+    for(l=0; l<summary->levels; l++)
+    {
+      memset(summary->level[l], 0x00, summary->words[l] * sizeof(res_bitmap_word_t));
+      for(i=0; i<units; i++)
+        if(0 != _res_bitmap_summary_bit(bitmap_handle, summary, l, i))
+          summary->level[l][i/BITS] |= (res_bitmap_word_t)1 << (i%BITS);
+      units = summary->words[l];
+    }
+}
+
+ushort _res_bitmap_summary_bit(res_bitmap_t* bitmap_handle, res_bitmap_summary_t* summary, ushort level, size_t unit)
+{
+  res_bitmap_word_t word;
+   /*upper levels - any bit set in the word below*/
+    if(0 != level)
+      return(0 != summary->level[level-1][unit]);
+
+   /*level 0 - any bit clear in the bitmap word, counting bits past num_bits as taken*/
+    word = ((res_bitmap_word_t*)bitmap_handle->base)[unit];
+    if(unit == bitmap_handle->num_bits / BITS)
+      word |= ~_res_bitmap_mask(0, bitmap_handle->num_bits % BITS);
+  return(~(res_bitmap_word_t)0 != word);
+}
+
+void _res_bitmap_summary_update(res_bitmap_t* bitmap_handle, size_t first_word, size_t last_word, ushort up)
+{
+  res_bitmap_summary_t* summary;
+  res_bitmap_word_t bit;
+  res_bitmap_word_t old;
+  size_t i;
+  ushort l;
+    summary = bitmap_handle->summary;
+    for(l=0; l<summary->levels; l++)
+    {
+     /*words strictly between first and last are either all taken (no free bits) or all free*/
+      if(last_word - first_word > 1)
+      {
+        if(2 == up)
+        {
+          for(i=first_word+1; i<last_word; i++)
+          {
+            bit = (res_bitmap_word_t)1 << (i%BITS);
+            if(0 != _res_bitmap_summary_bit(bitmap_handle, summary, l, i))
+              summary->level[l][i/BITS] |= bit;
+            else
+              summary->level[l][i/BITS] &= ~bit;
+          }
+        } else {
+          _res_bitmap_mark(summary->level[l], first_word+1, last_word-1, (0 == up) ? 1 : 0);
+        }
+      }
+
+     /*first and last always worked out from the level below*/
+      old = summary->level[l][first_word/BITS];
+      bit = (res_bitmap_word_t)1 << (first_word%BITS);
+      if(0 != _res_bitmap_summary_bit(bitmap_handle, summary, l, first_word))
+        summary->level[l][first_word/BITS] |= bit;
+      else
+        summary->level[l][first_word/BITS] &= ~bit;
+      if(last_word != first_word)
+      {
+        bit = (res_bitmap_word_t)1 << (last_word%BITS);
+        if(0 != _res_bitmap_summary_bit(bitmap_handle, summary, l, last_word))
+          summary->level[l][last_word/BITS] |= bit;
+        else
+          summary->level[l][last_word/BITS] &= ~bit;
+      }
+
+     /*single bit that didn't change - nothing above can have changed either*/
+      if((2 != up) && (first_word == last_word) && (old == summary->level[l][first_word/BITS]))
+        return;
+
+      first_word /= BITS;
+      last_word /= BITS;
+    }
+}
+
+size_t _res_bitmap_summary_next(res_bitmap_summary_t* summary, ushort level, size_t unit)
+{
+  res_bitmap_word_t word;
+  size_t w;
+    w = unit / BITS;
+    if(w >= summary->words[level])
+      return(RES_BITMAP_ERR);
+
+   /*anything at or after unit in this word?*/
+    word = summary->level[level][w] & _res_bitmap_mask(unit%BITS, BITS-1);
+    if(0 != word)
+      return(w * BITS + RES_BITMAP_CTZ(word));
+
+   /*no - ask the level above for the next word here with anything in it*/
+    if(level + 1 >= summary->levels)
+      return(RES_BITMAP_ERR);
+    w = _res_bitmap_summary_next(summary, (ushort)(level + 1), w + 1);
+    if(RES_BITMAP_ERR == w)
+      return(RES_BITMAP_ERR);
+  return(w * BITS + RES_BITMAP_CTZ(summary->level[level][w]));
+}
+
+ushort _res_bitmap_summary_reserve(res_bitmap_summary_t* summary, size_t num_bits)
+{
+  size_t words[RES_BITMAP_SUMMARY_LEVELS];
+  res_bitmap_word_t* level;
+  ushort levels;
+  ushort l;
+   /*make sure each level has room for num_bits - nothing else changes, so the summary stays valid for the old size if the caller fails later*/
+    levels = _res_bitmap_summary_levels(num_bits, words);
+    for(l=0; l<levels; l++)
+    {
+      if(words[l] <= summary->capacity[l])
+        continue;
+      level = realloc( summary->level[l], words[l] * sizeof(res_bitmap_word_t) );
+      if(NULL == level)
+        return(2);
+      memset(level + summary->capacity[l], 0x00, (words[l] - summary->capacity[l]) * sizeof(res_bitmap_word_t));
+      summary->level[l] = level;
+      summary->capacity[l] = words[l];
+    }
+  return(0);
+}
+
+void _res_bitmap_summary_commit(res_bitmap_t* bitmap_handle, size_t old_num_bits)
+{
+  res_bitmap_summary_t* summary;
+  size_t words[RES_BITMAP_SUMMARY_LEVELS];
+  size_t units;
+  size_t old_last;
+  size_t new_last;
+  ushort levels;
+  ushort l;
+    summary = bitmap_handle->summary;
+    levels = _res_bitmap_summary_levels(bitmap_handle->num_bits, words);
+
+   /*different number of levels - just start again, this only happens when the size crosses a power of BITS*/
+    if(levels != summary->levels)
+    {
+      summary->levels = levels;
+      memcpy(summary->words, words, sizeof(words));
+      _res_bitmap_summary_rebuild(bitmap_handle, summary);
+      return;
+    }
+
+   /*same shape - zero any new words (old contents past the end may be stale from an earlier shrink), and clear bits past the end of each level*/
+    units = (bitmap_handle->num_bits / BITS) + 1;
+    for(l=0; l<levels; l++)
+    {
+      if(words[l] > summary->words[l])
+        memset(summary->level[l] + summary->words[l], 0x00, (words[l] - summary->words[l]) * sizeof(res_bitmap_word_t));
+      summary->level[l][words[l]-1] &= _res_bitmap_mask(0, (units-1)%BITS);
+      summary->words[l] = words[l];
+      units = words[l];
+    }
+
+   /*then update from the old last word to the new one. Words in between are new, and so free*/
+    old_last = old_num_bits / BITS;
+    new_last = bitmap_handle->num_bits / BITS;
+    if(new_last > old_last)
+      _res_bitmap_summary_update(bitmap_handle, old_last, new_last, 0);
+    else
+      _res_bitmap_summary_update(bitmap_handle, new_last, new_last, 2);
+}
@@ -1,7 +1,11 @@
 /* bitmap_test.c - unit tests for bitmap.c
  *
  * REQUIRES: bitmap_1
- * TESTS: bitmap_1.0
+ * TESTS: bitmap_1.13
+ *
+ * Also built against tree-1 (compile with RES_BITMAP_TREE), as
+ * bitmap_test_tree - only reff-1's white box checks and file-backed maps are
+ * left out.
  *
  * This file is released into the public domain, and permission is granted
  * to use, modify, and / or redistribute at will. This software is provided
@@ -13,17 +17,48 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <errno.h>
 #include <assert.h>
 #include <time.h>
 #include "bitmap.h"
 #include "res_err.h"
 
+#if !defined(RES_BITMAP_BUDDY) && !defined(RES_BITMAP_TREE)
+ #define RES_BITMAP_TEST_REFF  /*white box checks of reff-1's handle, skipped for other implementations*/
+#endif
+#ifndef RES_BITMAP_MAP_MIN
+ #define RES_BITMAP_MAP_MIN 262144  /*implementations that never map memory get the same big resizes*/
+#endif
+
+#define RANK_MAP_BITS 65536  /*random rank maps are up to 5 times this - reff-1's superblock, so they cross several*/
+
   int main(void);
   int create_destroy(void);
   int free_take_check_count(void);
   int test_alloc(void);  /*named test_... because alloc is already a function name, don't want to cause problems if linked against stdlib*/
   int resize(void);
+  int summary(void);
+  int policy(void);
+  int extents(void);
+  int aligned(void);
+  int batch(void);
+  int find_iterate(void);
+  int combine(void);
+  int file(void);  /*tree-1 can't be file-backed, so just checks the file functions fail*/
+  int rank_select(void);
+  int free_stats(void);
+  int reserve(void);
+  int delta(void);
+  int parallel(void);
+  ushort combine_bit(ushort a, ushort b, ushort op);  /*one bit of a op b, the slow way*/
+  size_t free_run(unsigned char* shadow, size_t size, size_t i);  /*length of the run of 0's starting at shadow[i], stopping at size*/
+  ushort same_map(res_bitmap_t* a, res_bitmap_t* b, size_t num_bits);  /*1 if a and b both have num_bits and the same bits taken*/
+#ifdef RES_BITMAP_TEST_REFF
+  ushort page_dirty(res_bitmap_t* bitmap, size_t offset);  /*1 if the page of bitmap's file holding byte offset is waiting for a sync, else 0*/
+  ushort file_clean(res_bitmap_t* bitmap);  /*1 if no page of bitmap's file is waiting for a sync, else 0*/
+#endif
+  size_t send_delta(res_bitmap_t* src, res_bitmap_t** dest, size_t dests, size_t size);  /*exports src's changes size words at a time and applies them to each of dest, until there are none left. Returns number of exports*/
   void print_bitmap(res_bitmap_t* bitmap); /*print_ functions used for debugging, not in tests*/
   void print_bitmap_2(res_bitmap_t* bitmap);
   
@@ -62,6 +97,110 @@ int main()
       return(EXIT_FAILURE);
     }
 
+   /*summary index*/
+    printf("05 - summary index\n");
+    if( 0 != summary() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*allocation policies*/
+    printf("06 - allocation policies\n");
+    if( 0 != policy() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*best & worst fit, extent index*/
+    printf("07 - best & worst fit, extent index\n");
+    if( 0 != extents() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*aligned alloc*/
+    printf("08 - aligned alloc\n");
+    if( 0 != aligned() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*alloc_many, free_many*/
+    printf("09 - batch alloc & free\n");
+    if( 0 != batch() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*find_next / find_prev, iterators*/
+    printf("10 - find & iterate\n");
+    if( 0 != find_iterate() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*and / or / xor / andnot between maps*/
+    printf("11 - boolean operations between bitmaps\n");
+    if( 0 != combine() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*maps in memory mapped files*/
+    printf("12 - file-backed bitmaps\n");
+    if( 0 != file() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*rank & select*/
+    printf("13 - rank & select\n");
+    if( 0 != rank_select() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*free run statistics*/
+    printf("14 - free run statistics\n");
+    if( 0 != free_stats() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*several ranges, all or nothing*/
+    printf("15 - multi-range reserve\n");
+    if( 0 != reserve() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*dirty tracking & deltas*/
+    printf("16 - dirty tracking & deltas\n");
+    if( 0 != delta() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*parallel scans*/
+    printf("17 - parallel count, check & find\n");
+    if( 0 != parallel() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
   printf("ALL TESTS PASSED!\n");
   return(EXIT_SUCCESS);
 }
@@ -106,6 +245,9 @@ int free_take_check_count()
   uint16_t taken_array[500];
   size_t i;
   size_t j;
+  size_t base;
+  size_t limit;
+  size_t expected;
    /*create bitmap - size 2001*/
     printf("\tcreating new bitmap, size 2001... ");
     bitmap1 = res_bitmap_create(2000);
@@ -351,6 +493,45 @@ int free_take_check_count()
     assert(0 == res_bitmap_destroy(bitmap1));
     printf("Good!\n");
 
+   /*long ranges spanning many whole words, not aligned at either end*/
+    printf("\ttesting long multi-word ranges... ");
+    bitmap1 = res_bitmap_create(999999);
+    assert(NULL != bitmap1);
+    assert(0 == res_bitmap_take(bitmap1, 37, 900000));
+    assert(1 == res_bitmap_check(bitmap1, 37, 900000));
+    assert(0 == res_bitmap_check(bitmap1, 0, 36));
+    assert(0 == res_bitmap_check(bitmap1, 900038, 999999 - 900038));
+    assert(2 == res_bitmap_check(bitmap1, 36, 900001));
+    assert(2 == res_bitmap_check(bitmap1, 37, 900001));
+    assert(900001 == res_bitmap_count(bitmap1, 0, 999999));
+    assert(0 == res_bitmap_free(bitmap1, 1001, 500000));
+    assert(0 == res_bitmap_check(bitmap1, 1001, 500000));
+    assert(1 == res_bitmap_check(bitmap1, 37, 963));
+    assert(1 == res_bitmap_check(bitmap1, 501002, 399035));
+    assert(400000 == res_bitmap_count(bitmap1, 0, 999999));
+    assert(0 == res_bitmap_take(bitmap1, 0, 999999));
+    assert(1 == res_bitmap_check(bitmap1, 0, 999999));
+    assert(0 == res_bitmap_free(bitmap1, 0, 999999));
+    assert(0 == res_bitmap_check(bitmap1, 0, 999999));
+    printf("Good!\n");
+
+   /*counts over random ranges of a random map, against a bit-by-bit count*/
+    printf("\ttesting count over random ranges... ");
+    for(i=0; i<20000; i++)
+      assert(0 == res_bitmap_take(bitmap1, (unsigned)rand() % 100000, 0));
+    for(i=0; i<200; i++)
+    {
+      base = (unsigned)rand() % 100000;
+      limit = (unsigned)rand() % (100000 - base);
+      expected = 0;
+      for(j=base; j<=(base+limit); j++)
+        if(1 == res_bitmap_check(bitmap1, j, 0))
+          expected++;
+      assert(expected == res_bitmap_count(bitmap1, base, limit));
+    }
+    assert(0 == res_bitmap_destroy(bitmap1));
+    printf("Good!\n");
+
   return(0);
 }
 
@@ -359,6 +540,9 @@ int test_alloc()
   res_bitmap_t* bitmap1;
   size_t i;
   size_t j;
+  size_t k;
+  size_t size;
+  size_t expected;
   size_t alloc_array[6];
    /*create bitmap - size 2001*/
     printf("\tcreating new bitmap, size 2001... ");
@@ -431,6 +615,34 @@ int test_alloc()
     printf("\tdestroying bitmap... ");
     assert(0 == res_bitmap_destroy(bitmap1));
     printf("Good!\n");
+
+  /*first fit - alloc must find the same block as checking every start in turn*/
+    printf("\tchecking alloc against a bit-by-bit first fit... ");
+    bitmap1 = res_bitmap_create(4999);
+    assert(NULL != bitmap1);
+    for(k=0; k<300; k++)
+    {
+      /*random holes of random sizes - denser as we go*/
+      assert(0 == res_bitmap_free(bitmap1, 0, 4999));
+      for(i=0; i<k*10; i++)
+      {
+        j = (unsigned)rand() % 4990;
+        assert(0 == res_bitmap_take(bitmap1, j, (unsigned)rand() % 8));
+      }
+      size = ((0 == k%3) ? (unsigned)rand() % 8 : (unsigned)rand() % 200);
+      expected = RES_BITMAP_ERR;
+      for(i=0; i<=(4999 - size); i++)
+        if(0 == res_bitmap_check(bitmap1, i, size))
+        {
+          expected = i;
+          break;
+        }
+      assert(expected == res_bitmap_alloc(bitmap1, size));
+      if(RES_BITMAP_ERR != expected)
+        assert(1 == res_bitmap_check(bitmap1, expected, size));
+    }
+    assert(0 == res_bitmap_destroy(bitmap1));
+    printf("Good!\n");
     
   /*NOTE that we do NOT test if the allocator can find space in hard conditions
    * (eg only one match). This is because allocators may be designed to be fast
@@ -483,10 +695,1453 @@ int resize(void)
     assert( 1 == res_bitmap_check(bitmap1, 57, 0) );
     printf("Good!\n");
 
+   /*big maps are mapped rather than malloc'd - crossing over and back, and growing and shrinking while mapped*/
+    printf("\tresizing past RES_BITMAP_MAP_MIN and back... ");
+    assert( 0 == res_bitmap_resize(bitmap1, (size_t)RES_BITMAP_MAP_MIN * 8 * 4 - 1) );
+    assert( 4 == res_bitmap_count(bitmap1, 0, (size_t)RES_BITMAP_MAP_MIN * 8 * 4 - 1) );
+    assert( 1 == res_bitmap_check(bitmap1, 57, 0) );
+    assert( 0 == res_bitmap_take(bitmap1, (size_t)RES_BITMAP_MAP_MIN * 8 * 2, 99999) );
+    assert( 0 == res_bitmap_resize(bitmap1, (size_t)RES_BITMAP_MAP_MIN * 8 * 16 - 1) );
+    assert( 100004 == res_bitmap_count(bitmap1, 0, (size_t)RES_BITMAP_MAP_MIN * 8 * 16 - 1) );
+    assert( 0 == res_bitmap_resize(bitmap1, (size_t)RES_BITMAP_MAP_MIN * 8 * 2 + 4999) );  /*ends part way into a page*/
+    assert( 5004 == res_bitmap_count(bitmap1, 0, (size_t)RES_BITMAP_MAP_MIN * 8 * 2 + 4999) );
+    assert( 0 == res_bitmap_resize(bitmap1, (size_t)RES_BITMAP_MAP_MIN * 8 * 4 - 1) );
+    assert( 0 == res_bitmap_check(bitmap1, (size_t)RES_BITMAP_MAP_MIN * 8 * 2 + 5000, (size_t)RES_BITMAP_MAP_MIN * 8 * 2 - 5001) );  /*cut off bits didn't come back*/
+    assert( 0 == res_bitmap_resize(bitmap1, 57) );
+    assert( 4 == res_bitmap_count(bitmap1, 0, 57) );
+    printf("Good!\n");
+
    /*destroy the bitmap*/
     printf("\tdestroying bitmap... ");
     assert(0 == res_bitmap_destroy(bitmap1));
     printf("Good!\n");
+
+   /*a huge map costs nothing until it's used*/
+    printf("\tcreating a 2^30 bit bitmap, touching both ends... ");
+    bitmap1 = res_bitmap_create(((size_t)1 << 30) - 1);
+    assert(NULL != bitmap1);
+    assert(0 == res_bitmap_take(bitmap1, 0, 0));
+    assert(0 == res_bitmap_take(bitmap1, ((size_t)1 << 30) - 1, 0));
+    assert(1 == res_bitmap_alloc(bitmap1, 0));
+    assert(2 == res_bitmap_check(bitmap1, ((size_t)1 << 30) - 2, 1));
+    assert(0 == res_bitmap_resize(bitmap1, ((size_t)1 << 31) - 1));
+    assert(1 == res_bitmap_check(bitmap1, ((size_t)1 << 30) - 1, 0));
+    assert(0 == res_bitmap_check(bitmap1, (size_t)1 << 30, ((size_t)1 << 30) - 1));
+    assert(0 == res_bitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int summary(void)
+{
+  res_bitmap_t *plain;
+  res_bitmap_t *indexed;
+  size_t i;
+  size_t base;
+  size_t limit;
+  size_t size;
+  size_t sizes[5] = {70000, 262143, 262144, 300000, 1000};  /*crosses the point where a 2nd summary level is needed*/
+   /*bad options*/
+    printf("\tcreating bitmap with unknown option... ");
+    errno = 0;
+    assert(NULL == res_bitmap_create_opts(100, 0x8000));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+   /*the summary must never change the answer - run the same random operations on an indexed and a plain map*/
+    printf("\tcreating plain and indexed bitmaps... ");
+    plain = res_bitmap_create(99999);
+    indexed = res_bitmap_create_opts(99999, RES_BITMAP_OPT_SUMMARY);
+    assert(NULL != plain);
+    assert(NULL != indexed);
+    printf("Good!\n");
+
+    printf("\tcomparing random take, free, alloc & resize... ");
+    for(i=0; i<30000; i++)
+    {
+      size = res_bitmap_get_size(plain);
+      assert(size == res_bitmap_get_size(indexed));
+      switch(rand() % 8)
+      {
+        case 0 :  /*take a range - more takes than frees, so the maps fill up*/
+        case 1 :
+        case 2 :
+          base = (unsigned)rand() % (size + 1);
+          limit = (unsigned)rand() % 2000;
+          if(limit > size - base)
+            limit = size - base;
+          assert(0 == res_bitmap_take(plain, base, limit));
+          assert(0 == res_bitmap_take(indexed, base, limit));
+          break;
+        case 3 :  /*free a range*/
+          base = (unsigned)rand() % (size + 1);
+          limit = (unsigned)rand() % 1000;
+          if(limit > size - base)
+            limit = size - base;
+          assert(0 == res_bitmap_free(plain, base, limit));
+          assert(0 == res_bitmap_free(indexed, base, limit));
+          break;
+        case 4 :  /*alloc*/
+        case 5 :
+        case 6 :
+          limit = (0 == rand() % 2) ? (unsigned)rand() % 4 : (unsigned)rand() % 300;
+          assert(res_bitmap_alloc(plain, limit) == res_bitmap_alloc(indexed, limit));
+          break;
+        default :  /*resize, now and again*/
+          if(0 != rand() % 200)
+            break;
+          size = sizes[(unsigned)rand() % 5];
+          assert(0 == res_bitmap_resize(plain, size));
+          assert(0 == res_bitmap_resize(indexed, size));
+          assert(0 == res_bitmap_free(plain, 0, size));  /*empty the map out, so the allocs are interesting at each size*/
+          assert(0 == res_bitmap_free(indexed, 0, size));
+      }
+    }
+    assert(res_bitmap_count(plain, 0, res_bitmap_get_size(plain)) == res_bitmap_count(indexed, 0, res_bitmap_get_size(indexed)));
+    printf("Good!\n");
+
+   /*a full map with one free bit near the end*/
+    printf("\tsingle free bit in a full map... ");
+    assert(0 == res_bitmap_resize(indexed, 999999));
+    assert(0 == res_bitmap_take(indexed, 0, 999999));
+    assert(RES_BITMAP_ERR == res_bitmap_alloc(indexed, 0));
+    assert(0 == res_bitmap_free(indexed, 999000, 0));
+    assert(999000 == res_bitmap_alloc(indexed, 0));
+    assert(RES_BITMAP_ERR == res_bitmap_alloc(indexed, 0));
+    assert(0 == res_bitmap_resize(indexed, 1000000));  /*new bit at the end is free*/
+    assert(1000000 == res_bitmap_alloc(indexed, 0));
+    printf("Good!\n");
+
+    printf("\tdestroying bitmaps... ");
+    assert(0 == res_bitmap_destroy(plain));
+    assert(0 == res_bitmap_destroy(indexed));
+    printf("Good!\n");
+  return(0);
+}
+
+int policy(void)
+{
+  res_bitmap_t *bitmap1;
+   /*create bitmap*/
+    printf("\tcreating new bitmap, size 100... ");
+    bitmap1 = res_bitmap_create(99);
+    assert(NULL != bitmap1);
+    assert(2 == res_bitmap_set_policy(bitmap1, 0xFF));
+    assert(0 == res_bitmap_set_policy(bitmap1, RES_BITMAP_WORST_FIT));
+    assert(0 == res_bitmap_set_policy(bitmap1, RES_BITMAP_NEXT_FIT));
+    printf("Good!\n");
+
+   /*next fit carries on after the last block, even with space lower down*/
+    printf("\tnext fit from the cursor... ");
+    assert(0 == res_bitmap_alloc(bitmap1, 0));
+    assert(1 == res_bitmap_alloc(bitmap1, 0));
+    assert(2 == res_bitmap_alloc(bitmap1, 0));
+    assert(0 == res_bitmap_free(bitmap1, 0, 0));
+    assert(3 == res_bitmap_alloc(bitmap1, 0));
+    printf("Good!\n");
+
+   /*freeing the last block moves the cursor back over it*/
+    printf("\tfreeing the last block allocated... ");
+    assert(0 == res_bitmap_free(bitmap1, 3, 0));
+    assert(3 == res_bitmap_alloc(bitmap1, 0));
+    printf("Good!\n");
+
+   /*wraps round when there's nothing after the cursor*/
+    printf("\twrapping round... ");
+    assert(0 == res_bitmap_take(bitmap1, 4, 95));
+    assert(0 == res_bitmap_alloc(bitmap1, 0));
+    assert(RES_BITMAP_ERR == res_bitmap_alloc(bitmap1, 0));
+    assert(RES_ERR_NO_MATCH == errno);
+    assert(0 == res_bitmap_free(bitmap1, 0, 99));
+    assert(0 == res_bitmap_alloc(bitmap1, 59));
+    assert(0 == res_bitmap_free(bitmap1, 0, 49));
+    assert(0 == res_bitmap_alloc(bitmap1, 44));  /*only 40 bits free after the cursor*/
+    assert(1 == res_bitmap_check(bitmap1, 0, 44));
+    assert(0 == res_bitmap_check(bitmap1, 45, 4));
+    printf("Good!\n");
+
+   /*resizing below the cursor wraps it round*/
+    printf("\tresizing below the cursor... ");
+    assert(0 == res_bitmap_free(bitmap1, 0, 99));
+    assert(0 == res_bitmap_alloc(bitmap1, 79));
+    assert(0 == res_bitmap_resize(bitmap1, 49));
+    assert(0 == res_bitmap_free(bitmap1, 10, 4));
+    assert(10 == res_bitmap_alloc(bitmap1, 0));
+    printf("Good!\n");
+
+   /*back to first fit*/
+    printf("\tfirst fit... ");
+    assert(0 == res_bitmap_set_policy(bitmap1, RES_BITMAP_FIRST_FIT));
+    assert(0 == res_bitmap_free(bitmap1, 0, 49));
+    assert(0 == res_bitmap_alloc(bitmap1, 0));
+    assert(1 == res_bitmap_alloc(bitmap1, 0));
+    assert(0 == res_bitmap_free(bitmap1, 0, 0));
+    assert(0 == res_bitmap_alloc(bitmap1, 0));
+    printf("Good!\n");
+
+    printf("\tdestroying bitmap... ");
+    assert(0 == res_bitmap_destroy(bitmap1));
+    printf("Good!\n");
   return(0);
 }
 
+int extents(void)
+{
+  res_bitmap_t *bitmap;
+  unsigned char *shadow;
+  size_t i;
+  size_t j;
+  size_t k;
+  size_t base;
+  size_t limit;
+  size_t size;
+  size_t len;
+  size_t got;
+  size_t expected;
+  size_t sizes[3] = {999, 2999, 3999};
+  ushort worst;
+   /*a full map with holes of 5, 3 and 8 bits - with and without the index*/
+    for(k=0; k<2; k++)
+    {
+      printf((0 == k) ? "\tbest & worst fit, plain bitmap... " : "\tbest & worst fit, indexed bitmap... ");
+      bitmap = (0 == k) ? res_bitmap_create(99) : res_bitmap_create_opts(99, RES_BITMAP_OPT_EXTENTS);
+      assert(NULL != bitmap);
+      assert(0 == res_bitmap_take(bitmap, 0, 99));
+      assert(0 == res_bitmap_free(bitmap, 10, 4));
+      assert(0 == res_bitmap_free(bitmap, 30, 2));
+      assert(0 == res_bitmap_free(bitmap, 50, 7));
+      assert(7 == res_bitmap_largest_free(bitmap));
+
+      assert(0 == res_bitmap_set_policy(bitmap, RES_BITMAP_BEST_FIT));
+      assert(30 == res_bitmap_alloc(bitmap, 1));  /*the 3 bit hole, not the first one*/
+      assert(10 == res_bitmap_alloc(bitmap, 3));  /*too big for what's left at 32, so the 5 bit hole*/
+      assert(14 == res_bitmap_alloc(bitmap, 0));  /*two 1 bit holes left, the lower one*/
+
+      assert(0 == res_bitmap_set_policy(bitmap, RES_BITMAP_WORST_FIT));
+      assert(50 == res_bitmap_alloc(bitmap, 0));
+      assert(6 == res_bitmap_largest_free(bitmap));
+      assert(51 == res_bitmap_alloc(bitmap, 6));
+      errno = 0;
+      assert(RES_BITMAP_ERR == res_bitmap_alloc(bitmap, 1));
+      assert(RES_ERR_NO_MATCH == errno);
+      assert(32 == res_bitmap_alloc(bitmap, 0));  /*the other 1 bit hole*/
+      errno = 0;
+      assert(RES_BITMAP_ERR == res_bitmap_largest_free(bitmap));
+      assert(RES_ERR_NO_MATCH == errno);
+
+      assert(0 == res_bitmap_destroy(bitmap));
+      printf("Good!\n");
+    }
+
+   /*runs of the same length - the lowest is taken, whatever order the index keeps them in (the last freed first)*/
+    for(k=0; k<2; k++)
+    {
+      printf((0 == k) ? "\tequal runs, plain bitmap... " : "\tequal runs, indexed bitmap... ");
+      bitmap = (0 == k) ? res_bitmap_create(99) : res_bitmap_create_opts(99, RES_BITMAP_OPT_EXTENTS);
+      assert(NULL != bitmap);
+      assert(0 == res_bitmap_take(bitmap, 0, 99));
+      assert(0 == res_bitmap_free(bitmap, 10, 4));
+      assert(0 == res_bitmap_free(bitmap, 30, 4));
+      assert(0 == res_bitmap_free(bitmap, 50, 4));
+      assert(0 == res_bitmap_free(bitmap, 70, 8));
+      assert(0 == res_bitmap_free(bitmap, 90, 8));
+
+      assert(0 == res_bitmap_set_policy(bitmap, RES_BITMAP_WORST_FIT));
+      assert(70 == res_bitmap_alloc(bitmap, 0));  /*9 bits at 70 and 90*/
+      assert(90 == res_bitmap_alloc(bitmap, 0));
+      assert(71 == res_bitmap_alloc(bitmap, 0));  /*8 bits at 71 and 91*/
+
+      assert(0 == res_bitmap_set_policy(bitmap, RES_BITMAP_BEST_FIT));
+      assert(10 == res_bitmap_alloc(bitmap, 4));  /*exact fit - 5 bits at 10, 30 and 50*/
+      assert(30 == res_bitmap_alloc(bitmap, 2));  /*nothing of 3 or 2, so the smallest bigger - 30 or 50*/
+      assert(0 == res_bitmap_destroy(bitmap));
+      printf("Good!\n");
+    }
+
+   /*random operations, checking every alloc against the smallest / largest run in a byte-per-bit copy of the map*/
+    shadow = calloc(4000, 1);
+    assert(NULL != shadow);
+    for(k=0; k<2; k++)
+    {
+      printf((0 == k) ? "\trandom best & worst fit, plain bitmap... " : "\trandom best & worst fit, indexed bitmap... ");
+      bitmap = (0 == k) ? res_bitmap_create(2999) : res_bitmap_create_opts(2999, RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_SUMMARY);
+      assert(NULL != bitmap);
+      memset(shadow, 0, 4000);
+      size = 3000;
+      for(i=0; i<20000; i++)
+      {
+        switch(rand() % 8)
+        {
+          case 0 :  /*take a range*/
+          case 1 :
+            base = (unsigned)rand() % size;
+            limit = (unsigned)rand() % 60;
+            if(limit > size - 1 - base)
+              limit = size - 1 - base;
+            assert(0 == res_bitmap_take(bitmap, base, limit));
+            memset(shadow + base, 1, limit + 1);
+            break;
+          case 2 :  /*free a range*/
+            base = (unsigned)rand() % size;
+            limit = (unsigned)rand() % 100;
+            if(limit > size - 1 - base)
+              limit = size - 1 - base;
+            assert(0 == res_bitmap_free(bitmap, base, limit));
+            memset(shadow + base, 0, limit + 1);
+            break;
+          case 3 :  /*alloc, best or worst*/
+          case 4 :
+          case 5 :
+            worst = (ushort)(rand() % 2);
+            assert(0 == res_bitmap_set_policy(bitmap, (0 == worst) ? RES_BITMAP_BEST_FIT : RES_BITMAP_WORST_FIT));
+            limit = (unsigned)rand() % 40;
+            expected = 0;
+            for(j=0; j<size; j+=len)
+            {
+              len = free_run(shadow, size, j);
+              if(0 == len)
+              {
+                len = 1;
+                continue;
+              }
+              if((len > limit) && ((0 == expected) || ((0 != worst) ? (len > expected) : (len < expected))))
+              {
+                expected = len;
+                base = j;  /*the lowest of equal runs*/
+              }
+            }
+            errno = 0;
+            got = res_bitmap_alloc(bitmap, limit);
+            if(0 == expected)
+            {
+              assert(RES_BITMAP_ERR == got);
+              assert(RES_ERR_NO_MATCH == errno);
+              break;
+            }
+            assert(base == got);
+            memset(shadow + got, 1, limit + 1);
+            break;
+          case 6 :  /*largest free*/
+            expected = 0;
+            for(j=0; j<size; j+=len)
+            {
+              len = free_run(shadow, size, j);
+              if(len > expected)
+                expected = len;
+              if(0 == len)
+                len = 1;
+            }
+            if(0 == expected)
+              assert(RES_BITMAP_ERR == res_bitmap_largest_free(bitmap));
+            else
+              assert(expected - 1 == res_bitmap_largest_free(bitmap));
+            break;
+          default :  /*resize, now and again*/
+            if(0 != rand() % 50)
+              break;
+            j = sizes[(unsigned)rand() % 3] + 1;
+            assert(0 == res_bitmap_resize(bitmap, j - 1));
+            if(j > size)
+              memset(shadow + size, 0, j - size);
+            size = j;
+        }
+      }
+      for(j=0; j<size; j++)
+        assert(shadow[j] == res_bitmap_check(bitmap, j, 0));
+      assert(0 == res_bitmap_destroy(bitmap));
+      printf("Good!\n");
+    }
+    free(shadow);
+  return(0);
+}
+
+int aligned(void)
+{
+  res_bitmap_t *bitmap;
+  unsigned char *shadow;
+  size_t i;
+  size_t j;
+  size_t k;
+  size_t base;
+  size_t limit;
+  size_t expected;
+  ushort order;
+   /*simple cases*/
+    printf("\taligned blocks... ");
+    bitmap = res_bitmap_create(299);
+    assert(NULL != bitmap);
+    assert(0 == res_bitmap_take(bitmap, 0, 0));
+    assert(64 == res_bitmap_alloc_aligned(bitmap, 9, 6));
+    assert(8 == res_bitmap_alloc_aligned(bitmap, 0, 3));
+    assert(1 == res_bitmap_alloc_aligned(bitmap, 0, 0));
+    assert(128 == res_bitmap_alloc_aligned(bitmap, 99, 7));  /*runs into the last word*/
+    assert(256 == res_bitmap_alloc_aligned(bitmap, 43, 8));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_alloc_aligned(bitmap, 0, 8));
+    assert(RES_ERR_NO_MATCH == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_alloc_aligned(bitmap, 300, 0));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_alloc_aligned(bitmap, 0, 200));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(1 == res_bitmap_check(bitmap, 64, 9));
+    assert(0 == res_bitmap_check(bitmap, 74, 53));
+    assert(0 == res_bitmap_destroy(bitmap));
+    printf("Good!\n");
+
+   /*random maps, checking every alloc against the lowest aligned free block in a byte-per-bit copy*/
+    shadow = calloc(5000, 1);
+    assert(NULL != shadow);
+    for(k=0; k<2; k++)
+    {
+      printf((0 == k) ? "\trandom aligned alloc, plain bitmap... " : "\trandom aligned alloc, summary bitmap... ");
+      bitmap = res_bitmap_create_opts(4999, (0 == k) ? 0 : RES_BITMAP_OPT_SUMMARY);
+      assert(NULL != bitmap);
+      memset(shadow, 0, 5000);
+      for(i=0; i<20000; i++)
+      {
+        if(0 == rand() % 3)
+        {
+          base = (unsigned)rand() % 5000;
+          limit = (unsigned)rand() % 300;
+          if(limit > 4999 - base)
+            limit = 4999 - base;
+          assert(0 == res_bitmap_free(bitmap, base, limit));
+          memset(shadow + base, 0, limit + 1);
+          continue;
+        }
+        order = (ushort)(rand() % 9);
+        limit = (0 == rand() % 2) ? (unsigned)rand() % 4 : (unsigned)rand() % 200;
+        expected = RES_BITMAP_ERR;
+        for(j=0; j + limit < 5000; j += (size_t)1 << order)
+        {
+          if(free_run(shadow, 5000, j) > limit)
+          {
+            expected = j;
+            break;
+          }
+        }
+        assert(expected == res_bitmap_alloc_aligned(bitmap, limit, order));
+        if(RES_BITMAP_ERR != expected)
+          memset(shadow + expected, 1, limit + 1);
+      }
+      for(j=0; j<5000; j++)
+        assert(shadow[j] == res_bitmap_check(bitmap, j, 0));
+      assert(0 == res_bitmap_destroy(bitmap));
+      printf("Good!\n");
+    }
+    free(shadow);
+  return(0);
+}
+
+int batch(void)
+{
+  res_bitmap_t *bitmap;
+  res_bitmap_t *reference;
+  size_t out[300];
+  size_t bits[300];
+  size_t i;
+  size_t j;
+  size_t k;
+  size_t n;
+  size_t t;
+  size_t base;
+  size_t limit;
+  size_t block_size;
+  ushort opts[4] = {0, RES_BITMAP_OPT_SUMMARY, RES_BITMAP_OPT_EXTENTS, RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS};
+   /*simple cases*/
+    printf("\tsingle bits and blocks... ");
+    bitmap = res_bitmap_create(299);
+    assert(NULL != bitmap);
+    assert(0 == res_bitmap_take(bitmap, 1, 2));
+    assert(0 == res_bitmap_take(bitmap, 10, 99));
+    assert(5 == res_bitmap_alloc_many(bitmap, 0, 5, out));
+    assert((0 == out[0]) && (4 == out[1]) && (5 == out[2]) && (6 == out[3]) && (7 == out[4]));
+    assert(100 == res_bitmap_alloc_many(bitmap, 0, 100, out));  /*8, 9, then whole words from 110*/
+    assert((8 == out[0]) && (9 == out[1]) && (110 == out[2]) && (207 == out[99]));
+    assert(1 == res_bitmap_check(bitmap, 0, 207));
+    assert(0 == res_bitmap_check(bitmap, 208, 91));
+    assert(9 == res_bitmap_alloc_many(bitmap, 9, 20, out));  /*only room for 9*/
+    assert((208 == out[0]) && (288 == out[8]));
+    assert(RES_ERR_NO_MATCH == errno);
+    assert(2 == res_bitmap_alloc_many(bitmap, 0, 3, out));  /*the last two bits*/
+    assert((298 == out[0]) && (299 == out[1]));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_alloc_many(bitmap, 300, 1, out));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\tunsorted free... ");
+    bits[0] = 150; bits[1] = 4; bits[2] = 130; bits[3] = 5; bits[4] = 131; bits[5] = 299;
+    assert(0 == res_bitmap_free_many(bitmap, bits, 6, 0));
+    assert((4 == bits[0]) && (5 == bits[1]) && (299 == bits[5]));  /*sorted in place*/
+    assert(294 == res_bitmap_count(bitmap, 0, 299));
+    assert(0 == res_bitmap_check(bitmap, 130, 1));
+    assert(0 == res_bitmap_check(bitmap, 299, 0));
+    bits[0] = 200; bits[1] = 300;
+    assert(2 == res_bitmap_free_many(bitmap, bits, 2, 0));
+    bits[1] = 290;
+    assert(3 == res_bitmap_free_many(bitmap, bits, 2, 10));
+    assert(1 == res_bitmap_check(bitmap, 200, 0));  /*nothing freed on error*/
+    bits[0] = 200; bits[1] = 190; bits[2] = 195;  /*overlapping blocks*/
+    assert(0 == res_bitmap_free_many(bitmap, bits, 3, 9));
+    assert(0 == res_bitmap_check(bitmap, 190, 19));
+    assert(1 == res_bitmap_check(bitmap, 189, 0));
+    assert(1 == res_bitmap_check(bitmap, 210, 0));
+    assert(0 == res_bitmap_destroy(bitmap));
+    printf("Good!\n");
+
+   /*random maps - batch on one map, the same allocs and frees one at a time on a plain reference*/
+    for(k=0; k<8; k++)
+    {
+      printf("\trandom batches, options %u, %s... ", opts[k%4], (k < 4) ? "first fit" : "next fit");
+      bitmap = res_bitmap_create_opts(4999, opts[k%4]);
+      reference = res_bitmap_create(4999);
+      assert((NULL != bitmap) && (NULL != reference));
+      if(k >= 4)
+      {
+        assert(0 == res_bitmap_set_policy(bitmap, RES_BITMAP_NEXT_FIT));
+        assert(0 == res_bitmap_set_policy(reference, RES_BITMAP_NEXT_FIT));
+      }
+      for(i=0; i<2000; i++)
+      {
+        switch(rand() % 3)
+        {
+          case 0:
+            base = (unsigned)rand() % 5000;
+            limit = (unsigned)rand() % 200;
+            if(limit > 4999 - base)
+              limit = 4999 - base;
+            assert(0 == res_bitmap_free(bitmap, base, limit));
+            assert(0 == res_bitmap_free(reference, base, limit));
+            break;
+          case 1:
+            block_size = (0 == rand() % 2) ? 0 : (unsigned)rand() % 20;
+            n = (unsigned)rand() % 300;
+            t = res_bitmap_alloc_many(bitmap, block_size, n, out);
+            for(j=0; j<t; j++)
+              assert(out[j] == res_bitmap_alloc(reference, block_size));
+            if(t < n)
+              assert(RES_BITMAP_ERR == res_bitmap_alloc(reference, block_size));
+            break;
+          default:
+            n = (unsigned)rand() % 300;
+            for(j=0; j<n; j++)
+            {
+              bits[j] = 2 * ((unsigned)rand() % 2500);  /*bits that never touch, so the next fit cursor ends up the same whatever order they're freed in*/
+              assert(0 == res_bitmap_free(reference, bits[j], 0));
+            }
+            assert(0 == res_bitmap_free_many(bitmap, bits, n, 0));
+        }
+      }
+      assert(1 == same_map(bitmap, reference, 4999));
+      assert(res_bitmap_largest_free(reference) == res_bitmap_largest_free(bitmap));
+      assert(0 == res_bitmap_destroy(bitmap));
+      assert(0 == res_bitmap_destroy(reference));
+      printf("Good!\n");
+    }
+  return(0);
+}
+
+int find_iterate(void)
+{
+  res_bitmap_t *bitmap;
+  res_bitmap_iter_t iter;
+  size_t i;
+  size_t j;
+  size_t k;
+  size_t base;
+  size_t limit;
+  size_t expected;
+   /*simple cases*/
+    printf("\tfind next & previous... ");
+    bitmap = res_bitmap_create(299);
+    assert(NULL != bitmap);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_find_next_set(bitmap, 0));
+    assert(RES_ERR_NO_MATCH == errno);
+    assert(RES_BITMAP_ERR == res_bitmap_find_prev_set(bitmap, 299));
+    assert(0 == res_bitmap_take(bitmap, 5, 0));
+    assert(0 == res_bitmap_take(bitmap, 70, 129));
+    assert(0 == res_bitmap_take(bitmap, 299, 0));
+    assert(5 == res_bitmap_find_next_set(bitmap, 0));
+    assert(5 == res_bitmap_find_next_set(bitmap, 5));
+    assert(70 == res_bitmap_find_next_set(bitmap, 6));
+    assert(299 == res_bitmap_find_next_set(bitmap, 200));
+    assert(0 == res_bitmap_find_next_clear(bitmap, 0));
+    assert(200 == res_bitmap_find_next_clear(bitmap, 70));
+    assert(5 == res_bitmap_find_prev_set(bitmap, 69));
+    assert(199 == res_bitmap_find_prev_set(bitmap, 298));
+    assert(299 == res_bitmap_find_prev_set(bitmap, 299));
+    assert(RES_BITMAP_ERR == res_bitmap_find_prev_set(bitmap, 4));
+    assert(0 == res_bitmap_free(bitmap, 200, 98));
+    assert(0 == res_bitmap_take(bitmap, 0, 4));
+    assert(0 == res_bitmap_take(bitmap, 6, 63));
+    assert(0 == res_bitmap_take(bitmap, 200, 98));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_find_next_clear(bitmap, 0));  /*bits past the end don't count*/
+    assert(RES_ERR_NO_MATCH == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_find_next_set(bitmap, 300));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_find_prev_set(bitmap, 300));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\titerating over a range... ");
+    assert(0 == res_bitmap_free(bitmap, 0, 299));
+    assert(0 == res_bitmap_take(bitmap, 3, 0));
+    assert(0 == res_bitmap_take(bitmap, 63, 1));
+    assert(0 == res_bitmap_take(bitmap, 250, 0));
+    assert(0 == res_bitmap_iter_init(bitmap, &iter, 0, 299));
+    assert(3 == res_bitmap_iter_next(&iter));
+    assert(63 == res_bitmap_iter_next(&iter));
+    assert(64 == res_bitmap_iter_next(&iter));
+    assert(250 == res_bitmap_iter_next(&iter));
+    assert(RES_BITMAP_ERR == res_bitmap_iter_next(&iter));
+    assert(RES_BITMAP_ERR == res_bitmap_iter_next(&iter));  /*stays finished*/
+    assert(0 == res_bitmap_iter_init(bitmap, &iter, 4, 58));  /*63 and 64 are just outside*/
+    assert(RES_BITMAP_ERR == res_bitmap_iter_next(&iter));
+    assert(0 == res_bitmap_iter_init(bitmap, &iter, 64, 0));
+    assert(64 == res_bitmap_iter_next(&iter));
+    assert(RES_BITMAP_ERR == res_bitmap_iter_next(&iter));
+    assert(2 == res_bitmap_iter_init(bitmap, &iter, 300, 0));
+    assert(3 == res_bitmap_iter_init(bitmap, &iter, 299, 1));
+    assert(0 == res_bitmap_destroy(bitmap));
+    printf("Good!\n");
+
+   /*random maps against check, one bit at a time*/
+    for(k=0; k<2; k++)
+    {
+      printf((0 == k) ? "\trandom maps, plain bitmap... " : "\trandom maps, summary bitmap... ");
+      bitmap = res_bitmap_create_opts(2999, (0 == k) ? 0 : RES_BITMAP_OPT_SUMMARY);
+      assert(NULL != bitmap);
+      for(i=0; i<200; i++)
+      {
+        base = (unsigned)rand() % 3000;
+        limit = (unsigned)rand() % 400;
+        if(limit > 2999 - base)
+          limit = 2999 - base;
+        if(0 == rand() % 2)
+          assert(0 == res_bitmap_take(bitmap, base, limit));
+        else
+          assert(0 == res_bitmap_free(bitmap, base, limit));
+
+        j = (unsigned)rand() % 3000;
+        for(expected=j; (expected < 3000) && (1 != res_bitmap_check(bitmap, expected, 0)); expected++)
+          ;
+        assert(((3000 == expected) ? RES_BITMAP_ERR : expected) == res_bitmap_find_next_set(bitmap, j));
+        for(expected=j; (expected < 3000) && (0 != res_bitmap_check(bitmap, expected, 0)); expected++)
+          ;
+        assert(((3000 == expected) ? RES_BITMAP_ERR : expected) == res_bitmap_find_next_clear(bitmap, j));
+        for(expected=j+1; (expected > 0) && (1 != res_bitmap_check(bitmap, expected-1, 0)); expected--)
+          ;
+        assert(((0 == expected) ? RES_BITMAP_ERR : expected-1) == res_bitmap_find_prev_set(bitmap, j));
+
+        assert(0 == res_bitmap_iter_init(bitmap, &iter, base, limit));
+        for(j=base; j<=base+limit; j++)
+          if(1 == res_bitmap_check(bitmap, j, 0))
+            assert(j == res_bitmap_iter_next(&iter));
+        assert(RES_BITMAP_ERR == res_bitmap_iter_next(&iter));
+      }
+      assert(0 == res_bitmap_destroy(bitmap));
+      printf("Good!\n");
+    }
+  return(0);
+}
+
+int combine(void)
+{
+  res_bitmap_t* a;
+  res_bitmap_t* b;
+  res_bitmap_t* dest;
+  size_t size[3];
+  size_t expected;
+  size_t base;
+  size_t limit;
+  size_t i;
+  size_t j;
+  ushort op;
+  ushort bit;
+    printf("\tcreating bitmaps of size 300... ");
+    a = res_bitmap_create(299);
+    b = res_bitmap_create(299);
+    dest = res_bitmap_create(299);
+    assert((NULL != a) && (NULL != b) && (NULL != dest));
+    assert(0 == res_bitmap_take(a, 0, 99));
+    assert(0 == res_bitmap_take(b, 50, 99));
+    printf("Good!\n");
+
+    printf("\tout-of-place and, or, xor, andnot... ");
+    assert(0 == res_bitmap_combine_into(dest, a, b, RES_BITMAP_AND));
+    assert(50 == res_bitmap_count(dest, 0, 299));
+    assert(1 == res_bitmap_check(dest, 50, 49));
+    assert(0 == res_bitmap_combine_into(dest, a, b, RES_BITMAP_OR));
+    assert(1 == res_bitmap_check(dest, 0, 149));
+    assert(0 == res_bitmap_check(dest, 150, 149));
+    assert(0 == res_bitmap_combine_into(dest, a, b, RES_BITMAP_XOR));
+    assert(1 == res_bitmap_check(dest, 0, 49));
+    assert(0 == res_bitmap_check(dest, 50, 49));
+    assert(1 == res_bitmap_check(dest, 100, 49));
+    assert(0 == res_bitmap_combine_into(dest, a, b, RES_BITMAP_ANDNOT));
+    assert(1 == res_bitmap_check(dest, 0, 49));
+    assert(0 == res_bitmap_check(dest, 50, 249));
+    assert(1 == res_bitmap_check(a, 0, 99));  /*operands untouched*/
+    assert(1 == res_bitmap_check(b, 50, 99));
+    printf("Good!\n");
+
+    printf("\tin-place, and counting without writing... ");
+    assert(50 == res_bitmap_combine_count(a, b, RES_BITMAP_ANDNOT));
+    assert(100 == res_bitmap_combine_count(b, a, RES_BITMAP_XOR));
+    assert(0 == res_bitmap_combine(a, b, RES_BITMAP_OR));
+    assert(150 == res_bitmap_count(a, 0, 299));
+    assert(0 == res_bitmap_combine(a, a, RES_BITMAP_XOR));  /*with itself*/
+    assert(0 == res_bitmap_check(a, 0, 299));
+    printf("Good!\n");
+
+    printf("\tdifferent sizes, as if resized... ");
+    assert(0 == res_bitmap_take(a, 0, 299));
+    assert(0 == res_bitmap_resize(dest, 99));
+    assert(0 == res_bitmap_combine_into(dest, a, b, RES_BITMAP_OR));  /*a and b cut down to 100 bits*/
+    assert(100 == res_bitmap_count(dest, 0, 99));
+    assert(0 == res_bitmap_resize(dest, 299));
+    assert(0 == res_bitmap_check(dest, 100, 199));  /*nothing past the old end came through*/
+    assert(0 == res_bitmap_resize(b, 199));
+    assert(0 == res_bitmap_combine(a, b, RES_BITMAP_ANDNOT));  /*b grown to 300 bits with 0's*/
+    assert(1 == res_bitmap_check(a, 0, 49));
+    assert(0 == res_bitmap_check(a, 50, 99));
+    assert(1 == res_bitmap_check(a, 150, 149));
+    assert(300 == res_bitmap_combine_count(a, b, RES_BITMAP_OR));
+    assert(200 == res_bitmap_combine_count(b, a, RES_BITMAP_XOR));  /*a cut down to 200 bits*/
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    assert(2 == res_bitmap_combine(a, b, 4));
+    assert(2 == res_bitmap_combine_into(dest, a, b, 4));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_combine_count(a, b, 4));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(0 == res_bitmap_destroy(a));
+    assert(0 == res_bitmap_destroy(b));
+    assert(0 == res_bitmap_destroy(dest));
+    printf("Good!\n");
+
+   /*random maps of random sizes - big enough for the vector kernels - against the same op done bit by bit*/
+    printf("\trandom maps, every op, against bit by bit... ");
+    for(i=0; i<40; i++)
+    {
+      for(j=0; j<3; j++)
+        size[j] = (unsigned)rand() % 4000;
+      a = res_bitmap_create(size[0]);
+      b = res_bitmap_create(size[1]);
+      dest = res_bitmap_create_opts(size[2], RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS);
+      assert((NULL != a) && (NULL != b) && (NULL != dest));
+      for(j=0; j<30; j++)
+      {
+        base = (unsigned)rand() % (size[j%3] + 1);
+        limit = (unsigned)rand() % 200;
+        if(limit > size[j%3] - base)
+          limit = size[j%3] - base;
+        assert(0 == res_bitmap_take((0 == j%3) ? a : (1 == j%3) ? b : dest, base, limit));
+      }
+
+      op = (ushort)(i % 4);
+      expected = 0;
+      for(j=0; j<=size[0]; j++)
+        expected += combine_bit(res_bitmap_check(a, j, 0), (j <= size[1]) ? res_bitmap_check(b, j, 0) : 0, op);
+      assert(expected == res_bitmap_combine_count(a, b, op));
+
+      assert(0 == res_bitmap_combine_into(dest, a, b, op));
+      for(j=0; j<=size[2]; j++)
+      {
+        bit = combine_bit((j <= size[0]) ? res_bitmap_check(a, j, 0) : 0, (j <= size[1]) ? res_bitmap_check(b, j, 0) : 0, op);
+        assert(bit == res_bitmap_check(dest, j, 0));
+      }
+
+     /*the indexes must agree with the new map*/
+      expected = res_bitmap_find_next_clear(dest, 0);
+      if(RES_BITMAP_ERR != expected)
+      {
+        assert(expected == res_bitmap_alloc(dest, 0));
+        assert(1 == res_bitmap_check(dest, expected, 0));
+      }
+
+     /*in place, with dest as the second operand*/
+      assert(0 == res_bitmap_combine_into(dest, a, dest, RES_BITMAP_OR));
+      for(j=0; j<=size[2] && j<=size[0]; j++)
+        if(1 == res_bitmap_check(a, j, 0))
+          assert(1 == res_bitmap_check(dest, j, 0));
+
+      assert(0 == res_bitmap_destroy(a));
+      assert(0 == res_bitmap_destroy(b));
+      assert(0 == res_bitmap_destroy(dest));
+    }
+    printf("Good!\n");
+  return(0);
+}
+
+#ifndef RES_BITMAP_TREE
+int file(void)
+{
+  const char* path = "bitmap_test.bits";
+  res_bitmap_t* bitmap;
+  FILE* f;
+    printf("\tcreating a file-backed bitmap of size 100000... ");
+    bitmap = res_bitmap_create_file(path, 99999, RES_BITMAP_OPT_SUMMARY);
+    assert(NULL != bitmap);
+    assert(99999 == res_bitmap_get_size(bitmap));
+    assert(0 == res_bitmap_check(bitmap, 0, 99999));
+    printf("Good!\n");
+
+    printf("\tonly pages written are dirty, and sync cleans them... ");
+    assert(0 == res_bitmap_sync(bitmap));
+#ifdef RES_BITMAP_TEST_REFF
+    assert(1 == file_clean(bitmap));
+#endif
+    assert(0 == res_bitmap_take(bitmap, 10, 99));
+    assert(0 == res_bitmap_take(bitmap, 99000, 0));
+    assert(110 == res_bitmap_alloc(bitmap, 49));
+#ifdef RES_BITMAP_TEST_REFF
+    assert(1 == page_dirty(bitmap, RES_BITMAP_FILE_HEADER + (99000/BITS) * sizeof(res_bitmap_word_t)));
+    assert(1 == page_dirty(bitmap, RES_BITMAP_FILE_HEADER));
+    assert(0 == page_dirty(bitmap, 0));  /*header page - not touched since the last sync*/
+#endif
+    assert(0 == res_bitmap_sync(bitmap));
+#ifdef RES_BITMAP_TEST_REFF
+    assert(1 == file_clean(bitmap));
+#endif
+    assert(0 == res_bitmap_destroy(bitmap));
+    printf("Good!\n");
+
+    printf("\treopening... ");
+    bitmap = res_bitmap_open_file(path, RES_BITMAP_OPT_EXTENTS);
+    assert(NULL != bitmap);
+    assert(99999 == res_bitmap_get_size(bitmap));
+    assert(151 == res_bitmap_count(bitmap, 0, 99999));
+    assert(1 == res_bitmap_check(bitmap, 10, 149));
+    assert(1 == res_bitmap_check(bitmap, 99000, 0));
+    assert(98839 == res_bitmap_largest_free(bitmap));
+    printf("Good!\n");
+
+    printf("\tresizing grows and shrinks the file... ");
+    assert(0 == res_bitmap_resize(bitmap, 199999));
+    assert(0 == res_bitmap_check(bitmap, 100000, 99999));
+    assert(0 == res_bitmap_take(bitmap, 150000, 0));
+    assert(0 == res_bitmap_resize(bitmap, 999));
+    assert(150 == res_bitmap_count(bitmap, 0, 999));
+    assert(0 == res_bitmap_destroy(bitmap));
+    bitmap = res_bitmap_open_file(path, 0);
+    assert(NULL != bitmap);
+    assert(999 == res_bitmap_get_size(bitmap));
+    assert(150 == res_bitmap_count(bitmap, 0, 999));
+    assert(0 == res_bitmap_resize(bitmap, 199999));
+    assert(150 == res_bitmap_count(bitmap, 0, 199999));  /*bits cut off by the shrink stay gone*/
+    assert(0 == res_bitmap_destroy(bitmap));
+    printf("Good!\n");
+
+    printf("\trejecting bad files... ");
+    errno = 0;
+    assert(NULL == res_bitmap_open_file(path, 0x0100));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    f = fopen(path, "r+b");
+    assert(NULL != f);
+    assert(0 == fseek(f, 8, SEEK_SET));
+    assert(EOF != fputc(2, f));  /*version*/
+    assert(0 == fclose(f));
+    errno = 0;
+    assert(NULL == res_bitmap_open_file(path, 0));
+    assert(RES_ERR_INCOMPATIBLE_RESOURCE == errno);
+    f = fopen(path, "wb");
+    assert(NULL != f);
+    assert(7 == fwrite("RESBMAP", 1, 7, f));  /*short*/
+    assert(0 == fclose(f));
+    errno = 0;
+    assert(NULL == res_bitmap_open_file(path, 0));
+    assert(RES_ERR_INCOMPATIBLE_RESOURCE == errno);
+    assert(0 == remove(path));
+    errno = 0;
+    assert(NULL == res_bitmap_open_file(path, 0));
+    assert(0 != errno);
+    printf("Good!\n");
+  return(0);
+}
+#else
+int file(void)
+{
+  res_bitmap_t* bitmap;
+    printf("\tfile functions, which tree-1 doesn't have... ");
+    errno = 0;
+    assert(NULL == res_bitmap_create_file("bitmap_test.bits", 99999, 0));
+    assert(RES_ERR_INCOMPATIBLE_RESOURCE == errno);
+    errno = 0;
+    assert(NULL == res_bitmap_open_file("bitmap_test.bits", 0));
+    assert(RES_ERR_INCOMPATIBLE_RESOURCE == errno);
+    bitmap = res_bitmap_create(99);
+    assert(NULL != bitmap);
+    assert(0 == res_bitmap_sync(bitmap));  /*nothing to sync*/
+    assert(0 == res_bitmap_destroy(bitmap));
+    printf("Good!\n");
+  return(0);
+}
+#endif
+
+int rank_select(void)
+{
+  res_bitmap_t* bitmap[2];
+  unsigned char* shadow;
+  size_t* prefix;
+  size_t size;
+  size_t base;
+  size_t limit;
+  size_t i;
+  size_t j;
+  size_t k;
+  int round;
+    printf("\tsimple cases, with and without the directory... ");
+    for(k=0; k<2; k++)
+    {
+      bitmap[0] = (0 == k) ? res_bitmap_create(199999) : res_bitmap_create_opts(199999, RES_BITMAP_OPT_RANK);
+      assert(NULL != bitmap[0]);
+      assert(0 == res_bitmap_rank(bitmap[0], 200000));
+      errno = 0;
+      assert(RES_BITMAP_ERR == res_bitmap_select(bitmap[0], 0));
+      assert(RES_ERR_NO_MATCH == errno);
+      assert(0 == res_bitmap_take(bitmap[0], 5, 9));
+      assert(0 == res_bitmap_take(bitmap[0], 150000, 0));
+      assert(0 == res_bitmap_rank(bitmap[0], 5));
+      assert(3 == res_bitmap_rank(bitmap[0], 8));
+      assert(10 == res_bitmap_rank(bitmap[0], 150000));
+      assert(11 == res_bitmap_rank(bitmap[0], 150001));
+      assert(11 == res_bitmap_rank(bitmap[0], 200000));
+      assert(5 == res_bitmap_select(bitmap[0], 0));
+      assert(14 == res_bitmap_select(bitmap[0], 9));
+      assert(150000 == res_bitmap_select(bitmap[0], 10));
+      assert(0 == res_bitmap_free(bitmap[0], 5, 0));  /*stale from the start*/
+      assert(5 == res_bitmap_rank(bitmap[0], 11));
+      assert(150000 == res_bitmap_select(bitmap[0], 9));
+      assert(0 == res_bitmap_resize(bitmap[0], 99999));  /*cuts off bit 150000*/
+      assert(9 == res_bitmap_rank(bitmap[0], 100000));
+      errno = 0;
+      assert(RES_BITMAP_ERR == res_bitmap_select(bitmap[0], 9));
+      assert(RES_ERR_NO_MATCH == errno);
+      assert(0 == res_bitmap_resize(bitmap[0], 299999));
+      assert(0 == res_bitmap_take(bitmap[0], 299999, 0));
+      assert(299999 == res_bitmap_select(bitmap[0], 9));
+      errno = 0;
+      assert(RES_BITMAP_ERR == res_bitmap_rank(bitmap[0], 300001));
+      assert(RES_ERR_BAD_PARAMETER == errno);
+      assert(0 == res_bitmap_destroy(bitmap[0]));
+    }
+    printf("Good!\n");
+
+   /*random maps, one with a directory and one without, against a prefix count of a byte per bit copy*/
+    printf("\trandom maps, against a reference... ");
+    for(round=0; round<20; round++)
+    {
+      size = (size_t)rand() % (RANK_MAP_BITS * 5) + 1;
+      shadow = calloc(size, 1);
+      prefix = malloc((size + 1) * sizeof(size_t));
+      assert((NULL != shadow) && (NULL != prefix));
+      bitmap[0] = res_bitmap_create(size - 1);
+      bitmap[1] = res_bitmap_create_opts(size - 1, RES_BITMAP_OPT_RANK | RES_BITMAP_OPT_SUMMARY);
+      assert((NULL != bitmap[0]) && (NULL != bitmap[1]));
+      for(i=0; i<200; i++)
+      {
+       /*a few changes, dense or sparse, then queries*/
+        base = (size_t)rand() % size;
+        limit = (0 == rand() % 2) ? (size_t)rand() % 64 : (size_t)rand() % (size - base);
+        if(base + limit >= size)
+          limit = size - base - 1;
+        k = (size_t)rand() % 3;
+        for(j=0; j<2; j++)
+        {
+          if(0 == k)
+            assert(0 == res_bitmap_free(bitmap[j], base, limit));
+          else
+            assert(0 == res_bitmap_take(bitmap[j], base, limit));
+        }
+        memset(shadow + base, (0 == k) ? 0 : 1, limit + 1);
+        if(0 != i % 4)
+          continue;
+
+        prefix[0] = 0;
+        for(j=0; j<size; j++)
+          prefix[j+1] = prefix[j] + shadow[j];
+        for(j=0; j<20; j++)
+        {
+          base = (size_t)rand() % (size + 1);
+          assert(prefix[base] == res_bitmap_rank(bitmap[0], base));
+          assert(prefix[base] == res_bitmap_rank(bitmap[1], base));
+          if(0 == prefix[size])
+          {
+            assert(RES_BITMAP_ERR == res_bitmap_select(bitmap[1], 0));
+            continue;
+          }
+          k = (size_t)rand() % prefix[size];
+          limit = res_bitmap_select(bitmap[1], k);
+          assert(limit == res_bitmap_select(bitmap[0], k));
+          assert((limit < size) && (1 == shadow[limit]) && (k == prefix[limit]));
+        }
+        assert(RES_BITMAP_ERR == res_bitmap_select(bitmap[1], prefix[size]));
+      }
+      assert(0 == res_bitmap_destroy(bitmap[0]));
+      assert(0 == res_bitmap_destroy(bitmap[1]));
+      free(shadow);
+      free(prefix);
+    }
+    printf("Good!\n");
+  return(0);
+}
+
+int free_stats(void)
+{
+  res_bitmap_t* bitmap[2];
+  res_bitmap_free_stats_t stats[2];
+  res_bitmap_free_stats_t want;
+  unsigned char* shadow;
+  size_t size;
+  size_t base;
+  size_t limit;
+  size_t len;
+  size_t i;
+  size_t j;
+  size_t k;
+  int round;
+    printf("\tsimple cases, with and without the extent index... ");
+    for(k=0; k<2; k++)
+    {
+      bitmap[0] = (0 == k) ? res_bitmap_create(999) : res_bitmap_create_opts(999, RES_BITMAP_OPT_EXTENTS);
+      assert(NULL != bitmap[0]);
+      assert(0 == res_bitmap_free_stats(bitmap[0], &stats[0]));
+      assert((1000 == stats[0].free_bits) && (1 == stats[0].runs) && (1000 == stats[0].largest));
+      assert(1 == stats[0].histogram[9]);  /*512 <= 1000 < 1024*/
+      assert(0 == res_bitmap_take(bitmap[0], 10, 9));  /*runs of 10, 1 and 978 left*/
+      assert(0 == res_bitmap_take(bitmap[0], 21, 0));
+      assert(0 == res_bitmap_free_stats(bitmap[0], &stats[0]));
+      assert((989 == stats[0].free_bits) && (3 == stats[0].runs) && (978 == stats[0].largest));
+      assert((1 == stats[0].histogram[0]) && (1 == stats[0].histogram[3]) && (1 == stats[0].histogram[9]));
+      for(i=0; i<BITS; i++)
+        if((0 != i) && (3 != i) && (9 != i))
+          assert(0 == stats[0].histogram[i]);
+
+     /*a block longer than the longest run can't be allocated, whatever the policy*/
+      errno = 0;
+      assert(RES_BITMAP_ERR == res_bitmap_alloc(bitmap[0], 978));
+      assert(RES_ERR_NO_MATCH == errno);
+      assert(22 == res_bitmap_alloc(bitmap[0], 977));
+      assert(0 == res_bitmap_free_stats(bitmap[0], &stats[0]));
+      assert((11 == stats[0].free_bits) && (2 == stats[0].runs) && (10 == stats[0].largest));
+      assert(0 == res_bitmap_take(bitmap[0], 0, 999));
+      assert(0 == res_bitmap_free_stats(bitmap[0], &stats[0]));
+      assert((0 == stats[0].free_bits) && (0 == stats[0].runs) && (0 == stats[0].largest));
+      assert(0 == res_bitmap_destroy(bitmap[0]));
+    }
+    printf("Good!\n");
+
+   /*random maps, one with the index and one without, against a byte per bit copy*/
+    printf("\trandom maps, against a reference... ");
+    for(round=0; round<20; round++)
+    {
+      size = (size_t)rand() % 5000 + 1;
+      shadow = calloc(size, 1);
+      assert(NULL != shadow);
+      bitmap[0] = res_bitmap_create(size - 1);
+      bitmap[1] = res_bitmap_create_opts(size - 1, RES_BITMAP_OPT_EXTENTS);
+      assert((NULL != bitmap[0]) && (NULL != bitmap[1]));
+      for(i=0; i<200; i++)
+      {
+        base = (size_t)rand() % size;
+        limit = (size_t)rand() % 64;
+        if(base + limit >= size)
+          limit = size - base - 1;
+        k = (size_t)rand() % 2;
+        for(j=0; j<2; j++)
+        {
+          if(0 == k)
+            assert(0 == res_bitmap_free(bitmap[j], base, limit));
+          else
+            assert(0 == res_bitmap_take(bitmap[j], base, limit));
+        }
+        memset(shadow + base, (int)k, limit + 1);
+
+        memset(&want, 0, sizeof(want));
+        for(j=0; j<size; j+=len+1)
+        {
+          len = free_run(shadow, size, j);
+          if(0 == len)
+            continue;
+          want.free_bits += len;
+          want.runs++;
+          for(k=0; ((size_t)2 << k) <= len; k++);
+          want.histogram[k]++;
+          if(len > want.largest)
+            want.largest = len;
+        }
+        for(j=0; j<2; j++)
+        {
+          assert(0 == res_bitmap_free_stats(bitmap[j], &stats[j]));
+          assert((want.free_bits == stats[j].free_bits) && (want.runs == stats[j].runs) && (want.largest == stats[j].largest));
+          for(k=0; k<BITS; k++)
+            assert(want.histogram[k] == stats[j].histogram[k]);
+        }
+      }
+      assert(0 == res_bitmap_destroy(bitmap[0]));
+      assert(0 == res_bitmap_destroy(bitmap[1]));
+      free(shadow);
+    }
+    printf("Good!\n");
+  return(0);
+}
+
+int reserve(void)
+{
+  res_bitmap_t* bitmap[2];
+  res_bitmap_range_t good[4] = {{10, 0}, {60, 139}, {300, 5}, {999, 0}};  /*60-199 over several words*/
+  res_bitmap_range_t clash[4] = {{400, 99}, {520, 0}, {190, 20}, {700, 0}};  /*clash[2] runs into 190-199*/
+  res_bitmap_range_t bad[2] = {{400, 0}, {1000, 0}};
+  res_bitmap_free_stats_t stats[2];
+  size_t failed;
+  size_t i;
+  size_t k;
+    printf("\tall ranges free, with and without indexes... ");
+    for(k=0; k<2; k++)
+    {
+      bitmap[k] = (0 == k) ? res_bitmap_create(999) : res_bitmap_create_opts(999, RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK);
+      assert(NULL != bitmap[k]);
+      assert(0 == res_bitmap_reserve(bitmap[k], good, 4, NULL));
+      for(i=0; i<4; i++)
+        assert(1 == res_bitmap_check(bitmap[k], good[i].base, good[i].limit));
+      assert(148 == res_bitmap_count(bitmap[k], 0, 999));
+      assert(148 == res_bitmap_rank(bitmap[k], 1000));
+      assert(0 == res_bitmap_reserve(bitmap[k], clash, 0, NULL));
+    }
+    printf("Good!\n");
+
+    printf("\ta taken bit puts everything back... ");
+    for(k=0; k<2; k++)
+    {
+      clash[2].base = 190;
+      failed = 0;
+      assert(1 == res_bitmap_reserve(bitmap[k], clash, 4, &failed));
+      assert(2 == failed);
+      assert(0 == res_bitmap_check(bitmap[k], 400, 99));
+      assert(0 == res_bitmap_check(bitmap[k], 520, 0));
+      assert(0 == res_bitmap_check(bitmap[k], 200, 10));
+      assert(1 == res_bitmap_check(bitmap[k], 190, 9));
+      assert(148 == res_bitmap_count(bitmap[k], 0, 999));
+
+     /*overlapping each other counts too*/
+      clash[2].base = 450;
+      assert(1 == res_bitmap_reserve(bitmap[k], clash, 4, &failed));
+      assert(2 == failed);
+      assert(148 == res_bitmap_count(bitmap[k], 0, 999));
+    }
+    assert(0 == res_bitmap_free_stats(bitmap[0], &stats[0]));
+    assert(0 == res_bitmap_free_stats(bitmap[1], &stats[1]));
+    assert((stats[0].free_bits == stats[1].free_bits) && (stats[0].runs == stats[1].runs) && (stats[0].largest == stats[1].largest));
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    for(k=0; k<2; k++)
+    {
+      bad[1].base = 1000;
+      bad[1].limit = 0;
+      assert(2 == res_bitmap_reserve(bitmap[k], bad, 2, &failed));
+      assert(1 == failed);
+      bad[1].base = 990;
+      bad[1].limit = 10;
+      assert(3 == res_bitmap_reserve(bitmap[k], bad, 2, &failed));
+      assert(1 == failed);
+      bad[1].limit = SIZE_MAX;
+      assert(3 == res_bitmap_reserve(bitmap[k], bad, 2, &failed));
+      assert(0 == res_bitmap_check(bitmap[k], 400, 0));  /*range 0 was fine, but never taken*/
+      assert(0 == res_bitmap_destroy(bitmap[k]));
+    }
+    printf("Good!\n");
+  return(0);
+}
+
+int delta(void)
+{
+  res_bitmap_t* src;
+  res_bitmap_t* other;
+  res_bitmap_t* dest[2];
+  res_bitmap_word_t buf[64];
+  res_bitmap_word_t bad[5];
+  size_t i;
+  size_t k;
+  size_t n;
+    printf("\tcreating a tracked bitmap and two copies, size 1000... ");
+    src = res_bitmap_create_opts(1000, RES_BITMAP_OPT_DELTA);
+    dest[0] = res_bitmap_create(1000);
+    dest[1] = res_bitmap_create_opts(1000, RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK);
+    assert((NULL != src) && (NULL != dest[0]) && (NULL != dest[1]));
+    assert(RES_BITMAP_DELTA_HEADER == res_bitmap_delta_size(src));
+    assert(RES_BITMAP_DELTA_HEADER == res_bitmap_delta_export(src, buf, 64));
+    assert((1000 == buf[0]) && (1000 == buf[1]));
+    printf("Good!\n");
+
+    printf("\tonly words changed are sent... ");
+    assert(0 == res_bitmap_take(src, 0, 0));
+    assert(0 == res_bitmap_take(src, 5*BITS + 1, BITS));  /*words 5 & 6*/
+    assert(0 == res_bitmap_free(src, 5*BITS + 1, 0));
+    assert(RES_BITMAP_DELTA_HEADER + 3 + 4 == res_bitmap_delta_size(src));
+    n = res_bitmap_delta_export(src, buf, 64);
+    assert(RES_BITMAP_DELTA_HEADER + 3 + 4 == n);
+    assert((0 == buf[2]) && (1 == buf[3]) && (5 == buf[5]) && (2 == buf[6]));
+    assert(RES_BITMAP_DELTA_HEADER == res_bitmap_delta_size(src));
+    for(k=0; k<2; k++)
+    {
+      assert(0 == res_bitmap_delta_apply(dest[k], buf, n));
+      assert(1 == same_map(src, dest[k], 1000));
+    }
+    printf("Good!\n");
+
+    printf("\ttake, free, alloc & combine, a small buffer at a time... ");
+    other = res_bitmap_create(1000);
+    assert(NULL != other);
+    for(i=0; i<200; i++)
+    {
+      k = (size_t)rand() % 1000;
+      switch(rand() % 4)
+      {
+        case 0 :
+          res_bitmap_take(src, k, (size_t)rand() % 64);
+          break;
+        case 1 :
+          res_bitmap_free(src, k, (size_t)rand() % 64);
+          break;
+        case 2 :
+          res_bitmap_alloc(src, (size_t)rand() % 32 + 1);
+          break;
+        default :
+          res_bitmap_take(other, k, 0);
+      }
+      if(0 == i % 50)
+        assert(0 == res_bitmap_combine(src, other, RES_BITMAP_XOR));
+      if(0 == i % 10)
+        assert(0 < send_delta(src, dest, 2, (i % 20) ? 64 : RES_BITMAP_DELTA_HEADER + 3));
+    }
+    assert(0 < send_delta(src, dest, 2, 64));
+    for(k=0; k<2; k++)
+      assert(1 == same_map(src, dest[k], 1000));
+    assert(res_bitmap_count(src, 0, 1000) == res_bitmap_rank(dest[1], 1001));
+    assert(0 == res_bitmap_destroy(other));
+    printf("Good!\n");
+
+    printf("\tshrinking then growing, and growing past the copies... ");
+    assert(0 == res_bitmap_take(src, 900, 100));
+    assert(0 < send_delta(src, dest, 2, 64));
+    assert(0 == res_bitmap_resize(src, 500));
+    assert(0 == res_bitmap_resize(src, 1000));
+    assert(0 == res_bitmap_take(src, 990, 0));
+    n = res_bitmap_delta_export(src, buf, 64);
+    assert((1000 == buf[0]) && (500 == buf[1]));
+    assert(RES_BITMAP_DELTA_HEADER + 3 == n);  /*just the word holding 990*/
+    for(k=0; k<2; k++)
+    {
+      assert(0 == res_bitmap_delta_apply(dest[k], buf, n));
+      assert(1 == same_map(src, dest[k], 1000));
+      assert(1 == res_bitmap_count(dest[k], 900, 100));
+    }
+    assert(0 == res_bitmap_resize(src, 5000));
+    assert(0 == res_bitmap_take(src, 4000, 999));
+    assert(0 < send_delta(src, dest, 2, RES_BITMAP_DELTA_HEADER + 3));
+    for(k=0; k<2; k++)
+      assert(1 == same_map(src, dest[k], 5000));
+    assert(res_bitmap_count(src, 0, 5000) == res_bitmap_rank(dest[1], 5001));
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_delta_size(dest[0]));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_delta_export(dest[0], buf, 64));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_delta_export(src, buf, RES_BITMAP_DELTA_HEADER - 1));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    bad[0] = 100;
+    bad[1] = 100;
+    bad[2] = 0;
+    bad[3] = 1;
+    bad[4] = 1;
+    assert(2 == res_bitmap_delta_apply(dest[0], bad, 1));  /*no header*/
+    assert(2 == res_bitmap_delta_apply(dest[0], bad, 4));  /*run cut short*/
+    bad[1] = 101;
+    assert(2 == res_bitmap_delta_apply(dest[0], bad, 5));  /*low above num_bits*/
+    bad[1] = 100;
+    bad[2] = 100 / BITS + 1;
+    assert(2 == res_bitmap_delta_apply(dest[0], bad, 5));  /*run past the end of the map*/
+    bad[2] = 0;
+    bad[3] = 0;
+    assert(2 == res_bitmap_delta_apply(dest[0], bad, 5));  /*empty run*/
+    bad[2] = 100 / BITS;
+    bad[3] = 1;
+    bad[4] = ~(res_bitmap_word_t)0;
+    assert(2 == res_bitmap_delta_apply(dest[0], bad, 5));  /*bits above num_bits*/
+    assert(1 == same_map(src, dest[0], 5000));
+    printf("Good!\n");
+
+    printf("\tdestroying bitmaps... ");
+    assert(0 == res_bitmap_destroy(src));
+    assert(0 == res_bitmap_destroy(dest[0]));
+    assert(0 == res_bitmap_destroy(dest[1]));
+    printf("Good!\n");
+  return(0);
+}
+
+int parallel(void)
+{
+  res_bitmap_t* bitmap;
+  size_t num_bits;
+  size_t base;
+  size_t limit;
+  size_t i;
+  ushort threads;
+    num_bits = RES_BITMAP_PARALLEL_MIN * 16 + 12345;  /*enough for 16 workers, and a part word at the end*/
+    printf("\tcreating bitmap big enough for 16 workers... ");
+    bitmap = res_bitmap_create_opts(num_bits, RES_BITMAP_OPT_SUMMARY);
+    assert(NULL != bitmap);
+    printf("Good!\n");
+
+    printf("\tempty & full, small ranges on this thread... ");
+    for(threads=0; threads<=16; threads+=4)
+    {
+      assert(0 == res_bitmap_count_parallel(bitmap, 0, num_bits, threads));
+      assert(0 == res_bitmap_check_parallel(bitmap, 0, num_bits, threads));
+      assert(777 == res_bitmap_find_next_clear_parallel(bitmap, 777, threads));
+    }
+    assert(0 == res_bitmap_take(bitmap, 0, num_bits));
+    assert(num_bits + 1 == res_bitmap_count_parallel(bitmap, 0, num_bits, 8));
+    assert(1 == res_bitmap_check_parallel(bitmap, 0, num_bits, 8));
+    assert(1 == res_bitmap_check_parallel(bitmap, 3, 100, 8));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_find_next_clear_parallel(bitmap, 5, 8));
+    assert(RES_ERR_NO_MATCH == errno);
+    assert(0 == res_bitmap_free(bitmap, num_bits, 0));  /*the very last bit*/
+    assert(num_bits == res_bitmap_find_next_clear_parallel(bitmap, 0, 16));
+    assert(2 == res_bitmap_check_parallel(bitmap, 1, num_bits - 1, 16));
+    assert(0 == res_bitmap_free(bitmap, 0, num_bits));
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_count_parallel(bitmap, num_bits + 1, 0, 8));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_count_parallel(bitmap, 1, SIZE_MAX, 8));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(4 == res_bitmap_check_parallel(bitmap, num_bits + 1, 0, 8));
+    assert(5 == res_bitmap_check_parallel(bitmap, 0, num_bits + 1, 8));
+    errno = 0;
+    assert(RES_BITMAP_ERR == res_bitmap_find_next_clear_parallel(bitmap, num_bits + 1, 8));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\tsame answers as one thread over random ranges... ");
+    for(i=0; i<2000; i++)
+      assert(0 == res_bitmap_take(bitmap, (size_t)rand() % num_bits, 0));
+    assert(0 == res_bitmap_take(bitmap, 0, RES_BITMAP_PARALLEL_MIN * 10));  /*so find has to go past some workers*/
+    for(i=0; i<100; i++)
+    {
+      base = (0 == i % 2) ? (size_t)rand() % num_bits : (size_t)rand() % 1000;
+      limit = (size_t)rand() % (num_bits - base + 1);
+      threads = (ushort)((unsigned)rand() % 20);
+      assert(res_bitmap_count(bitmap, base, limit) == res_bitmap_count_parallel(bitmap, base, limit, threads));
+      assert(res_bitmap_check(bitmap, base, limit) == res_bitmap_check_parallel(bitmap, base, limit, threads));
+      assert(res_bitmap_find_next_clear(bitmap, base) == res_bitmap_find_next_clear_parallel(bitmap, base, threads));
+    }
+    printf("Good!\n");
+
+    printf("\ta range all taken but one bit, in each worker's slice... ");
+    assert(0 == res_bitmap_take(bitmap, 0, num_bits));
+    for(i=1; i<16; i++)
+    {
+      base = i * RES_BITMAP_PARALLEL_MIN + (size_t)rand() % RES_BITMAP_PARALLEL_MIN;
+      assert(0 == res_bitmap_free(bitmap, base, 0));
+      assert(base == res_bitmap_find_next_clear_parallel(bitmap, 0, 16));
+      assert(2 == res_bitmap_check_parallel(bitmap, 0, num_bits, 16));
+      assert(1 == res_bitmap_check_parallel(bitmap, 0, base - 1, 16));
+      assert(num_bits == res_bitmap_count_parallel(bitmap, 0, num_bits, 16));
+      assert(0 == res_bitmap_take(bitmap, base, 0));
+    }
+    printf("Good!\n");
+
+    printf("\tdestroying bitmap... ");
+    assert(0 == res_bitmap_destroy(bitmap));
+    printf("Good!\n");
+  return(0);
+}
+
+ushort combine_bit(ushort a, ushort b, ushort op)
+{
+  switch(op)
+  {
+    case RES_BITMAP_AND :
+      return(a & b);
+    case RES_BITMAP_OR :
+      return(a | b);
+    case RES_BITMAP_XOR :
+      return(a ^ b);
+    default :
+      return(a & !b);
+  }
+}
+
+size_t free_run(unsigned char* shadow, size_t size, size_t i)
+{
+  size_t len = 0;
+    while((i + len < size) && (0 == shadow[i + len]))
+      len++;
+  return(len);
+}
+
+ushort same_map(res_bitmap_t* a, res_bitmap_t* b, size_t num_bits)
+{
+  if((4 == res_bitmap_check(a, num_bits, 0)) || (4 != res_bitmap_check(a, num_bits + 1, 0)))
+    return(0);
+  if((4 == res_bitmap_check(b, num_bits, 0)) || (4 != res_bitmap_check(b, num_bits + 1, 0)))
+    return(0);
+  return((0 == res_bitmap_combine_count(a, b, RES_BITMAP_XOR)) ? 1 : 0);
+}
+
+#ifdef RES_BITMAP_TEST_REFF
+ushort page_dirty(res_bitmap_t* bitmap, size_t offset)
+{
+  size_t page;
+    assert(NULL != bitmap->file);
+    page = offset / bitmap->file->page;
+  return((0 != (bitmap->file->dirty[page/BITS] & ((res_bitmap_word_t)1 << (page%BITS)))) ? 1 : 0);
+}
+
+ushort file_clean(res_bitmap_t* bitmap)
+{
+  size_t i;
+    assert(NULL != bitmap->file);
+    for(i=0; i<bitmap->file->dirty_words; i++)
+      if(0 != bitmap->file->dirty[i])
+        return(0);
+  return(1);
+}
+#endif
+
+size_t send_delta(res_bitmap_t* src, res_bitmap_t** dest, size_t dests, size_t size)
+{
+  res_bitmap_word_t buf[64];
+  size_t exports = 0;
+  size_t n;
+  size_t k;
+    do
+    {
+      n = res_bitmap_delta_export(src, buf, size);
+      assert((RES_BITMAP_ERR != n) && (n <= size));
+      for(k=0; k<dests; k++)
+        assert(0 == res_bitmap_delta_apply(dest[k], buf, n));
+      exports++;
+    } while(RES_BITMAP_DELTA_HEADER != res_bitmap_delta_size(src));
+  return(exports);
+}
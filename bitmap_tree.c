@@ -0,0 +1,1394 @@
+/* bitmap_tree.c - extent tree implementation of the bitmap API
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: tree-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap_tree.h"
+
+/* Taken bits are kept as extents in a treap ordered by start, with the nodes
+ * in one array linked by index, as bitmap_extents.c. Extents never touch or
+ * overlap - a take that reaches one joins it - so the free runs of the map are
+ * exactly the gaps between them, plus the run from the end of the last extent
+ * to the end of the map. Each node keeps the gap before its own extent, and
+ * for its subtree the bits taken and the largest gap. That is enough to
+ * count, rank and select by walking down from the root, and to find the
+ * lowest gap big enough by only going into subtrees whose largest gap is.
+ *
+ * Every change is done the same way: split the treap into the extents before
+ * the range, the ones touching it and the rest, replace the middle with at
+ * most two new extents, fix the gap of the first extent after, and merge the
+ * three back. Nodes are reserved before the split, so a change either
+ * happens completely or not at all.*/
+
+res_bitmap_t* res_bitmap_create(size_t num_bits)
+{
+  return(res_bitmap_create_opts(num_bits, 0));
+}
+
+res_bitmap_t* res_bitmap_create_opts(size_t num_bits, ushort opts)
+{
+  res_bitmap_t *handle;
+   /*check options - all known ones but RES_BITMAP_OPT_DELTA are no-ops here. Bits up to num_bits+1 must fit a size_t*/
+    if(0 != (opts & ~(RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK | RES_BITMAP_OPT_DELTA)))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+    if(num_bits >= RES_BITMAP_ERR)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+    handle = malloc( sizeof(res_bitmap_t) );
+    if(NULL == handle)
+      return(NULL);
+
+   /*empty tree - every bit free*/
+    _res_bitmap_tree_init(&handle->tree);
+    handle->num_bits = num_bits;
+    handle->opts = opts;
+    handle->policy = RES_BITMAP_FIRST_FIT;
+    handle->rover = 0;
+    handle->delta = NULL;
+    if(0 != (opts & RES_BITMAP_OPT_DELTA))
+    {
+      handle->delta = _res_bitmap_delta_create(num_bits);
+      if(NULL == handle->delta)
+      {
+        res_bitmap_destroy(handle);
+        return(NULL);
+      }
+    }
+  return(handle);
+}
+
+res_bitmap_t* res_bitmap_create_file(const char* path, size_t num_bits, ushort opts)
+{
+  (void)path;
+  (void)num_bits;
+  if(0 != (opts & ~(RES_BITMAP_OPT_SUMMARY | RES_BITMAP_OPT_EXTENTS | RES_BITMAP_OPT_RANK | RES_BITMAP_OPT_DELTA)))
+    errno = RES_ERR_BAD_PARAMETER;
+  else
+    errno = RES_ERR_INCOMPATIBLE_RESOURCE;  /*there's no map to put in a file*/
+  return(NULL);
+}
+
+res_bitmap_t* res_bitmap_open_file(const char* path, ushort opts)
+{
+  return(res_bitmap_create_file(path, 0, opts));
+}
+
+ushort res_bitmap_sync(res_bitmap_t* bitmap_handle)
+{
+  (void)bitmap_handle;
+  return(0);
+}
+
+ushort res_bitmap_destroy(res_bitmap_t* bitmap_handle)
+{
+  _res_bitmap_tree_clear(&bitmap_handle->tree);
+  if(NULL != bitmap_handle->delta)
+    _res_bitmap_delta_destroy(bitmap_handle->delta);
+  free(bitmap_handle);
+  return(0);
+}
+
+size_t res_bitmap_alloc(res_bitmap_t* bitmap_handle, size_t block_size)
+{
+  size_t i;
+  size_t num_bits;
+    num_bits = bitmap_handle->num_bits;
+
+   /*check if block_size valid*/
+    if(block_size > num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*find a block of free bits big enough - the same one reff-1 would*/
+    if(RES_BITMAP_NEXT_FIT == bitmap_handle->policy)
+    {
+     /*next fit - carry on from the end of the last block. If nothing is free from there on, the lowest block must start before the cursor*/
+      i = _res_bitmap_tree_scan(bitmap_handle, bitmap_handle->rover, block_size + 1);
+      if((RES_BITMAP_ERR == i) && (0 != bitmap_handle->rover))
+        i = _res_bitmap_tree_scan(bitmap_handle, 0, block_size + 1);
+    } else if((RES_BITMAP_BEST_FIT == bitmap_handle->policy) || (RES_BITMAP_WORST_FIT == bitmap_handle->policy)) {
+      i = _res_bitmap_tree_fit(bitmap_handle, block_size + 1, (RES_BITMAP_WORST_FIT == bitmap_handle->policy) ? 1 : 0);
+    } else {
+      i = _res_bitmap_tree_scan(bitmap_handle, 0, block_size + 1);
+    }
+    if(RES_BITMAP_ERR == i)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);  /*nothing found :-(*/
+    }
+    if(0 != _res_bitmap_tree_mark(bitmap_handle, i, i + block_size, 1))
+      return(RES_BITMAP_ERR);
+
+   /*move cursor to just after the block*/
+    if(i + block_size >= num_bits)
+      bitmap_handle->rover = 0;
+    else
+      bitmap_handle->rover = i + block_size + 1;
+  return(i);
+}
+
+size_t res_bitmap_alloc_aligned(res_bitmap_t* bitmap_handle, size_t block_size, ushort align_order)
+{
+  res_bitmap_tree_t* tree;
+  size_t i;
+  size_t align;
+  size_t end;
+   /*check parameters*/
+    if((block_size > bitmap_handle->num_bits) || (align_order >= sizeof(size_t) * BITS_IN_A_BYTE))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+    tree = &bitmap_handle->tree;
+    align = (size_t)1 << align_order;
+
+   /*lowest aligned block in a gap, and if none the free run at the end*/
+    i = _res_bitmap_tree_aligned(tree, tree->root, block_size + 1, align);
+    if(RES_BITMAP_ERR == i)
+    {
+      end = _res_bitmap_tree_end(tree);
+      i = end;
+      if(0 != (i & (align - 1)))
+        i = (i > SIZE_MAX - align) ? RES_BITMAP_ERR : (i | (align - 1)) + 1;
+      if((i > bitmap_handle->num_bits) || (bitmap_handle->num_bits - i < block_size))
+        i = RES_BITMAP_ERR;  /*includes RES_BITMAP_ERR itself*/
+    }
+    if(RES_BITMAP_ERR == i)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+    if(0 != _res_bitmap_tree_mark(bitmap_handle, i, i + block_size, 1))
+      return(RES_BITMAP_ERR);
+  return(i);
+}
+
+size_t res_bitmap_alloc_many(res_bitmap_t* bitmap_handle, size_t block_size, size_t count, size_t* out)
+{
+  size_t n;
+  size_t i;
+   /*check if block_size valid*/
+    if(block_size > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*each alloc is a search from the root, so there's nothing to gain from a single pass*/
+    for(n=0; n<count; n++)
+    {
+      i = res_bitmap_alloc(bitmap_handle, block_size);
+      if(RES_BITMAP_ERR == i)
+        break;  /*errno set by res_bitmap_alloc*/
+      out[n] = i;
+    }
+  return(n);
+}
+
+ushort res_bitmap_free(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > bitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+    if(0 != _res_bitmap_tree_mark(bitmap_handle, base, base+limit, 0))
+      return(4);
+
+   /*if this block ran up to the next fit cursor (eg it was the last one allocated), move the cursor back so the space is used again first*/
+    if((bitmap_handle->rover > base) && (bitmap_handle->rover <= base + limit + 1))
+      bitmap_handle->rover = base;
+  return(0);
+}
+
+ushort res_bitmap_free_many(res_bitmap_t* bitmap_handle, size_t* bits, size_t count, size_t block_size)
+{
+  size_t first;
+  size_t last;
+  size_t i;
+   /*check every block before freeing any of them*/
+    for(i=0; i<count; i++)
+    {
+      if(bits[i] > bitmap_handle->num_bits)
+        return(2);
+      if((bits[i] > (SIZE_MAX - block_size)) || ((bits[i]+block_size) > bitmap_handle->num_bits))
+        return(3);
+    }
+
+   /*a free splits at most one extent, so this many nodes are enough for all of them*/
+    if(0 != _res_bitmap_tree_reserve(&bitmap_handle->tree, count + 2))
+      return(4);
+
+   /*sort them, unless they already are (eg straight from res_bitmap_alloc_many)*/
+    for(i=1; i<count; i++)
+    {
+      if(bits[i] < bits[i-1])
+      {
+        qsort(bits, count, sizeof(size_t), _res_bitmap_compare);
+        break;
+      }
+    }
+
+   /*join up blocks that touch or overlap, and free each run in one go*/
+    i = 0;
+    while(i < count)
+    {
+      first = bits[i];
+      last = bits[i] + block_size;
+      for(i++; (i < count) && (bits[i] <= last + 1); i++)
+        if(bits[i] + block_size > last)
+          last = bits[i] + block_size;
+      _res_bitmap_tree_mark(bitmap_handle, first, last, 0);  /*can't fail - reserved above*/
+
+     /*as res_bitmap_free - a run up to the next fit cursor moves it back*/
+      if((bitmap_handle->rover > first) && (bitmap_handle->rover <= last + 1))
+        bitmap_handle->rover = first;
+    }
+  return(0);
+}
+
+ushort res_bitmap_take(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > bitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+    if(0 != _res_bitmap_tree_mark(bitmap_handle, base, base+limit, 1))
+      return(4);
+  return(0);
+}
+
+ushort res_bitmap_reserve(res_bitmap_t* bitmap_handle, const res_bitmap_range_t* ranges, size_t count, size_t* failed)
+{
+  size_t i;
+  size_t j;
+   /*check every range before touching the map*/
+    for(i=0; i<count; i++)
+    {
+      if(ranges[i].base > bitmap_handle->num_bits)
+      {
+        if(NULL != failed)
+          *failed = i;
+        return(2);
+      }
+      if((ranges[i].base > (SIZE_MAX - ranges[i].limit)) || ((ranges[i].base+ranges[i].limit) > bitmap_handle->num_bits))
+      {
+        if(NULL != failed)
+          *failed = i;
+        return(3);
+      }
+    }
+
+   /*each take adds at most one extent, and putting them back never has more than the takes did - so nothing after this can fail*/
+    if(0 != _res_bitmap_tree_reserve(&bitmap_handle->tree, count + 2))
+      return(4);
+
+   /*count each range, then take it - the first with a bit taken puts back the ranges already in. They were all clear, so freeing them leaves the map as it was*/
+    for(i=0; i<count; i++)
+    {
+      if(0 != _res_bitmap_tree_rank(&bitmap_handle->tree, ranges[i].base + ranges[i].limit + 1) - _res_bitmap_tree_rank(&bitmap_handle->tree, ranges[i].base))
+      {
+        for(j=i; j>0; j--)
+          _res_bitmap_tree_mark(bitmap_handle, ranges[j-1].base, ranges[j-1].base+ranges[j-1].limit, 0);
+        if(NULL != failed)
+          *failed = i;
+        return(1);
+      }
+      _res_bitmap_tree_mark(bitmap_handle, ranges[i].base, ranges[i].base+ranges[i].limit, 1);
+    }
+  return(0);
+}
+
+ushort res_bitmap_check(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+{
+  size_t count;
+   /*check base & limit*/
+    if(base > bitmap_handle->num_bits)
+      return(4);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(5);
+
+   /*none, all or some of the range taken*/
+    count = _res_bitmap_tree_rank(&bitmap_handle->tree, base + limit + 1) - _res_bitmap_tree_rank(&bitmap_handle->tree, base);
+    if(0 == count)
+      return(0);
+    if(limit + 1 == count)
+      return(1);
+  return(2);
+}
+
+ushort res_bitmap_set_policy(res_bitmap_t* bitmap_handle, ushort policy)
+{
+  if(policy > RES_BITMAP_WORST_FIT)
+    return(2);
+  bitmap_handle->policy = policy;
+  return(0);
+}
+
+ushort res_bitmap_resize(res_bitmap_t* bitmap_handle, size_t num_bits)
+{
+  res_bitmap_delta_t* delta;
+  size_t old_num_bits;
+    if(num_bits >= RES_BITMAP_ERR)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(2);
+    }
+    old_num_bits = bitmap_handle->num_bits;
+
+   /*make room in the delta first, so nothing has changed if that fails*/
+    if(NULL != bitmap_handle->delta)
+      if(0 != _res_bitmap_delta_reserve(bitmap_handle->delta, num_bits))
+        return(2);
+
+   /*when shrinking, cut off extents past the end, so they don't come back on the next grow. Growing is just a bigger free run at the end. The receiver of a delta cuts them off too, so as in reff-1 they aren't changes to send*/
+    if(num_bits < old_num_bits)
+    {
+      delta = bitmap_handle->delta;
+      bitmap_handle->delta = NULL;
+      if(0 != _res_bitmap_tree_mark(bitmap_handle, num_bits + 1, old_num_bits, 0))
+      {
+        bitmap_handle->delta = delta;
+        return(2);
+      }
+      bitmap_handle->delta = delta;
+    }
+    bitmap_handle->num_bits = num_bits;
+    if(NULL != bitmap_handle->delta)
+      _res_bitmap_delta_resize(bitmap_handle->delta, old_num_bits, num_bits);
+
+   /*next fit cursor off the end - wrap round*/
+    if(bitmap_handle->rover > num_bits)
+      bitmap_handle->rover = 0;
+  return(0);
+}
+
+size_t res_bitmap_count(res_bitmap_t* bitmap_handle, size_t base, size_t limit)
+{
+   /*check parameters*/
+    if(base > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+  return(_res_bitmap_tree_rank(&bitmap_handle->tree, base + limit + 1) - _res_bitmap_tree_rank(&bitmap_handle->tree, base));
+}
+
+size_t res_bitmap_get_size(res_bitmap_t* bitmap_handle)
+{
+ /*return num_bits*/
+  return(bitmap_handle -> num_bits);
+}
+
+size_t res_bitmap_largest_free(res_bitmap_t* bitmap_handle)
+{
+  res_bitmap_tree_t* tree;
+  size_t largest = 0;
+    tree = &bitmap_handle->tree;
+
+   /*the largest gap, or the run at the end if that's bigger*/
+    if(RES_BITMAP_TREE_NIL != tree->root)
+      largest = tree->node[tree->root].max_gap;
+    if(bitmap_handle->num_bits + 1 - _res_bitmap_tree_end(tree) > largest)
+      largest = bitmap_handle->num_bits + 1 - _res_bitmap_tree_end(tree);
+
+    if(0 == largest)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+  return(largest - 1);  /*a block_size*/
+}
+
+ushort res_bitmap_free_stats(res_bitmap_t* bitmap_handle, res_bitmap_free_stats_t* stats)
+{
+  size_t c;
+  size_t end;
+    stats->free_bits = 0;
+    stats->runs = 0;
+    stats->largest = 0;
+    for(c=0; c<BITS; c++)
+      stats->histogram[c] = 0;
+
+   /*every gap, then the run at the end*/
+    _res_bitmap_tree_stats(&bitmap_handle->tree, bitmap_handle->tree.root, stats);
+    end = _res_bitmap_tree_end(&bitmap_handle->tree);
+    if(end <= bitmap_handle->num_bits)
+      _res_bitmap_free_run(stats, bitmap_handle->num_bits + 1 - end);
+  return(0);
+}
+
+size_t res_bitmap_find_next_set(res_bitmap_t* bitmap_handle, size_t from)
+{
+  size_t i;
+   /*check parameters*/
+    if(from > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*from itself if it's in an extent, otherwise the start of the next one*/
+    i = _res_bitmap_tree_at(&bitmap_handle->tree, from);
+    if(RES_BITMAP_TREE_NIL == i)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+  return((bitmap_handle->tree.node[i].start > from) ? bitmap_handle->tree.node[i].start : from);
+}
+
+size_t res_bitmap_find_next_clear(res_bitmap_t* bitmap_handle, size_t from)
+{
+  res_bitmap_tree_node_t* node;
+  size_t i;
+   /*check parameters*/
+    if(from > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*from itself if it's free, otherwise the end of its extent - extents don't touch, so that bit is free if it's in the map*/
+    i = _res_bitmap_tree_find_le(&bitmap_handle->tree, from);
+    if(RES_BITMAP_TREE_NIL == i)
+      return(from);
+    node = &bitmap_handle->tree.node[i];
+    if(node->start + node->len <= from)
+      return(from);
+    if(node->start + node->len > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+  return(node->start + node->len);
+}
+
+size_t res_bitmap_find_prev_set(res_bitmap_t* bitmap_handle, size_t from)
+{
+  res_bitmap_tree_node_t* node;
+  size_t i;
+   /*check parameters*/
+    if(from > bitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*from itself if it's in the last extent starting at or before it, otherwise that extent's last bit*/
+    i = _res_bitmap_tree_find_le(&bitmap_handle->tree, from);
+    if(RES_BITMAP_TREE_NIL == i)
+    {
+      errno = RES_ERR_NO_MATCH;
+      return(RES_BITMAP_ERR);
+    }
+    node = &bitmap_handle->tree.node[i];
+  return((node->start + node->len - 1 < from) ? node->start + node->len - 1 : from);
+}
+
+ushort res_bitmap_iter_init(res_bitmap_t* bitmap_handle, res_bitmap_iter_t* iter, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > bitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > bitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+    iter->bitmap = bitmap_handle;
+    iter->bit = base;
+    iter->end = 0;  /*look it up on the first call*/
+    iter->last = base + limit;
+  return(0);
+}
+
+size_t res_bitmap_iter_next(res_bitmap_iter_t* iter)
+{
+  res_bitmap_tree_t* tree;
+  size_t i;
+    if(iter->bit > iter->last)
+      return(RES_BITMAP_ERR);
+
+   /*off the end of the extent we were in - on to the one holding bit, or the next*/
+    if(iter->bit >= iter->end)
+    {
+      tree = &iter->bitmap->tree;
+      i = _res_bitmap_tree_at(tree, iter->bit);
+      if(RES_BITMAP_TREE_NIL == i)
+      {
+        iter->bit = iter->last + 1;
+        return(RES_BITMAP_ERR);
+      }
+      if(tree->node[i].start > iter->bit)
+        iter->bit = tree->node[i].start;
+      iter->end = tree->node[i].start + tree->node[i].len;
+      if(iter->bit > iter->last)
+        return(RES_BITMAP_ERR);
+    }
+  return(iter->bit++);
+}
+
+size_t res_bitmap_rank(res_bitmap_t* bitmap_handle, size_t bit)
+{
+   /*check bit - num_bits+1 is allowed, for the whole map*/
+    if(bit > bitmap_handle->num_bits + 1)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+  return(_res_bitmap_tree_rank(&bitmap_handle->tree, bit));
+}
+
+size_t res_bitmap_select(res_bitmap_t* bitmap_handle, size_t k)
+{
+  res_bitmap_tree_t* tree;
+  res_bitmap_tree_node_t* node;
+  size_t t;
+  size_t below;
+    tree = &bitmap_handle->tree;
+
+   /*down from the root - left if k is in the left subtree, this extent if it's in it, otherwise right with what was passed knocked off k*/
+    t = tree->root;
+    while(RES_BITMAP_TREE_NIL != t)
+    {
+      node = &tree->node[t];
+      below = (RES_BITMAP_TREE_NIL == node->left) ? 0 : tree->node[node->left].taken;
+      if(k < below)
+      {
+        t = node->left;
+        continue;
+      }
+      k -= below;
+      if(k < node->len)
+        return(node->start + k);
+      k -= node->len;
+      t = node->right;
+    }
+    errno = RES_ERR_NO_MATCH;
+  return(RES_BITMAP_ERR);
+}
+
+size_t res_bitmap_delta_size(res_bitmap_t* bitmap_handle)
+{
+  if(NULL == bitmap_handle->delta)
+  {
+    errno = RES_ERR_BAD_PARAMETER;
+    return(RES_BITMAP_ERR);
+  }
+  return(_res_bitmap_delta_size(bitmap_handle->delta, bitmap_handle->num_bits));
+}
+
+size_t res_bitmap_delta_export(res_bitmap_t* bitmap_handle, res_bitmap_word_t* buf, size_t size)
+{
+  res_bitmap_delta_t* delta;
+  size_t words;
+  size_t first;
+  size_t n;
+  size_t out;
+    delta = bitmap_handle->delta;
+    if((NULL == delta) || (size < RES_BITMAP_DELTA_HEADER))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+
+   /*as _res_bitmap_delta_export, but there's no map to copy the words from - they're made from the extents*/
+    buf[0] = (res_bitmap_word_t)bitmap_handle->num_bits;
+    buf[1] = (res_bitmap_word_t)delta->low;
+    delta->low = bitmap_handle->num_bits;  /*the receiver has been told*/
+    out = RES_BITMAP_DELTA_HEADER;
+
+    words = bitmap_handle->num_bits / BITS + 1;
+    first = _res_bitmap_delta_next(delta, 0, words, 1);
+    while((first < words) && (out + 3 <= size))
+    {
+      n = _res_bitmap_delta_next(delta, first, words, 0) - first;
+      if(n > size - out - 2)
+        n = size - out - 2;  /*the rest stays dirty for the next export*/
+      buf[out] = (res_bitmap_word_t)first;
+      buf[out + 1] = (res_bitmap_word_t)n;
+      _res_bitmap_tree_words(&bitmap_handle->tree, first, n, buf + out + 2);
+      _res_bitmap_mark(delta->dirty, first, first + n - 1, 0);
+      out += n + 2;
+      first = _res_bitmap_delta_next(delta, first + n, words, 1);
+    }
+  return(out);
+}
+
+ushort res_bitmap_delta_apply(res_bitmap_t* bitmap_handle, const res_bitmap_word_t* buf, size_t size)
+{
+  res_bitmap_word_t word;
+  res_bitmap_word_t carry;
+  size_t runs = 0;
+  size_t i;
+  size_t w;
+  size_t n;
+  size_t lo;
+  size_t hi;
+  size_t start;
+  size_t end;
+    if(0 != _res_bitmap_delta_check(buf, size))
+      return(2);
+
+   /*a run of words frees at most one extent in two, and each run of set bits in it adds one - reserve for all of them, and the resizes, so nothing changes unless everything can*/
+    for(i=RES_BITMAP_DELTA_HEADER; i<size; i+=n + 2)
+    {
+      n = (size_t)buf[i+1];
+      carry = 0;
+      for(w=0; w<n; w++)
+      {
+        word = buf[i + 2 + w];
+        runs += RES_BITMAP_POPCOUNT(word & ~((word << 1) | carry));
+        carry = word >> (BITS - 1);
+      }
+      runs++;
+    }
+    if(0 != _res_bitmap_tree_reserve(&bitmap_handle->tree, runs + 4))
+      return(3);
+    if(NULL != bitmap_handle->delta)
+      if(0 != _res_bitmap_delta_reserve(bitmap_handle->delta, (size_t)buf[0]))
+        return(3);
+
+   /*down to the smallest size the source had, then up to its size now*/
+    if((size_t)buf[1] < bitmap_handle->num_bits)
+      res_bitmap_resize(bitmap_handle, (size_t)buf[1]);
+    if((size_t)buf[0] != bitmap_handle->num_bits)
+      res_bitmap_resize(bitmap_handle, (size_t)buf[0]);
+
+   /*free the bits of each run of words, then take its runs of set bits - which may go on from word to word*/
+    for(i=RES_BITMAP_DELTA_HEADER; i<size; i+=n + 2)
+    {
+      n = (size_t)buf[i+1];
+      lo = (size_t)buf[i] * BITS;
+      hi = lo + n * BITS - 1;
+      if(hi > bitmap_handle->num_bits)
+        hi = bitmap_handle->num_bits;
+      _res_bitmap_tree_mark(bitmap_handle, lo, hi, 0);
+
+      start = _res_bitmap_tree_next(buf + i + 2, n, 0, 1);
+      while(start < n * BITS)
+      {
+        end = _res_bitmap_tree_next(buf + i + 2, n, start, 0);
+        _res_bitmap_tree_mark(bitmap_handle, lo + start, lo + end - 1, 1);
+        start = _res_bitmap_tree_next(buf + i + 2, n, end, 1);
+      }
+    }
+  return(0);
+}
+
+ushort res_bitmap_combine(res_bitmap_t* dest_handle, res_bitmap_t* src_handle, ushort op)
+{
+  return(res_bitmap_combine_into(dest_handle, dest_handle, src_handle, op));
+}
+
+ushort res_bitmap_combine_into(res_bitmap_t* dest_handle, res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op)
+{
+  res_bitmap_tree_t result;
+    if(op > RES_BITMAP_ANDNOT)
+      return(2);
+
+   /*into a new tree, so a and b can be read while it's built even when one of them is dest*/
+    _res_bitmap_tree_init(&result);
+    if(RES_BITMAP_ERR == _res_bitmap_tree_combine(&result, &a_handle->tree, &b_handle->tree, dest_handle->num_bits, op))
+    {
+      _res_bitmap_tree_clear(&result);
+      return(3);
+    }
+    _res_bitmap_tree_clear(&dest_handle->tree);
+    dest_handle->tree = result;
+
+    if(NULL != dest_handle->delta)
+      _res_bitmap_delta_touch(dest_handle->delta, 0, dest_handle->num_bits/BITS);
+  return(0);
+}
+
+size_t res_bitmap_combine_count(res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op)
+{
+    if(op > RES_BITMAP_ANDNOT)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_BITMAP_ERR);
+    }
+  return(_res_bitmap_tree_combine(NULL, &a_handle->tree, &b_handle->tree, a_handle->num_bits, op));
+}
+
+/*-------------- Internals ----------------*/
+
+res_bitmap_word_t _res_bitmap_mask(size_t first, size_t last)
+{
+  return( (~(res_bitmap_word_t)0 >> (BITS - 1 - last)) & (~(res_bitmap_word_t)0 << first) );
+}
+
+void _res_bitmap_mark(res_bitmap_word_t* bitmap, size_t first, size_t last, ushort up)
+{
+  size_t i;
+  size_t first_word;
+  size_t last_word;
+    first_word = first / BITS;
+    last_word = last / BITS;
+    if(first_word == last_word)
+    {
+      if(0 != up)
+        bitmap[first_word] |= _res_bitmap_mask(first%BITS, last%BITS);
+      else
+        bitmap[first_word] &= ~_res_bitmap_mask(first%BITS, last%BITS);
+      return;
+    }
+
+   /*partial first word, whole words in the middle, partial last word*/
+    if(0 != up)
+    {
+      bitmap[first_word] |= _res_bitmap_mask(first%BITS, BITS-1);
+      for(i=first_word+1; i<last_word; i++)
+        bitmap[i] = ~(res_bitmap_word_t)0;
+      bitmap[last_word] |= _res_bitmap_mask(0, last%BITS);
+    } else {
+      bitmap[first_word] &= ~_res_bitmap_mask(first%BITS, BITS-1);
+      for(i=first_word+1; i<last_word; i++)
+        bitmap[i] = 0;
+      bitmap[last_word] &= ~_res_bitmap_mask(0, last%BITS);
+    }
+}
+
+void _res_bitmap_tree_init(res_bitmap_tree_t* tree)
+{
+  tree->node = NULL;
+  tree->capacity = 0;
+  tree->used = 0;
+  tree->free_node = RES_BITMAP_TREE_NIL;
+  tree->root = RES_BITMAP_TREE_NIL;
+  tree->count = 0;
+  tree->seed = 2463534242u;
+}
+
+void _res_bitmap_tree_clear(res_bitmap_tree_t* tree)
+{
+  free(tree->node);
+  _res_bitmap_tree_init(tree);
+}
+
+ushort _res_bitmap_tree_reserve(res_bitmap_tree_t* tree, size_t n)
+{
+  res_bitmap_tree_node_t* node;
+  size_t capacity;
+   /*nodes not holding an extent are either on the free list or not handed out yet*/
+    if(tree->capacity - tree->count >= n)
+      return(0);
+
+    capacity = (0 == tree->capacity) ? 64 : tree->capacity * 2;
+    if(capacity < tree->count + n)
+      capacity = tree->count + n;
+    if(capacity > SIZE_MAX / sizeof(res_bitmap_tree_node_t))
+    {
+      errno = ENOMEM;
+      return(2);
+    }
+    node = realloc( tree->node, capacity * sizeof(res_bitmap_tree_node_t) );
+    if(NULL == node)
+      return(2);
+    tree->node = node;
+    tree->capacity = capacity;
+  return(0);
+}
+
+size_t _res_bitmap_tree_node(res_bitmap_tree_t* tree, size_t start, size_t len, size_t gap)
+{
+  res_bitmap_tree_node_t* node;
+  size_t i;
+   /*off the free list, or from the end of the array*/
+    if(RES_BITMAP_TREE_NIL != tree->free_node)
+    {
+      i = tree->free_node;
+      tree->free_node = tree->node[i].left;
+    } else {
+      i = tree->used++;
+    }
+
+    node = &tree->node[i];
+    node->start = start;
+    node->len = len;
+    node->gap = gap;
+    node->left = RES_BITMAP_TREE_NIL;
+    node->right = RES_BITMAP_TREE_NIL;
+    node->taken = len;
+    node->max_gap = gap;
+    tree->seed ^= tree->seed << 13;  /*xorshift*/
+    tree->seed ^= tree->seed >> 17;
+    tree->seed ^= tree->seed << 5;
+    node->priority = tree->seed;
+    tree->count++;
+  return(i);
+}
+
+void _res_bitmap_tree_release(res_bitmap_tree_t* tree, size_t t)
+{
+  size_t right;
+    while(RES_BITMAP_TREE_NIL != t)
+    {
+      _res_bitmap_tree_release(tree, tree->node[t].left);
+      right = tree->node[t].right;
+      tree->node[t].left = tree->free_node;
+      tree->free_node = t;
+      tree->count--;
+      t = right;
+    }
+}
+
+void _res_bitmap_tree_pull(res_bitmap_tree_t* tree, size_t t)
+{
+  res_bitmap_tree_node_t* node;
+  res_bitmap_tree_node_t* child;
+    node = &tree->node[t];
+    node->taken = node->len;
+    node->max_gap = node->gap;
+    if(RES_BITMAP_TREE_NIL != node->left)
+    {
+      child = &tree->node[node->left];
+      node->taken += child->taken;
+      if(child->max_gap > node->max_gap)
+        node->max_gap = child->max_gap;
+    }
+    if(RES_BITMAP_TREE_NIL != node->right)
+    {
+      child = &tree->node[node->right];
+      node->taken += child->taken;
+      if(child->max_gap > node->max_gap)
+        node->max_gap = child->max_gap;
+    }
+}
+
+void _res_bitmap_tree_split(res_bitmap_tree_t* tree, size_t t, size_t start, size_t* left, size_t* right)
+{
+   /*left gets nodes starting below start, right the rest*/
+    if(RES_BITMAP_TREE_NIL == t)
+    {
+      *left = RES_BITMAP_TREE_NIL;
+      *right = RES_BITMAP_TREE_NIL;
+      return;
+    }
+    if(tree->node[t].start < start)
+    {
+      _res_bitmap_tree_split(tree, tree->node[t].right, start, &tree->node[t].right, right);
+      *left = t;
+    } else {
+      _res_bitmap_tree_split(tree, tree->node[t].left, start, left, &tree->node[t].left);
+      *right = t;
+    }
+    _res_bitmap_tree_pull(tree, t);
+}
+
+size_t _res_bitmap_tree_merge(res_bitmap_tree_t* tree, size_t left, size_t right)
+{
+   /*everything in left starts before everything in right - highest priority ends up on top*/
+    if(RES_BITMAP_TREE_NIL == left)
+      return(right);
+    if(RES_BITMAP_TREE_NIL == right)
+      return(left);
+    if(tree->node[left].priority > tree->node[right].priority)
+    {
+      tree->node[left].right = _res_bitmap_tree_merge(tree, tree->node[left].right, right);
+      _res_bitmap_tree_pull(tree, left);
+      return(left);
+    }
+    tree->node[right].left = _res_bitmap_tree_merge(tree, left, tree->node[right].left);
+    _res_bitmap_tree_pull(tree, right);
+  return(right);
+}
+
+void _res_bitmap_tree_after(res_bitmap_tree_t* tree, size_t t, size_t end)
+{
+   /*down the left edge to the first extent, then back up it putting the sums right*/
+    if(RES_BITMAP_TREE_NIL == tree->node[t].left)
+      tree->node[t].gap = tree->node[t].start - end;
+    else
+      _res_bitmap_tree_after(tree, tree->node[t].left, end);
+    _res_bitmap_tree_pull(tree, t);
+}
+
+size_t _res_bitmap_tree_first_node(res_bitmap_tree_t* tree, size_t t)
+{
+  if(RES_BITMAP_TREE_NIL == t)
+    return(t);
+  while(RES_BITMAP_TREE_NIL != tree->node[t].left)
+    t = tree->node[t].left;
+  return(t);
+}
+
+size_t _res_bitmap_tree_last_node(res_bitmap_tree_t* tree, size_t t)
+{
+  if(RES_BITMAP_TREE_NIL == t)
+    return(t);
+  while(RES_BITMAP_TREE_NIL != tree->node[t].right)
+    t = tree->node[t].right;
+  return(t);
+}
+
+size_t _res_bitmap_tree_end(res_bitmap_tree_t* tree)
+{
+  size_t t;
+    t = _res_bitmap_tree_last_node(tree, tree->root);
+    if(RES_BITMAP_TREE_NIL == t)
+      return(0);
+  return(tree->node[t].start + tree->node[t].len);
+}
+
+size_t _res_bitmap_tree_find_le(res_bitmap_tree_t* tree, size_t bit)
+{
+  size_t t;
+  size_t found = RES_BITMAP_TREE_NIL;
+    t = tree->root;
+    while(RES_BITMAP_TREE_NIL != t)
+    {
+      if(tree->node[t].start <= bit)
+      {
+        found = t;
+        t = tree->node[t].right;
+      } else {
+        t = tree->node[t].left;
+      }
+    }
+  return(found);
+}
+
+size_t _res_bitmap_tree_find_ge(res_bitmap_tree_t* tree, size_t bit)
+{
+  size_t t;
+  size_t found = RES_BITMAP_TREE_NIL;
+    t = tree->root;
+    while(RES_BITMAP_TREE_NIL != t)
+    {
+      if(tree->node[t].start >= bit)
+      {
+        found = t;
+        t = tree->node[t].left;
+      } else {
+        t = tree->node[t].right;
+      }
+    }
+  return(found);
+}
+
+size_t _res_bitmap_tree_at(res_bitmap_tree_t* tree, size_t bit)
+{
+  size_t i;
+    i = _res_bitmap_tree_find_le(tree, bit);
+    if((RES_BITMAP_TREE_NIL != i) && (tree->node[i].start + tree->node[i].len > bit))
+      return(i);
+  return(_res_bitmap_tree_find_ge(tree, bit));
+}
+
+size_t _res_bitmap_tree_rank(res_bitmap_tree_t* tree, size_t bit)
+{
+  res_bitmap_tree_node_t* node;
+  size_t t;
+  size_t r = 0;
+   /*extents starting at or after bit don't count. Of one starting before it, the whole left subtree counts, and as much of its own extent as is below bit*/
+    t = tree->root;
+    while(RES_BITMAP_TREE_NIL != t)
+    {
+      node = &tree->node[t];
+      if(node->start >= bit)
+      {
+        t = node->left;
+        continue;
+      }
+      if(RES_BITMAP_TREE_NIL != node->left)
+        r += tree->node[node->left].taken;
+      r += (node->len < bit - node->start) ? node->len : bit - node->start;
+      t = node->right;
+    }
+  return(r);
+}
+
+ushort _res_bitmap_tree_mark(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up)
+{
+  res_bitmap_tree_t* tree;
+  size_t left;
+  size_t middle;
+  size_t right;
+  size_t i;
+  size_t start;
+  size_t end;  /*NOT inclusive*/
+  size_t prev;  /*end of the extent before the ones being replaced, NOT inclusive*/
+    tree = &bitmap_handle->tree;
+
+   /*a take or free replaces the extents it touches with at most two*/
+    if(0 != _res_bitmap_tree_reserve(tree, 2))
+      return(2);
+
+   /*extents starting before the range, starting in it (or just after, so a take can join them), and the rest*/
+    _res_bitmap_tree_split(tree, tree->root, first, &left, &right);
+    _res_bitmap_tree_split(tree, right, last + 2, &middle, &right);
+
+   /*the last extent before the range goes in the middle too, if it reaches it*/
+    i = _res_bitmap_tree_last_node(tree, left);
+    if((RES_BITMAP_TREE_NIL != i) && (tree->node[i].start + tree->node[i].len >= first))
+    {
+      _res_bitmap_tree_split(tree, left, tree->node[i].start, &left, &i);
+      middle = _res_bitmap_tree_merge(tree, i, middle);
+    }
+    i = _res_bitmap_tree_last_node(tree, left);
+    prev = (RES_BITMAP_TREE_NIL == i) ? 0 : tree->node[i].start + tree->node[i].len;
+
+   /*what the middle covers, from the first start to the last end*/
+    start = first;
+    end = first;
+    if(RES_BITMAP_TREE_NIL != middle)
+    {
+      start = tree->node[_res_bitmap_tree_first_node(tree, middle)].start;
+      i = _res_bitmap_tree_last_node(tree, middle);
+      end = tree->node[i].start + tree->node[i].len;
+      _res_bitmap_tree_release(tree, middle);
+      middle = RES_BITMAP_TREE_NIL;
+    }
+
+    if(0 != up)
+    {
+     /*take - one extent over the range and everything it touched*/
+      if(start > first)
+        start = first;
+      if(end < last + 1)
+        end = last + 1;
+      middle = _res_bitmap_tree_node(tree, start, end - start, start - prev);
+      prev = end;
+    } else {
+     /*free - keep whatever of the middle was before or after the range*/
+      if(start < first)
+      {
+        middle = _res_bitmap_tree_node(tree, start, first - start, start - prev);
+        prev = first;
+      }
+      if(end > last + 1)
+      {
+        i = _res_bitmap_tree_node(tree, last + 1, end - (last + 1), last + 1 - prev);
+        middle = _res_bitmap_tree_merge(tree, middle, i);
+        prev = end;
+      }
+    }
+
+   /*the first extent after has a new one (or none) before it*/
+    if(RES_BITMAP_TREE_NIL != right)
+      _res_bitmap_tree_after(tree, right, prev);
+    tree->root = _res_bitmap_tree_merge(tree, _res_bitmap_tree_merge(tree, left, middle), right);
+
+    if(NULL != bitmap_handle->delta)
+      _res_bitmap_delta_touch(bitmap_handle->delta, first/BITS, last/BITS);
+  return(0);
+}
+
+size_t _res_bitmap_tree_first(res_bitmap_tree_t* tree, size_t t, size_t from, size_t need)
+{
+  size_t i;
+   /*nothing big enough anywhere below here*/
+    if((RES_BITMAP_TREE_NIL == t) || (tree->node[t].max_gap < need))
+      return(RES_BITMAP_TREE_NIL);
+
+   /*too low - only the right subtree can have any that start at or after from*/
+    if(tree->node[t].start < from)
+      return(_res_bitmap_tree_first(tree, tree->node[t].right, from, need));
+
+    i = _res_bitmap_tree_first(tree, tree->node[t].left, from, need);
+    if(RES_BITMAP_TREE_NIL != i)
+      return(i);
+    if(tree->node[t].gap >= need)
+      return(t);
+  return(_res_bitmap_tree_first(tree, tree->node[t].right, from, need));
+}
+
+size_t _res_bitmap_tree_scan(res_bitmap_t* bitmap_handle, size_t from, size_t need)
+{
+  res_bitmap_tree_t* tree;
+  size_t i;
+  size_t end;
+  size_t after;  /*extents starting after this one's start have gaps wholly at or after from*/
+    tree = &bitmap_handle->tree;
+    if(from > bitmap_handle->num_bits)
+      return(RES_BITMAP_ERR);
+
+    i = _res_bitmap_tree_find_le(tree, from);
+    if((RES_BITMAP_TREE_NIL != i) && (tree->node[i].start + tree->node[i].len > from))
+    {
+     /*from is taken - the next gap, or anything after it*/
+      after = tree->node[i].start;
+    } else {
+     /*from is free - from itself, if its run goes on long enough*/
+      i = _res_bitmap_tree_find_ge(tree, from);
+      end = (RES_BITMAP_TREE_NIL == i) ? bitmap_handle->num_bits + 1 : tree->node[i].start;
+      if(end - from >= need)
+        return(from);
+      if(RES_BITMAP_TREE_NIL == i)
+        return(RES_BITMAP_ERR);  /*that was the run at the end*/
+      after = tree->node[i].start;
+    }
+
+   /*the lowest gap big enough after that, otherwise the run at the end*/
+    i = _res_bitmap_tree_first(tree, tree->root, after + 1, need);
+    if(RES_BITMAP_TREE_NIL != i)
+      return(tree->node[i].start - tree->node[i].gap);
+    end = _res_bitmap_tree_end(tree);
+    if(bitmap_handle->num_bits + 1 - end >= need)
+      return(end);
+  return(RES_BITMAP_ERR);
+}
+
+size_t _res_bitmap_tree_fit(res_bitmap_t* bitmap_handle, size_t need, ushort worst)
+{
+  res_bitmap_tree_t* tree;
+  size_t best = RES_BITMAP_ERR;
+  size_t best_len = 0;
+  size_t end;
+  size_t len;
+  size_t i;
+    tree = &bitmap_handle->tree;
+    end = _res_bitmap_tree_end(tree);
+    len = bitmap_handle->num_bits + 1 - end;  /*the run at the end - it's last, so only wins ties if nothing else does*/
+
+    if(0 != worst)
+    {
+     /*worst fit - the lowest of the largest gaps, unless the run at the end is larger still*/
+      if((RES_BITMAP_TREE_NIL != tree->root) && (tree->node[tree->root].max_gap >= len))
+      {
+        if(tree->node[tree->root].max_gap < need)
+          return(RES_BITMAP_ERR);
+        i = _res_bitmap_tree_widest(tree, tree->node[tree->root].max_gap);
+        return(tree->node[i].start - tree->node[i].gap);
+      }
+      return((len >= need) ? end : RES_BITMAP_ERR);
+    }
+
+   /*best fit - every gap big enough, lowest first, then the run at the end*/
+    _res_bitmap_tree_best(tree, tree->root, need, &best, &best_len);
+    if((best_len != need) && (len >= need) && ((0 == best_len) || (len < best_len)))
+      best = end;
+  return(best);
+}
+
+void _res_bitmap_tree_best(res_bitmap_tree_t* tree, size_t t, size_t need, size_t* best, size_t* best_len)
+{
+  res_bitmap_tree_node_t* node;
+    while((RES_BITMAP_TREE_NIL != t) && (tree->node[t].max_gap >= need) && (*best_len != need))
+    {
+      _res_bitmap_tree_best(tree, tree->node[t].left, need, best, best_len);
+      if(*best_len == need)
+        return;  /*can't do better than an exact fit*/
+      node = &tree->node[t];
+      if((node->gap >= need) && ((0 == *best_len) || (node->gap < *best_len)))
+      {
+        *best = node->start - node->gap;
+        *best_len = node->gap;
+      }
+      t = node->right;
+    }
+}
+
+size_t _res_bitmap_tree_widest(res_bitmap_tree_t* tree, size_t len)
+{
+  size_t t;
+  size_t left;
+   /*left whenever the left subtree has a gap that big, so the lowest is found*/
+    t = tree->root;
+    for(;;)
+    {
+      left = tree->node[t].left;
+      if((RES_BITMAP_TREE_NIL != left) && (tree->node[left].max_gap == len))
+        t = left;
+      else if(tree->node[t].gap == len)
+        return(t);
+      else
+        t = tree->node[t].right;
+    }
+}
+
+size_t _res_bitmap_tree_aligned(res_bitmap_tree_t* tree, size_t t, size_t need, size_t align)
+{
+  res_bitmap_tree_node_t* node;
+  size_t i;
+  size_t start;
+    while((RES_BITMAP_TREE_NIL != t) && (tree->node[t].max_gap >= need))
+    {
+      i = _res_bitmap_tree_aligned(tree, tree->node[t].left, need, align);
+      if(RES_BITMAP_ERR != i)
+        return(i);
+
+     /*the gap rounded up to a boundary - still room for the block before the extent?*/
+      node = &tree->node[t];
+      if(node->gap >= need)
+      {
+        start = node->start - node->gap;
+        if((0 != (start & (align - 1))) && (start <= SIZE_MAX - align))
+          start = (start | (align - 1)) + 1;
+        if((0 == (start & (align - 1))) && (start < node->start) && (node->start - start >= need))
+          return(start);
+      }
+      t = node->right;
+    }
+  return(RES_BITMAP_ERR);
+}
+
+void _res_bitmap_tree_stats(res_bitmap_tree_t* tree, size_t t, res_bitmap_free_stats_t* stats)
+{
+  while(RES_BITMAP_TREE_NIL != t)
+  {
+    _res_bitmap_tree_stats(tree, tree->node[t].left, stats);
+    if(0 != tree->node[t].gap)
+      _res_bitmap_free_run(stats, tree->node[t].gap);
+    t = tree->node[t].right;
+  }
+}
+
+ushort _res_bitmap_tree_append(res_bitmap_tree_t* tree, size_t start, size_t len)
+{
+  size_t i;
+    if(0 != _res_bitmap_tree_reserve(tree, 1))
+      return(2);
+    i = _res_bitmap_tree_node(tree, start, len, start - _res_bitmap_tree_end(tree));
+    tree->root = _res_bitmap_tree_merge(tree, tree->root, i);
+  return(0);
+}
+
+size_t _res_bitmap_tree_combine(res_bitmap_tree_t* out, res_bitmap_tree_t* a, res_bitmap_tree_t* b, size_t num_bits, ushort op)
+{
+  res_bitmap_word_t in_a;
+  res_bitmap_word_t in_b;
+  size_t ia;
+  size_t ib;
+  size_t pos = 0;
+  size_t next;
+  size_t run_start = 0;  /*run of a op b not added to out yet - empty while run_end is 0*/
+  size_t run_end = 0;
+  size_t count = 0;
+   /*step from one extent edge of either map to the next. In between, each map is all taken or all free, so a op b is too*/
+    ia = _res_bitmap_tree_at(a, 0);
+    ib = _res_bitmap_tree_at(b, 0);
+    while(pos <= num_bits)
+    {
+      next = num_bits + 1;
+      in_a = 0;
+      if(RES_BITMAP_TREE_NIL != ia)
+      {
+        if(a->node[ia].start <= pos)
+        {
+          in_a = ~(res_bitmap_word_t)0;
+          if(a->node[ia].start + a->node[ia].len < next)
+            next = a->node[ia].start + a->node[ia].len;
+        } else if(a->node[ia].start < next) {
+          next = a->node[ia].start;
+        }
+      }
+      in_b = 0;
+      if(RES_BITMAP_TREE_NIL != ib)
+      {
+        if(b->node[ib].start <= pos)
+        {
+          in_b = ~(res_bitmap_word_t)0;
+          if(b->node[ib].start + b->node[ib].len < next)
+            next = b->node[ib].start + b->node[ib].len;
+        } else if(b->node[ib].start < next) {
+          next = b->node[ib].start;
+        }
+      }
+
+      if(0 != _res_bitmap_combine_word(in_a, in_b, op))
+      {
+        count += next - pos;
+        if(NULL != out)
+        {
+         /*joins the run before if it carries straight on from it*/
+          if((0 != run_end) && (run_end != pos))
+            if(0 != _res_bitmap_tree_append(out, run_start, run_end - run_start))
+              return(RES_BITMAP_ERR);
+          if(run_end != pos)
+            run_start = pos;
+          run_end = next;
+        }
+      }
+
+     /*past the end of an extent - on to the next. Extents don't touch, so it starts after pos*/
+      pos = next;
+      if((RES_BITMAP_TREE_NIL != ia) && (a->node[ia].start + a->node[ia].len <= pos))
+        ia = _res_bitmap_tree_find_ge(a, pos);
+      if((RES_BITMAP_TREE_NIL != ib) && (b->node[ib].start + b->node[ib].len <= pos))
+        ib = _res_bitmap_tree_find_ge(b, pos);
+    }
+    if((NULL != out) && (0 != run_end))
+      if(0 != _res_bitmap_tree_append(out, run_start, run_end - run_start))
+        return(RES_BITMAP_ERR);
+  return(count);
+}
+
+void _res_bitmap_tree_words(res_bitmap_tree_t* tree, size_t first_word, size_t n, res_bitmap_word_t* out)
+{
+  size_t lo;
+  size_t hi;  /*NOT inclusive*/
+  size_t i;
+  size_t start;
+  size_t end;
+    memset(out, 0, n * sizeof(res_bitmap_word_t));
+    lo = first_word * BITS;
+    hi = lo + n * BITS;
+
+   /*each extent over the words, cut down to them*/
+    i = _res_bitmap_tree_at(tree, lo);
+    while((RES_BITMAP_TREE_NIL != i) && (tree->node[i].start < hi))
+    {
+      start = (tree->node[i].start > lo) ? tree->node[i].start : lo;
+      end = tree->node[i].start + tree->node[i].len;
+      if(end > hi)
+        end = hi;
+      _res_bitmap_mark(out, start - lo, end - 1 - lo, 1);
+      i = _res_bitmap_tree_find_ge(tree, end);
+    }
+}
+
+size_t _res_bitmap_tree_next(const res_bitmap_word_t* words, size_t n, size_t from, ushort up)
+{
+  res_bitmap_word_t word;
+  size_t w;
+    w = from / BITS;
+    if(w >= n)
+      return(n * BITS);
+
+   /*flip the words when looking for clear bits. Bits before from don't count*/
+    word = (0 == up) ? ~words[w] : words[w];
+    word &= ~(res_bitmap_word_t)0 << (from % BITS);
+    while(0 == word)
+    {
+      w++;
+      if(w >= n)
+        return(n * BITS);
+      word = (0 == up) ? ~words[w] : words[w];
+    }
+  return(w * BITS + RES_BITMAP_CTZ(word));
+}
+
+int _res_bitmap_compare(const void* a, const void* b)
+{
+  size_t x;
+  size_t y;
+    x = *(const size_t*)a;
+    y = *(const size_t*)b;
+  return((x > y) - (x < y));
+}
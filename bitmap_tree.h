@@ -0,0 +1,238 @@
+/* bitmap_tree.h - header for bitmap_tree.c, an extent tree implementation of
+ *                 the bitmap API, for very big and very sparse maps
+ *
+ * API: bitmap 1.13
+ * IMPLEMENTATION: tree-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+/* A drop-in replacement for bitmap.c - define RES_BITMAP_TREE when
+ * compiling, so that bitmap.h pulls in this header instead, and link
+ * bitmap_tree.c, bitmap_simd.c and bitmap_delta.c in place of the reff-1 files.
+ *
+ * There is no map. Taken bits are kept as extents - runs of taken bits, by
+ * start and length - in a balanced tree, so memory and time go with the
+ * number of extents rather than num_bits. take and free merge and split
+ * extents, and check, count, rank, select, first / next / worst fit and
+ * res_bitmap_largest_free are O(log extents) whatever the size of the range.
+ * Best fit and aligned alloc look at every free run big enough, so are
+ * O(extents). alloc returns the same block as reff-1 for every policy.
+ *
+ * Maps can't live in files - res_bitmap_create_file and _open_file always
+ * fail.*/
+#ifndef H_RES_BITMAP
+#define H_RES_BITMAP
+ #include "res_config.h"
+ #include "res_types.h"
+ #include "res_err.h"
+
+/*Types:*/
+ #ifdef BITS_64
+  typedef uint64_t res_bitmap_word_t;  /*deltas, and res_bitmap_free_stats_t, are in machine words as reff-1*/
+ #else
+  typedef uint32_t res_bitmap_word_t;
+ #endif
+
+/*Options - the indexes are accepted for compatibility. The tree already does the job of all of them:*/
+ #define RES_BITMAP_OPT_SUMMARY 0x0001
+ #define RES_BITMAP_OPT_EXTENTS 0x0002
+ #define RES_BITMAP_OPT_RANK    0x0004
+ #define RES_BITMAP_OPT_DELTA   0x0008  /*track changed words for res_bitmap_delta_export, as reff-1*/
+
+/*Allocation policies - as reff-1:*/
+ #define RES_BITMAP_FIRST_FIT 0  /*lowest free block big enough. The default*/
+ #define RES_BITMAP_NEXT_FIT  1  /*first free block big enough after the end of the last one allocated, wrapping round to the start of the map*/
+ #define RES_BITMAP_BEST_FIT  2  /*start of the smallest free run big enough. O(extents)*/
+ #define RES_BITMAP_WORST_FIT 3  /*start of the largest free run*/
+
+/*Boolean operations, for res_bitmap_combine...:*/
+ #define RES_BITMAP_AND    0
+ #define RES_BITMAP_OR     1
+ #define RES_BITMAP_XOR    2
+ #define RES_BITMAP_ANDNOT 3
+
+/*Files - not supported, defined so code written for reff-1 still compiles:*/
+ #define RES_BITMAP_FILE_MAGIC "RESBMAP"
+ #define RES_BITMAP_FILE_VERSION 1
+ #define RES_BITMAP_FILE_HEADER 4096
+
+/*Deltas, from res_bitmap_delta_export - the same format as reff-1, so each can apply the other's:*/
+ #define RES_BITMAP_DELTA_HEADER 2
+
+/*Config:*/
+ #ifndef RES_BITMAP_PARALLEL_MIN
+  #define RES_BITMAP_PARALLEL_MIN 4194304  /*as reff-1*/
+ #endif
+
+/*Structures:*/
+ #define RES_BITMAP_TREE_NIL SIZE_MAX  /*no node*/
+ typedef struct
+ {
+   size_t start;  /*first taken bit*/
+   size_t len;  /*number of taken bits - NOT a limit, never 0*/
+   size_t gap;  /*free bits between the end of the extent before (or bit 0) and start*/
+   size_t left;  /*treap children by start, node indexes. left also links the free node list*/
+   size_t right;
+   size_t taken;  /*len of every extent in the subtree*/
+   size_t max_gap;  /*largest gap in the subtree*/
+   uint32_t priority;  /*treap heap key*/
+ } res_bitmap_tree_node_t;
+
+ typedef struct
+ {
+   res_bitmap_tree_node_t *node;  /*node array, nodes refer to each other by index*/
+   size_t capacity;  /*nodes allocated*/
+   size_t used;  /*nodes handed out from the end of the array so far*/
+   size_t free_node;  /*list of nodes handed back*/
+   size_t root;  /*treap of extents ordered by start. Extents never touch or overlap*/
+   size_t count;  /*number of extents*/
+   uint32_t seed;  /*for priorities*/
+ } res_bitmap_tree_t;
+
+ typedef struct
+ {
+   res_bitmap_word_t *dirty;  /*bit w set = map word w written since the last export*/
+   size_t capacity;  /*words allocated for dirty*/
+   size_t low;  /*smallest num_bits the map has had since the last export*/
+ } res_bitmap_delta_t;
+
+ typedef struct
+ {
+   res_bitmap_tree_t tree;  /*the taken extents*/
+   size_t num_bits; /*num_bits of 0 = 1 bit in the map. At most RES_BITMAP_ERR - 1*/
+   ushort opts;  /*RES_BITMAP_OPT_... flags given at create time*/
+   ushort policy;  /*RES_BITMAP_..._FIT allocation policy*/
+   size_t rover;  /*next fit cursor - where the next search starts*/
+   res_bitmap_delta_t *delta;  /*NULL unless created with RES_BITMAP_OPT_DELTA*/
+  } res_bitmap_t;
+
+ typedef struct
+ {
+   res_bitmap_t *bitmap;  /*map being walked*/
+   size_t bit;  /*next bit to hand out, if it's taken*/
+   size_t end;  /*end (NOT inclusive) of the extent bit is in, or 0 if not known*/
+   size_t last;  /*last bit of the range*/
+ } res_bitmap_iter_t;
+
+ typedef struct
+ {
+   size_t free_bits;  /*bits free in the whole map*/
+   size_t runs;  /*runs of free bits*/
+   size_t largest;  /*length of the longest run, in bits - 0 if none is free*/
+   size_t histogram[BITS];  /*histogram[c] is the number of runs with floor(log2(length)) = c*/
+ } res_bitmap_free_stats_t;
+
+ typedef struct
+ {
+   size_t base;  /*first bit*/
+   size_t limit;  /*bits after base - 0 = just base, as take*/
+ } res_bitmap_range_t;
+
+/*External functions - see bitmap.h. Anything that adds extents may have to grow the node array, so can fail on memory where reff-1 can't*/
+ res_bitmap_t* res_bitmap_create(size_t num_bits); /*creates an empty tree for a map of size num_bits and a handle for it. O(1) whatever num_bits is. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER if num_bits is RES_BITMAP_ERR or more. NOTE - num_bits starts at 0. 0 implies a bitmap with 1 bit, etc.*/
+ res_bitmap_t* res_bitmap_create_opts(size_t num_bits, ushort opts); /*as res_bitmap_create. Known options other than RES_BITMAP_OPT_DELTA are ignored. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER on unknown flags*/
+ res_bitmap_t* res_bitmap_create_file(const char* path, size_t num_bits, ushort opts); /*not supported - always fails. Returns NULL; errno set to RES_ERR_BAD_PARAMETER on unknown flags, RES_ERR_INCOMPATIBLE_RESOURCE otherwise*/
+ res_bitmap_t* res_bitmap_open_file(const char* path, ushort opts); /*not supported - always fails, as res_bitmap_create_file*/
+ ushort res_bitmap_sync(res_bitmap_t* bitmap_handle); /*does nothing - a tree is never file-backed. Returns 0*/
+ ushort res_bitmap_destroy(res_bitmap_t* bitmap_handle); /*frees tree and handle memory. Returns 0 on success, other non-zero on unknown error*/
+
+ size_t res_bitmap_alloc(res_bitmap_t* bitmap_handle, size_t block_size); /*finds and marks a continuous set of free bits, of amount block_size+1, by the handle's policy - the same block reff-1 would pick. O(log extents) but for best fit. Returns RES_BITMAP_ERR on failure, bit number of the start of the block allocated on success, starting at 0; errno is set to a corresponding res_err defined error on failure, preserved on malloc fail*/
+ size_t res_bitmap_alloc_aligned(res_bitmap_t* bitmap_handle, size_t block_size, ushort align_order); /*as res_bitmap_alloc, but the block starts on a multiple of 2^align_order bits. Always the lowest such block, whatever the policy. O(extents). Returns RES_BITMAP_ERR on failure, start bit on success; errno is set to a corresponding res_err defined error on failure*/
+ size_t res_bitmap_alloc_many(res_bitmap_t* bitmap_handle, size_t block_size, size_t count, size_t* out); /*allocates up to count blocks as count calls to res_bitmap_alloc would, writing their start bits to out. Returns number of blocks allocated (less than count if the map ran out, errno then set to RES_ERR_NO_MATCH, or on malloc fail, errno preserved), RES_BITMAP_ERR on bad block_size; errno set to RES_ERR_BAD_PARAMETER*/
+ ushort res_bitmap_free(res_bitmap_t* bitmap_handle, size_t base, size_t limit); /*unmarks bits from base to (base+limit), cutting or splitting the extents under them. Limit of 0 = 1 bit. Does not check if they are already free. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range, 4 on malloc fail (map unchanged, errno preserved)*/
+ ushort res_bitmap_free_many(res_bitmap_t* bitmap_handle, size_t* bits, size_t count, size_t block_size); /*frees count blocks of block_size+1 bits, starting at each of bits[], in any order. bits is sorted in place, and blocks that touch are freed together. Returns 0 on success, 2 on a base out-of-range, 3 on a block running past the end, 4 on malloc fail - nothing is freed on error*/
+ ushort res_bitmap_take(res_bitmap_t* bitmap_handle, size_t base, size_t limit); /*marks bits from base to (base+limit), merging them with any extents they touch or overlap into one. Limit of 0 = 1 bit. Does not check if they are already free. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range, 4 on malloc fail (map unchanged, errno preserved)*/
+ ushort res_bitmap_reserve(res_bitmap_t* bitmap_handle, const res_bitmap_range_t* ranges, size_t count, size_t* failed); /*takes count ranges all together or not at all, as reff-1. Each range is counted before it is taken - the first with a bit already taken (including by an earlier range) puts back everything taken so far. Returns 0 on success, 1 on a bit already taken, 2 on a base out-of-range, 3 on a limit out-of-range, 4 on malloc fail (errno preserved) - the map is unchanged on error, and failed (if not NULL) is set to the index of the range at fault, except on malloc fail*/
+ ushort res_bitmap_check(res_bitmap_t* bitmap_handle, size_t base, size_t limit); /*returns 0 if all bits from base to (base+limit) are 0, 1 if all bits in this range are 1, 2 if they vary, 4 on base-out-of-range, 5 on limit-out-of-range. Limit of 0 = 1 bit. O(log extents), however long the range*/
+
+ ushort res_bitmap_set_policy(res_bitmap_t* bitmap_handle, ushort policy);  /*sets the allocation policy used by res_bitmap_alloc to one of the RES_BITMAP_..._FIT values. Returns 0 on success, 2 on unknown policy*/
+
+ ushort res_bitmap_resize(res_bitmap_t* bitmap_handle, size_t num_bits);  /*re-sizes the bitmap to new total size num_bits. Growing only changes num_bits, shrinking cuts off any extents past the end. Returns: 0 on success, 2 on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER if num_bits is RES_BITMAP_ERR or more*/
+
+ size_t res_bitmap_count(res_bitmap_t* bitmap, size_t base, size_t limit);  /*counts bits taken from base to base+limit. Limit of 0 = 1 bit to count. O(log extents). Returns count on success, RES_BITMAP_ERR on failure; errno is set to a corresponding res_err defined error on failure*/
+ size_t res_bitmap_get_size(res_bitmap_t* bitmap);  /*Returns: number of bits (taken and free) in bitmap on success, RES_BITMAP_ERR on failure; errno is set to a res_err.h error code*/
+ size_t res_bitmap_largest_free(res_bitmap_t* bitmap_handle);  /*finds the biggest block_size that res_bitmap_alloc could succeed with right now. O(log extents). Returns block_size (0 = 1 free bit) on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_NO_MATCH if no bits are free*/
+ ushort res_bitmap_free_stats(res_bitmap_t* bitmap_handle, res_bitmap_free_stats_t* stats);  /*fills in stats with the free bits, the number of runs of them, the longest and a histogram of their lengths by power of 2. One walk of the tree. Returns 0 on success*/
+ size_t res_bitmap_find_next_set(res_bitmap_t* bitmap_handle, size_t from);  /*finds the first taken bit at or after from. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on from out-of-range, RES_ERR_NO_MATCH if there isn't one*/
+ size_t res_bitmap_find_next_clear(res_bitmap_t* bitmap_handle, size_t from);  /*finds the first free bit at or after from. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set as find_next_set*/
+ size_t res_bitmap_find_prev_set(res_bitmap_t* bitmap_handle, size_t from);  /*finds the last taken bit at or before from. Returns bit number on success, RES_BITMAP_ERR on failure; errno is set as find_next_set*/
+ ushort res_bitmap_iter_init(res_bitmap_t* bitmap_handle, res_bitmap_iter_t* iter, size_t base, size_t limit);  /*sets up iter to walk the taken bits from base to (base+limit). Limit of 0 = 1 bit. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ size_t res_bitmap_iter_next(res_bitmap_iter_t* iter);  /*returns the next taken bit in the iterator's range, lowest first, or RES_BITMAP_ERR when there are no more. The tree is searched once per extent. The map MUST NOT be changed while iterating*/
+ size_t res_bitmap_rank(res_bitmap_t* bitmap_handle, size_t bit);  /*counts the bits taken below bit - from 0 to bit-1. bit may be num_bits+1, for the whole map. O(log extents). Returns count on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on bit out-of-range*/
+ size_t res_bitmap_select(res_bitmap_t* bitmap_handle, size_t k);  /*finds the k'th taken bit, counting from 0. O(log extents). Returns bit number on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_NO_MATCH if k bits or fewer are taken*/
+ size_t res_bitmap_delta_size(res_bitmap_t* bitmap_handle);  /*words a res_bitmap_delta_export of every change so far would need. Returns size on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER if the map wasn't made with RES_BITMAP_OPT_DELTA*/
+ size_t res_bitmap_delta_export(res_bitmap_t* bitmap_handle, res_bitmap_word_t* buf, size_t size);  /*writes the words changed since the last export into buf, as reff-1 - each word is worked out from the extents over it. Returns words written on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER if the map wasn't made with RES_BITMAP_OPT_DELTA, or size is less than RES_BITMAP_DELTA_HEADER*/
+ ushort res_bitmap_delta_apply(res_bitmap_t* bitmap_handle, const res_bitmap_word_t* buf, size_t size);  /*applies a delta from any implementation, resizing to match. Each run of words is freed, then its runs of set bits taken, so a run of whole words taken is one extent. Returns 0 on success, 2 on a bad delta (map unchanged), 3 on memory error (errno preserved, map unchanged)*/
+ ushort res_bitmap_combine(res_bitmap_t* dest_handle, res_bitmap_t* src_handle, ushort op);  /*dest = dest op src, one of the RES_BITMAP_AND/OR/XOR/ANDNOT values. Bits of src past dest's num_bits are ignored, bits dest has past src's num_bits are combined with 0 - as if src were resized to dest's size. One merge of the two extent lists into a new tree. Returns 0 on success, 2 on unknown op, 3 on malloc fail (dest unchanged, errno preserved)*/
+ ushort res_bitmap_combine_into(res_bitmap_t* dest_handle, res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op);  /*dest = a op b, with a and b read as if resized to dest's size. dest may be a or b. Returns 0 on success, 2 on unknown op, 3 on malloc fail (dest unchanged, errno preserved)*/
+ size_t res_bitmap_combine_count(res_bitmap_t* a_handle, res_bitmap_t* b_handle, ushort op);  /*counts the bits a op b would have, without writing anything - e.g. RES_BITMAP_ANDNOT counts bits taken in a but not in b. b is read as if resized to a's size. Returns count on success, RES_BITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on unknown op*/
+ size_t res_bitmap_count_parallel(res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads);  /*as reff-1 - bitmap_parallel.c, shared by every implementation*/
+ ushort res_bitmap_check_parallel(res_bitmap_t* bitmap_handle, size_t base, size_t limit, ushort threads);  /*as reff-1*/
+ size_t res_bitmap_find_next_clear_parallel(res_bitmap_t* bitmap_handle, size_t from, ushort threads);  /*as reff-1*/
+
+/*Internal Functions:*/
+ res_bitmap_word_t _res_bitmap_mask(size_t first, size_t last);  /*returns a word with bits first to last (inclusive, both < BITS) set*/
+ void _res_bitmap_mark(res_bitmap_word_t* bitmap, size_t first, size_t last, ushort up);  /*sets (up=1) or clears (up=0) bits first to last inclusive of an array of words. Does NOT check range*/
+ size_t _res_bitmap_popcount_word(res_bitmap_word_t word);  /*bitmap_simd.c, portable single-word popcount*/
+ size_t _res_bitmap_ctz_word(res_bitmap_word_t word);  /*bitmap_simd.c, portable count trailing zeros, word MUST be non-zero*/
+ size_t _res_bitmap_clz_word(res_bitmap_word_t word);  /*bitmap_simd.c, portable count leading zeros, word MUST be non-zero*/
+ void _res_bitmap_free_run(res_bitmap_free_stats_t* stats, size_t len);  /*bitmap_simd.c, adds a free run of len (non-zero) bits to stats*/
+ res_bitmap_word_t _res_bitmap_combine_word(res_bitmap_word_t a, res_bitmap_word_t b, ushort op);  /*bitmap_simd.c, a op b for one word*/
+ res_bitmap_delta_t* _res_bitmap_delta_create(size_t num_bits);  /*bitmap_delta.c, shared with reff-1. Returns NULL on malloc fail, errno preserved*/
+ void _res_bitmap_delta_destroy(res_bitmap_delta_t* delta);
+ size_t _res_bitmap_delta_words(size_t num_bits);  /*words of dirty map for a map of num_bits*/
+ ushort _res_bitmap_delta_reserve(res_bitmap_delta_t* delta, size_t num_bits);  /*makes room for a map of num_bits, before a resize. Returns 0 on success, 2 on memory error; errno preserved*/
+ void _res_bitmap_delta_resize(res_bitmap_delta_t* delta, size_t old_num_bits, size_t num_bits);  /*updates tracking after a resize from old_num_bits*/
+ void _res_bitmap_delta_touch(res_bitmap_delta_t* delta, size_t first_word, size_t last_word);  /*marks map words first_word to last_word changed*/
+ size_t _res_bitmap_delta_size(res_bitmap_delta_t* delta, size_t num_bits);  /*res_bitmap_delta_size*/
+ size_t _res_bitmap_delta_next(res_bitmap_delta_t* delta, size_t from, size_t words, ushort up);  /*first map word from from on that is changed (up=1) or not (up=0), or words if there isn't one*/
+ ushort _res_bitmap_delta_check(const res_bitmap_word_t* buf, size_t size);  /*checks a delta is well formed. Returns 0 if it is, 2 if not*/
+ void _res_bitmap_tree_init(res_bitmap_tree_t* tree);  /*makes tree empty, with no nodes allocated*/
+ void _res_bitmap_tree_clear(res_bitmap_tree_t* tree);  /*frees tree's nodes, leaving it as _res_bitmap_tree_init does*/
+ ushort _res_bitmap_tree_reserve(res_bitmap_tree_t* tree, size_t n);  /*makes sure n more extents can be added without allocating. Node indexes stay the same, but pointers to nodes don't. Returns 0 on success, 2 on malloc fail; errno preserved*/
+ size_t _res_bitmap_tree_node(res_bitmap_tree_t* tree, size_t start, size_t len, size_t gap);  /*takes a node for an extent, not in the treap yet. There MUST be one reserved. Returns its index*/
+ void _res_bitmap_tree_release(res_bitmap_tree_t* tree, size_t t);  /*puts every node of subtree t on the free list*/
+ void _res_bitmap_tree_pull(res_bitmap_tree_t* tree, size_t t);  /*works out t's taken and max_gap from its own extent and its children*/
+ void _res_bitmap_tree_split(res_bitmap_tree_t* tree, size_t t, size_t start, size_t* left, size_t* right);  /*splits subtree t into extents starting below start and the rest*/
+ size_t _res_bitmap_tree_merge(res_bitmap_tree_t* tree, size_t left, size_t right);  /*joins two subtrees, everything in left starting before everything in right. Returns the new root*/
+ void _res_bitmap_tree_after(res_bitmap_tree_t* tree, size_t t, size_t end);  /*sets the gap of the first extent of subtree t (NOT empty) for the extent before it ending at end (NOT inclusive)*/
+ size_t _res_bitmap_tree_first_node(res_bitmap_tree_t* tree, size_t t);  /*leftmost node of subtree t, RES_BITMAP_TREE_NIL if empty*/
+ size_t _res_bitmap_tree_last_node(res_bitmap_tree_t* tree, size_t t);  /*rightmost node of subtree t, RES_BITMAP_TREE_NIL if empty*/
+ size_t _res_bitmap_tree_end(res_bitmap_tree_t* tree);  /*end (NOT inclusive) of the last extent - where the free run at the end of the map starts. 0 if there are no extents*/
+ size_t _res_bitmap_tree_find_le(res_bitmap_tree_t* tree, size_t bit);  /*last extent starting at or before bit, RES_BITMAP_TREE_NIL if none*/
+ size_t _res_bitmap_tree_find_ge(res_bitmap_tree_t* tree, size_t bit);  /*first extent starting at or after bit, RES_BITMAP_TREE_NIL if none*/
+ size_t _res_bitmap_tree_at(res_bitmap_tree_t* tree, size_t bit);  /*extent holding bit, or else the first one after it. RES_BITMAP_TREE_NIL if none*/
+ size_t _res_bitmap_tree_rank(res_bitmap_tree_t* tree, size_t bit);  /*bits taken below bit*/
+ ushort _res_bitmap_tree_mark(res_bitmap_t* bitmap_handle, size_t first, size_t last, ushort up);  /*takes (up=1) or frees (up=0) bits first to last, merging and splitting extents, and notes the change in any delta. Does NOT check range. Returns 0 on success, 2 on malloc fail (map unchanged, errno preserved)*/
+ size_t _res_bitmap_tree_first(res_bitmap_tree_t* tree, size_t t, size_t from, size_t need);  /*lowest extent in subtree t starting at or after from, with a gap of need bits or more before it. Returns node index, RES_BITMAP_TREE_NIL if there isn't one*/
+ size_t _res_bitmap_tree_scan(res_bitmap_t* bitmap_handle, size_t from, size_t need);  /*lowest bit at or after from with need free bits from it on. Returns RES_BITMAP_ERR if there isn't one*/
+ size_t _res_bitmap_tree_fit(res_bitmap_t* bitmap_handle, size_t need, ushort worst);  /*start of the lowest of the smallest (worst=0) or largest (worst=1) free runs of need bits or more. Returns RES_BITMAP_ERR if there isn't one*/
+ void _res_bitmap_tree_best(res_bitmap_tree_t* tree, size_t t, size_t need, size_t* best, size_t* best_len);  /*looks for a better fit than best (best_len bits, 0 = none yet) in subtree t's gaps, lowest first. Stops at an exact fit*/
+ size_t _res_bitmap_tree_widest(res_bitmap_tree_t* tree, size_t len);  /*lowest extent with a gap of len, which MUST be the root's max_gap*/
+ size_t _res_bitmap_tree_aligned(res_bitmap_tree_t* tree, size_t t, size_t need, size_t align);  /*lowest multiple of align in subtree t's gaps with need free bits from it on. Returns RES_BITMAP_ERR if there isn't one*/
+ void _res_bitmap_tree_stats(res_bitmap_tree_t* tree, size_t t, res_bitmap_free_stats_t* stats);  /*adds subtree t's gaps to stats*/
+ ushort _res_bitmap_tree_append(res_bitmap_tree_t* tree, size_t start, size_t len);  /*adds an extent after (and NOT touching) the last one. Returns 0 on success, 2 on malloc fail; errno preserved*/
+ size_t _res_bitmap_tree_combine(res_bitmap_tree_t* out, res_bitmap_tree_t* a, res_bitmap_tree_t* b, size_t num_bits, ushort op);  /*walks the extents of a and b together, up to num_bits, adding the runs of a op b to out (unless NULL). Returns bits in a op b, RES_BITMAP_ERR on malloc fail; errno preserved*/
+ void _res_bitmap_tree_words(res_bitmap_tree_t* tree, size_t first_word, size_t n, res_bitmap_word_t* out);  /*writes map words first_word to first_word+n-1, as reff-1 would have them, to out*/
+ size_t _res_bitmap_tree_next(const res_bitmap_word_t* words, size_t n, size_t from, ushort up);  /*first bit from from on that is set (up=1) or clear (up=0) in n words, n*BITS if there isn't one*/
+ int _res_bitmap_compare(const void* a, const void* b);  /*qsort comparison for size_t's*/
+
+/*Internal macros:*/
+ #if defined(__GNUC__) && defined(BITS_64)
+  #define RES_BITMAP_POPCOUNT(word) ((size_t)__builtin_popcountll(word))
+  #define RES_BITMAP_CTZ(word) ((size_t)__builtin_ctzll(word))  /*word MUST be non-zero*/
+  #define RES_BITMAP_CLZ(word) ((size_t)__builtin_clzll(word))  /*word MUST be non-zero*/
+ #elif defined(__GNUC__)
+  #define RES_BITMAP_POPCOUNT(word) ((size_t)__builtin_popcountl(word))
+  #define RES_BITMAP_CTZ(word) ((size_t)__builtin_ctzl(word))
+  #define RES_BITMAP_CLZ(word) ((size_t)__builtin_clzl(word) - (sizeof(long) * BITS_IN_A_BYTE - BITS))
+ #else
+  #define RES_BITMAP_POPCOUNT(word) _res_bitmap_popcount_word(word)
+  #define RES_BITMAP_CTZ(word) _res_bitmap_ctz_word(word)
+  #define RES_BITMAP_CLZ(word) _res_bitmap_clz_word(word)
+ #endif
+#endif
@@ -0,0 +1,125 @@
+/* bitmap_tree_test.c - unit tests for bitmap_tree.c
+ *
+ * REQUIRES: bitmap_1, tree-1 implementation (compile with RES_BITMAP_TREE)
+ *
+ * Only what tree-1 can do and reff-1 can't - maps far too big to hold a bit
+ * per bit. Everything else is bitmap_test.c, built as bitmap_test_tree.
+ * TESTS: bitmap_1.13
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+#include "bitmap.h"
+#include "res_err.h"
+
+  int main(void);
+  int sparse(void);
+
+int main()
+{
+   /*maps only tree-1 can hold*/
+    printf("01 - huge sparse bitmaps\n");
+    if( 0 != sparse() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+  printf("ALL TESTS PASSED!\n");
+  return(EXIT_SUCCESS);
+}
+
+int sparse(void)
+{
+  res_bitmap_t* bitmap1;
+  res_bitmap_t* bitmap2;
+  res_bitmap_word_t delta[64];
+  res_bitmap_word_t* buf;
+  size_t num_bits;
+  size_t i;
+  size_t n;
+    printf("\tcreating bitmaps of the largest sizes... ");
+    errno = 0;
+    assert(NULL == res_bitmap_create(RES_BITMAP_ERR));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    bitmap1 = res_bitmap_create(RES_BITMAP_ERR - 1);
+    assert(NULL != bitmap1);
+    assert(RES_BITMAP_ERR - 1 == res_bitmap_largest_free(bitmap1));
+    assert(0 == res_bitmap_destroy(bitmap1));
+    printf("Good!\n");
+
+    num_bits = SIZE_MAX / 4;  /*far too big for a map*/
+    printf("\ttaking & checking huge extents... ");
+    bitmap1 = res_bitmap_create(num_bits);
+    assert(NULL != bitmap1);
+    assert(0 == res_bitmap_take(bitmap1, 1000, 9999999));
+    assert(0 == res_bitmap_take(bitmap1, num_bits - 999, 999));
+    assert(1 == res_bitmap_check(bitmap1, 1000, 9999999));
+    assert(2 == res_bitmap_check(bitmap1, 0, num_bits));
+    assert(0 == res_bitmap_check(bitmap1, 10001000, num_bits - 10002000));
+    assert(10001000 == res_bitmap_count(bitmap1, 0, num_bits));
+    assert(10000999 == res_bitmap_select(bitmap1, 9999999));
+    assert(num_bits - 999 == res_bitmap_select(bitmap1, 10000000));
+    assert(num_bits - 10002000 == res_bitmap_largest_free(bitmap1));
+    printf("Good!\n");
+
+    printf("\tparallel count, check & find... ");
+    assert(10001000 == res_bitmap_count_parallel(bitmap1, 0, num_bits, 8));
+    assert(1 == res_bitmap_check_parallel(bitmap1, 1000, 9999999, 8));
+    assert(2 == res_bitmap_check_parallel(bitmap1, 5, num_bits - 5, 8));
+    assert(10001000 == res_bitmap_find_next_clear_parallel(bitmap1, 1000, 8));
+    printf("Good!\n");
+
+    printf("\tsplitting & allocating... ");
+    for(i=0; i<1000; i++)
+      assert(0 == res_bitmap_free(bitmap1, 1000 + i * 10000, 0));
+    assert(10000000 == res_bitmap_count(bitmap1, 0, num_bits));
+    assert(0 == res_bitmap_alloc(bitmap1, 999));
+    for(i=0; i<1000; i++)
+      assert(1000 + i * 10000 == res_bitmap_alloc(bitmap1, 0));
+    assert(10001000 == res_bitmap_alloc(bitmap1, 99999999));
+    assert(0 == res_bitmap_set_policy(bitmap1, RES_BITMAP_WORST_FIT));
+    assert(110001000 == res_bitmap_alloc(bitmap1, 0));
+    assert(0 == res_bitmap_resize(bitmap1, num_bits / 2));
+    assert(110001001 == res_bitmap_count(bitmap1, 0, num_bits / 2));
+    printf("Good!\n");
+
+    printf("\tsending deltas... ");
+    assert(0 == res_bitmap_destroy(bitmap1));
+    num_bits = ((size_t)1 << 30) - 1;  /*dirty tracking is a bit per word, so not quite as big*/
+    bitmap1 = res_bitmap_create_opts(num_bits, RES_BITMAP_OPT_DELTA);
+    bitmap2 = res_bitmap_create(0);
+    assert((NULL != bitmap1) && (NULL != bitmap2));
+    assert(0 == res_bitmap_take(bitmap1, 1000, 9999999));
+    assert(0 == res_bitmap_take(bitmap1, num_bits - 999, 999));
+    n = res_bitmap_delta_export(bitmap1, delta, 64);  /*the extents are lots of words - only the first few fit*/
+    assert(64 == n);
+    assert(0 == res_bitmap_delta_apply(bitmap2, delta, n));
+    assert(num_bits == res_bitmap_get_size(bitmap2));
+    assert(0 == res_bitmap_check(bitmap2, 0, 999));
+    assert(1 == res_bitmap_check(bitmap2, 1000, (1000 / BITS + 60) * BITS - 1001));  /*a run of 60 words from the one bit 1000 is in*/
+    assert(0 == res_bitmap_check(bitmap2, (1000 / BITS + 60) * BITS, num_bits - (1000 / BITS + 60) * BITS));
+    n = res_bitmap_delta_size(bitmap1);
+    buf = malloc(n * sizeof(res_bitmap_word_t));
+    assert(NULL != buf);
+    n = res_bitmap_delta_export(bitmap1, buf, n);
+    assert(0 == res_bitmap_delta_apply(bitmap2, buf, n));
+    free(buf);
+    assert(1 == res_bitmap_check(bitmap2, 1000, 9999999));
+    assert(1 == res_bitmap_check(bitmap2, num_bits - 999, 999));
+    assert(10001000 == res_bitmap_count(bitmap2, 0, num_bits));
+    assert(RES_BITMAP_DELTA_HEADER == res_bitmap_delta_export(bitmap1, delta, 64));  /*nothing left to send*/
+    assert(0 == res_bitmap_destroy(bitmap1));
+    assert(0 == res_bitmap_destroy(bitmap2));
+    printf("Good!\n");
+  return(0);
+}
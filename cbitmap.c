@@ -0,0 +1,368 @@
+/* cbitmap.c - bitmap that can be shared between threads without locks
+ *
+ * API: cbitmap 1.1
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include "cbitmap.h"
+
+/* Every word of the map is a C11 atomic. take and free are one fetch_or /
+ * fetch_and per word, so they never wait. alloc of a block that fits in a
+ * word finds a gap in a word it has read, and claims it with one
+ * compare-and-swap - if another thread changed the word first, the CAS hands
+ * back the new value and the gap is looked for again. Blocks that can't be
+ * found inside one word are claimed word by word, from the lowest up, and if
+ * any bit turns out to have been taken in the meantime the words already
+ * claimed are put back and the search carries on past it. While that
+ * happens, other threads may briefly see part of a block taken that then
+ * turns out to be free after all.*/
+
+res_cbitmap_t* res_cbitmap_create(size_t num_bits)
+{
+  res_cbitmap_t* handle;
+  size_t i;
+    handle = malloc( sizeof(res_cbitmap_t) );
+    if(NULL == handle)
+      return(NULL);
+
+    handle->words = (num_bits / BITS) + 1;
+    handle->base = malloc( handle->words * sizeof(res_cbitmap_word_t) );
+    if(NULL == handle->base)
+    {
+      free(handle);
+      return(NULL);
+    }
+
+   /*all free, apart from the bits past the end*/
+    for(i=0; i<handle->words; i++)
+      atomic_init(&handle->base[i], 0);
+    if(num_bits % BITS != BITS - 1)
+      atomic_init(&handle->base[handle->words-1], ~_res_cbitmap_mask(0, num_bits % BITS));
+    handle->num_bits = num_bits;
+    atomic_init(&handle->hint, 0);
+  return(handle);
+}
+
+ushort res_cbitmap_destroy(res_cbitmap_t* cbitmap_handle)
+{
+  free(cbitmap_handle->base);
+  free(cbitmap_handle);
+  return(0);
+}
+
+size_t res_cbitmap_alloc(res_cbitmap_t* cbitmap_handle, size_t block_size)
+{
+  size_t need;
+  size_t start;
+  size_t conflict;
+    if(block_size > cbitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_CBITMAP_ERR);
+    }
+    need = block_size + 1;
+
+   /*fits in a word - one CAS*/
+    if(need <= BITS)
+    {
+      start = _res_cbitmap_alloc_word(cbitmap_handle, need);
+      if(RES_CBITMAP_ERR != start)
+        return(start);
+    }
+
+   /*slow path - blocks across word boundaries. Claim the lowest gap found, and if that loses a race, look again past the bit that got in the way*/
+    start = 0;
+    while(RES_CBITMAP_ERR != (start = _res_cbitmap_scan(cbitmap_handle, start, need)))
+    {
+      if(0 == _res_cbitmap_claim(cbitmap_handle, start, start + block_size, &conflict))
+        return(start);
+      start = conflict + 1;
+    }
+    errno = RES_ERR_NO_MATCH;
+  return(RES_CBITMAP_ERR);
+}
+
+ushort res_cbitmap_free(res_cbitmap_t* cbitmap_handle, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > cbitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > cbitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+    _res_cbitmap_mark(cbitmap_handle, base, base+limit, 0);
+  return(0);
+}
+
+ushort res_cbitmap_take(res_cbitmap_t* cbitmap_handle, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > cbitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > cbitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+    _res_cbitmap_mark(cbitmap_handle, base, base+limit, 1);
+  return(0);
+}
+
+ushort res_cbitmap_reserve(res_cbitmap_t* cbitmap_handle, const res_bitmap_range_t* ranges, size_t count, size_t* failed)
+{
+  size_t i;
+  size_t j;
+  size_t conflict;
+   /*check every range before claiming any*/
+    for(i=0; i<count; i++)
+    {
+      if(ranges[i].base > cbitmap_handle->num_bits)
+      {
+        if(NULL != failed)
+          *failed = i;
+        return(2);
+      }
+      if((ranges[i].base > (SIZE_MAX - ranges[i].limit)) || ((ranges[i].base+ranges[i].limit) > cbitmap_handle->num_bits))
+      {
+        if(NULL != failed)
+          *failed = i;
+        return(3);
+      }
+    }
+
+   /*claim them in order. A claim that fails has already put back its own words - the ranges before it are ours in full, so clearing them can't touch another thread's bits*/
+    for(i=0; i<count; i++)
+    {
+      if(0 != _res_cbitmap_claim(cbitmap_handle, ranges[i].base, ranges[i].base+ranges[i].limit, &conflict))
+      {
+        for(j=0; j<i; j++)
+          _res_cbitmap_mark(cbitmap_handle, ranges[j].base, ranges[j].base+ranges[j].limit, 0);
+        if(NULL != failed)
+          *failed = i;
+        return(1);
+      }
+    }
+  return(0);
+}
+
+ushort res_cbitmap_check(res_cbitmap_t* cbitmap_handle, size_t base, size_t limit)
+{
+  res_bitmap_word_t word;
+  res_bitmap_word_t mask;
+  res_bitmap_word_t want;
+  size_t w;
+  size_t first_word;
+  size_t last_word;
+  ushort up = 0;
+   /*check base & limit*/
+    if(base > cbitmap_handle->num_bits)
+      return(4);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > cbitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(5);
+
+    first_word = base / BITS;
+    last_word = (base + limit) / BITS;
+    for(w=first_word; w<=last_word; w++)
+    {
+      mask = ~(res_bitmap_word_t)0;
+      if(w == first_word)
+        mask &= _res_cbitmap_mask(base%BITS, BITS-1);
+      if(w == last_word)
+        mask &= _res_cbitmap_mask(0, (base+limit)%BITS);
+      word = atomic_load_explicit(&cbitmap_handle->base[w], memory_order_acquire);
+
+     /*the first bit decides what the rest must be*/
+      if(w == first_word)
+        up = (0 == (word & ((res_bitmap_word_t)1 << (base%BITS)))) ? 0 : 1;
+      want = (0 == up) ? 0 : ~(res_bitmap_word_t)0;
+      if((word & mask) != (want & mask))
+        return(2);
+    }
+  return(up);
+}
+
+size_t res_cbitmap_count(res_cbitmap_t* cbitmap_handle, size_t base, size_t limit)
+{
+  res_bitmap_word_t mask;
+  size_t w;
+  size_t first_word;
+  size_t last_word;
+  size_t count = 0;
+   /*check parameters*/
+    if((base > cbitmap_handle->num_bits) || (base > (SIZE_MAX - limit)) || ((base+limit) > cbitmap_handle->num_bits))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_CBITMAP_ERR);
+    }
+
+    first_word = base / BITS;
+    last_word = (base + limit) / BITS;
+    for(w=first_word; w<=last_word; w++)
+    {
+      mask = ~(res_bitmap_word_t)0;
+      if(w == first_word)
+        mask &= _res_cbitmap_mask(base%BITS, BITS-1);
+      if(w == last_word)
+        mask &= _res_cbitmap_mask(0, (base+limit)%BITS);
+      count += RES_BITMAP_POPCOUNT(atomic_load_explicit(&cbitmap_handle->base[w], memory_order_relaxed) & mask);
+    }
+  return(count);
+}
+
+size_t res_cbitmap_get_size(res_cbitmap_t* cbitmap_handle)
+{
+  return(cbitmap_handle->num_bits);
+}
+
+/*-------------- Internals ----------------*/
+
+res_bitmap_word_t _res_cbitmap_mask(size_t first, size_t last)
+{
+  return( (~(res_bitmap_word_t)0 >> (BITS - 1 - last)) & (~(res_bitmap_word_t)0 << first) );
+}
+
+void _res_cbitmap_mark(res_cbitmap_t* cbitmap_handle, size_t first, size_t last, ushort up)
+{
+  res_bitmap_word_t mask;
+  size_t w;
+  size_t first_word;
+  size_t last_word;
+    first_word = first / BITS;
+    last_word = last / BITS;
+    for(w=first_word; w<=last_word; w++)
+    {
+      mask = ~(res_bitmap_word_t)0;
+      if(w == first_word)
+        mask &= _res_cbitmap_mask(first%BITS, BITS-1);
+      if(w == last_word)
+        mask &= _res_cbitmap_mask(0, last%BITS);
+      if(0 == up)
+        atomic_fetch_and_explicit(&cbitmap_handle->base[w], ~mask, memory_order_release);
+      else
+        atomic_fetch_or_explicit(&cbitmap_handle->base[w], mask, memory_order_acq_rel);
+    }
+}
+
+size_t _res_cbitmap_fit_word(res_bitmap_word_t word, size_t need)
+{
+  res_bitmap_word_t runs;
+  size_t len = 1;
+  size_t step;
+   /*bit i of runs stays set while bits i to i+len-1 are all clear - double len each time, until it reaches need. Shifts bring in 0's at the top, so runs can't wrap off the end*/
+    runs = ~word;
+    while((len < need) && (0 != runs))
+    {
+      step = (need - len < len) ? need - len : len;
+      runs &= runs >> step;
+      len += step;
+    }
+    if(0 == runs)
+      return(BITS);
+  return(RES_BITMAP_CTZ(runs));
+}
+
+size_t _res_cbitmap_alloc_word(res_cbitmap_t* cbitmap_handle, size_t need)
+{
+  res_bitmap_word_t word;
+  size_t w;
+  size_t n;
+  size_t bit;
+   /*look for a gap in each word, starting where the last one was found, and CAS it in*/
+    w = atomic_load_explicit(&cbitmap_handle->hint, memory_order_relaxed);
+    for(n=0; n<cbitmap_handle->words; n++, w++)
+    {
+      if(w >= cbitmap_handle->words)
+        w = 0;
+      word = atomic_load_explicit(&cbitmap_handle->base[w], memory_order_relaxed);
+      while(BITS != (bit = _res_cbitmap_fit_word(word, need)))
+      {
+        if(atomic_compare_exchange_weak_explicit(&cbitmap_handle->base[w], &word, word | _res_cbitmap_mask(bit, bit + need - 1),
+                                                 memory_order_acq_rel, memory_order_relaxed))
+        {
+          atomic_store_explicit(&cbitmap_handle->hint, w, memory_order_relaxed);
+          return(w * BITS + bit);
+        }
+        /*failed - word now holds what's really there*/
+      }
+    }
+  return(RES_CBITMAP_ERR);
+}
+
+size_t _res_cbitmap_scan(res_cbitmap_t* cbitmap_handle, size_t from, size_t need)
+{
+  res_bitmap_word_t word;
+  size_t w;
+  size_t bit;
+  size_t n;
+  size_t run_start = 0;
+  size_t run_len = 0;
+    if(from > cbitmap_handle->num_bits)
+      return(RES_CBITMAP_ERR);
+
+    for(w=from/BITS; w<cbitmap_handle->words; w++)
+    {
+      word = atomic_load_explicit(&cbitmap_handle->base[w], memory_order_relaxed);
+      if(w == from/BITS)
+        word |= ~_res_cbitmap_mask(from%BITS, BITS-1);  /*bits before from count as taken*/
+
+     /*walk the runs of 0's and 1's in the word - bits past the end are always set, so runs stop there*/
+      bit = 0;
+      while(bit < BITS)
+      {
+        n = (0 == (word >> bit)) ? BITS - bit : RES_BITMAP_CTZ(word >> bit);
+        if(0 != n)
+        {
+          if(0 == run_len)
+            run_start = w * BITS + bit;
+          run_len += n;
+          if(run_len >= need)
+            return(run_start);
+          bit += n;
+          if(bit >= BITS)
+            break;
+        }
+        n = (0 == (~word >> bit)) ? BITS - bit : RES_BITMAP_CTZ(~word >> bit);
+        run_len = 0;
+        bit += n;
+      }
+    }
+  return(RES_CBITMAP_ERR);
+}
+
+ushort _res_cbitmap_claim(res_cbitmap_t* cbitmap_handle, size_t first, size_t last, size_t* conflict)
+{
+  res_bitmap_word_t word;
+  res_bitmap_word_t mask;
+  size_t w;
+  size_t first_word;
+  size_t last_word;
+    first_word = first / BITS;
+    last_word = last / BITS;
+    for(w=first_word; w<=last_word; w++)
+    {
+      mask = ~(res_bitmap_word_t)0;
+      if(w == first_word)
+        mask &= _res_cbitmap_mask(first%BITS, BITS-1);
+      if(w == last_word)
+        mask &= _res_cbitmap_mask(0, last%BITS);
+
+     /*only swap in while every bit we want is still clear*/
+      word = atomic_load_explicit(&cbitmap_handle->base[w], memory_order_relaxed);
+      do
+      {
+        if(0 != (word & mask))
+        {
+          *conflict = w * BITS + RES_BITMAP_CTZ(word & mask);
+          if(w != first_word)
+            _res_cbitmap_mark(cbitmap_handle, first, w * BITS - 1, 0);  /*roll back what we have*/
+          return(1);
+        }
+      } while(!atomic_compare_exchange_weak_explicit(&cbitmap_handle->base[w], &word, word | mask,
+                                                     memory_order_acq_rel, memory_order_relaxed));
+    }
+  return(0);
+}
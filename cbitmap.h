@@ -0,0 +1,52 @@
+/* cbitmap.h - header for cbitmap.c, a bitmap that can be shared between
+ *             threads without locks
+ *
+ * API: cbitmap 1.1
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#ifndef H_RES_CBITMAP
+#define H_RES_CBITMAP
+ #include <stdatomic.h>
+ #include "res_config.h"
+ #include "res_types.h"
+ #include "res_err.h"
+ #include "bitmap.h"  /*for res_bitmap_word_t and the word macros*/
+
+/*Types:*/
+ typedef _Atomic res_bitmap_word_t res_cbitmap_word_t;
+
+/*Structures:*/
+ typedef struct
+ {
+   res_cbitmap_word_t *base;  /*the map, one atomic word at a time. Bits past num_bits in the last word are always set, so alloc never finds them*/
+   size_t words;  /*number of words in the map*/
+   size_t num_bits;  /*num_bits of 0 = 1 bit in the map. Fixed - there is no resize*/
+   _Atomic size_t hint;  /*word the last small alloc came from - where the next one starts looking*/
+  } res_cbitmap_t;
+
+/*External functions. Everything but create and destroy may be called from any number of threads at once*/
+ res_cbitmap_t* res_cbitmap_create(size_t num_bits);  /*creates a bitmap of size num_bits and a handle for it. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail. NOTE - num_bits starts at 0. 0 implies a bitmap with 1 bit, etc.*/
+ ushort res_cbitmap_destroy(res_cbitmap_t* cbitmap_handle);  /*frees bitmap and handle memory. No other thread may be using it. Returns 0 on success*/
+
+ size_t res_cbitmap_alloc(res_cbitmap_t* cbitmap_handle, size_t block_size);  /*finds and marks block_size+1 free bits in a row. Blocks that fit in a word are claimed with a single compare-and-swap, bigger ones word by word, backing out if another thread gets there first. Returns start bit on success, RES_CBITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER or RES_ERR_NO_MATCH*/
+ ushort res_cbitmap_free(res_cbitmap_t* cbitmap_handle, size_t base, size_t limit);  /*unmarks bits from base to (base+limit), a word at a time. Limit of 0 = 1 bit. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_cbitmap_take(res_cbitmap_t* cbitmap_handle, size_t base, size_t limit);  /*marks bits from base to (base+limit), a word at a time. Does not check if they were free. Limit of 0 = 1 bit. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_cbitmap_reserve(res_cbitmap_t* cbitmap_handle, const res_bitmap_range_t* ranges, size_t count, size_t* failed);  /*takes count ranges all together or not at all, with no lock. Each word is claimed with a compare-and-swap that only goes in while its bits are clear, and the first bit found taken - by another thread, or an earlier range - puts back every word claimed so far. Other threads may see some of the ranges taken for a moment before a rollback, but never end up with any of them. Returns 0 on success, 1 on a bit already taken, 2 on a base out-of-range, 3 on a limit out-of-range - nothing is left taken on error, and failed (if not NULL) is set to the index of the range at fault*/
+ ushort res_cbitmap_check(res_cbitmap_t* cbitmap_handle, size_t base, size_t limit);  /*returns 0 if all bits from base to (base+limit) are 0, 1 if all are 1, 2 if they vary, 4 on base-out-of-range, 5 on limit-out-of-range. Each word is read atomically, but a range over several words is not one snapshot*/
+ size_t res_cbitmap_count(res_cbitmap_t* cbitmap_handle, size_t base, size_t limit);  /*counts bits taken from base to base+limit, with the same caveat as check. Returns count on success, RES_CBITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER*/
+ size_t res_cbitmap_get_size(res_cbitmap_t* cbitmap_handle);  /*Returns: num_bits*/
+
+/*Internal functions:*/
+ res_bitmap_word_t _res_cbitmap_mask(size_t first, size_t last);  /*returns a word with bits first to last (inclusive, both < BITS) set*/
+ size_t _res_cbitmap_fit_word(res_bitmap_word_t word, size_t need);  /*finds the lowest run of need (1 to BITS) clear bits inside word. Returns the bit it starts at, or BITS if there isn't one*/
+ size_t _res_cbitmap_alloc_word(res_cbitmap_t* cbitmap_handle, size_t need);  /*claims the first gap of need (1 to BITS) clear bits found inside a single word, from the hint on, with one compare-and-swap. Returns start bit, or RES_CBITMAP_ERR if no word has one*/
+ size_t _res_cbitmap_scan(res_cbitmap_t* cbitmap_handle, size_t from, size_t need);  /*finds the lowest run of need clear bits from bit from on, in whatever state each word is in as it's read. Returns start bit, or RES_CBITMAP_ERR*/
+ ushort _res_cbitmap_claim(res_cbitmap_t* cbitmap_handle, size_t first, size_t last, size_t* conflict);  /*sets bits first to last, a word at a time, as long as every one of them is clear. Returns 0 on success, or 1 having put back any words already claimed, with the first bit found taken in conflict*/
+ void _res_cbitmap_mark(res_cbitmap_t* cbitmap_handle, size_t first, size_t last, ushort up);  /*atomically sets (up=1) or clears (up=0) bits first to last, a word at a time. Does NOT check range*/
+#endif
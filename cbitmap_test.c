@@ -0,0 +1,386 @@
+/* cbitmap_test.c - unit tests for cbitmap.c
+ *
+ * REQUIRES: cbitmap_1, reff-1 implementation
+ * TESTS: cbitmap_1.1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include "cbitmap.h"
+#include "res_err.h"
+
+#define STRESS_THREADS 8
+#define STRESS_ROUNDS 20000
+#define STRESS_BITS 4096
+
+  int main(void);
+  int create_destroy(void);
+  int free_take_check_count(void);
+  int test_alloc(void);  /*named test_... because alloc is already a function name*/
+  int stress(void);
+  void* stress_thread(void* arg);  /*allocs and frees blocks of random sizes, checking no other thread holds any bit of them*/
+  int reserve_stress(void);
+  void* reserve_thread(void* arg);  /*reserves and frees sets of random ranges, checking no other thread holds any bit of them*/
+
+ /*shared by the stress threads*/
+  res_cbitmap_t* stress_map;
+  _Atomic unsigned char stress_owner[STRESS_BITS];  /*0 = nobody, else thread number + 1*/
+  _Atomic size_t stress_failures;
+
+int main()
+{
+   /*create, destroy*/
+    printf("01 - create & destroy bitmaps\n");
+    if( 0 != create_destroy() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*free, take, check, count*/
+    printf("02 - free, take, check, & count operations\n");
+    if( 0 != free_take_check_count() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*alloc*/
+    printf("03 - alloc\n");
+    if( 0 != test_alloc() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*many threads at once*/
+    printf("04 - %d threads allocating and freeing at once\n", STRESS_THREADS);
+    if( 0 != stress() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*many threads reserving several ranges at a time*/
+    printf("05 - %d threads reserving ranges at once\n", STRESS_THREADS);
+    if( 0 != reserve_stress() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+  printf("ALL TESTS PASSED!\n");
+  return(EXIT_SUCCESS);
+}
+
+int create_destroy(void)
+{
+  res_cbitmap_t* bitmap1;
+  res_cbitmap_t* bitmap2;
+    printf("\tcreating bitmaps of size 1 and 1,000,000... ");
+    bitmap1 = res_cbitmap_create(0);
+    bitmap2 = res_cbitmap_create(999999);
+    assert(NULL != bitmap1);
+    assert(NULL != bitmap2);
+    assert(0 == res_cbitmap_get_size(bitmap1));
+    assert(999999 == res_cbitmap_get_size(bitmap2));
+    assert(0 == res_cbitmap_check(bitmap1, 0, 0));
+    assert(0 == res_cbitmap_check(bitmap2, 0, 999999));
+    printf("Good!\n");
+
+    printf("\tdestroying bitmaps... ");
+    assert(0 == res_cbitmap_destroy(bitmap1));
+    assert(0 == res_cbitmap_destroy(bitmap2));
+    printf("Good!\n");
+  return(0);
+}
+
+int free_take_check_count(void)
+{
+  res_cbitmap_t* bitmap1;
+  res_bitmap_range_t good[3] = {{0, 9}, {250, 299}, {999, 1}};  /*good[2] runs off the end*/
+  res_bitmap_range_t clash[3] = {{0, 9}, {105, 9}, {500, 0}};
+  size_t i;
+    printf("\tcreating bitmap of size 1000... ");
+    bitmap1 = res_cbitmap_create(999);
+    assert(NULL != bitmap1);
+    printf("Good!\n");
+
+    printf("\ttake, free & check over word boundaries... ");
+    assert(0 == res_cbitmap_take(bitmap1, 60, 139));
+    assert(1 == res_cbitmap_check(bitmap1, 60, 139));
+    assert(0 == res_cbitmap_check(bitmap1, 0, 59));
+    assert(2 == res_cbitmap_check(bitmap1, 59, 1));
+    assert(0 == res_cbitmap_free(bitmap1, 100, 9));
+    assert(2 == res_cbitmap_check(bitmap1, 60, 139));
+    assert(0 == res_cbitmap_check(bitmap1, 100, 9));
+    assert(0 == res_cbitmap_check(bitmap1, 200, 799));  /*padding past the end doesn't show*/
+    printf("Good!\n");
+
+    printf("\tcount... ");
+    assert(130 == res_cbitmap_count(bitmap1, 0, 999));
+    assert(40 == res_cbitmap_count(bitmap1, 60, 39));
+    assert(0 == res_cbitmap_count(bitmap1, 999, 0));
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    assert(2 == res_cbitmap_take(bitmap1, 1000, 0));
+    assert(3 == res_cbitmap_take(bitmap1, 999, 1));
+    assert(2 == res_cbitmap_free(bitmap1, 1000, 0));
+    assert(3 == res_cbitmap_free(bitmap1, 1, SIZE_MAX));
+    assert(4 == res_cbitmap_check(bitmap1, 1000, 0));
+    assert(5 == res_cbitmap_check(bitmap1, 999, 1));
+    errno = 0;
+    assert(RES_CBITMAP_ERR == res_cbitmap_count(bitmap1, 999, 1));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\tmulti-range reserve... ");
+    assert(1 == res_cbitmap_reserve(bitmap1, clash, 3, &i));  /*105-114 runs into 110*/
+    assert(1 == i);
+    assert(0 == res_cbitmap_check(bitmap1, 0, 9));
+    assert(0 == res_cbitmap_check(bitmap1, 100, 9));
+    assert(130 == res_cbitmap_count(bitmap1, 0, 999));
+    assert(3 == res_cbitmap_reserve(bitmap1, good, 3, &i));
+    assert(2 == i);
+    assert(0 == res_cbitmap_reserve(bitmap1, good, 2, NULL));
+    assert(1 == res_cbitmap_check(bitmap1, 0, 9));
+    assert(1 == res_cbitmap_check(bitmap1, 250, 299));
+    assert(440 == res_cbitmap_count(bitmap1, 0, 999));
+    printf("Good!\n");
+
+    printf("\tdestroying bitmap... ");
+    assert(0 == res_cbitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int test_alloc(void)
+{
+  res_cbitmap_t* bitmap1;
+  size_t i;
+    printf("\tsmall blocks, one thread... ");
+    bitmap1 = res_cbitmap_create(199);
+    assert(NULL != bitmap1);
+    assert(0 == res_cbitmap_alloc(bitmap1, 0));
+    assert(1 == res_cbitmap_alloc(bitmap1, 9));
+    assert(11 == res_cbitmap_alloc(bitmap1, 3));
+    assert(1 == res_cbitmap_check(bitmap1, 0, 14));
+    assert(0 == res_cbitmap_free(bitmap1, 1, 9));
+    assert(1 == res_cbitmap_alloc(bitmap1, 4));  /*fits back in the gap*/
+    assert(0 == res_cbitmap_check(bitmap1, 6, 4));
+    printf("Good!\n");
+
+    printf("\tblocks across word boundaries... ");
+    assert(0 == res_cbitmap_free(bitmap1, 0, 199));
+    assert(0 == res_cbitmap_take(bitmap1, 20, 0));
+    assert(21 == res_cbitmap_alloc(bitmap1, 99));  /*too big for a word*/
+    assert(1 == res_cbitmap_check(bitmap1, 20, 100));
+    assert(0 == res_cbitmap_check(bitmap1, 121, 78));
+    assert(0 == res_cbitmap_free(bitmap1, 0, 199));
+    for(i=0; i+BITS/2<200; i+=BITS)  /*a bit taken in the middle of every word, so nothing fits in one*/
+      assert(0 == res_cbitmap_take(bitmap1, i + BITS/2, 0));
+    assert(BITS/2 + 1 == res_cbitmap_alloc(bitmap1, BITS/2 + 2));
+    printf("Good!\n");
+
+    printf("\tfull and error conditions... ");
+    assert(0 == res_cbitmap_free(bitmap1, 0, 199));
+    assert(0 == res_cbitmap_alloc(bitmap1, 199));
+    errno = 0;
+    assert(RES_CBITMAP_ERR == res_cbitmap_alloc(bitmap1, 0));
+    assert(RES_ERR_NO_MATCH == errno);
+    errno = 0;
+    assert(RES_CBITMAP_ERR == res_cbitmap_alloc(bitmap1, 200));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(0 == res_cbitmap_free(bitmap1, 199, 0));
+    assert(199 == res_cbitmap_alloc(bitmap1, 0));  /*last bit, next to the padding*/
+    assert(0 == res_cbitmap_destroy(bitmap1));
+    printf("Good!\n");
+
+    printf("\tone bit at a time until full... ");
+    bitmap1 = res_cbitmap_create(999);
+    assert(NULL != bitmap1);
+    for(i=0; i<1000; i++)
+      assert(RES_CBITMAP_ERR != res_cbitmap_alloc(bitmap1, 0));
+    assert(RES_CBITMAP_ERR == res_cbitmap_alloc(bitmap1, 0));
+    assert(1000 == res_cbitmap_count(bitmap1, 0, 999));
+    assert(0 == res_cbitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int stress(void)
+{
+  pthread_t thread[STRESS_THREADS];
+  size_t id[STRESS_THREADS];
+  size_t i;
+    printf("\tcreating bitmap of size %d... ", STRESS_BITS);
+    stress_map = res_cbitmap_create(STRESS_BITS - 1);
+    assert(NULL != stress_map);
+    for(i=0; i<STRESS_BITS; i++)
+      atomic_init(&stress_owner[i], 0);
+    atomic_init(&stress_failures, 0);
+    printf("Good!\n");
+
+    printf("\tallocating and freeing, checking no bit is handed out twice... ");
+    for(i=0; i<STRESS_THREADS; i++)
+    {
+      id[i] = i;
+      assert(0 == pthread_create(&thread[i], NULL, stress_thread, &id[i]));
+    }
+    for(i=0; i<STRESS_THREADS; i++)
+      assert(0 == pthread_join(thread[i], NULL));
+    assert(0 == atomic_load(&stress_failures));
+    printf("Good!\n");
+
+    printf("\tall bits back free... ");
+    assert(0 == res_cbitmap_count(stress_map, 0, STRESS_BITS - 1));
+    assert(0 == res_cbitmap_alloc(stress_map, STRESS_BITS - 1));
+    assert(0 == res_cbitmap_destroy(stress_map));
+    printf("Good!\n");
+  return(0);
+}
+
+void* stress_thread(void* arg)
+{
+  unsigned char me;
+  unsigned int seed;
+  size_t held_start[16];
+  size_t held_size[16];
+  size_t held = 0;
+  size_t round;
+  size_t size;
+  size_t start;
+  size_t i;
+    me = (unsigned char)(*(size_t*)arg + 1);
+    seed = me * 2654435761u;
+
+    for(round=0; round<STRESS_ROUNDS; round++)
+    {
+      seed = seed * 1103515245u + 12345u;
+      if((held < 16) && ((held == 0) || (0 != (seed & 0x10000))))
+      {
+       /*mostly small blocks, now and then one that spans words*/
+        size = (0 == (seed & 0x7000000)) ? (seed >> 8) % (3 * BITS) : (seed >> 8) % 8;
+        start = res_cbitmap_alloc(stress_map, size);
+        if(RES_CBITMAP_ERR == start)
+          continue;
+        for(i=start; i<=start+size; i++)
+          if(0 != atomic_exchange(&stress_owner[i], me))
+            atomic_fetch_add(&stress_failures, 1);
+        held_start[held] = start;
+        held_size[held] = size;
+        held++;
+      }
+      else
+      {
+        held--;
+        for(i=held_start[held]; i<=held_start[held]+held_size[held]; i++)
+          if(me != atomic_exchange(&stress_owner[i], 0))
+            atomic_fetch_add(&stress_failures, 1);
+        if(0 != res_cbitmap_free(stress_map, held_start[held], held_size[held]))
+          atomic_fetch_add(&stress_failures, 1);
+      }
+    }
+    while(held > 0)
+    {
+      held--;
+      for(i=held_start[held]; i<=held_start[held]+held_size[held]; i++)
+        if(me != atomic_exchange(&stress_owner[i], 0))
+          atomic_fetch_add(&stress_failures, 1);
+      res_cbitmap_free(stress_map, held_start[held], held_size[held]);
+    }
+  return(NULL);
+}
+
+int reserve_stress(void)
+{
+  pthread_t thread[STRESS_THREADS];
+  size_t id[STRESS_THREADS];
+  size_t i;
+    stress_map = res_cbitmap_create(STRESS_BITS - 1);
+    assert(NULL != stress_map);
+    for(i=0; i<STRESS_BITS; i++)
+      atomic_init(&stress_owner[i], 0);
+    atomic_init(&stress_failures, 0);
+
+    printf("\treserving and freeing, checking every set is all or nothing... ");
+    for(i=0; i<STRESS_THREADS; i++)
+    {
+      id[i] = i;
+      assert(0 == pthread_create(&thread[i], NULL, reserve_thread, &id[i]));
+    }
+    for(i=0; i<STRESS_THREADS; i++)
+      assert(0 == pthread_join(thread[i], NULL));
+    assert(0 == atomic_load(&stress_failures));
+    printf("Good!\n");
+
+    printf("\tall bits back free... ");
+    assert(0 == res_cbitmap_count(stress_map, 0, STRESS_BITS - 1));
+    assert(0 == res_cbitmap_destroy(stress_map));
+    printf("Good!\n");
+  return(0);
+}
+
+void* reserve_thread(void* arg)
+{
+  unsigned char me;
+  unsigned int seed;
+  res_bitmap_range_t range[4];
+  size_t ranges;
+  size_t round;
+  size_t failed;
+  size_t won = 0;
+  size_t i;
+  size_t j;
+    me = (unsigned char)(*(size_t*)arg + 1);
+    seed = me * 2654435761u;
+
+    for(round=0; round<STRESS_ROUNDS / 4; round++)
+    {
+     /*two to four ranges anywhere in the map, sometimes spanning words*/
+      seed = seed * 1103515245u + 12345u;
+      ranges = 2 + (seed >> 16) % 3;
+      for(i=0; i<ranges; i++)
+      {
+        seed = seed * 1103515245u + 12345u;
+        range[i].limit = (0 == (seed & 0x700)) ? (seed >> 20) % (2 * BITS) : (seed >> 20) % 8;
+        seed = seed * 1103515245u + 12345u;
+        range[i].base = (seed >> 8) % (STRESS_BITS - range[i].limit);
+      }
+      if(0 != res_cbitmap_reserve(stress_map, range, ranges, &failed))
+      {
+        if(failed >= ranges)
+          atomic_fetch_add(&stress_failures, 1);
+        continue;
+      }
+      won++;
+
+     /*every bit of every range is ours - then give them all back*/
+      for(i=0; i<ranges; i++)
+        for(j=range[i].base; j<=range[i].base+range[i].limit; j++)
+          if(0 != atomic_exchange(&stress_owner[j], me))
+            atomic_fetch_add(&stress_failures, 1);
+      for(i=0; i<ranges; i++)
+        for(j=range[i].base; j<=range[i].base+range[i].limit; j++)
+          if(me != atomic_exchange(&stress_owner[j], 0))
+            atomic_fetch_add(&stress_failures, 1);
+      for(i=0; i<ranges; i++)
+        if(0 != res_cbitmap_free(stress_map, range[i].base, range[i].limit))
+          atomic_fetch_add(&stress_failures, 1);
+    }
+    if(0 == won)
+      atomic_fetch_add(&stress_failures, 1);  /*not much of a test*/
+  return(NULL);
+}
@@ -0,0 +1,158 @@
+/* cstack.c - stack of pointers that can be shared between threads without
+ *            locks
+ *
+ * API: cstack 1.0
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include "cstack.h"
+
+/* A Treiber stack. Entries are nodes in a linked list, and the head of the
+ * list is a single atomic word, so a push or pop is one compare-and-swap of
+ * it - if another thread changed the head first, the CAS fails and is tried
+ * again from the new one.
+ *
+ * The trouble with that is ABA: a thread reads head A and A's next, B, then
+ * sleeps. Meanwhile others pop A, pop B and push A again. The head is A
+ * once more, so the sleeping thread's CAS would go in and make B - no longer
+ * on the stack - the top. So the head is not just a node but a node index
+ * and a tag, and every change to it bumps the tag. The CAS then fails unless
+ * nothing at all has happened since the head was read. The tag is 32 bits,
+ * so a thread would have to sleep through 2^32 changes for it to come round
+ * again.
+ *
+ * Nodes are all allocated up front, as res_stack_create allocates its
+ * array, and the ones not on the stack are kept on a second list, spare,
+ * handled the same way. So no node is freed while another thread might
+ * still read it, and push never calls malloc.*/
+
+res_cstack_t* res_cstack_create(size_t max_entries)
+{
+  res_cstack_t* handle;
+  size_t i;
+   /*node indexes must fit below RES_CSTACK_NIL*/
+    if(max_entries >= (size_t)RES_CSTACK_NIL - 1)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+    handle = malloc( sizeof(res_cstack_t) );
+    if(NULL == handle)
+      return(NULL);
+    handle->node = malloc( (max_entries + 1) * sizeof(res_cstack_node_t) );
+    if(NULL == handle->node)
+    {
+      free(handle);
+      return(NULL);
+    }
+
+   /*every node spare, in order, nothing pushed*/
+    for(i=0; i<=max_entries; i++)
+    {
+      handle->node[i].resource = NULL;
+      atomic_init(&handle->node[i].next, (i == max_entries) ? RES_CSTACK_NIL : (uint32_t)(i + 1));
+    }
+    handle->limit = max_entries;
+    atomic_init(&handle->top, (uint64_t)RES_CSTACK_NIL);
+    atomic_init(&handle->spare, (uint64_t)0);
+    atomic_init(&handle->entries, 0);
+  return(handle);
+}
+
+ushort res_cstack_destroy(res_cstack_t* cstack_handle)
+{
+  free(cstack_handle->node);
+  free(cstack_handle);
+  return(0);
+}
+
+ushort res_cstack_push(res_cstack_t* cstack_handle, void* resource)
+{
+  uint32_t i;
+   /*a free node - none means full*/
+    i = _res_cstack_take(cstack_handle, &cstack_handle->spare);
+    if(RES_CSTACK_NIL == i)
+      return(2);
+
+   /*it's ours until it's on the stack. Counted first, so a pop taking it straight away can't bring entries below 0*/
+    cstack_handle->node[i].resource = resource;
+    atomic_fetch_add_explicit(&cstack_handle->entries, 1, memory_order_relaxed);
+    _res_cstack_put(cstack_handle, &cstack_handle->top, i);
+  return(0);
+}
+
+void* res_cstack_pop(res_cstack_t* cstack_handle)
+{
+  void* retval;
+  uint32_t i;
+    i = _res_cstack_take(cstack_handle, &cstack_handle->top);
+    if(RES_CSTACK_NIL == i)
+    {
+      errno = RES_ERR_STACK_EMPTY;
+      return(NULL);
+    }
+
+   /*read it before handing the node back - it may be reused straight away*/
+    retval = cstack_handle->node[i].resource;
+    atomic_fetch_sub_explicit(&cstack_handle->entries, 1, memory_order_relaxed);
+    _res_cstack_put(cstack_handle, &cstack_handle->spare, i);
+
+  if(NULL == retval)  /*NULL is also used to signal error, so set errno to 0 to make it clear this is the answer, not an error*/
+    errno = 0;
+  return(retval);
+}
+
+size_t res_cstack_get_entries(res_cstack_t* cstack_handle)
+{
+  return(atomic_load_explicit(&cstack_handle->entries, memory_order_relaxed));
+}
+
+size_t res_cstack_get_size(res_cstack_t* cstack_handle)
+{
+  return(cstack_handle->limit);
+}
+
+/*-------------- Internals ----------------*/
+
+uint32_t _res_cstack_take(res_cstack_t* cstack_handle, _Atomic uint64_t* list)
+{
+  uint64_t head;
+  uint32_t i;
+  uint32_t next;
+    head = atomic_load_explicit(list, memory_order_acquire);
+    do
+    {
+      i = (uint32_t)head;
+      if(RES_CSTACK_NIL == i)
+        return(RES_CSTACK_NIL);
+
+     /*if head is stale, next may be rubbish - but then the tag won't match, and the CAS fails*/
+      next = atomic_load_explicit(&cstack_handle->node[i].next, memory_order_relaxed);
+    } while(!atomic_compare_exchange_weak_explicit(list, &head, _res_cstack_head(head, next),
+                                                   memory_order_acquire, memory_order_acquire));
+  return(i);
+}
+
+void _res_cstack_put(res_cstack_t* cstack_handle, _Atomic uint64_t* list, uint32_t i)
+{
+  uint64_t head;
+   /*release, so whoever takes the node next sees its resource*/
+    head = atomic_load_explicit(list, memory_order_relaxed);
+    do
+    {
+      atomic_store_explicit(&cstack_handle->node[i].next, (uint32_t)head, memory_order_relaxed);
+    } while(!atomic_compare_exchange_weak_explicit(list, &head, _res_cstack_head(head, i),
+                                                   memory_order_release, memory_order_relaxed));
+}
+
+uint64_t _res_cstack_head(uint64_t old, uint32_t i)
+{
+  return((((old >> RES_CSTACK_TAG_SHIFT) + 1) << RES_CSTACK_TAG_SHIFT) | i);
+}
@@ -0,0 +1,54 @@
+/* cstack.h - header for cstack.c, a stack of pointers that can be shared
+ *            between threads without locks
+ *
+ * API: cstack 1.0
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#ifndef H_RES_CSTACK
+#define H_RES_CSTACK
+ #include <stdatomic.h>
+ #include "res_config.h"
+ #include "res_types.h"
+ #include "res_err.h"
+
+/*Config:*/
+ #define RES_CSTACK_NIL 0xFFFFFFFF  /*node index meaning none - the end of a list. A stack has fewer nodes than this*/
+ #define RES_CSTACK_TAG_SHIFT 32  /*a list head is a node index in the low 32 bits, and a tag bumped by every change in the high 32*/
+
+/*Structures:*/
+ typedef struct
+ {
+   void *resource;  /*only read or written by the thread that holds the node - off both lists*/
+   _Atomic uint32_t next;  /*node below this one in its list, RES_CSTACK_NIL at the bottom. Atomic, as a thread whose head is stale may read it while the holder writes it*/
+ } res_cstack_node_t;
+
+ typedef struct
+ {
+   res_cstack_node_t *node;  /*limit+1 nodes, never freed until destroy - so a node is always safe to read, whoever holds it*/
+   size_t limit;  /*number of pointers possible in stack. Stack with 1 entry, limit = 0*/
+   _Atomic uint64_t top;  /*list of pushed nodes, top first - tag and index, see RES_CSTACK_TAG_SHIFT*/
+   _Atomic uint64_t spare;  /*list of nodes not in use, in the same form*/
+   _Atomic size_t entries;  /*pushes less pops*/
+  } res_cstack_t;
+
+/*External functions. Everything but create and destroy may be called from any number of threads at once*/
+ res_cstack_t* res_cstack_create(size_t max_entries);  /*creates a stack big enough to fit max_entries, starts at 0 (i.e. res_cstack_create(0) means stack with 1 entry), as res_stack_create. Returns NULL on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER on max_entries of RES_CSTACK_NIL-1 or more*/
+ ushort res_cstack_destroy(res_cstack_t* cstack_handle);  /*frees the stack and its handle. No other thread may be using it. Returns 0 on success*/
+
+ ushort res_cstack_push(res_cstack_t* cstack_handle, void* resource);  /*pushes a resource pointer to the top of the stack - a node is taken from the spare list and swapped in as the top with one compare-and-swap, retried if another thread got there first. Returns 0 on success, 2 on stack full*/
+ void* res_cstack_pop(res_cstack_t* cstack_handle);  /*returns the resource pointer at the top of the stack and removes that entry, in the same way. Returns NULL on failure with errno set to RES_ERR_STACK_EMPTY. If resource was a null pointer to begin with, errno=0*/
+
+ size_t res_cstack_get_entries(res_cstack_t* cstack_handle);  /*returns the number of entries pushed and not popped. Exact when no push or pop is under way, otherwise may briefly count pushes not yet on the stack - but never pops of entries not yet counted*/
+ size_t res_cstack_get_size(res_cstack_t* cstack_handle);  /*returns the maximum number of entries that the stack can hold, 0= max one entry*/
+
+/*Internal functions:*/
+ uint32_t _res_cstack_take(res_cstack_t* cstack_handle, _Atomic uint64_t* list);  /*removes the first node of list (top or spare), bumping its tag so a thread holding an older head can't swap it back in - the ABA problem. Returns node index, or RES_CSTACK_NIL if the list is empty*/
+ void _res_cstack_put(res_cstack_t* cstack_handle, _Atomic uint64_t* list, uint32_t i);  /*adds node i, which the caller holds, to the front of list*/
+ uint64_t _res_cstack_head(uint64_t old, uint32_t i);  /*list head for node i, with old's tag plus one*/
+#endif
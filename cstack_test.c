@@ -0,0 +1,260 @@
+/* cstack_test.c - unit tests for cstack.c
+ *
+ * REQUIRES: cstack_1
+ * TESTS: cstack_1.0
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include "cstack.h"
+#include "res_err.h"
+
+#define STRESS_THREADS 8
+#define STRESS_ROUNDS 100000
+#define STRESS_ENTRIES 64  /*few, so nodes are reused constantly - the case ABA comes from*/
+
+  int main(void);
+  int create_destroy(void);
+  int push_pop(void);
+  int stress(void);
+  void* stress_thread(void* arg);  /*pops entries, checks no other thread holds them, and pushes them back - now and again pushing a few of its own instead*/
+
+ /*shared by the stress threads*/
+  res_cstack_t* stress_stack;
+  _Atomic unsigned char stress_owner[STRESS_ENTRIES * (STRESS_THREADS + 1)];  /*0 = on the stack, else thread number + 1*/
+  _Atomic size_t stress_failures;
+
+int main()
+{
+   /*create, destroy*/
+    printf("01 - create & destroy\n");
+    if( 0 != create_destroy() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*one thread*/
+    printf("02 - push & pop\n");
+    if( 0 != push_pop() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*many threads at once*/
+    printf("03 - %d threads pushing and popping at once\n", STRESS_THREADS);
+    if( 0 != stress() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+  printf("ALL TESTS PASSED!\n");
+  return(EXIT_SUCCESS);
+}
+
+int create_destroy(void)
+{
+  res_cstack_t* stack1;
+  res_cstack_t* stack2;
+    printf("\tcreating stacks of size 1 and 1,000,000... ");
+    stack1 = res_cstack_create(0);
+    stack2 = res_cstack_create(999999);
+    assert(NULL != stack1);
+    assert(NULL != stack2);
+    assert(0 == res_cstack_get_size(stack1));
+    assert(999999 == res_cstack_get_size(stack2));
+    assert(0 == res_cstack_get_entries(stack2));
+    printf("Good!\n");
+
+    printf("\tcreating a stack too big for its node indexes... ");
+    errno = 0;
+    assert(NULL == res_cstack_create((size_t)RES_CSTACK_NIL - 1));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\tdestroying stacks... ");
+    assert(0 == res_cstack_destroy(stack1));
+    assert(0 == res_cstack_destroy(stack2));
+    printf("Good!\n");
+  return(0);
+}
+
+int push_pop(void)
+{
+  res_cstack_t* stack1;
+  size_t i;
+    printf("\tcreating stack of size 100... ");
+    stack1 = res_cstack_create(99);
+    assert(NULL != stack1);
+    printf("Good!\n");
+
+    printf("\tempty, full & NULL entries... ");
+    errno = 0;
+    assert(NULL == res_cstack_pop(stack1));
+    assert(RES_ERR_STACK_EMPTY == errno);
+    for(i=0; i<100; i++)
+      assert(0 == res_cstack_push(stack1, (void*) i));
+    assert(2 == res_cstack_push(stack1, (void*) 100));
+    assert(100 == res_cstack_get_entries(stack1));
+    printf("Good!\n");
+
+    printf("\tlast on, first off... ");
+    for(i=100; i>1; i--)
+      assert((void*) (i - 1) == res_cstack_pop(stack1));
+    errno = 1;
+    assert(NULL == res_cstack_pop(stack1));  /*entry 0 really is NULL*/
+    assert(0 == errno);
+    errno = 0;
+    assert(NULL == res_cstack_pop(stack1));
+    assert(RES_ERR_STACK_EMPTY == errno);
+    assert(0 == res_cstack_get_entries(stack1));
+    printf("Good!\n");
+
+    printf("\tnodes reused over and over... ");
+    for(i=0; i<10000; i++)
+    {
+      assert(0 == res_cstack_push(stack1, (void*) (i + 1)));
+      assert(0 == res_cstack_push(stack1, (void*) (i + 2)));
+      assert((void*) (i + 2) == res_cstack_pop(stack1));
+      assert((void*) (i + 1) == res_cstack_pop(stack1));
+    }
+    assert(0 == res_cstack_get_entries(stack1));
+    assert(99 == res_cstack_get_size(stack1));
+    assert(0 == res_cstack_destroy(stack1));
+    printf("Good!\n");
+  return(0);
+}
+
+int stress(void)
+{
+  pthread_t thread[STRESS_THREADS];
+  size_t id[STRESS_THREADS];
+  size_t seen[STRESS_ENTRIES * (STRESS_THREADS + 1)];
+  size_t total;
+  size_t i;
+  void* entry;
+    printf("\tcreating stack of %d entries, room for %d... ", STRESS_ENTRIES, STRESS_ENTRIES * (STRESS_THREADS + 1));
+    stress_stack = res_cstack_create(STRESS_ENTRIES * (STRESS_THREADS + 1) - 1);
+    assert(NULL != stress_stack);
+    for(i=0; i<STRESS_ENTRIES * (STRESS_THREADS + 1); i++)
+      atomic_init(&stress_owner[i], 0);
+    for(i=0; i<STRESS_ENTRIES; i++)
+      assert(0 == res_cstack_push(stress_stack, (void*) (i + 1)));  /*entries are numbers from 1, so never NULL*/
+    atomic_init(&stress_failures, 0);
+    printf("Good!\n");
+
+    printf("\tpushing and popping, checking nothing is handed out twice... ");
+    for(i=0; i<STRESS_THREADS; i++)
+    {
+      id[i] = i;
+      assert(0 == pthread_create(&thread[i], NULL, stress_thread, &id[i]));
+    }
+    for(i=0; i<STRESS_THREADS; i++)
+      assert(0 == pthread_join(thread[i], NULL));
+    assert(0 == atomic_load(&stress_failures));
+    printf("Good!\n");
+
+   /*each thread added STRESS_ENTRIES of its own, so every entry should be there exactly once*/
+    printf("\tevery entry back, none lost or doubled... ");
+    for(i=0; i<STRESS_ENTRIES * (STRESS_THREADS + 1); i++)
+      seen[i] = 0;
+    total = res_cstack_get_entries(stress_stack);
+    assert(STRESS_ENTRIES * (STRESS_THREADS + 1) == total);
+    for(i=0; i<total; i++)
+    {
+      entry = res_cstack_pop(stress_stack);
+      assert((NULL != entry) && ((size_t) entry <= STRESS_ENTRIES * (STRESS_THREADS + 1)));
+      seen[(size_t) entry - 1]++;
+    }
+    for(i=0; i<STRESS_ENTRIES * (STRESS_THREADS + 1); i++)
+      assert(1 == seen[i]);
+    errno = 0;
+    assert(NULL == res_cstack_pop(stress_stack));
+    assert(RES_ERR_STACK_EMPTY == errno);
+    assert(0 == res_cstack_destroy(stress_stack));
+    printf("Good!\n");
+  return(0);
+}
+
+void* stress_thread(void* arg)
+{
+  unsigned char me;
+  unsigned int seed;
+  size_t held[8];
+  size_t count = 0;
+  size_t added = 0;
+  size_t round;
+  size_t entry;
+  unsigned char owner;
+    me = (unsigned char)(*(size_t*)arg + 1);
+    seed = me * 2654435761u;
+
+    for(round=0; round<STRESS_ROUNDS; round++)
+    {
+      seed = seed * 1103515245u + 12345u;
+
+     /*pop one, if there's room to hold it - it must not be held by anyone else*/
+      if((count < 8) && (0 != (seed & 0x10000)))
+      {
+        entry = (size_t) res_cstack_pop(stress_stack);
+        if(res_cstack_get_entries(stress_stack) > STRESS_ENTRIES * (STRESS_THREADS + 1))  /*counted before it's pushed, so never wraps below 0*/
+          atomic_fetch_add(&stress_failures, 1);
+        if(0 == entry)
+          continue;  /*others have them all for now*/
+        owner = 0;
+        if(!atomic_compare_exchange_strong(&stress_owner[entry - 1], &owner, me))
+          atomic_fetch_add(&stress_failures, 1);
+        held[count++] = entry;
+        continue;
+      }
+
+     /*now and again add one of our own, numbered after the starting ones*/
+      if((added < STRESS_ENTRIES) && (0 == (seed & 0x700000)))
+      {
+        entry = STRESS_ENTRIES * me + added + 1;
+        added++;
+        if(0 != res_cstack_push(stress_stack, (void*) entry))
+          atomic_fetch_add(&stress_failures, 1);
+        continue;
+      }
+
+     /*push one back*/
+      if(0 != count)
+      {
+        entry = held[--count];
+        owner = me;
+        if(!atomic_compare_exchange_strong(&stress_owner[entry - 1], &owner, 0))
+          atomic_fetch_add(&stress_failures, 1);
+        if(0 != res_cstack_push(stress_stack, (void*) entry))
+          atomic_fetch_add(&stress_failures, 1);
+      }
+    }
+
+   /*give back what's left, and the rest of our own*/
+    while(0 != count)
+    {
+      entry = held[--count];
+      owner = me;
+      if(!atomic_compare_exchange_strong(&stress_owner[entry - 1], &owner, 0))
+        atomic_fetch_add(&stress_failures, 1);
+      if(0 != res_cstack_push(stress_stack, (void*) entry))
+        atomic_fetch_add(&stress_failures, 1);
+    }
+    for(; added<STRESS_ENTRIES; added++)
+      if(0 != res_cstack_push(stress_stack, (void*) (STRESS_ENTRIES * me + added + 1)))
+        atomic_fetch_add(&stress_failures, 1);
+  return(NULL);
+}
@@ -0,0 +1,358 @@
+/* pbitmap.c - bitmap that lives in shared memory, for allocating from one
+ *             pool in several processes at once without locks
+ *
+ * API: pbitmap 1.0
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#define _POSIX_C_SOURCE 200809L  /*for kill and getpid under -std=c11*/
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "pbitmap.h"
+
+/* A region is a header, a table of slots and the map, each starting on a
+ * multiple of RES_PBITMAP_ALIGN, and it holds offsets rather than pointers
+ * so every process can map it wherever it likes (shm_open, memfd_create, or
+ * MAP_SHARED | MAP_ANONYMOUS before a fork). The map is a cbitmap's words,
+ * and C11 atomics that are lock-free work across processes just as across
+ * threads, so take, free, check, count and small allocs are the cbitmap
+ * functions on a view of the map.
+ *
+ * The one thing processes add is dying part way through something. A block
+ * inside a word is claimed by a single compare-and-swap, so it is either all
+ * taken or not at all. A bigger block is claimed a word at a time, and a
+ * process killed half way would leave the first part taken for ever - so
+ * each handle has a slot in the region, and while it claims (or puts back)
+ * a block it keeps the block and how many of its words it holds there.
+ * res_pbitmap_recover finds slots whose process has gone, and puts back the
+ * words they held. The count of words held only goes up after a word is
+ * claimed and down before one is put back: a process that dies between the
+ * two leaves at most one word's worth of its block taken, but recovery never
+ * clears bits that weren't its to clear.
+ *
+ * The journal uses seq_cst atomics throughout, so its stores and the claims
+ * of the map words they describe are seen by other processes in the order
+ * they were made.*/
+
+size_t res_pbitmap_size(size_t num_bits, size_t slots)
+{
+  size_t map;
+  size_t words;
+    if((0 == slots) || (slots > (SIZE_MAX / 2 - _res_pbitmap_slot_offset()) / sizeof(res_pbitmap_slot_t)))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_PBITMAP_ERR);
+    }
+    map = _res_pbitmap_map_offset(slots);
+    words = num_bits / BITS + 1;
+    if(words > (SIZE_MAX - map) / sizeof(res_cbitmap_word_t))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_PBITMAP_ERR);
+    }
+  return(map + words * sizeof(res_cbitmap_word_t));
+}
+
+res_pbitmap_t* res_pbitmap_init(void* region, size_t num_bits, size_t slots)
+{
+  res_pbitmap_header_t *header;
+  res_pbitmap_slot_t *slot;
+  res_cbitmap_word_t *map;
+  size_t words;
+  size_t i;
+    if((RES_PBITMAP_ERR == res_pbitmap_size(num_bits, slots)) || (0 != (uintptr_t)region % RES_PBITMAP_ALIGN))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+    header = region;
+    slot = (res_pbitmap_slot_t*)((uint8_t*)region + _res_pbitmap_slot_offset());
+    map = (res_cbitmap_word_t*)((uint8_t*)region + _res_pbitmap_map_offset(slots));
+
+   /*another process's view of the map is only safe if the atomics never fall back on a lock, which would be in this process's memory*/
+    if(!atomic_is_lock_free(&slot->pid) || !atomic_is_lock_free(map))
+    {
+      errno = RES_ERR_INCOMPATIBLE_RESOURCE;
+      return(NULL);
+    }
+
+   /*header, with ready set last*/
+    atomic_store_explicit(&header->ready, 0, memory_order_relaxed);
+    words = num_bits / BITS + 1;
+    memcpy(header->magic, RES_PBITMAP_MAGIC, sizeof(header->magic));
+    header->version = RES_PBITMAP_VERSION;
+    header->word_bits = BITS;
+    header->num_bits = num_bits;
+    header->words = words;
+    header->slots = slots;
+    header->slot = _res_pbitmap_slot_offset();
+    header->map = _res_pbitmap_map_offset(slots);
+    for(i=0; i<slots; i++)
+    {
+      atomic_init(&slot[i].pid, 0);
+      atomic_init(&slot[i].busy, 0);
+      atomic_init(&slot[i].first, 0);
+      atomic_init(&slot[i].last, 0);
+      atomic_init(&slot[i].claimed, 0);
+    }
+
+   /*all free, apart from the bits past the end - as cbitmap*/
+    for(i=0; i<words; i++)
+      atomic_init(&map[i], 0);
+    if(num_bits % BITS != BITS - 1)
+      atomic_init(&map[words-1], ~_res_cbitmap_mask(0, num_bits % BITS));
+    atomic_store_explicit(&header->ready, 1, memory_order_release);
+  return(_res_pbitmap_handle(region));
+}
+
+res_pbitmap_t* res_pbitmap_attach(void* region)
+{
+  res_pbitmap_header_t *header;
+    if(0 != (uintptr_t)region % RES_PBITMAP_ALIGN)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+   /*check the header was finished, and agrees with itself and with us*/
+    header = region;
+    if((1 != atomic_load_explicit(&header->ready, memory_order_acquire)) || (0 != memcmp(header->magic, RES_PBITMAP_MAGIC, sizeof(header->magic)))
+       || (RES_PBITMAP_VERSION != header->version) || (BITS != header->word_bits) || (0 == header->slots)
+       || (header->words != header->num_bits / BITS + 1) || (header->slot != _res_pbitmap_slot_offset())
+       || (RES_PBITMAP_ERR == res_pbitmap_size((size_t)header->num_bits, (size_t)header->slots))
+       || (header->map != _res_pbitmap_map_offset((size_t)header->slots)))
+    {
+      errno = RES_ERR_INCOMPATIBLE_RESOURCE;
+      return(NULL);
+    }
+  return(_res_pbitmap_handle(region));
+}
+
+ushort res_pbitmap_detach(res_pbitmap_t* pbitmap_handle)
+{
+  atomic_store(&pbitmap_handle->slot->pid, 0);
+  free(pbitmap_handle);
+  return(0);
+}
+
+size_t res_pbitmap_recover(res_pbitmap_t* pbitmap_handle)
+{
+  res_pbitmap_slot_t *slot;
+  uint64_t pid;
+  uint64_t self;
+  size_t recovered = 0;
+  size_t i;
+    slot = (res_pbitmap_slot_t*)((uint8_t*)pbitmap_handle->header + pbitmap_handle->header->slot);
+    self = (uint64_t)getpid();
+    for(i=0; i<pbitmap_handle->header->slots; i++)
+    {
+      if(&slot[i] == pbitmap_handle->slot)
+        continue;
+      pid = atomic_load(&slot[i].pid);
+      if((0 == pid) || (0 == _res_pbitmap_dead(pid)))
+        continue;
+
+     /*take the slot over, so no other process recovers it too. If we die in here, it's just a dead slot again, and the count of words held is still right*/
+      if(!atomic_compare_exchange_strong(&slot[i].pid, &pid, self))
+        continue;
+      if(0 != atomic_load(&slot[i].busy))
+        _res_pbitmap_rollback(pbitmap_handle, &slot[i]);
+      atomic_store(&slot[i].pid, 0);
+      recovered++;
+    }
+  return(recovered);
+}
+
+size_t res_pbitmap_alloc(res_pbitmap_t* pbitmap_handle, size_t block_size)
+{
+  size_t need;
+  size_t start;
+  size_t conflict;
+    if(block_size > pbitmap_handle->map.num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_PBITMAP_ERR);
+    }
+    need = block_size + 1;
+
+   /*fits in a word - one CAS, nothing to recover*/
+    if(need <= BITS)
+    {
+      start = _res_cbitmap_alloc_word(&pbitmap_handle->map, need);
+      if(RES_CBITMAP_ERR != start)
+        return(start);
+    }
+
+   /*across words - as cbitmap, but claimed through the slot*/
+    start = 0;
+    while(RES_CBITMAP_ERR != (start = _res_cbitmap_scan(&pbitmap_handle->map, start, need)))
+    {
+      if(0 == _res_pbitmap_claim(pbitmap_handle, start, start + block_size, &conflict))
+        return(start);
+      start = conflict + 1;
+    }
+    errno = RES_ERR_NO_MATCH;
+  return(RES_PBITMAP_ERR);
+}
+
+ushort res_pbitmap_free(res_pbitmap_t* pbitmap_handle, size_t base, size_t limit)
+{
+  return(res_cbitmap_free(&pbitmap_handle->map, base, limit));
+}
+
+ushort res_pbitmap_take(res_pbitmap_t* pbitmap_handle, size_t base, size_t limit)
+{
+  return(res_cbitmap_take(&pbitmap_handle->map, base, limit));
+}
+
+ushort res_pbitmap_check(res_pbitmap_t* pbitmap_handle, size_t base, size_t limit)
+{
+  return(res_cbitmap_check(&pbitmap_handle->map, base, limit));
+}
+
+size_t res_pbitmap_count(res_pbitmap_t* pbitmap_handle, size_t base, size_t limit)
+{
+  return(res_cbitmap_count(&pbitmap_handle->map, base, limit));
+}
+
+size_t res_pbitmap_get_size(res_pbitmap_t* pbitmap_handle)
+{
+  return(pbitmap_handle->map.num_bits);
+}
+
+/*-------------- Internals ----------------*/
+
+size_t _res_pbitmap_slot_offset(void)
+{
+  return((sizeof(res_pbitmap_header_t) + RES_PBITMAP_ALIGN - 1) / RES_PBITMAP_ALIGN * RES_PBITMAP_ALIGN);
+}
+
+size_t _res_pbitmap_map_offset(size_t slots)
+{
+  return(_res_pbitmap_slot_offset() + slots * sizeof(res_pbitmap_slot_t));  /*slots are RES_PBITMAP_ALIGN apart, so this is aligned too*/
+}
+
+res_pbitmap_t* _res_pbitmap_handle(void* region)
+{
+  res_pbitmap_t *handle;
+  res_pbitmap_header_t *header;
+    handle = malloc( sizeof(res_pbitmap_t) );
+    if(NULL == handle)
+      return(NULL);
+    header = region;
+    handle->header = header;
+    handle->map.base = (res_cbitmap_word_t*)((uint8_t*)region + header->map);
+    handle->map.words = (size_t)header->words;
+    handle->map.num_bits = (size_t)header->num_bits;
+    atomic_init(&handle->map.hint, 0);
+
+   /*a slot - if they're all in use, some may belong to processes that have died*/
+    handle->slot = _res_pbitmap_take_slot(header, (uint64_t)getpid());
+    if(NULL == handle->slot)
+    {
+      res_pbitmap_recover(handle);
+      handle->slot = _res_pbitmap_take_slot(header, (uint64_t)getpid());
+      if(NULL == handle->slot)
+      {
+        free(handle);
+        errno = RES_ERR_NO_MATCH;
+        return(NULL);
+      }
+    }
+  return(handle);
+}
+
+res_pbitmap_slot_t* _res_pbitmap_take_slot(res_pbitmap_header_t* header, uint64_t pid)
+{
+  res_pbitmap_slot_t *slot;
+  uint64_t expected;
+  size_t i;
+    slot = (res_pbitmap_slot_t*)((uint8_t*)header + header->slot);
+    for(i=0; i<header->slots; i++)
+    {
+      expected = 0;
+      if(atomic_compare_exchange_strong(&slot[i].pid, &expected, pid))
+        return(&slot[i]);
+    }
+  return(NULL);
+}
+
+ushort _res_pbitmap_dead(uint64_t pid)
+{
+  ushort dead;
+  int e;
+   /*signal 0 only checks the process is there. EPERM means it is, just not ours*/
+    e = errno;
+    dead = ((0 != kill((pid_t)pid, 0)) && (ESRCH == errno)) ? 1 : 0;
+    errno = e;
+  return(dead);
+}
+
+ushort _res_pbitmap_claim(res_pbitmap_t* pbitmap_handle, size_t first, size_t last, size_t* conflict)
+{
+  res_pbitmap_slot_t *slot;
+  res_bitmap_word_t word;
+  res_bitmap_word_t mask;
+  size_t w;
+  size_t first_word;
+  size_t last_word;
+    slot = pbitmap_handle->slot;
+    first_word = first / BITS;
+    last_word = last / BITS;
+
+   /*say what we're about to do before doing any of it*/
+    atomic_store(&slot->first, first);
+    atomic_store(&slot->last, last);
+    atomic_store(&slot->claimed, first_word);
+    atomic_store(&slot->busy, 1);
+
+    for(w=first_word; w<=last_word; w++)
+    {
+      mask = ~(res_bitmap_word_t)0;
+      if(w == first_word)
+        mask &= _res_cbitmap_mask(first%BITS, BITS-1);
+      if(w == last_word)
+        mask &= _res_cbitmap_mask(0, last%BITS);
+
+     /*only swap in while every bit we want is still clear*/
+      word = atomic_load_explicit(&pbitmap_handle->map.base[w], memory_order_relaxed);
+      do
+      {
+        if(0 != (word & mask))
+        {
+          *conflict = w * BITS + RES_BITMAP_CTZ(word & mask);
+          _res_pbitmap_rollback(pbitmap_handle, slot);
+          return(1);
+        }
+      } while(!atomic_compare_exchange_weak(&pbitmap_handle->map.base[w], &word, word | mask));
+      atomic_store(&slot->claimed, w + 1);
+    }
+    atomic_store(&slot->busy, 0);
+  return(0);
+}
+
+void _res_pbitmap_rollback(res_pbitmap_t* pbitmap_handle, res_pbitmap_slot_t* slot)
+{
+  size_t first;
+  size_t last;
+  size_t w;
+    first = (size_t)atomic_load(&slot->first);
+    last = (size_t)atomic_load(&slot->last);
+
+   /*highest word first, each one no longer counted as held before it's cleared*/
+    while((w = (size_t)atomic_load(&slot->claimed)) > first / BITS)
+    {
+      w--;
+      atomic_store(&slot->claimed, w);
+      _res_cbitmap_mark(&pbitmap_handle->map, (w == first / BITS) ? first : w * BITS, (w == last / BITS) ? last : w * BITS + BITS - 1, 0);
+    }
+    atomic_store(&slot->busy, 0);
+}
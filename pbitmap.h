@@ -0,0 +1,81 @@
+/* pbitmap.h - header for pbitmap.c, a bitmap that lives in shared memory
+ *             and can be used by several processes at once without locks
+ *
+ * API: pbitmap 1.0
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#ifndef H_RES_PBITMAP
+#define H_RES_PBITMAP
+ #include <stdatomic.h>
+ #include <stdint.h>
+ #include "res_config.h"
+ #include "res_types.h"
+ #include "res_err.h"
+ #include "bitmap.h"
+ #include "cbitmap.h"  /*the map is a cbitmap's words, used through a cbitmap view*/
+
+/*Regions:*/
+ #define RES_PBITMAP_MAGIC "RESPBMP"
+ #define RES_PBITMAP_VERSION 1
+ #define RES_PBITMAP_ALIGN 64  /*a region MUST start on a multiple of this. The slot table and map start on one too, so slots don't share cache lines with the map*/
+
+/*Structures - in the region. Everything is an offset from the start of the region, never a pointer, so each process may map it anywhere:*/
+ typedef struct
+ {
+   char magic[8];  /*RES_PBITMAP_MAGIC*/
+   uint32_t version;  /*RES_PBITMAP_VERSION*/
+   uint32_t word_bits;  /*BITS of the machines using it*/
+   uint64_t num_bits;  /*num_bits of 0 = 1 bit in the map. Fixed - there is no resize*/
+   uint64_t words;
+   uint64_t slots;  /*number of slots, at most this many handles attached at once*/
+   uint64_t slot;  /*offset of the slot table*/
+   uint64_t map;  /*offset of the map*/
+   _Atomic uint32_t ready;  /*set last by res_pbitmap_init - nothing else may be read until it is*/
+ } res_pbitmap_header_t;
+
+ typedef struct
+ {
+   _Alignas(RES_PBITMAP_ALIGN) _Atomic uint64_t pid;  /*process attached through this slot, 0 = free*/
+   _Atomic uint64_t busy;  /*1 while a block over several words is being claimed or put back*/
+   _Atomic uint64_t first;  /*bits of that block*/
+   _Atomic uint64_t last;
+   _Atomic uint64_t claimed;  /*words first/BITS to claimed-1 of the block are held. Moved up only after a word is claimed, and down before one is put back, so a process dying in between leaves at most one word held - never clears bits it didn't have*/
+ } res_pbitmap_slot_t;
+
+/*Structures - in each process:*/
+ typedef struct
+ {
+   res_cbitmap_t map;  /*view of the shared map - base points into the region, hint is this handle's own. NEVER passed to res_cbitmap_destroy*/
+   res_pbitmap_header_t *header;
+   res_pbitmap_slot_t *slot;  /*this handle's slot*/
+  } res_pbitmap_t;
+
+/*External functions. A handle is for one thread - threads of a process that all allocate attach a handle each. Any number of handles, in any processes, may use the map at once*/
+ size_t res_pbitmap_size(size_t num_bits, size_t slots);  /*returns the bytes of region a map of num_bits with slots slots needs - what to ftruncate a shm_open or memfd_create file to. Returns RES_PBITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER on slots of 0, or a size that doesn't fit a size_t*/
+ res_pbitmap_t* res_pbitmap_init(void* region, size_t num_bits, size_t slots);  /*lays out a new map, all free, in region (res_pbitmap_size bytes, mapped MAP_SHARED), and attaches to it. Nothing else may use the region until this returns. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER on slots of 0 or region not aligned to RES_PBITMAP_ALIGN, RES_ERR_INCOMPATIBLE_RESOURCE if the machine has no lock-free 64 bit atomics. NOTE - num_bits starts at 0. 0 implies a bitmap with 1 bit, etc.*/
+ res_pbitmap_t* res_pbitmap_attach(void* region);  /*attaches to a map made by res_pbitmap_init, maybe in another process and at another address, taking a free slot - and if there are none, first recovering the slots of processes that have died. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER if region isn't aligned, RES_ERR_INCOMPATIBLE_RESOURCE on a bad header, RES_ERR_NO_MATCH if every slot is in use*/
+ ushort res_pbitmap_detach(res_pbitmap_t* pbitmap_handle);  /*gives back the handle's slot and frees the handle. Blocks allocated stay allocated, and the region stays mapped. Returns 0 on success*/
+ size_t res_pbitmap_recover(res_pbitmap_t* pbitmap_handle);  /*finds slots of processes that have died without detaching, puts back any block one was part way through claiming, and frees the slot. Blocks a dead process had allocated are NOT freed - only it knew which they were. Returns the number of slots recovered*/
+
+ size_t res_pbitmap_alloc(res_pbitmap_t* pbitmap_handle, size_t block_size);  /*finds and marks block_size+1 free bits in a row. Blocks that fit in a word are claimed with a single compare-and-swap, as cbitmap. Bigger ones are claimed word by word with the progress kept in the handle's slot, so res_pbitmap_recover can put them back if the process dies part way. Returns start bit on success, RES_PBITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER or RES_ERR_NO_MATCH*/
+ ushort res_pbitmap_free(res_pbitmap_t* pbitmap_handle, size_t base, size_t limit);  /*unmarks bits from base to (base+limit), a word at a time. Limit of 0 = 1 bit. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_pbitmap_take(res_pbitmap_t* pbitmap_handle, size_t base, size_t limit);  /*marks bits from base to (base+limit), a word at a time. Does not check if they were free. Limit of 0 = 1 bit. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_pbitmap_check(res_pbitmap_t* pbitmap_handle, size_t base, size_t limit);  /*returns 0 if all bits from base to (base+limit) are 0, 1 if all are 1, 2 if they vary, 4 on base-out-of-range, 5 on limit-out-of-range. As cbitmap, a range over several words is not one snapshot*/
+ size_t res_pbitmap_count(res_pbitmap_t* pbitmap_handle, size_t base, size_t limit);  /*counts bits taken from base to base+limit. Returns count on success, RES_PBITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER*/
+ size_t res_pbitmap_get_size(res_pbitmap_t* pbitmap_handle);  /*Returns: num_bits*/
+
+/*Internal functions:*/
+ size_t _res_pbitmap_slot_offset(void);  /*offset of the slot table in a region*/
+ size_t _res_pbitmap_map_offset(size_t slots);  /*offset of the map in a region with slots slots*/
+ res_pbitmap_t* _res_pbitmap_handle(void* region);  /*allocates a handle for the map in region and takes a slot for it. Returns NULL on failure, errno set as res_pbitmap_attach*/
+ res_pbitmap_slot_t* _res_pbitmap_take_slot(res_pbitmap_header_t* header, uint64_t pid);  /*claims a free slot for pid. Returns NULL if there isn't one*/
+ ushort _res_pbitmap_dead(uint64_t pid);  /*returns 1 if process pid has gone, 0 if it is still running (or might be)*/
+ ushort _res_pbitmap_claim(res_pbitmap_t* pbitmap_handle, size_t first, size_t last, size_t* conflict);  /*as _res_cbitmap_claim, keeping progress in the handle's slot. Returns 0 on success, or 1 having put back any words already claimed, with the first bit found taken in conflict*/
+ void _res_pbitmap_rollback(res_pbitmap_t* pbitmap_handle, res_pbitmap_slot_t* slot);  /*puts back the words of slot's block that it holds, highest first, and clears busy. The slot MUST NOT be in use by anyone else*/
+#endif
@@ -0,0 +1,418 @@
+/* pbitmap_test.c - unit tests for pbitmap.c
+ *
+ * REQUIRES: pbitmap_1, cbitmap_1, reff-1 implementation
+ * TESTS: pbitmap_1.0
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#define _GNU_SOURCE  /*for fork, kill, mmap and friends under -std=c11*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "pbitmap.h"
+#include "res_err.h"
+
+#define STRESS_PROCS 4
+#define STRESS_ROUNDS 20000
+#define STRESS_BITS 4096
+
+  int main(void);
+  int attach_detach(void);
+  int free_take_check_count_alloc(void);
+  int stress(void);
+  int stress_proc(void* region, unsigned char me);  /*allocs and frees blocks of random sizes, checking no other process holds any bit of them. Returns number of failures*/
+  int recover(void);
+  void* shared(size_t size);  /*size bytes of zeroed memory, shared with children forked after*/
+
+ /*shared by the stress processes, in a mapping of its own*/
+  typedef struct
+  {
+    _Atomic unsigned char owner[STRESS_BITS];  /*0 = nobody, else process number + 1*/
+    _Atomic size_t failures;
+  } stress_t;
+  stress_t* stress_shared;
+
+int main()
+{
+  srand((unsigned int)time(NULL));
+   /*init, attach, detach*/
+    printf("01 - init, attach & detach\n");
+    if( 0 != attach_detach() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*free, take, check, count, alloc*/
+    printf("02 - free, take, check, count & alloc, through two mappings\n");
+    if( 0 != free_take_check_count_alloc() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*many processes at once*/
+    printf("03 - %d processes allocating and freeing at once\n", STRESS_PROCS);
+    if( 0 != stress() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*processes that die*/
+    printf("04 - recovering after processes die\n");
+    if( 0 != recover() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+  printf("ALL TESTS PASSED!\n");
+  return(EXIT_SUCCESS);
+}
+
+int attach_detach(void)
+{
+  res_pbitmap_t* handle[4];
+  void* region;
+  void* empty;
+  size_t size;
+    printf("\tlaying out a bitmap of size 1000 with 3 slots... ");
+    size = res_pbitmap_size(999, 3);
+    assert(RES_PBITMAP_ERR != size);
+    assert(size >= 1000 / 8 + 3 * sizeof(res_pbitmap_slot_t));
+    region = shared(size);
+    handle[0] = res_pbitmap_init(region, 999, 3);
+    assert(NULL != handle[0]);
+    assert(999 == res_pbitmap_get_size(handle[0]));
+    assert(0 == res_pbitmap_check(handle[0], 0, 999));
+    printf("Good!\n");
+
+    printf("\tattaching until the slots run out... ");
+    handle[1] = res_pbitmap_attach(region);
+    handle[2] = res_pbitmap_attach(region);
+    assert((NULL != handle[1]) && (NULL != handle[2]));
+    assert(999 == res_pbitmap_get_size(handle[2]));
+    errno = 0;
+    assert(NULL == res_pbitmap_attach(region));  /*all three are ours, and we're alive*/
+    assert(RES_ERR_NO_MATCH == errno);
+    assert(0 == res_pbitmap_recover(handle[0]));
+    assert(0 == res_pbitmap_detach(handle[1]));
+    handle[3] = res_pbitmap_attach(region);
+    assert(NULL != handle[3]);
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    errno = 0;
+    assert(RES_PBITMAP_ERR == res_pbitmap_size(999, 0));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    errno = 0;
+    assert(RES_PBITMAP_ERR == res_pbitmap_size(999, SIZE_MAX / 64));  /*slot table bigger than memory*/
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    errno = 0;
+    assert(NULL == res_pbitmap_init(region, 999, 0));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    errno = 0;
+    assert(NULL == res_pbitmap_attach((uint8_t*)region + 8));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    empty = shared(size);
+    errno = 0;
+    assert(NULL == res_pbitmap_attach(empty));  /*never laid out*/
+    assert(RES_ERR_INCOMPATIBLE_RESOURCE == errno);
+    assert(0 == munmap(empty, size));
+    printf("Good!\n");
+
+    printf("\tdetaching... ");
+    assert(0 == res_pbitmap_detach(handle[0]));
+    assert(0 == res_pbitmap_detach(handle[2]));
+    assert(0 == res_pbitmap_detach(handle[3]));
+    assert(0 == munmap(region, size));
+    printf("Good!\n");
+  return(0);
+}
+
+int free_take_check_count_alloc(void)
+{
+  const char* path = "pbitmap_test.shm";
+  res_pbitmap_t* handle[2];
+  void* region[2];
+  size_t size;
+  size_t i;
+  int fd;
+    printf("\tmapping one file twice, at different addresses... ");
+    size = res_pbitmap_size(999, 2);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    assert(-1 != fd);
+    assert(0 == ftruncate(fd, (off_t)size));
+    region[0] = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    region[1] = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert((MAP_FAILED != region[0]) && (MAP_FAILED != region[1]) && (region[0] != region[1]));
+    handle[0] = res_pbitmap_init(region[0], 999, 2);
+    handle[1] = res_pbitmap_attach(region[1]);
+    assert((NULL != handle[0]) && (NULL != handle[1]));
+    printf("Good!\n");
+
+    printf("\ttake, free, check & count, seen through both... ");
+    assert(0 == res_pbitmap_take(handle[0], 60, 139));
+    assert(1 == res_pbitmap_check(handle[1], 60, 139));
+    assert(2 == res_pbitmap_check(handle[1], 59, 1));
+    assert(0 == res_pbitmap_free(handle[1], 100, 9));
+    assert(0 == res_pbitmap_check(handle[0], 100, 9));
+    assert(130 == res_pbitmap_count(handle[0], 0, 999));
+    assert(130 == res_pbitmap_count(handle[1], 0, 999));
+    printf("Good!\n");
+
+    printf("\talloc, small blocks and across words... ");
+    assert(0 == res_pbitmap_free(handle[0], 0, 999));
+    assert(0 == res_pbitmap_alloc(handle[0], 0));
+    assert(1 == res_pbitmap_alloc(handle[1], 9));
+    assert(1 == res_pbitmap_check(handle[0], 0, 10));
+    assert(0 == res_pbitmap_take(handle[0], 100, 0));
+    assert(101 == res_pbitmap_alloc(handle[1], 2 * BITS));  /*too big for a word*/
+    assert(1 == res_pbitmap_check(handle[0], 100, 2 * BITS + 1));
+    assert(0 == res_pbitmap_free(handle[0], 0, 999));
+    for(i=0; i+BITS/2<1000; i+=BITS)  /*a bit taken in the middle of every word, so nothing fits in one*/
+      assert(0 == res_pbitmap_take(handle[1], i + BITS/2, 0));
+    assert(BITS/2 + 1 == res_pbitmap_alloc(handle[0], BITS/2 + 2));
+    printf("Good!\n");
+
+    printf("\tfull and error conditions... ");
+    assert(0 == res_pbitmap_free(handle[0], 0, 999));
+    assert(0 == res_pbitmap_alloc(handle[0], 999));
+    errno = 0;
+    assert(RES_PBITMAP_ERR == res_pbitmap_alloc(handle[1], 0));
+    assert(RES_ERR_NO_MATCH == errno);
+    errno = 0;
+    assert(RES_PBITMAP_ERR == res_pbitmap_alloc(handle[1], 1000));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(2 == res_pbitmap_take(handle[0], 1000, 0));
+    assert(3 == res_pbitmap_free(handle[0], 999, 1));
+    assert(4 == res_pbitmap_check(handle[0], 1000, 0));
+    errno = 0;
+    assert(RES_PBITMAP_ERR == res_pbitmap_count(handle[0], 999, 1));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\tdetaching... ");
+    assert(0 == res_pbitmap_detach(handle[0]));
+    assert(0 == res_pbitmap_detach(handle[1]));
+    assert(0 == munmap(region[0], size));
+    assert(0 == munmap(region[1], size));
+    assert(0 == close(fd));
+    assert(0 == remove(path));
+    printf("Good!\n");
+  return(0);
+}
+
+int stress(void)
+{
+  res_pbitmap_t* handle;
+  void* region;
+  pid_t child[STRESS_PROCS];
+  size_t size;
+  size_t i;
+  int status;
+    printf("\tlaying out a bitmap of size %d... ", STRESS_BITS);
+    size = res_pbitmap_size(STRESS_BITS - 1, STRESS_PROCS + 1);
+    region = shared(size);
+    stress_shared = shared(sizeof(stress_t));
+    handle = res_pbitmap_init(region, STRESS_BITS - 1, STRESS_PROCS + 1);
+    assert(NULL != handle);
+    for(i=0; i<STRESS_BITS; i++)
+      atomic_init(&stress_shared->owner[i], 0);
+    atomic_init(&stress_shared->failures, 0);
+    printf("Good!\n");
+
+    printf("\tallocating and freeing, checking no bit is handed out twice... ");
+    fflush(stdout);
+    for(i=0; i<STRESS_PROCS; i++)
+    {
+      child[i] = fork();
+      assert(-1 != child[i]);
+      if(0 == child[i])
+        _exit(stress_proc(region, (unsigned char)(i + 1)));
+    }
+    for(i=0; i<STRESS_PROCS; i++)
+    {
+      assert(child[i] == waitpid(child[i], &status, 0));
+      assert(WIFEXITED(status) && (0 == WEXITSTATUS(status)));
+    }
+    assert(0 == atomic_load(&stress_shared->failures));
+    printf("Good!\n");
+
+    printf("\tall bits back free, and every slot detached... ");
+    assert(0 == res_pbitmap_count(handle, 0, STRESS_BITS - 1));
+    assert(0 == res_pbitmap_alloc(handle, STRESS_BITS - 1));
+    assert(0 == res_pbitmap_recover(handle));
+    assert(0 == res_pbitmap_detach(handle));
+    assert(0 == munmap(region, size));
+    assert(0 == munmap(stress_shared, sizeof(stress_t)));
+    printf("Good!\n");
+  return(0);
+}
+
+int stress_proc(void* region, unsigned char me)
+{
+  res_pbitmap_t* handle;
+  unsigned int seed;
+  size_t held_start[16];
+  size_t held_size[16];
+  size_t held = 0;
+  size_t round;
+  size_t size;
+  size_t start;
+  size_t won = 0;
+  size_t i;
+    handle = res_pbitmap_attach(region);
+    if(NULL == handle)
+      return(1);
+    seed = me * 2654435761u;
+
+    for(round=0; round<STRESS_ROUNDS; round++)
+    {
+      seed = seed * 1103515245u + 12345u;
+      if((held < 16) && ((held == 0) || (0 != (seed & 0x10000))))
+      {
+       /*mostly small blocks, now and then one that spans words*/
+        size = (0 == (seed & 0x7000000)) ? (seed >> 8) % (3 * BITS) : (seed >> 8) % 8;
+        start = res_pbitmap_alloc(handle, size);
+        if(RES_PBITMAP_ERR == start)
+          continue;
+        won++;
+        for(i=start; i<=start+size; i++)
+          if(0 != atomic_exchange(&stress_shared->owner[i], me))
+            atomic_fetch_add(&stress_shared->failures, 1);
+        held_start[held] = start;
+        held_size[held] = size;
+        held++;
+      }
+      else
+      {
+        held--;
+        for(i=held_start[held]; i<=held_start[held]+held_size[held]; i++)
+          if(me != atomic_exchange(&stress_shared->owner[i], 0))
+            atomic_fetch_add(&stress_shared->failures, 1);
+        if(0 != res_pbitmap_free(handle, held_start[held], held_size[held]))
+          atomic_fetch_add(&stress_shared->failures, 1);
+      }
+    }
+    while(held > 0)
+    {
+      held--;
+      for(i=held_start[held]; i<=held_start[held]+held_size[held]; i++)
+        if(me != atomic_exchange(&stress_shared->owner[i], 0))
+          atomic_fetch_add(&stress_shared->failures, 1);
+      res_pbitmap_free(handle, held_start[held], held_size[held]);
+    }
+    res_pbitmap_detach(handle);
+  return((0 == won) ? 1 : 0);  /*not much of a test*/
+}
+
+int recover(void)
+{
+  res_pbitmap_t* handle;
+  res_pbitmap_t* handle2;
+  void* region;
+  size_t size;
+  size_t conflict;
+  pid_t child;
+  int status;
+    size = res_pbitmap_size(999, 2);
+    region = shared(size);
+    handle = res_pbitmap_init(region, 999, 2);
+    assert(NULL != handle);
+
+    printf("\ta process that exits without detaching... ");
+    fflush(stdout);
+    child = fork();
+    assert(-1 != child);
+    if(0 == child)
+      _exit((NULL == res_pbitmap_attach(region)) ? 1 : 0);
+    assert(child == waitpid(child, &status, 0));
+    assert(WIFEXITED(status) && (0 == WEXITSTATUS(status)));
+    handle2 = res_pbitmap_attach(region);  /*both slots look used - this recovers the dead one*/
+    assert(NULL != handle2);
+    assert(0 == res_pbitmap_detach(handle2));
+    printf("Good!\n");
+
+    printf("\ta process that dies part way through a block... ");
+    fflush(stdout);
+    child = fork();
+    assert(-1 != child);
+    if(0 == child)
+    {
+     /*as if killed on the third word of a claim of 5 - two words held, the journal saying so*/
+      handle2 = res_pbitmap_attach(region);
+      if(NULL == handle2)
+        _exit(1);
+      atomic_store(&handle2->slot->first, 10);
+      atomic_store(&handle2->slot->last, 4 * BITS + 10);
+      atomic_store(&handle2->slot->claimed, 0);
+      atomic_store(&handle2->slot->busy, 1);
+      res_pbitmap_take(handle2, 10, 2 * BITS - 11);
+      atomic_store(&handle2->slot->claimed, 2);
+      res_pbitmap_take(handle2, 2 * BITS, BITS - 1);  /*claimed, but not yet counted - this word stays taken*/
+      _exit(0);
+    }
+    assert(child == waitpid(child, &status, 0));
+    assert(WIFEXITED(status) && (0 == WEXITSTATUS(status)));
+    assert(0 == res_pbitmap_take(handle, 3 * BITS + 1, 0));  /*someone else's, in a word of the block it never got to*/
+    assert(1 == res_pbitmap_recover(handle));
+    assert(0 == res_pbitmap_check(handle, 0, 2 * BITS - 1));
+    assert(1 == res_pbitmap_check(handle, 2 * BITS, BITS - 1));
+    assert(1 == res_pbitmap_check(handle, 3 * BITS + 1, 0));
+    assert(BITS + 1 == res_pbitmap_count(handle, 0, 999));
+    assert(0 == res_pbitmap_recover(handle));
+    printf("Good!\n");
+
+    printf("\ta process killed while claiming blocks... ");
+    fflush(stdout);
+    assert(0 == res_pbitmap_free(handle, 0, 999));
+    assert(0 == res_pbitmap_take(handle, 3 * BITS + 5, 0));  /*every claim of 10 to 3*BITS+5 fails on its last word, and is put back*/
+    child = fork();
+    assert(-1 != child);
+    if(0 == child)
+    {
+      handle2 = res_pbitmap_attach(region);
+      if(NULL == handle2)
+        _exit(1);
+      for(;;)
+        _res_pbitmap_claim(handle2, 10, 3 * BITS + 5, &conflict);
+    }
+    usleep((useconds_t)(1000 + rand() % 20000));
+    assert(0 == kill(child, SIGKILL));
+    assert(child == waitpid(child, &status, 0));
+    assert(WIFSIGNALED(status));
+    assert(1 == res_pbitmap_recover(handle));
+    assert(1 == res_pbitmap_check(handle, 3 * BITS + 5, 0));
+    assert(res_pbitmap_count(handle, 0, 999) <= BITS + 1);  /*at most the one word it was on when it died*/
+    printf("Good!\n");
+
+    printf("\tdetaching... ");
+    assert(0 == res_pbitmap_detach(handle));
+    assert(0 == munmap(region, size));
+    printf("Good!\n");
+  return(0);
+}
+
+void* shared(size_t size)
+{
+  void* region;
+    region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(MAP_FAILED != region);
+  return(region);
+}
@@ -0,0 +1,688 @@
+/* rbitmap.c - compressed bitmap for huge, mostly empty bit spaces
+ *
+ * API: rbitmap 1.0
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "rbitmap.h"
+
+/* The bit space is cut into chunks of 64Ki bits, in the style of roaring
+ * bitmaps. Chunks with nothing taken aren't stored at all, and each one that
+ * is stored is kept as whichever of three types is smallest for it: a sorted
+ * array of the taken offsets (2 bytes a bit, up to 4096 bits), a plain
+ * bitmap (8KiB), or a sorted list of runs of taken bits (4 bytes a run). Every
+ * change keeps the chunk's count of taken bits and of runs up to date - the
+ * run count by looking only at run starts in and just after the range
+ * changed - so the choice is made after each change without reading the rest
+ * of the chunk, and a chunk is only rebuilt when its type actually changes.
+ * Memory is then roughly proportional to the taken bits (or runs), and a
+ * chunk in heavy use is never more than 8KiB.*/
+
+#define RES_RBITMAP_OFFSET(bit) ((bit) & (RES_RBITMAP_CHUNK_BITS - 1))
+
+res_rbitmap_t* res_rbitmap_create(size_t num_bits)
+{
+  res_rbitmap_t* handle;
+    if(num_bits >= RES_RBITMAP_ERR)  /*so that num_bits+1 and every start bit alloc can return are never mistaken for an error*/
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+    handle = malloc( sizeof(res_rbitmap_t) );
+    if(NULL == handle)
+      return(NULL);
+    handle->chunk = NULL;
+    handle->chunks = 0;
+    handle->capacity = 0;
+    handle->hint = 0;
+    handle->num_bits = num_bits;
+  return(handle);
+}
+
+ushort res_rbitmap_destroy(res_rbitmap_t* rbitmap_handle)
+{
+  size_t i;
+    for(i=0; i<rbitmap_handle->chunks; i++)
+      free(rbitmap_handle->chunk[i].data);
+    free(rbitmap_handle->chunk);
+    free(rbitmap_handle);
+  return(0);
+}
+
+size_t res_rbitmap_alloc(res_rbitmap_t* rbitmap_handle, size_t block_size)
+{
+  size_t start;
+  size_t end;
+    if(block_size > rbitmap_handle->num_bits)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_RBITMAP_ERR);
+    }
+
+   /*each free run in turn, lowest first - missing chunks are one free run, so they're crossed in one step*/
+    start = _res_rbitmap_find(rbitmap_handle, 0, 0);
+    while((start <= rbitmap_handle->num_bits) && (rbitmap_handle->num_bits - start >= block_size))
+    {
+      end = _res_rbitmap_find(rbitmap_handle, start, 1);
+      if(end - start > block_size)
+      {
+        if(0 != _res_rbitmap_mark(rbitmap_handle, start, start + block_size, 1))
+          return(RES_RBITMAP_ERR);
+        return(start);
+      }
+      start = _res_rbitmap_find(rbitmap_handle, end, 0);
+    }
+    errno = RES_ERR_NO_MATCH;
+  return(RES_RBITMAP_ERR);
+}
+
+ushort res_rbitmap_free(res_rbitmap_t* rbitmap_handle, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > rbitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > rbitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+  return(_res_rbitmap_mark(rbitmap_handle, base, base+limit, 0));
+}
+
+ushort res_rbitmap_take(res_rbitmap_t* rbitmap_handle, size_t base, size_t limit)
+{
+   /*check base & limit*/
+    if(base > rbitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > rbitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+  return(_res_rbitmap_mark(rbitmap_handle, base, base+limit, 1));
+}
+
+ushort res_rbitmap_check(res_rbitmap_t* rbitmap_handle, size_t base, size_t limit)
+{
+  size_t count;
+   /*check base & limit*/
+    if(base > rbitmap_handle->num_bits)
+      return(4);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > rbitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(5);
+
+    count = res_rbitmap_count(rbitmap_handle, base, limit);
+    if(0 == count)
+      return(0);
+    if(limit + 1 == count)
+      return(1);
+  return(2);
+}
+
+size_t res_rbitmap_count(res_rbitmap_t* rbitmap_handle, size_t base, size_t limit)
+{
+  res_rbitmap_chunk_t* chunk;
+  size_t last;
+  size_t i;
+  size_t lo;
+  size_t hi;
+  size_t count = 0;
+   /*check parameters*/
+    if((base > rbitmap_handle->num_bits) || (base > (SIZE_MAX - limit)) || ((base+limit) > rbitmap_handle->num_bits))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_RBITMAP_ERR);
+    }
+
+   /*only stored chunks have anything to count*/
+    last = base + limit;
+    for(i = _res_rbitmap_lookup(rbitmap_handle, base >> RES_RBITMAP_CHUNK_SHIFT); i<rbitmap_handle->chunks; i++)
+    {
+      chunk = &rbitmap_handle->chunk[i];
+      if(chunk->key > (last >> RES_RBITMAP_CHUNK_SHIFT))
+        break;
+      lo = (chunk->key == (base >> RES_RBITMAP_CHUNK_SHIFT)) ? RES_RBITMAP_OFFSET(base) : 0;
+      hi = (chunk->key == (last >> RES_RBITMAP_CHUNK_SHIFT)) ? RES_RBITMAP_OFFSET(last) : RES_RBITMAP_CHUNK_BITS - 1;
+      count += _res_rbitmap_chunk_count(chunk, lo, hi);
+    }
+  return(count);
+}
+
+size_t res_rbitmap_get_size(res_rbitmap_t* rbitmap_handle)
+{
+  return(rbitmap_handle->num_bits);
+}
+
+ushort res_rbitmap_stats(res_rbitmap_t* rbitmap_handle, res_rbitmap_stats_t* stats)
+{
+  res_rbitmap_chunk_t* chunk;
+  size_t i;
+    stats->chunks = rbitmap_handle->chunks;
+    stats->arrays = 0;
+    stats->bitmaps = 0;
+    stats->runs = 0;
+    stats->taken = 0;
+    stats->bytes = sizeof(res_rbitmap_t) + rbitmap_handle->capacity * sizeof(res_rbitmap_chunk_t);
+    for(i=0; i<rbitmap_handle->chunks; i++)
+    {
+      chunk = &rbitmap_handle->chunk[i];
+      if(RES_RBITMAP_ARRAY == chunk->type)
+        stats->arrays++;
+      else if(RES_RBITMAP_BITMAP == chunk->type)
+        stats->bitmaps++;
+      else
+        stats->runs++;
+      stats->taken += chunk->card;
+      stats->bytes += _res_rbitmap_bytes(chunk);
+    }
+  return(0);
+}
+
+/*-------------- Internals ----------------*/
+
+res_bitmap_word_t _res_rbitmap_mask(size_t first, size_t last)
+{
+  return( (~(res_bitmap_word_t)0 >> (BITS - 1 - last)) & (~(res_bitmap_word_t)0 << first) );
+}
+
+size_t _res_rbitmap_lookup(res_rbitmap_t* rbitmap_handle, size_t key)
+{
+  size_t lo;
+  size_t hi;
+  size_t mid;
+    if((rbitmap_handle->hint < rbitmap_handle->chunks) && (rbitmap_handle->chunk[rbitmap_handle->hint].key == key))
+      return(rbitmap_handle->hint);
+
+    lo = 0;
+    hi = rbitmap_handle->chunks;
+    while(lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if(rbitmap_handle->chunk[mid].key < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if((lo < rbitmap_handle->chunks) && (rbitmap_handle->chunk[lo].key == key))
+      rbitmap_handle->hint = lo;
+  return(lo);
+}
+
+ushort _res_rbitmap_insert(res_rbitmap_t* rbitmap_handle, size_t i, size_t key)
+{
+  res_rbitmap_chunk_t* chunk;
+  size_t capacity;
+    if(rbitmap_handle->chunks == rbitmap_handle->capacity)
+    {
+      capacity = (0 == rbitmap_handle->capacity) ? 4 : rbitmap_handle->capacity * 2;
+      chunk = realloc(rbitmap_handle->chunk, capacity * sizeof(res_rbitmap_chunk_t));
+      if(NULL == chunk)
+        return(2);
+      rbitmap_handle->chunk = chunk;
+      rbitmap_handle->capacity = capacity;
+    }
+
+    memmove(&rbitmap_handle->chunk[i+1], &rbitmap_handle->chunk[i], (rbitmap_handle->chunks - i) * sizeof(res_rbitmap_chunk_t));
+    rbitmap_handle->chunks++;
+    chunk = &rbitmap_handle->chunk[i];
+    chunk->key = key;
+    chunk->data = NULL;
+    chunk->card = 0;
+    chunk->runs = 0;
+    chunk->n = 0;
+    chunk->cap = 0;
+    chunk->type = RES_RBITMAP_ARRAY;
+  return(0);
+}
+
+void _res_rbitmap_remove(res_rbitmap_t* rbitmap_handle, size_t i)
+{
+  free(rbitmap_handle->chunk[i].data);
+  memmove(&rbitmap_handle->chunk[i], &rbitmap_handle->chunk[i+1], (rbitmap_handle->chunks - i - 1) * sizeof(res_rbitmap_chunk_t));
+  rbitmap_handle->chunks--;
+}
+
+ushort _res_rbitmap_mark(res_rbitmap_t* rbitmap_handle, size_t first, size_t last, ushort up)
+{
+  res_rbitmap_chunk_t* chunk;
+  size_t key;
+  size_t i;
+  size_t lo;
+  size_t hi;
+  ushort type;
+   /*take visits every chunk in the range, making any that are missing. free only visits the ones that are stored*/
+    key = first >> RES_RBITMAP_CHUNK_SHIFT;
+    i = _res_rbitmap_lookup(rbitmap_handle, key);
+    for(;;)
+    {
+      if(0 != up)
+      {
+        if(((i == rbitmap_handle->chunks) || (rbitmap_handle->chunk[i].key != key)) && (0 != _res_rbitmap_insert(rbitmap_handle, i, key)))
+          return(4);
+      } else {
+        if((i == rbitmap_handle->chunks) || (rbitmap_handle->chunk[i].key > (last >> RES_RBITMAP_CHUNK_SHIFT)))
+          return(0);
+        key = rbitmap_handle->chunk[i].key;
+      }
+
+      chunk = &rbitmap_handle->chunk[i];
+      lo = (key == (first >> RES_RBITMAP_CHUNK_SHIFT)) ? RES_RBITMAP_OFFSET(first) : 0;
+      hi = (key == (last >> RES_RBITMAP_CHUNK_SHIFT)) ? RES_RBITMAP_OFFSET(last) : RES_RBITMAP_CHUNK_BITS - 1;
+      if(0 != _res_rbitmap_chunk_mark(chunk, lo, hi, up))
+      {
+        if(0 == chunk->card)
+          _res_rbitmap_remove(rbitmap_handle, i);
+        return(4);
+      }
+
+     /*empty chunks go, the rest change type if another would now be smaller. If that can't be done, the chunk is still right as it is*/
+      if(0 == chunk->card)
+      {
+        _res_rbitmap_remove(rbitmap_handle, i);
+      } else {
+        type = _res_rbitmap_chunk_pick(chunk);
+        if(type != chunk->type)
+          _res_rbitmap_chunk_convert(chunk, type);
+        i++;
+      }
+
+      if(key == (last >> RES_RBITMAP_CHUNK_SHIFT))
+        return(0);
+      key++;
+    }
+}
+
+size_t _res_rbitmap_find(res_rbitmap_t* rbitmap_handle, size_t from, ushort up)
+{
+  res_rbitmap_chunk_t* chunk;
+  size_t end;
+  size_t key;
+  size_t i;
+  size_t offset;
+    end = rbitmap_handle->num_bits + 1;
+    key = from >> RES_RBITMAP_CHUNK_SHIFT;
+    i = _res_rbitmap_lookup(rbitmap_handle, key);
+
+    if(0 != up)
+    {
+     /*the first stored chunk from here with a taken bit at or after from - any chunk after the first has one*/
+      for(; i<rbitmap_handle->chunks; i++)
+      {
+        chunk = &rbitmap_handle->chunk[i];
+        offset = _res_rbitmap_chunk_next(chunk, (chunk->key == key) ? RES_RBITMAP_OFFSET(from) : 0, 1);
+        if(RES_RBITMAP_CHUNK_BITS != offset)
+          return((chunk->key << RES_RBITMAP_CHUNK_SHIFT) + offset);
+      }
+      return(end);
+    }
+
+   /*a missing chunk is all free, a stored one may be full - then try the next chunk along*/
+    offset = RES_RBITMAP_OFFSET(from);
+    for(;;)
+    {
+      if((i == rbitmap_handle->chunks) || (rbitmap_handle->chunk[i].key != key))
+        break;
+      offset = _res_rbitmap_chunk_next(&rbitmap_handle->chunk[i], offset, 0);
+      if(RES_RBITMAP_CHUNK_BITS != offset)
+        break;
+      if(key == (rbitmap_handle->num_bits >> RES_RBITMAP_CHUNK_SHIFT))
+        return(end);
+      key++;
+      i++;
+      offset = 0;
+    }
+    from = (key << RES_RBITMAP_CHUNK_SHIFT) + offset;
+  return((from > end) ? end : from);
+}
+
+size_t _res_rbitmap_bytes(res_rbitmap_chunk_t* chunk)
+{
+  if(RES_RBITMAP_BITMAP == chunk->type)
+    return(RES_RBITMAP_CHUNK_WORDS * sizeof(res_bitmap_word_t));
+  if(RES_RBITMAP_RUN == chunk->type)
+    return(chunk->cap * 2 * sizeof(uint16_t));
+  return(chunk->cap * sizeof(uint16_t));
+}
+
+size_t _res_rbitmap_chunk_next(res_rbitmap_chunk_t* chunk, size_t offset, ushort up)
+{
+  const uint16_t* entry;
+  res_bitmap_word_t* bitmap;
+  res_bitmap_word_t word;
+  size_t i;
+  size_t w;
+    switch(chunk->type)
+    {
+      case RES_RBITMAP_ARRAY :
+        entry = chunk->data;
+        i = _res_rbitmap_array_find(entry, chunk->n, offset);
+        if(0 != up)
+          return((i < chunk->n) ? entry[i] : RES_RBITMAP_CHUNK_BITS);
+        for(; (i < chunk->n) && (entry[i] == offset); i++)  /*walk along any taken bits starting at offset*/
+          offset++;
+        return(offset);
+
+      case RES_RBITMAP_RUN :
+        entry = chunk->data;
+        i = _res_rbitmap_run_find(entry, chunk->n, offset);
+        if(0 != up)
+          return((i == chunk->n) ? RES_RBITMAP_CHUNK_BITS : (entry[2*i] > offset) ? entry[2*i] : offset);
+        return(((i < chunk->n) && (entry[2*i] <= offset)) ? (size_t)entry[2*i+1] + 1 : offset);  /*runs never touch, so the bit after one is free*/
+
+      default :
+        bitmap = chunk->data;
+        w = offset / BITS;
+        word = ((0 != up) ? bitmap[w] : ~bitmap[w]) & _res_rbitmap_mask(offset%BITS, BITS-1);
+        while(0 == word)
+        {
+          if(++w == RES_RBITMAP_CHUNK_WORDS)
+            return(RES_RBITMAP_CHUNK_BITS);
+          word = (0 != up) ? bitmap[w] : ~bitmap[w];
+        }
+        return(w * BITS + RES_BITMAP_CTZ(word));
+    }
+}
+
+size_t _res_rbitmap_chunk_count(res_rbitmap_chunk_t* chunk, size_t lo, size_t hi)
+{
+  const uint16_t* entry;
+  res_bitmap_word_t* bitmap;
+  size_t count = 0;
+  size_t i;
+  size_t from;
+  size_t to;
+    switch(chunk->type)
+    {
+      case RES_RBITMAP_ARRAY :
+        entry = chunk->data;
+        return(_res_rbitmap_array_find(entry, chunk->n, hi + 1) - _res_rbitmap_array_find(entry, chunk->n, lo));
+
+      case RES_RBITMAP_RUN :
+        entry = chunk->data;
+        for(i = _res_rbitmap_run_find(entry, chunk->n, lo); (i < chunk->n) && (entry[2*i] <= hi); i++)
+        {
+          from = (entry[2*i] > lo) ? entry[2*i] : lo;
+          to = (entry[2*i+1] < hi) ? entry[2*i+1] : hi;
+          count += to - from + 1;
+        }
+        return(count);
+
+      default :
+        bitmap = chunk->data;
+        if(lo / BITS == hi / BITS)
+          return(RES_BITMAP_POPCOUNT(bitmap[lo / BITS] & _res_rbitmap_mask(lo%BITS, hi%BITS)));
+        count = RES_BITMAP_POPCOUNT(bitmap[lo / BITS] & _res_rbitmap_mask(lo%BITS, BITS-1));
+        count += _res_bitmap_popcount(&bitmap[lo / BITS + 1], hi / BITS - lo / BITS - 1);
+        count += RES_BITMAP_POPCOUNT(bitmap[hi / BITS] & _res_rbitmap_mask(0, hi%BITS));
+        return(count);
+    }
+}
+
+size_t _res_rbitmap_chunk_starts(res_rbitmap_chunk_t* chunk, size_t lo, size_t hi)
+{
+  const uint16_t* entry;
+  res_bitmap_word_t* bitmap;
+  res_bitmap_word_t word;
+  size_t count = 0;
+  size_t i;
+  size_t end;
+  size_t w;
+    switch(chunk->type)
+    {
+      case RES_RBITMAP_ARRAY :
+       /*an entry starts a run unless the one before it is one less*/
+        entry = chunk->data;
+        end = _res_rbitmap_array_find(entry, chunk->n, hi + 1);
+        for(i = _res_rbitmap_array_find(entry, chunk->n, lo); i < end; i++)
+          if((0 == i) || ((size_t)entry[i-1] + 1 != entry[i]))
+            count++;
+        return(count);
+
+      case RES_RBITMAP_RUN :
+        entry = chunk->data;
+        i = _res_rbitmap_run_find(entry, chunk->n, lo);
+        if((i < chunk->n) && (entry[2*i] < lo))
+          i++;
+        for(; (i < chunk->n) && (entry[2*i] <= hi); i++)
+          count++;
+        return(count);
+
+      default :
+       /*a set bit whose lower neighbour (carried over from the word below) is clear*/
+        bitmap = chunk->data;
+        for(w = lo / BITS; w <= hi / BITS; w++)
+        {
+          word = bitmap[w] & ~((bitmap[w] << 1) | ((0 == w) ? 0 : bitmap[w-1] >> (BITS - 1)));
+          if(w == lo / BITS)
+            word &= _res_rbitmap_mask(lo%BITS, BITS-1);
+          if(w == hi / BITS)
+            word &= _res_rbitmap_mask(0, hi%BITS);
+          count += RES_BITMAP_POPCOUNT(word);
+        }
+        return(count);
+    }
+}
+
+ushort _res_rbitmap_chunk_mark(res_rbitmap_chunk_t* chunk, size_t lo, size_t hi, ushort up)
+{
+  uint16_t* entry;
+  res_bitmap_word_t* bitmap;
+  size_t before;
+  size_t starts;
+  size_t len;
+  size_t i;
+  size_t j;
+  size_t k;
+  size_t first;
+  size_t last;
+  size_t pieces;
+  uint16_t piece[4];
+   /*run starts can change from lo to just past hi - count them either side of the change*/
+    len = hi - lo + 1;
+    before = _res_rbitmap_chunk_count(chunk, lo, hi);
+    last = (hi + 1 < RES_RBITMAP_CHUNK_BITS) ? hi + 1 : hi;
+    starts = _res_rbitmap_chunk_starts(chunk, lo, last);
+
+   /*an array that would grow past RES_RBITMAP_ARRAY_MAX becomes a run list first - never bigger than the array, and it can take any range*/
+    if((RES_RBITMAP_ARRAY == chunk->type) && (0 != up) && (chunk->card - before + len > RES_RBITMAP_ARRAY_MAX))
+      if(0 != _res_rbitmap_chunk_convert(chunk, RES_RBITMAP_RUN))
+        return(2);
+
+    switch(chunk->type)
+    {
+      case RES_RBITMAP_ARRAY :
+       /*entries from lo to hi (i to j) are replaced by all of lo to hi, or by nothing*/
+        i = _res_rbitmap_array_find(chunk->data, chunk->n, lo);
+        j = _res_rbitmap_array_find(chunk->data, chunk->n, hi + 1);
+        pieces = (0 != up) ? len : 0;
+        k = i + pieces + (chunk->n - j);  /*entries after*/
+        if(0 != _res_rbitmap_chunk_reserve(chunk, k, sizeof(uint16_t)))
+          return(2);
+        entry = chunk->data;
+        memmove(&entry[i + pieces], &entry[j], (chunk->n - j) * sizeof(uint16_t));
+        for(first=0; first<pieces; first++)
+          entry[i + first] = (uint16_t)(lo + first);
+        chunk->n = (uint32_t)k;
+        break;
+
+      case RES_RBITMAP_RUN :
+        entry = chunk->data;
+        if(0 != up)
+        {
+         /*every run touching lo-1 to hi+1 joins the new one*/
+          i = _res_rbitmap_run_find(entry, chunk->n, (0 == lo) ? 0 : lo - 1);
+          first = lo;
+          last = hi;
+          for(j=i; (j < chunk->n) && (entry[2*j] <= hi + 1); j++)
+          {
+            if(entry[2*j] < first)
+              first = entry[2*j];
+            if(entry[2*j+1] > last)
+              last = entry[2*j+1];
+          }
+          piece[0] = (uint16_t)first;
+          piece[1] = (uint16_t)last;
+          pieces = 1;
+        } else {
+         /*runs overlapping lo to hi go, leaving any parts that stick out either side*/
+          i = _res_rbitmap_run_find(entry, chunk->n, lo);
+          for(j=i; (j < chunk->n) && (entry[2*j] <= hi); j++)
+            ;
+          pieces = 0;
+          if((j > i) && (entry[2*i] < lo))
+          {
+            piece[0] = entry[2*i];
+            piece[1] = (uint16_t)(lo - 1);
+            pieces = 1;
+          }
+          if((j > i) && (entry[2*j-1] > hi))
+          {
+            piece[2*pieces] = (uint16_t)(hi + 1);
+            piece[2*pieces+1] = entry[2*j-1];
+            pieces++;
+          }
+        }
+
+        k = chunk->n - (j - i) + pieces;  /*runs after*/
+        if(0 != _res_rbitmap_chunk_reserve(chunk, k, 2 * sizeof(uint16_t)))
+          return(2);
+        entry = chunk->data;
+        memmove(&entry[2*(i + pieces)], &entry[2*j], (chunk->n - j) * 2 * sizeof(uint16_t));
+        memcpy(&entry[2*i], piece, pieces * 2 * sizeof(uint16_t));
+        chunk->n = (uint32_t)k;
+        break;
+
+      default :
+        bitmap = chunk->data;
+        for(i = lo / BITS; i <= hi / BITS; i++)
+        {
+          first = (i == lo / BITS) ? lo%BITS : 0;
+          last = (i == hi / BITS) ? hi%BITS : BITS - 1;
+          if(0 != up)
+            bitmap[i] |= _res_rbitmap_mask(first, last);
+          else
+            bitmap[i] &= ~_res_rbitmap_mask(first, last);
+        }
+    }
+
+    chunk->card = (uint32_t)((0 != up) ? chunk->card - before + len : chunk->card - before);
+    last = (hi + 1 < RES_RBITMAP_CHUNK_BITS) ? hi + 1 : hi;
+    chunk->runs = (uint32_t)(chunk->runs - starts + _res_rbitmap_chunk_starts(chunk, lo, last));
+  return(0);
+}
+
+ushort _res_rbitmap_chunk_pick(res_rbitmap_chunk_t* chunk)
+{
+  size_t run_bytes;
+  size_t array_bytes;
+    run_bytes = (size_t)chunk->runs * 2 * sizeof(uint16_t);
+    array_bytes = (size_t)chunk->card * sizeof(uint16_t);
+    if((run_bytes < array_bytes) && (run_bytes < RES_RBITMAP_CHUNK_WORDS * sizeof(res_bitmap_word_t)))
+      return(RES_RBITMAP_RUN);
+    if(chunk->card <= RES_RBITMAP_ARRAY_MAX)
+      return(RES_RBITMAP_ARRAY);
+  return(RES_RBITMAP_BITMAP);
+}
+
+ushort _res_rbitmap_chunk_convert(res_rbitmap_chunk_t* chunk, ushort type)
+{
+  res_rbitmap_chunk_t new_chunk;
+  uint16_t* entry;
+  res_bitmap_word_t* bitmap;
+  size_t start;
+  size_t end;
+  size_t n = 0;
+  size_t i;
+    new_chunk = *chunk;
+    new_chunk.type = type;
+    if(RES_RBITMAP_BITMAP == type)
+    {
+      new_chunk.cap = 0;
+      new_chunk.n = 0;
+      new_chunk.data = calloc(RES_RBITMAP_CHUNK_WORDS, sizeof(res_bitmap_word_t));
+    } else {
+      new_chunk.cap = (RES_RBITMAP_ARRAY == type) ? chunk->card : chunk->runs;
+      new_chunk.n = new_chunk.cap;
+      new_chunk.data = malloc((RES_RBITMAP_ARRAY == type) ? new_chunk.cap * sizeof(uint16_t) : new_chunk.cap * 2 * sizeof(uint16_t));
+    }
+    if(NULL == new_chunk.data)
+      return(2);
+
+   /*copy over a run of taken bits at a time*/
+    entry = new_chunk.data;
+    bitmap = new_chunk.data;
+    start = _res_rbitmap_chunk_next(chunk, 0, 1);
+    while(RES_RBITMAP_CHUNK_BITS != start)
+    {
+      end = _res_rbitmap_chunk_next(chunk, start, 0);  /*NOT inclusive*/
+      if(RES_RBITMAP_ARRAY == type)
+      {
+        for(i=start; i<end; i++)
+          entry[n++] = (uint16_t)i;
+      } else if(RES_RBITMAP_RUN == type) {
+        entry[n++] = (uint16_t)start;
+        entry[n++] = (uint16_t)(end - 1);
+      } else {
+        for(i = start / BITS; i <= (end - 1) / BITS; i++)
+          bitmap[i] |= _res_rbitmap_mask((i == start / BITS) ? start%BITS : 0, (i == (end - 1) / BITS) ? (end - 1)%BITS : BITS - 1);
+      }
+      if(RES_RBITMAP_CHUNK_BITS == end)
+        break;
+      start = _res_rbitmap_chunk_next(chunk, end, 1);
+    }
+
+    free(chunk->data);
+    *chunk = new_chunk;
+  return(0);
+}
+
+ushort _res_rbitmap_chunk_reserve(res_rbitmap_chunk_t* chunk, size_t n, size_t entry)
+{
+  void* data;
+  size_t cap;
+    if(n <= chunk->cap)
+      return(0);
+
+   /*double, so a chunk filled a bit at a time isn't copied every time*/
+    cap = (chunk->cap < 4) ? 4 : (size_t)chunk->cap * 2;
+    if(cap < n)
+      cap = n;
+    data = realloc(chunk->data, cap * entry);
+    if(NULL == data)
+      return(2);
+    chunk->data = data;
+    chunk->cap = (uint32_t)cap;
+  return(0);
+}
+
+size_t _res_rbitmap_array_find(const uint16_t* array, size_t n, size_t offset)
+{
+  size_t lo = 0;
+  size_t mid;
+    while(lo < n)
+    {
+      mid = lo + (n - lo) / 2;
+      if(array[mid] < offset)
+        lo = mid + 1;
+      else
+        n = mid;
+    }
+  return(lo);
+}
+
+size_t _res_rbitmap_run_find(const uint16_t* run, size_t n, size_t offset)
+{
+  size_t lo = 0;
+  size_t mid;
+    while(lo < n)
+    {
+      mid = lo + (n - lo) / 2;
+      if(run[2*mid+1] < offset)
+        lo = mid + 1;
+      else
+        n = mid;
+    }
+  return(lo);
+}
@@ -0,0 +1,93 @@
+/* rbitmap.h - header for rbitmap.c, a compressed bitmap for huge, mostly
+ *             empty bit spaces
+ *
+ * API: rbitmap 1.0
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#ifndef H_RES_RBITMAP
+#define H_RES_RBITMAP
+ #include <stdint.h>
+ #include "res_config.h"
+ #include "res_types.h"
+ #include "res_err.h"
+ #include "bitmap.h"  /*for res_bitmap_word_t and the word macros*/
+
+/*Config:*/
+ #define RES_RBITMAP_CHUNK_SHIFT 16
+ #define RES_RBITMAP_CHUNK_BITS ((size_t)1 << RES_RBITMAP_CHUNK_SHIFT)  /*bits per chunk, 64Ki. Offsets in a chunk fit in a uint16_t*/
+ #define RES_RBITMAP_CHUNK_WORDS (RES_RBITMAP_CHUNK_BITS / BITS)  /*words in a bitmap chunk*/
+ #define RES_RBITMAP_ARRAY_MAX 4096  /*most taken bits an array chunk holds - at 2 bytes each, the size of a bitmap chunk*/
+
+/*Chunk types:*/
+ #define RES_RBITMAP_ARRAY  0  /*sorted uint16_t offsets of the taken bits*/
+ #define RES_RBITMAP_BITMAP 1  /*RES_RBITMAP_CHUNK_WORDS words, a bit per bit*/
+ #define RES_RBITMAP_RUN    2  /*sorted uint16_t pairs, first and last offset of each run of taken bits*/
+
+/*Structures:*/
+ typedef struct
+ {
+   size_t key;  /*chunk number - holds bits key*RES_RBITMAP_CHUNK_BITS on*/
+   void *data;  /*array, bitmap words or run pairs, as type*/
+   uint32_t card;  /*bits taken, never 0 - empty chunks are dropped*/
+   uint32_t runs;  /*runs of taken bits*/
+   uint32_t n;  /*entries in data - card for arrays, runs for run lists*/
+   uint32_t cap;  /*entries allocated in data*/
+   ushort type;  /*RES_RBITMAP_ARRAY, _BITMAP or _RUN, whichever is smallest for card and runs*/
+ } res_rbitmap_chunk_t;
+
+ typedef struct
+ {
+   res_rbitmap_chunk_t *chunk;  /*chunks with any bit taken, sorted by key. Every other chunk is all free*/
+   size_t chunks;
+   size_t capacity;  /*chunks allocated*/
+   size_t hint;  /*chunk last looked up - checked before searching, so runs of calls on one hot chunk don't search*/
+   size_t num_bits;  /*num_bits of 0 = 1 bit in the map. Fixed - there is no resize*/
+  } res_rbitmap_t;
+
+ typedef struct
+ {
+   size_t chunks;  /*chunks stored*/
+   size_t arrays;  /*...of which are arrays*/
+   size_t bitmaps;
+   size_t runs;
+   size_t taken;  /*bits taken in the whole map*/
+   size_t bytes;  /*memory used, handle and all*/
+ } res_rbitmap_stats_t;
+
+/*External functions*/
+ res_rbitmap_t* res_rbitmap_create(size_t num_bits);  /*creates an empty bitmap of size num_bits. Nothing is allocated for the bits until some are taken. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER if num_bits >= RES_RBITMAP_ERR. NOTE - num_bits starts at 0. 0 implies a bitmap with 1 bit, etc.*/
+ ushort res_rbitmap_destroy(res_rbitmap_t* rbitmap_handle);  /*frees every chunk and the handle. Returns 0 on success*/
+
+ size_t res_rbitmap_alloc(res_rbitmap_t* rbitmap_handle, size_t block_size);  /*finds and marks the lowest block_size+1 free bits in a row, hopping over whole chunks at a time. Returns start bit on success, RES_RBITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER or RES_ERR_NO_MATCH, or preserved on malloc fail*/
+ ushort res_rbitmap_free(res_rbitmap_t* rbitmap_handle, size_t base, size_t limit);  /*unmarks bits from base to (base+limit). Limit of 0 = 1 bit. Chunks left empty are freed. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range, 4 on memory error (errno preserved, chunks before the one that failed are done)*/
+ ushort res_rbitmap_take(res_rbitmap_t* rbitmap_handle, size_t base, size_t limit);  /*marks bits from base to (base+limit). Limit of 0 = 1 bit. Returns as res_rbitmap_free*/
+ ushort res_rbitmap_check(res_rbitmap_t* rbitmap_handle, size_t base, size_t limit);  /*returns 0 if all bits from base to (base+limit) are 0, 1 if all are 1, 2 if they vary, 4 on base-out-of-range, 5 on limit-out-of-range*/
+ size_t res_rbitmap_count(res_rbitmap_t* rbitmap_handle, size_t base, size_t limit);  /*counts bits taken from base to base+limit, only reading chunks that are stored. Returns count on success, RES_RBITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER*/
+ size_t res_rbitmap_get_size(res_rbitmap_t* rbitmap_handle);  /*Returns: num_bits*/
+ ushort res_rbitmap_stats(res_rbitmap_t* rbitmap_handle, res_rbitmap_stats_t* stats);  /*fills in stats for the whole map. Returns 0 on success*/
+
+/*Internal functions:*/
+ res_bitmap_word_t _res_rbitmap_mask(size_t first, size_t last);  /*returns a word with bits first to last (inclusive, both < BITS) set*/
+ size_t _res_rbitmap_lookup(res_rbitmap_t* rbitmap_handle, size_t key);  /*finds the first chunk with a key >= key, trying the hint first. Returns chunk index, chunks if there isn't one*/
+ ushort _res_rbitmap_insert(res_rbitmap_t* rbitmap_handle, size_t i, size_t key);  /*adds an empty array chunk at index i. Returns 0 on success, 2 on memory error; errno preserved*/
+ void _res_rbitmap_remove(res_rbitmap_t* rbitmap_handle, size_t i);  /*frees chunk i and closes the gap*/
+ ushort _res_rbitmap_mark(res_rbitmap_t* rbitmap_handle, size_t first, size_t last, ushort up);  /*sets (up=1) or clears (up=0) bits first to last, chunk by chunk. Does NOT check range. Returns as take / free*/
+ size_t _res_rbitmap_find(res_rbitmap_t* rbitmap_handle, size_t from, ushort up);  /*finds the first bit at or after from that is taken (up=1) or free (up=0). Returns bit number, or num_bits+1 if there isn't one*/
+ size_t _res_rbitmap_bytes(res_rbitmap_chunk_t* chunk);  /*bytes allocated for a chunk's data*/
+
+ size_t _res_rbitmap_chunk_next(res_rbitmap_chunk_t* chunk, size_t offset, ushort up);  /*first offset at or after offset that is taken (up=1) or free (up=0). Returns RES_RBITMAP_CHUNK_BITS if there isn't one*/
+ size_t _res_rbitmap_chunk_count(res_rbitmap_chunk_t* chunk, size_t lo, size_t hi);  /*taken bits from offset lo to hi inclusive*/
+ size_t _res_rbitmap_chunk_starts(res_rbitmap_chunk_t* chunk, size_t lo, size_t hi);  /*runs of taken bits that start from offset lo to hi inclusive*/
+ ushort _res_rbitmap_chunk_mark(res_rbitmap_chunk_t* chunk, size_t lo, size_t hi, ushort up);  /*sets or clears offsets lo to hi, keeping card and runs right. May change the chunk's type to make room. Returns 0 on success, 2 on memory error; errno preserved*/
+ ushort _res_rbitmap_chunk_pick(res_rbitmap_chunk_t* chunk);  /*the smallest type for the chunk's card and runs*/
+ ushort _res_rbitmap_chunk_convert(res_rbitmap_chunk_t* chunk, ushort type);  /*rebuilds the chunk as type. Returns 0 on success, 2 on memory error (chunk unchanged); errno preserved*/
+ ushort _res_rbitmap_chunk_reserve(res_rbitmap_chunk_t* chunk, size_t n, size_t entry);  /*makes room for n entries of entry bytes. Returns 0 on success, 2 on memory error; errno preserved*/
+ size_t _res_rbitmap_array_find(const uint16_t* array, size_t n, size_t offset);  /*index of the first of n sorted entries >= offset, n if none*/
+ size_t _res_rbitmap_run_find(const uint16_t* run, size_t n, size_t offset);  /*index of the first of n runs whose last bit is >= offset, n if none*/
+#endif
@@ -0,0 +1,388 @@
+/* rbitmap_test.c - unit tests for rbitmap.c
+ *
+ * REQUIRES: rbitmap_1, reff-1 implementation
+ * TESTS: rbitmap_1.0
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include "rbitmap.h"
+#include "res_err.h"
+
+#define CHUNK RES_RBITMAP_CHUNK_BITS
+#define RANDOM_BITS (4 * CHUNK)
+
+  int main(void);
+  int create_destroy(void);
+  int free_take_check_count(void);
+  int chunk_types(void);
+  int test_alloc(void);  /*named test_... because alloc is already a function name*/
+  int random_ops(void);
+  size_t shadow_alloc(unsigned char* shadow, size_t size, size_t block_size);  /*reference first fit on a byte-per-bit copy of the map. Returns start, or RES_RBITMAP_ERR*/
+
+int main()
+{
+  srand((unsigned int)time(NULL));
+   /*create, destroy*/
+    printf("01 - create & destroy bitmaps\n");
+    if( 0 != create_destroy() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*free, take, check, count*/
+    printf("02 - free, take, check, & count operations\n");
+    if( 0 != free_take_check_count() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*array, bitmap & run chunks*/
+    printf("03 - chunk types\n");
+    if( 0 != chunk_types() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*alloc*/
+    printf("04 - alloc\n");
+    if( 0 != test_alloc() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*everything at once*/
+    printf("05 - random operations against a reference\n");
+    if( 0 != random_ops() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+  printf("ALL TESTS PASSED!\n");
+  return(EXIT_SUCCESS);
+}
+
+int create_destroy(void)
+{
+  res_rbitmap_t* bitmap1;
+  res_rbitmap_t* bitmap2;
+  res_rbitmap_stats_t stats;
+  size_t huge;
+    printf("\tcreating bitmaps of size 1 and the largest size_t allows... ");
+    huge = RES_RBITMAP_ERR - 1;
+    bitmap1 = res_rbitmap_create(0);
+    bitmap2 = res_rbitmap_create(huge);
+    assert(NULL != bitmap1);
+    assert(NULL != bitmap2);
+    assert(0 == res_rbitmap_get_size(bitmap1));
+    assert(huge == res_rbitmap_get_size(bitmap2));
+    assert(0 == res_rbitmap_check(bitmap1, 0, 0));
+    assert(0 == res_rbitmap_check(bitmap2, 0, huge));
+    assert(0 == res_rbitmap_stats(bitmap2, &stats));
+    assert((0 == stats.chunks) && (0 == stats.taken));
+    assert(stats.bytes < 1024);  /*nothing allocated for the bits themselves*/
+    printf("Good!\n");
+
+    printf("\tsizes too big to use... ");
+    errno = 0;
+    assert(NULL == res_rbitmap_create(RES_RBITMAP_ERR));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(NULL == res_rbitmap_create(SIZE_MAX));
+    printf("Good!\n");
+
+    printf("\tdestroying bitmaps... ");
+    assert(0 == res_rbitmap_destroy(bitmap1));
+    assert(0 == res_rbitmap_destroy(bitmap2));
+    printf("Good!\n");
+  return(0);
+}
+
+int free_take_check_count(void)
+{
+  res_rbitmap_t* bitmap1;
+  res_rbitmap_stats_t stats;
+  size_t top;
+    printf("\tcreating bitmap of 2^40 bits... ");
+    top = ((size_t)1 << 40) - 1;
+    bitmap1 = res_rbitmap_create(top);
+    assert(NULL != bitmap1);
+    printf("Good!\n");
+
+    printf("\ttake, free & check over chunk boundaries... ");
+    assert(0 == res_rbitmap_take(bitmap1, CHUNK - 10, 19));
+    assert(1 == res_rbitmap_check(bitmap1, CHUNK - 10, 19));
+    assert(0 == res_rbitmap_check(bitmap1, 0, CHUNK - 11));
+    assert(2 == res_rbitmap_check(bitmap1, CHUNK - 11, 1));
+    assert(0 == res_rbitmap_free(bitmap1, CHUNK - 2, 3));
+    assert(0 == res_rbitmap_check(bitmap1, CHUNK - 2, 3));
+    assert(1 == res_rbitmap_check(bitmap1, CHUNK + 2, 7));
+    assert(0 == res_rbitmap_take(bitmap1, top - 5, 5));  /*far end of the space*/
+    assert(1 == res_rbitmap_check(bitmap1, top - 5, 5));
+    assert(0 == res_rbitmap_check(bitmap1, CHUNK * 2, top - CHUNK * 2 - 6));
+    printf("Good!\n");
+
+    printf("\tcount... ");
+    assert(22 == res_rbitmap_count(bitmap1, 0, top));
+    assert(8 == res_rbitmap_count(bitmap1, CHUNK - 10, 9));
+    assert(6 == res_rbitmap_count(bitmap1, top - 100, 100));
+    assert(0 == res_rbitmap_count(bitmap1, CHUNK * 5, CHUNK * 1000));
+    assert(0 == res_rbitmap_stats(bitmap1, &stats));
+    assert((3 == stats.chunks) && (22 == stats.taken));
+    printf("Good!\n");
+
+    printf("\ttaking and freeing many chunks at once... ");
+    assert(0 == res_rbitmap_take(bitmap1, 100, CHUNK * 10));
+    assert(1 == res_rbitmap_check(bitmap1, 100, CHUNK * 10));
+    assert(CHUNK * 10 + 1 + 6 == res_rbitmap_count(bitmap1, 0, top));
+    assert(0 == res_rbitmap_free(bitmap1, 0, top - 1));
+    assert(1 == res_rbitmap_count(bitmap1, 0, top));
+    assert(0 == res_rbitmap_stats(bitmap1, &stats));
+    assert(1 == stats.chunks);  /*empty chunks are dropped*/
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    assert(2 == res_rbitmap_take(bitmap1, top + 1, 0));
+    assert(3 == res_rbitmap_take(bitmap1, top, 1));
+    assert(2 == res_rbitmap_free(bitmap1, top + 1, 0));
+    assert(3 == res_rbitmap_free(bitmap1, 1, SIZE_MAX));
+    assert(4 == res_rbitmap_check(bitmap1, top + 1, 0));
+    assert(5 == res_rbitmap_check(bitmap1, top, 1));
+    errno = 0;
+    assert(RES_RBITMAP_ERR == res_rbitmap_count(bitmap1, top, 1));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\tdestroying bitmap... ");
+    assert(0 == res_rbitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int chunk_types(void)
+{
+  res_rbitmap_t* bitmap1;
+  res_rbitmap_stats_t stats;
+  size_t i;
+    bitmap1 = res_rbitmap_create(CHUNK * 4 - 1);
+    assert(NULL != bitmap1);
+
+    printf("\ta few scattered bits make an array... ");
+    for(i=0; i<100; i++)
+      assert(0 == res_rbitmap_take(bitmap1, i * 7, 0));
+    assert(0 == res_rbitmap_stats(bitmap1, &stats));
+    assert((1 == stats.arrays) && (100 == stats.taken));
+    assert(stats.bytes < sizeof(res_rbitmap_t) + 4 * sizeof(res_rbitmap_chunk_t) + 512);
+    printf("Good!\n");
+
+    printf("\tlots of scattered bits make a bitmap... ");
+    for(i=0; i<CHUNK/2; i+=2)
+      assert(0 == res_rbitmap_take(bitmap1, CHUNK + i, 0));
+    assert(0 == res_rbitmap_stats(bitmap1, &stats));
+    assert((1 == stats.arrays) && (1 == stats.bitmaps));
+    assert(CHUNK/4 == res_rbitmap_count(bitmap1, CHUNK, CHUNK - 1));
+    printf("Good!\n");
+
+    printf("\tlong runs make a run list... ");
+    assert(0 == res_rbitmap_take(bitmap1, CHUNK * 2 + 10, 30000));
+    assert(0 == res_rbitmap_take(bitmap1, CHUNK * 3, CHUNK - 1));  /*a whole chunk is one run*/
+    assert(0 == res_rbitmap_stats(bitmap1, &stats));
+    assert((4 == stats.chunks) && (2 == stats.runs));
+    assert(1 == res_rbitmap_check(bitmap1, CHUNK * 3, CHUNK - 1));
+    printf("Good!\n");
+
+    printf("\tchunks change type as they fill and empty... ");
+    assert(0 == res_rbitmap_take(bitmap1, CHUNK, CHUNK - 1));  /*bitmap filled in - now a run*/
+    assert(0 == res_rbitmap_free(bitmap1, CHUNK * 3 + 1, CHUNK - 3));  /*run down to 2 bits - now an array*/
+    assert(0 == res_rbitmap_stats(bitmap1, &stats));
+    assert((2 == stats.arrays) && (0 == stats.bitmaps) && (2 == stats.runs));
+    assert(2 == res_rbitmap_count(bitmap1, CHUNK * 3, CHUNK - 1));
+    for(i=0; i<5000; i++)  /*past RES_RBITMAP_ARRAY_MAX, one bit at a time*/
+      assert(0 == res_rbitmap_take(bitmap1, CHUNK * 3 + 1 + i * 3, 0));
+    assert(0 == res_rbitmap_stats(bitmap1, &stats));
+    assert((1 == stats.arrays) && (1 == stats.bitmaps));
+    assert(5002 == res_rbitmap_count(bitmap1, CHUNK * 3, CHUNK - 1));
+    assert(0 == res_rbitmap_free(bitmap1, 0, CHUNK * 4 - 1));
+    assert(0 == res_rbitmap_stats(bitmap1, &stats));
+    assert((0 == stats.chunks) && (0 == stats.taken));
+    assert(0 == res_rbitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int test_alloc(void)
+{
+  res_rbitmap_t* bitmap1;
+  size_t i;
+    printf("\tsmall blocks... ");
+    bitmap1 = res_rbitmap_create(CHUNK * 3 - 1);
+    assert(NULL != bitmap1);
+    assert(0 == res_rbitmap_alloc(bitmap1, 0));
+    assert(1 == res_rbitmap_alloc(bitmap1, 9));
+    assert(11 == res_rbitmap_alloc(bitmap1, 3));
+    assert(1 == res_rbitmap_check(bitmap1, 0, 14));
+    assert(0 == res_rbitmap_free(bitmap1, 1, 9));
+    assert(1 == res_rbitmap_alloc(bitmap1, 4));  /*fits back in the gap*/
+    assert(0 == res_rbitmap_check(bitmap1, 6, 4));
+    printf("Good!\n");
+
+    printf("\tblocks over full chunks and across chunk boundaries... ");
+    assert(0 == res_rbitmap_take(bitmap1, 0, CHUNK + 99));
+    assert(CHUNK + 100 == res_rbitmap_alloc(bitmap1, CHUNK));  /*runs into the third chunk*/
+    assert(1 == res_rbitmap_check(bitmap1, 0, CHUNK * 2 + 100));
+    assert(CHUNK * 2 + 101 == res_rbitmap_alloc(bitmap1, 0));
+    assert(0 == res_rbitmap_free(bitmap1, 0, CHUNK * 3 - 1));
+    for(i=0; i<CHUNK*3; i+=1000)  /*a bit taken every 1000, so nothing over 999 bits fits*/
+      assert(0 == res_rbitmap_take(bitmap1, i, 0));
+    assert(1 == res_rbitmap_alloc(bitmap1, 998));
+    assert(1001 == res_rbitmap_alloc(bitmap1, 998));
+    assert(RES_RBITMAP_ERR == res_rbitmap_alloc(bitmap1, 999));
+    printf("Good!\n");
+
+    printf("\tfull and error conditions... ");
+    assert(0 == res_rbitmap_free(bitmap1, 0, CHUNK * 3 - 1));
+    assert(0 == res_rbitmap_alloc(bitmap1, CHUNK * 3 - 1));
+    errno = 0;
+    assert(RES_RBITMAP_ERR == res_rbitmap_alloc(bitmap1, 0));
+    assert(RES_ERR_NO_MATCH == errno);
+    errno = 0;
+    assert(RES_RBITMAP_ERR == res_rbitmap_alloc(bitmap1, CHUNK * 3));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(0 == res_rbitmap_free(bitmap1, CHUNK * 3 - 1, 0));
+    assert(CHUNK * 3 - 1 == res_rbitmap_alloc(bitmap1, 0));  /*last bit*/
+    assert(0 == res_rbitmap_destroy(bitmap1));
+    printf("Good!\n");
+
+    printf("\tsparse map of 2^40 bits... ");
+    bitmap1 = res_rbitmap_create(((size_t)1 << 40) - 1);
+    assert(NULL != bitmap1);
+    assert(0 == res_rbitmap_take(bitmap1, 0, CHUNK * 100));
+    assert(CHUNK * 100 + 1 == res_rbitmap_alloc(bitmap1, CHUNK * 5));
+    assert(0 == res_rbitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int random_ops(void)
+{
+  res_rbitmap_t* bitmap1;
+  res_rbitmap_stats_t stats;
+  unsigned char* shadow;
+  size_t i;
+  size_t j;
+  size_t base;
+  size_t limit;
+  size_t expected;
+  size_t runs;
+  size_t card;
+  size_t key;
+    shadow = calloc(RANDOM_BITS, 1);
+    assert(NULL != shadow);
+    bitmap1 = res_rbitmap_create(RANDOM_BITS - 1);
+    assert(NULL != bitmap1);
+
+    printf("\tcomparing random take, free, alloc, check & count... ");
+    for(i=0; i<20000; i++)
+    {
+     /*mostly single bits and short ranges, so chunks move between all three types*/
+      base = (unsigned)rand() % RANDOM_BITS;
+      switch(rand() % 4)
+      {
+        case 0 :
+          limit = 0;
+          break;
+        case 1 :
+          limit = (unsigned)rand() % 64;
+          break;
+        case 2 :
+          limit = (unsigned)rand() % 5000;
+          break;
+        default :
+          limit = (unsigned)rand() % (2 * CHUNK);
+      }
+      if(limit > RANDOM_BITS - 1 - base)
+        limit = RANDOM_BITS - 1 - base;
+
+      switch(rand() % 6)
+      {
+        case 0 :
+        case 1 :
+          if(0 != rand() % 8)  /*takes mostly short, so the map doesn't fill up*/
+            limit %= 16;
+          assert(0 == res_rbitmap_take(bitmap1, base, limit));
+          memset(shadow + base, 1, limit + 1);
+          break;
+        case 2 :
+        case 3 :
+          assert(0 == res_rbitmap_free(bitmap1, base, limit));
+          memset(shadow + base, 0, limit + 1);
+          break;
+        case 4 :
+          limit %= 300;
+          expected = shadow_alloc(shadow, RANDOM_BITS, limit);
+          assert(expected == res_rbitmap_alloc(bitmap1, limit));
+          if(RES_RBITMAP_ERR != expected)
+            memset(shadow + expected, 1, limit + 1);
+          break;
+        default :
+          for(expected=0, j=base; j<=base+limit; j++)
+            expected += shadow[j];
+          assert(expected == res_rbitmap_count(bitmap1, base, limit));
+          assert(((0 == expected) ? 0 : (limit + 1 == expected) ? 1 : 2) == res_rbitmap_check(bitmap1, base, limit));
+      }
+    }
+    printf("Good!\n");
+
+    printf("\tevery bit, and every chunk's counts, match... ");
+    for(j=0; j<RANDOM_BITS; j++)
+      assert(shadow[j] == res_rbitmap_check(bitmap1, j, 0));
+    for(i=0; i<bitmap1->chunks; i++)
+    {
+      key = bitmap1->chunk[i].key;
+      card = 0;
+      runs = 0;
+      for(j=key*CHUNK; j<(key+1)*CHUNK; j++)
+      {
+        card += shadow[j];
+        if((1 == shadow[j]) && ((j == key*CHUNK) || (0 == shadow[j-1])))
+          runs++;
+      }
+      assert(card == bitmap1->chunk[i].card);
+      assert(runs == bitmap1->chunk[i].runs);
+      assert(bitmap1->chunk[i].type == _res_rbitmap_chunk_pick(&bitmap1->chunk[i]));
+    }
+    assert(0 == res_rbitmap_stats(bitmap1, &stats));
+    assert(res_rbitmap_count(bitmap1, 0, RANDOM_BITS - 1) == stats.taken);
+    assert(0 == res_rbitmap_destroy(bitmap1));
+    free(shadow);
+    printf("Good!\n");
+  return(0);
+}
+
+size_t shadow_alloc(unsigned char* shadow, size_t size, size_t block_size)
+{
+  size_t start;
+  size_t len = 0;
+    for(start=0; start<size; start++)
+    {
+      len = (0 == shadow[start]) ? len + 1 : 0;
+      if(len == block_size + 1)
+        return(start - block_size);
+    }
+  return(RES_RBITMAP_ERR);
+}
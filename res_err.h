@@ -15,6 +15,10 @@
   #define RES_BITMAP_ERR     SIZE_MAX-1
   #define RES_LIST_ERR       SIZE_MAX-1
   #define RES_STACK_ERR      SIZE_MAX-1
+  #define RES_CBITMAP_ERR    SIZE_MAX-1
+  #define RES_SBITMAP_ERR    SIZE_MAX-1
+  #define RES_RBITMAP_ERR    SIZE_MAX-1
+  #define RES_PBITMAP_ERR    SIZE_MAX-1
   #define RES_ID_ERR         0xFFFE
   #define RES_TYPE_ERR       0xFFFE
   #define RES_SORT_KEY_ERR   0x0FFE
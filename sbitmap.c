@@ -0,0 +1,271 @@
+/* sbitmap.c - bitmap split into shards so that threads can allocate from it
+ *             without all fighting over the same words
+ *
+ * API: sbitmap 1.0
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#include <stdlib.h>
+#include "sbitmap.h"
+
+/* The bit space is cut into equal slices, each its own res_bitmap_t behind
+ * its own spinlock, and each thread has a home shard. As long as there are
+ * at least as many shards as busy threads, every thread allocates from words
+ * (and takes a lock) that no other thread is touching, and only when its home
+ * shard is full does it go looking in the others. Shard sizes are a multiple
+ * of BITS, so no two shards ever share a word of the map.*/
+
+_Atomic size_t _res_sbitmap_threads = 0;
+_Thread_local size_t _res_sbitmap_thread = SIZE_MAX;
+
+res_sbitmap_t* res_sbitmap_create(size_t num_bits, size_t shards, ushort opts)
+{
+  res_sbitmap_t* handle;
+  size_t i;
+  size_t last;
+    if(0 == shards)
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(NULL);
+    }
+
+    handle = malloc( sizeof(res_sbitmap_t) );
+    if(NULL == handle)
+      return(NULL);
+
+   /*shard_bits is (num_bits+1)/shards, rounded up to whole words - if that leaves nothing for the last shards, there are fewer of them*/
+    handle->shard_bits = ((num_bits / shards) / BITS + 1) * BITS;
+    handle->shards = num_bits / handle->shard_bits + 1;
+    handle->num_bits = num_bits;
+    handle->shard = aligned_alloc(RES_SBITMAP_LINE, handle->shards * sizeof(res_sbitmap_shard_t));
+    if(NULL == handle->shard)
+    {
+      free(handle);
+      return(NULL);
+    }
+
+    for(i=0; i<handle->shards; i++)
+    {
+      handle->shard[i].base = i * handle->shard_bits;
+      last = (i == handle->shards - 1) ? num_bits : handle->shard[i].base + handle->shard_bits - 1;
+      handle->shard[i].map = res_bitmap_create_opts(last - handle->shard[i].base, opts);
+      if(NULL == handle->shard[i].map)
+      {
+        handle->shards = i;  /*only destroy what was made*/
+        res_sbitmap_destroy(handle);
+        return(NULL);
+      }
+      atomic_flag_clear(&handle->shard[i].lock);
+      atomic_init(&handle->shard[i].allocs, 0);
+      atomic_init(&handle->shard[i].steals, 0);
+      atomic_init(&handle->shard[i].stolen, 0);
+    }
+  return(handle);
+}
+
+ushort res_sbitmap_destroy(res_sbitmap_t* sbitmap_handle)
+{
+  size_t i;
+  int err;
+    err = errno;  /*keep malloc's errno when called from a failed create*/
+    for(i=0; i<sbitmap_handle->shards; i++)
+      res_bitmap_destroy(sbitmap_handle->shard[i].map);
+    free(sbitmap_handle->shard);
+    free(sbitmap_handle);
+    errno = err;
+  return(0);
+}
+
+size_t res_sbitmap_home(res_sbitmap_t* sbitmap_handle)
+{
+    if(SIZE_MAX == _res_sbitmap_thread)
+      _res_sbitmap_thread = atomic_fetch_add_explicit(&_res_sbitmap_threads, 1, memory_order_relaxed);
+  return(_res_sbitmap_thread % sbitmap_handle->shards);
+}
+
+size_t res_sbitmap_alloc(res_sbitmap_t* sbitmap_handle, size_t home, size_t block_size)
+{
+  res_sbitmap_shard_t* shard;
+  size_t start;
+  size_t i;
+   /*check parameters - the last shard may be smaller, but others can take the block*/
+    if((block_size >= sbitmap_handle->shard_bits) || (block_size > sbitmap_handle->num_bits))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_SBITMAP_ERR);
+    }
+    home %= sbitmap_handle->shards;
+
+   /*home shard first, then steal from the rest in turn*/
+    for(i=0; i<sbitmap_handle->shards; i++)
+    {
+      shard = &sbitmap_handle->shard[(home + i) % sbitmap_handle->shards];
+      if(block_size > res_bitmap_get_size(shard->map))
+        continue;
+      _res_sbitmap_lock(shard);
+      start = res_bitmap_alloc(shard->map, block_size);
+      _res_sbitmap_unlock(shard);
+      if(RES_BITMAP_ERR != start)
+      {
+        atomic_fetch_add_explicit(&shard->allocs, 1, memory_order_relaxed);
+        if(0 != i)
+        {
+          atomic_fetch_add_explicit(&sbitmap_handle->shard[home].steals, 1, memory_order_relaxed);
+          atomic_fetch_add_explicit(&shard->stolen, 1, memory_order_relaxed);
+        }
+        return(shard->base + start);
+      }
+    }
+    errno = RES_ERR_NO_MATCH;
+  return(RES_SBITMAP_ERR);
+}
+
+ushort res_sbitmap_free(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit)
+{
+  return(_res_sbitmap_mark(sbitmap_handle, base, limit, 0));
+}
+
+ushort res_sbitmap_take(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit)
+{
+  return(_res_sbitmap_mark(sbitmap_handle, base, limit, 1));
+}
+
+ushort res_sbitmap_check(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit)
+{
+  res_sbitmap_shard_t* shard;
+  size_t last;
+  size_t end;
+  ushort result;
+  ushort prev = 3;  /*nothing checked yet*/
+   /*check base & limit*/
+    if(base > sbitmap_handle->num_bits)
+      return(4);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > sbitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(5);
+
+    last = base + limit;
+    while(base <= last)
+    {
+      shard = &sbitmap_handle->shard[base / sbitmap_handle->shard_bits];
+      end = shard->base + res_bitmap_get_size(shard->map);
+      if(end > last)
+        end = last;
+      _res_sbitmap_lock(shard);
+      result = res_bitmap_check(shard->map, base - shard->base, end - base);
+      _res_sbitmap_unlock(shard);
+      if((3 != prev) && (result != prev))
+        return(2);
+      prev = result;
+      base = end + 1;
+      if(0 == base)
+        break;
+    }
+  return(prev);
+}
+
+size_t res_sbitmap_count(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit)
+{
+  res_sbitmap_shard_t* shard;
+  size_t last;
+  size_t end;
+  size_t count = 0;
+   /*check parameters*/
+    if((base > sbitmap_handle->num_bits) || (base > (SIZE_MAX - limit)) || ((base+limit) > sbitmap_handle->num_bits))
+    {
+      errno = RES_ERR_BAD_PARAMETER;
+      return(RES_SBITMAP_ERR);
+    }
+
+    last = base + limit;
+    while(base <= last)
+    {
+      shard = &sbitmap_handle->shard[base / sbitmap_handle->shard_bits];
+      end = shard->base + res_bitmap_get_size(shard->map);
+      if(end > last)
+        end = last;
+      _res_sbitmap_lock(shard);
+      count += res_bitmap_count(shard->map, base - shard->base, end - base);
+      _res_sbitmap_unlock(shard);
+      base = end + 1;
+      if(0 == base)
+        break;
+    }
+  return(count);
+}
+
+size_t res_sbitmap_get_size(res_sbitmap_t* sbitmap_handle)
+{
+  return(sbitmap_handle->num_bits);
+}
+
+size_t res_sbitmap_get_shards(res_sbitmap_t* sbitmap_handle)
+{
+  return(sbitmap_handle->shards);
+}
+
+ushort res_sbitmap_stats(res_sbitmap_t* sbitmap_handle, size_t shard, res_sbitmap_stats_t* stats)
+{
+  res_sbitmap_shard_t* s;
+    if(shard >= sbitmap_handle->shards)
+      return(2);
+
+    s = &sbitmap_handle->shard[shard];
+    stats->bits = res_bitmap_get_size(s->map) + 1;
+    _res_sbitmap_lock(s);
+    stats->taken = res_bitmap_count(s->map, 0, stats->bits - 1);
+    _res_sbitmap_unlock(s);
+    stats->allocs = atomic_load_explicit(&s->allocs, memory_order_relaxed);
+    stats->steals = atomic_load_explicit(&s->steals, memory_order_relaxed);
+    stats->stolen = atomic_load_explicit(&s->stolen, memory_order_relaxed);
+  return(0);
+}
+
+/*-------------- Internals ----------------*/
+
+void _res_sbitmap_lock(res_sbitmap_shard_t* shard)
+{
+  while(atomic_flag_test_and_set_explicit(&shard->lock, memory_order_acquire))
+    ;
+}
+
+void _res_sbitmap_unlock(res_sbitmap_shard_t* shard)
+{
+  atomic_flag_clear_explicit(&shard->lock, memory_order_release);
+}
+
+ushort _res_sbitmap_mark(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit, ushort up)
+{
+  res_sbitmap_shard_t* shard;
+  size_t last;
+  size_t end;
+   /*check base & limit*/
+    if(base > sbitmap_handle->num_bits)
+      return(2);
+    if((base > (SIZE_MAX - limit)) || ((base+limit) > sbitmap_handle->num_bits))  /*if base + limit so high they wrap around, or if base+limit out of range*/
+      return(3);
+
+   /*each shard's part of the range goes back to that shard, whoever allocated it*/
+    last = base + limit;
+    while(base <= last)
+    {
+      shard = &sbitmap_handle->shard[base / sbitmap_handle->shard_bits];
+      end = shard->base + res_bitmap_get_size(shard->map);
+      if(end > last)
+        end = last;
+      _res_sbitmap_lock(shard);
+      if(0 == up)
+        res_bitmap_free(shard->map, base - shard->base, end - base);
+      else
+        res_bitmap_take(shard->map, base - shard->base, end - base);
+      _res_sbitmap_unlock(shard);
+      base = end + 1;
+      if(0 == base)
+        break;
+    }
+  return(0);
+}
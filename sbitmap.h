@@ -0,0 +1,75 @@
+/* sbitmap.h - header for sbitmap.c, a bitmap split into shards so that
+ *             threads can allocate from it without all fighting over the
+ *             same words
+ *
+ * API: sbitmap 1.0
+ * IMPLEMENTATION: reff-1
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+#ifndef H_RES_SBITMAP
+#define H_RES_SBITMAP
+ #include <stdatomic.h>
+ #include "res_config.h"
+ #include "res_types.h"
+ #include "res_err.h"
+ #include "bitmap.h"
+
+/*Config:*/
+ #define RES_SBITMAP_LINE 64  /*bytes in a cache line - each shard's lock and counters get a line to themselves*/
+
+/*Structures:*/
+ typedef struct
+ {
+   _Alignas(RES_SBITMAP_LINE) atomic_flag lock;  /*held while the map is in use*/
+   res_bitmap_t *map;  /*this shard's bits - bit 0 of map is bit base of the whole bitmap*/
+   size_t base;
+   _Atomic size_t allocs;  /*allocs that came from this shard*/
+   _Atomic size_t steals;  /*allocs by threads whose home this is, that had to come from another shard*/
+   _Atomic size_t stolen;  /*allocs from this shard by threads whose home is another shard*/
+ } res_sbitmap_shard_t;
+
+ typedef struct
+ {
+   res_sbitmap_shard_t *shard;  /*one per shard, aligned to RES_SBITMAP_LINE*/
+   size_t shards;
+   size_t shard_bits;  /*bits in every shard but (maybe) the last, a multiple of BITS*/
+   size_t num_bits;  /*num_bits of 0 = 1 bit in the map. Fixed - there is no resize*/
+  } res_sbitmap_t;
+
+ typedef struct
+ {
+   size_t bits;  /*size of the shard, in bits*/
+   size_t taken;  /*bits taken right now*/
+   size_t allocs;
+   size_t steals;
+   size_t stolen;
+ } res_sbitmap_stats_t;
+
+/*External functions. Everything but create and destroy may be called from any number of threads at once*/
+ res_sbitmap_t* res_sbitmap_create(size_t num_bits, size_t shards, ushort opts);  /*creates a bitmap of size num_bits, split into shards roughly equal shards (fewer if the map is too small), each a res_bitmap_t created with opts. Returns: pointer to handle on success, NULL on failure; errno preserved on malloc fail, set to RES_ERR_BAD_PARAMETER on shards of 0 or unknown opts. NOTE - num_bits starts at 0. 0 implies a bitmap with 1 bit, etc.*/
+ ushort res_sbitmap_destroy(res_sbitmap_t* sbitmap_handle);  /*frees the shards and handle. No other thread may be using it. Returns 0 on success*/
+
+ size_t res_sbitmap_home(res_sbitmap_t* sbitmap_handle);  /*returns the calling thread's home shard. Threads are numbered in the order they first call this, and spread over the shards round-robin*/
+ size_t res_sbitmap_alloc(res_sbitmap_t* sbitmap_handle, size_t home, size_t block_size);  /*finds and marks block_size+1 free bits in shard home (modulo the number of shards), or if it has none, in the next shard along that does. Blocks never span shards. Returns start bit on success, RES_SBITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER if the block is bigger than a shard, RES_ERR_NO_MATCH if no shard has room*/
+ ushort res_sbitmap_free(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit);  /*unmarks bits from base to (base+limit), in whichever shards they belong to. Limit of 0 = 1 bit. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_sbitmap_take(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit);  /*marks bits from base to (base+limit). Does not check if they were free. Limit of 0 = 1 bit. Returns 0 on success, 2 on base out-of-range, 3 on limit out-of-range*/
+ ushort res_sbitmap_check(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit);  /*returns 0 if all bits from base to (base+limit) are 0, 1 if all are 1, 2 if they vary, 4 on base-out-of-range, 5 on limit-out-of-range. A range over several shards is not one snapshot*/
+ size_t res_sbitmap_count(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit);  /*counts bits taken from base to base+limit, with the same caveat as check. Returns count on success, RES_SBITMAP_ERR on failure; errno is set to RES_ERR_BAD_PARAMETER*/
+ size_t res_sbitmap_get_size(res_sbitmap_t* sbitmap_handle);  /*Returns: num_bits*/
+ size_t res_sbitmap_get_shards(res_sbitmap_t* sbitmap_handle);  /*Returns: number of shards*/
+ ushort res_sbitmap_stats(res_sbitmap_t* sbitmap_handle, size_t shard, res_sbitmap_stats_t* stats);  /*fills in stats for one shard. Returns 0 on success, 2 on shard out-of-range*/
+
+/*Internal functions:*/
+ void _res_sbitmap_lock(res_sbitmap_shard_t* shard);  /*spins until the shard is ours*/
+ void _res_sbitmap_unlock(res_sbitmap_shard_t* shard);
+ ushort _res_sbitmap_mark(res_sbitmap_t* sbitmap_handle, size_t base, size_t limit, ushort up);  /*takes (up=1) or frees (up=0) a range, shard by shard. Returns as take / free*/
+
+/*Internal variables:*/
+ extern _Atomic size_t _res_sbitmap_threads;  /*threads that have called res_sbitmap_home so far*/
+ extern _Thread_local size_t _res_sbitmap_thread;  /*the calling thread's number, or SIZE_MAX before its first call to res_sbitmap_home*/
+#endif
@@ -0,0 +1,336 @@
+/* sbitmap_test.c - unit tests for sbitmap.c
+ *
+ * REQUIRES: sbitmap_1, reff-1 implementation
+ * TESTS: sbitmap_1.0
+ *
+ * This file is released into the public domain, and permission is granted
+ * to use, modify, and / or redistribute at will. This software is provided
+ * 'as-is', without any express or implied  warranty. In no event will the
+ * authors be held liable for any damages arising from the use of this
+ * software.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include "sbitmap.h"
+#include "res_err.h"
+
+#define STRESS_THREADS 8
+#define STRESS_ROUNDS 20000
+#define STRESS_BITS 4096
+
+  int main(void);
+  int create_destroy(void);
+  int free_take_check_count(void);
+  int test_alloc(void);  /*named test_... because alloc is already a function name*/
+  int stress(void);
+  void* stress_thread(void* arg);  /*allocs and frees blocks from its home shard, checking no other thread holds any bit of them*/
+
+ /*shared by the stress threads*/
+  res_sbitmap_t* stress_map;
+  _Atomic unsigned char stress_owner[STRESS_BITS];  /*0 = nobody, else thread number + 1*/
+  _Atomic size_t stress_failures;
+
+int main()
+{
+   /*create, destroy*/
+    printf("01 - create & destroy bitmaps\n");
+    if( 0 != create_destroy() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*free, take, check, count*/
+    printf("02 - free, take, check, & count operations\n");
+    if( 0 != free_take_check_count() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*alloc*/
+    printf("03 - alloc & stealing\n");
+    if( 0 != test_alloc() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+   /*many threads at once*/
+    printf("04 - %d threads allocating and freeing at once\n", STRESS_THREADS);
+    if( 0 != stress() )
+    {
+      printf("TEST FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
+  printf("ALL TESTS PASSED!\n");
+  return(EXIT_SUCCESS);
+}
+
+int create_destroy(void)
+{
+  res_sbitmap_t* bitmap1;
+  res_sbitmap_t* bitmap2;
+  res_sbitmap_stats_t stats;
+  size_t i;
+    printf("\tcreating bitmaps of size 1,000 and 1,000,000... ");
+    bitmap1 = res_sbitmap_create(999, 4, 0);
+    bitmap2 = res_sbitmap_create(999999, 16, RES_BITMAP_OPT_SUMMARY);
+    assert(NULL != bitmap1);
+    assert(NULL != bitmap2);
+    assert(999 == res_sbitmap_get_size(bitmap1));
+    assert(4 == res_sbitmap_get_shards(bitmap1));
+    assert(16 == res_sbitmap_get_shards(bitmap2));
+    printf("Good!\n");
+
+    printf("\tshard sizes... ");
+    for(i=0; i<3; i++)
+    {
+      assert(0 == res_sbitmap_stats(bitmap1, i, &stats));
+      assert(0 == stats.bits % BITS);
+      assert(1000 / 4 <= stats.bits);
+    }
+    assert(0 == res_sbitmap_stats(bitmap1, 3, &stats));
+    assert(1000 - 3 * (1000 / 4 / BITS + 1) * BITS == stats.bits);
+    assert(0 == stats.taken);
+    assert(2 == res_sbitmap_stats(bitmap1, 4, &stats));
+    printf("Good!\n");
+
+    printf("\tsmall bitmaps get fewer shards... ");
+    assert(0 == res_sbitmap_destroy(bitmap1));
+    bitmap1 = res_sbitmap_create(0, 8, 0);
+    assert(NULL != bitmap1);
+    assert(1 == res_sbitmap_get_shards(bitmap1));
+    assert(0 == res_sbitmap_alloc(bitmap1, 5, 0));
+    assert(0 == res_sbitmap_destroy(bitmap1));
+    bitmap1 = res_sbitmap_create(BITS * 2, 8, 0);
+    assert(NULL != bitmap1);
+    assert(3 == res_sbitmap_get_shards(bitmap1));
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    errno = 0;
+    assert(NULL == res_sbitmap_create(100, 0, 0));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    errno = 0;
+    assert(NULL == res_sbitmap_create(100, 2, 0x8000));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\tdestroying bitmaps... ");
+    assert(0 == res_sbitmap_destroy(bitmap1));
+    assert(0 == res_sbitmap_destroy(bitmap2));
+    printf("Good!\n");
+  return(0);
+}
+
+int free_take_check_count(void)
+{
+  res_sbitmap_t* bitmap1;
+  res_sbitmap_stats_t stats;
+  size_t edge;
+    printf("\tcreating bitmap of size 1000 in 4 shards... ");
+    bitmap1 = res_sbitmap_create(999, 4, 0);
+    assert(NULL != bitmap1);
+    assert(0 == res_sbitmap_stats(bitmap1, 1, &stats));
+    edge = stats.bits;  /*first bit of shard 1*/
+    printf("Good!\n");
+
+    printf("\ttake, free & check over shard boundaries... ");
+    assert(0 == res_sbitmap_take(bitmap1, edge - 10, 2 * edge));
+    assert(1 == res_sbitmap_check(bitmap1, edge - 10, 2 * edge));
+    assert(0 == res_sbitmap_check(bitmap1, 0, edge - 11));
+    assert(2 == res_sbitmap_check(bitmap1, edge - 11, 1));
+    assert(0 == res_sbitmap_free(bitmap1, edge - 5, 9));
+    assert(2 == res_sbitmap_check(bitmap1, edge - 10, 2 * edge));
+    assert(0 == res_sbitmap_check(bitmap1, edge - 5, 9));
+    assert(0 == res_sbitmap_stats(bitmap1, 0, &stats));
+    assert(5 == stats.taken);
+    assert(0 == res_sbitmap_stats(bitmap1, 1, &stats));
+    assert(edge - 5 == stats.taken);
+    printf("Good!\n");
+
+    printf("\tcount... ");
+    assert(2 * edge + 1 - 10 == res_sbitmap_count(bitmap1, 0, 999));
+    assert(5 == res_sbitmap_count(bitmap1, edge - 20, 19));
+    assert(0 == res_sbitmap_count(bitmap1, 999, 0));
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    assert(2 == res_sbitmap_take(bitmap1, 1000, 0));
+    assert(3 == res_sbitmap_take(bitmap1, 999, 1));
+    assert(2 == res_sbitmap_free(bitmap1, 1000, 0));
+    assert(3 == res_sbitmap_free(bitmap1, 1, SIZE_MAX));
+    assert(4 == res_sbitmap_check(bitmap1, 1000, 0));
+    assert(5 == res_sbitmap_check(bitmap1, 999, 1));
+    errno = 0;
+    assert(RES_SBITMAP_ERR == res_sbitmap_count(bitmap1, 999, 1));
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    printf("Good!\n");
+
+    printf("\tdestroying bitmap... ");
+    assert(0 == res_sbitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int test_alloc(void)
+{
+  res_sbitmap_t* bitmap1;
+  res_sbitmap_stats_t stats;
+  size_t i;
+  size_t start;
+    printf("\tallocs come from the home shard... ");
+    bitmap1 = res_sbitmap_create(4 * BITS - 1, 4, 0);
+    assert(NULL != bitmap1);
+    assert(4 == res_sbitmap_get_shards(bitmap1));
+    assert(2 * BITS == res_sbitmap_alloc(bitmap1, 2, 9));
+    assert(2 * BITS + 10 == res_sbitmap_alloc(bitmap1, 2, 0));
+    assert(BITS == res_sbitmap_alloc(bitmap1, 5, 0));  /*home is modulo the number of shards*/
+    printf("Good!\n");
+
+    printf("\tfull home shard steals from the next... ");
+    assert(0 == res_sbitmap_free(bitmap1, 0, 4 * BITS - 1));
+    assert(3 * BITS == res_sbitmap_alloc(bitmap1, 3, BITS - 1));
+    assert(0 == res_sbitmap_alloc(bitmap1, 3, 0));  /*wraps round to shard 0*/
+    assert(0 == res_sbitmap_stats(bitmap1, 3, &stats));
+    assert(BITS == stats.taken);
+    assert(1 == stats.steals);
+    assert(0 == stats.stolen);
+    assert(0 == res_sbitmap_stats(bitmap1, 0, &stats));
+    assert(1 == stats.taken);
+    assert(1 == stats.stolen);
+    assert(0 == stats.steals);
+    printf("Good!\n");
+
+    printf("\tfreed bits go back to the shard they came from... ");
+    assert(0 == res_sbitmap_free(bitmap1, 0, 0));
+    assert(0 == res_sbitmap_stats(bitmap1, 0, &stats));
+    assert(0 == stats.taken);
+    assert(0 == res_sbitmap_free(bitmap1, 3 * BITS, 0));
+    assert(3 * BITS == res_sbitmap_alloc(bitmap1, 3, 0));  /*home has room again, so no steal*/
+    assert(0 == res_sbitmap_stats(bitmap1, 3, &stats));
+    assert(1 == stats.steals);
+    printf("Good!\n");
+
+    printf("\tfilling every shard... ");
+    assert(0 == res_sbitmap_free(bitmap1, 0, 4 * BITS - 1));
+    for(i=0; i<4 * BITS; i++)
+    {
+      start = res_sbitmap_alloc(bitmap1, 1, 0);
+      assert(RES_SBITMAP_ERR != start);
+    }
+    assert(1 == res_sbitmap_check(bitmap1, 0, 4 * BITS - 1));
+    errno = 0;
+    assert(RES_SBITMAP_ERR == res_sbitmap_alloc(bitmap1, 1, 0));
+    assert(RES_ERR_NO_MATCH == errno);
+    assert(0 == res_sbitmap_stats(bitmap1, 1, &stats));
+    assert(3 * BITS == stats.steals);
+    printf("Good!\n");
+
+    printf("\terror conditions... ");
+    errno = 0;
+    assert(RES_SBITMAP_ERR == res_sbitmap_alloc(bitmap1, 0, BITS));  /*blocks can't span shards*/
+    assert(RES_ERR_BAD_PARAMETER == errno);
+    assert(0 == res_sbitmap_destroy(bitmap1));
+    printf("Good!\n");
+  return(0);
+}
+
+int stress(void)
+{
+  pthread_t thread[STRESS_THREADS];
+  res_sbitmap_stats_t stats;
+  size_t i;
+  size_t allocs = 0;
+    printf("\tcreating bitmap of size %d in %d shards... ", STRESS_BITS, STRESS_THREADS);
+    stress_map = res_sbitmap_create(STRESS_BITS - 1, STRESS_THREADS, 0);
+    assert(NULL != stress_map);
+    for(i=0; i<STRESS_BITS; i++)
+      atomic_init(&stress_owner[i], 0);
+    atomic_init(&stress_failures, 0);
+    printf("Good!\n");
+
+    printf("\tallocating and freeing, checking no bit is handed out twice... ");
+    for(i=0; i<STRESS_THREADS; i++)
+      assert(0 == pthread_create(&thread[i], NULL, stress_thread, NULL));
+    for(i=0; i<STRESS_THREADS; i++)
+      assert(0 == pthread_join(thread[i], NULL));
+    assert(0 == atomic_load(&stress_failures));
+    printf("Good!\n");
+
+    printf("\tall bits back free... ");
+    assert(0 == res_sbitmap_count(stress_map, 0, STRESS_BITS - 1));
+    for(i=0; i<STRESS_THREADS; i++)
+    {
+      assert(0 == res_sbitmap_stats(stress_map, i, &stats));
+      assert(0 == stats.taken);
+      assert(stats.steals <= STRESS_ROUNDS);
+      allocs += stats.allocs;
+    }
+    assert(0 < allocs);
+    assert(0 == res_sbitmap_destroy(stress_map));
+    printf("Good!\n");
+  return(0);
+}
+
+void* stress_thread(void* arg)
+{
+  unsigned char me;
+  unsigned int seed;
+  size_t home;
+  size_t held_start[64];
+  size_t held_size[64];
+  size_t held = 0;
+  size_t round;
+  size_t size;
+  size_t start;
+  size_t i;
+    (void)arg;
+    home = res_sbitmap_home(stress_map);
+    me = (unsigned char)(_res_sbitmap_thread + 1);
+    seed = me * 2654435761u;
+
+    for(round=0; round<STRESS_ROUNDS; round++)
+    {
+      seed = seed * 1103515245u + 12345u;
+      if((held < 64) && ((held == 0) || (0 != (seed & 0x10000))))
+      {
+        size = (seed >> 8) % 16;
+        start = res_sbitmap_alloc(stress_map, home, size);
+        if(RES_SBITMAP_ERR == start)
+          continue;
+        for(i=start; i<=start+size; i++)
+          if(0 != atomic_exchange(&stress_owner[i], me))
+            atomic_fetch_add(&stress_failures, 1);
+        held_start[held] = start;
+        held_size[held] = size;
+        held++;
+      }
+      else
+      {
+        held--;
+        for(i=held_start[held]; i<=held_start[held]+held_size[held]; i++)
+          if(me != atomic_exchange(&stress_owner[i], 0))
+            atomic_fetch_add(&stress_failures, 1);
+        if(0 != res_sbitmap_free(stress_map, held_start[held], held_size[held]))
+          atomic_fetch_add(&stress_failures, 1);
+      }
+    }
+    while(held > 0)
+    {
+      held--;
+      for(i=held_start[held]; i<=held_start[held]+held_size[held]; i++)
+        if(me != atomic_exchange(&stress_owner[i], 0))
+          atomic_fetch_add(&stress_failures, 1);
+      res_sbitmap_free(stress_map, held_start[held], held_size[held]);
+    }
+  return(NULL);
+}
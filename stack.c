@@ -1,6 +1,6 @@
 /* stack.c - stack handling code
  *
- * API: stack 1.0
+ * API: stack 1.1
  * IMPLEMENTATION: reff-1
  *
  * This file is released into the public domain, and permission is granted
@@ -46,9 +46,14 @@ ushort res_stack_destroy(res_stack_t* stack_handle)
 ushort res_stack_push(res_stack_t* stack_handle, void* resource)
 {
   void **stack;
-   /*Is it full?*/
+  ushort retval;
+   /*Is it full? Grow it if we can*/
     if(stack_handle->top > stack_handle->limit)
-      return(2);
+    {
+      retval = _res_stack_grow(stack_handle);
+      if(0 != retval)
+        return(retval);
+    }
 
    /*Get stack*/
     stack = stack_handle->stack;
@@ -62,6 +67,7 @@ ushort res_stack_push(res_stack_t* stack_handle, void* resource)
 void* res_stack_pop(res_stack_t* stack_handle)
 {
   void **stack;  /*double pointer. int **stack -> **stack[3] = the integer, *stack[3] = the pointer to the integer, stack = pointer to the array of pointers*/
+  void* retval;
    /*Check if there are any entries at all*/
     if(0 == stack_handle->top)
     {
@@ -74,24 +80,40 @@ void* res_stack_pop(res_stack_t* stack_handle)
 
    /*Remove top entry*/
     stack_handle -> top--;
+    retval = stack[stack_handle -> top];
+    _res_stack_shrink(stack_handle);
 
-  if (NULL == stack[stack_handle -> top])  /*NULL is also used to signal error, so set errno to 0 to make it clear this is the answer, not an error*/
+  if (NULL == retval)  /*NULL is also used to signal error, so set errno to 0 to make it clear this is the answer, not an error*/
     errno = 0;
-  return(stack[stack_handle -> top]);
+  return(retval);
 }
 
 ushort res_stack_xpush(res_stack_t* stack_handle, size_t n, void* resource)
 {
   void **stack;  /*double pointer. int **stack -> **stack[3] = the integer, *stack[3] = the pointer to the integer, stack = pointer to the array of pointers*/
   size_t i;
-   /*is it full?*/
-    if (stack_handle->top > stack_handle->limit)
+   /*is it full, with no growing allowed? Checked before n, as it always was*/
+    if ((stack_handle->top > stack_handle->limit) && ((0 == stack_handle->growth) || (stack_handle->limit >= stack_handle->max_limit)))
       return(2);
 
    /*is n in range*/
     if (n > stack_handle->top)
       return(3);
 
+   /*full, but it can grow*/
+    if (stack_handle->top > stack_handle->limit)
+    {
+      switch(_res_stack_grow(stack_handle))
+      {
+        case 0 :
+          break;
+        case 2 :
+          return(2);
+        default :
+          return(4);
+      }
+    }
+
    /*get stack*/
     stack = stack_handle->stack;
 
@@ -127,6 +149,7 @@ void* res_stack_xpop(res_stack_t* stack_handle, size_t n)
     for(i=n; i < (stack_handle->top - 1); i++)  /*has to be top-1 since if stack is full top won't exist*/
       stack[i] = stack[i+1];
     stack_handle -> top--;
+    _res_stack_shrink(stack_handle);
 
   if (NULL == retval)  /*NULL is also used to signal error, so set errno to 0 to make it clear this is the answer, not an error*/
     errno = 0;
@@ -186,6 +209,19 @@ ushort res_stack_resize(res_stack_t* stack_handle, size_t max_entries)
   return(0);
 }
 
+ushort res_stack_set_growth(res_stack_t* stack_handle, ushort growth, size_t max_entries, ushort shrink)
+{
+   /*check it can grow to max_entries*/
+    if (max_entries < stack_handle->limit)
+      return(2);
+
+    stack_handle->growth = growth;
+    stack_handle->shrink = (0 == shrink) ? 0 : 1;
+    stack_handle->max_limit = max_entries;
+    stack_handle->min_limit = stack_handle->limit;
+  return(0);
+}
+
 size_t res_stack_get_entries(res_stack_t* stack_handle)
 {
   return(stack_handle->top);
@@ -204,6 +240,10 @@ void _res_stack_handle_set(res_stack_t* stack_handle, void** base, size_t max_en
     stack_handle->stack = base;
     stack_handle->limit = max_entries;
     stack_handle->top = 0;
+    stack_handle->growth = 0;
+    stack_handle->shrink = 0;
+    stack_handle->max_limit = max_entries;
+    stack_handle->min_limit = max_entries;
 }
 
 size_t _res_stack_size(size_t max_entries)
@@ -211,3 +251,40 @@ size_t _res_stack_size(size_t max_entries)
   return((max_entries + 1) * sizeof(void*));
 }
 
+ushort _res_stack_grow(res_stack_t* stack_handle)
+{
+  size_t entries;
+  size_t more;
+   /*can it grow at all?*/
+    if ((0 == stack_handle->growth) || (stack_handle->limit >= stack_handle->max_limit))
+      return(2);
+
+   /*growth percent more entries, at least one, capped at max_limit. Worked out so it can't overflow*/
+    entries = stack_handle->limit + 1;
+    more = (entries / 100) * stack_handle->growth + ((entries % 100) * stack_handle->growth) / 100;
+    if (0 == more)
+      more = 1;
+    if (more > (stack_handle->max_limit - stack_handle->limit))
+      more = stack_handle->max_limit - stack_handle->limit;
+
+    if (0 != res_stack_resize(stack_handle, stack_handle->limit + more))
+      return(3);  /*errno set by realloc*/
+  return(0);
+}
+
+void _res_stack_shrink(res_stack_t* stack_handle)
+{
+  size_t entries;
+   /*only once no more than 1/RES_STACK_SHRINK_AT is in use, and never below min_limit*/
+    if ((0 == stack_handle->shrink) || (stack_handle->limit <= stack_handle->min_limit))
+      return;
+    entries = stack_handle->limit + 1;
+    if (stack_handle->top > entries / RES_STACK_SHRINK_AT)
+      return;
+
+   /*to half - a failed realloc just leaves it as it was*/
+    entries /= 2;
+    if (entries < stack_handle->min_limit + 1)
+      entries = stack_handle->min_limit + 1;
+    res_stack_resize(stack_handle, entries - 1);
+}
@@ -1,6 +1,6 @@
 /* stack.h - header for stack.c
  *
- * API: stack 1.0
+ * API: stack 1.1
  * IMPLEMENTATION: reff-1
  *
  * This file is released into the public domain, and permission is granted
@@ -15,27 +15,35 @@
  #include "res_types.h"
  #include "res_err.h"
 
+/*Config:*/
+ #define RES_STACK_SHRINK_AT 4  /*a stack set to shrink halves once 1/RES_STACK_SHRINK_AT of it or less is in use - so it is half full after, and has to double again before it next grows*/
+
 /*Structures:*/
  typedef struct
  {
    void **stack;  /*pointer to an array of pointers*/
    size_t limit;  /*number of pointers possible in stack. Stack with 1 entry, limit = 0*/
    size_t top; /*that is, this entry is where new data will be pushed to. pop from top - 1*/
+   ushort growth;  /*percent push grows a full stack by, 0 = never grow - see res_stack_set_growth*/
+   ushort shrink;  /*1 if pop and xpop shrink the stack as it drains*/
+   size_t max_limit;  /*largest limit push may grow to*/
+   size_t min_limit;  /*smallest limit pop may shrink to - the limit when growth was set*/
   } res_stack_t;
 
 /*External Functions:*/
  res_stack_t* res_stack_create(size_t max_entries);  /*creates a stack of size big enough to fit max_entries, starts at 0 (i.e. res_add_stack(0) means stack with 1 entry). Returns NULL on failure to allocate memory, errno preserved from calloc call*/
  ushort res_stack_destroy(res_stack_t* stack_handle);  /*returns 0 on success, non-zero on fail*/
 
- ushort res_stack_push(res_stack_t* stack_handle, void* resource);  /*pushes a resource pointer to the top of the stack, returns 0 on success, 2 on stack full*/
- void* res_stack_pop(res_stack_t* stack_handle);  /*returns the resource pointer at the top of the stack and removes that entry, returns NULL on failure with errno set to res_err.h error code. If resource was a null pointer to begin with, errno=0*/
- ushort res_stack_xpush(res_stack_t* stack_handle, size_t n, void* resource);  /*inserts a resource pointer into the stack at point n (0 = first stack element. Cannot insert an entry more than one element after the top one), returns 0 on success, 2 on stack full, 3 on n too high*/
+ ushort res_stack_push(res_stack_t* stack_handle, void* resource);  /*pushes a resource pointer to the top of the stack. A full stack is grown first if res_stack_set_growth allows. Returns 0 on success, 2 on stack full, 3 on memory error growing it (errno preserved from realloc)*/
+ void* res_stack_pop(res_stack_t* stack_handle);  /*returns the resource pointer at the top of the stack and removes that entry, shrinking the stack if set to. Returns NULL on failure with errno set to res_err.h error code. If resource was a null pointer to begin with, errno=0*/
+ ushort res_stack_xpush(res_stack_t* stack_handle, size_t n, void* resource);  /*inserts a resource pointer into the stack at point n (0 = first stack element. Cannot insert an entry more than one element after the top one), growing it as push. Returns 0 on success, 2 on stack full, 3 on n too high, 4 on memory error growing it (errno preserved)*/
  void* res_stack_xpop(res_stack_t* stack_handle, size_t n);  /*removes and returns the resource pointer at n, returns NULL on failure with errno set to a res_err.h error code. If the resource was a null pointer to begin with, errno=0*/
 
  ushort res_stack_change(res_stack_t* stack_handle, size_t n, void* resource);  /*changes the resource pointer of stack entry n. Returns: 0 on success, 2 on stack entry non-existent*/
  void* res_stack_get(res_stack_t* stack_handle, size_t n);  /*returns the resource pointed to by stack entry n, returns NULL on failure with errno set to a res_err.h error code. If the resource was a null pointer to begin with, errno=0*/
 
  ushort res_stack_resize(res_stack_t* stack_handle, size_t max_entries);  /*resizes the stack to new size max_entries. Returns: 0 on success, 2 on stack too big, 3 on memory error; errno preserved on realloc fail*/
+ ushort res_stack_set_growth(res_stack_t* stack_handle, ushort growth, size_t max_entries, ushort shrink);  /*lets push grow a full stack by growth percent of its size (at least 1 entry) up to max_entries, starting at 0 as res_stack_create - so pushes are amortised O(1). growth of 0 turns it off, the default. shrink=1 also halves the stack on pop once no more than 1/RES_STACK_SHRINK_AT of it is in use, down to the size it is now. Returns: 0 on success, 2 on max_entries smaller than the stack is now*/
 
  size_t res_stack_get_entries(res_stack_t* stack_handle);  /*returns the number of entries that have been pushed onto stack, 0= no stack entries, returns RES_STACK_ERR on failure*/
  size_t res_stack_get_size(res_stack_t* stack_handle);  /*returns the maximum number of entries that the stack can hold, 0= max one entry, returns RES_STACK_ERR on failure*/
@@ -43,4 +51,6 @@
 /*Internal Functions:*/
  void _res_stack_handle_set(res_stack_t* stack_handle, void** base, size_t max_entries);
  size_t _res_stack_size(size_t max_entries);
+ ushort _res_stack_grow(res_stack_t* stack_handle);  /*makes room for one more entry in a full stack, if growth allows. Returns 0 on success, 2 if it can't grow, 3 on memory error (errno preserved)*/
+ void _res_stack_shrink(res_stack_t* stack_handle);  /*halves a stack set to shrink, if little enough of it is in use. The stack is left as it was if realloc fails*/
 #endif
@@ -1,7 +1,7 @@
 /* stack_test_c - unit tests for stack.c
  *
  * REQUIRES: stack_1
- * TESTS: stack_1.0
+ * TESTS: stack_1.1
  *
  * This file is released into the public domain, and permission is granted
  * to use, modify, and / or redistribute at will. This software is provided
@@ -23,6 +23,7 @@
   int push_pop_get_change(void);
   int pushx_popx(void);
   int resize(void);
+  int growth(void);
 
 int main()
 {
@@ -55,6 +56,13 @@ int main()
       return(EXIT_FAILURE);
     }
 
+    printf("05 - growth & shrinking\n");
+    if (0 != growth())
+    {
+      printf("TEST_FAIL!\n");
+      return(EXIT_FAILURE);
+    }
+
   printf("ALL TESTS PASSED!\n");
   return(EXIT_SUCCESS);
 }
@@ -369,3 +377,87 @@ int resize(void)
   return(0);
 }
 
+int growth(void)
+{
+  res_stack_t *stack1;
+  size_t i;
+  size_t resizes;
+  size_t last_size;
+   /*make test stack*/
+    printf("\tcreating stack for test... ");
+    stack1 = res_stack_create(3);
+    assert(NULL != stack1);
+    printf("Good!\n");
+
+   /*off by default - full is still full*/
+    printf("\terror conditions... ");
+    for (i=0; i<4; i++)
+      assert(0 == res_stack_push(stack1, (void*) i));
+    assert(2 == res_stack_push(stack1, (void*) 4));
+    assert(2 == res_stack_xpush(stack1, 0, (void*) 4));
+    assert(2 == res_stack_xpush(stack1, 10, (void*) 4));  /*full is reported before n too high*/
+    assert(2 == res_stack_set_growth(stack1, 100, 2, 0));
+    assert(3 == res_stack_get_size(stack1));
+    printf("Good!\n");
+
+   /*doubling, up to 1000 entries*/
+    printf("\tgrowing by 100%% up to 1000... ");
+    assert(0 == res_stack_set_growth(stack1, 100, 999, 1));
+    assert(3 == res_stack_xpush(stack1, 10, (void*) 4));  /*n checked before growing*/
+    assert(3 == res_stack_get_size(stack1));
+    assert(0 == res_stack_push(stack1, (void*) 4));
+    assert(7 == res_stack_get_size(stack1));
+    assert(0 == res_stack_xpush(stack1, 5, (void*) 5));
+    resizes = 1;
+    last_size = res_stack_get_size(stack1);
+    for (i=6; i<1000; i++)
+    {
+      assert(0 == res_stack_push(stack1, (void*) i));
+      if (res_stack_get_size(stack1) != last_size)
+      {
+        assert(res_stack_get_size(stack1) == ((2 * (last_size + 1) > 1000) ? 999 : 2 * (last_size + 1) - 1));
+        last_size = res_stack_get_size(stack1);
+        resizes++;
+      }
+    }
+    assert(8 == resizes);  /*4 -> 8 -> 16 ... 512 -> 1000*/
+    assert(999 == res_stack_get_size(stack1));
+    assert(2 == res_stack_push(stack1, (void*) 1000));
+    assert(2 == res_stack_xpush(stack1, 0, (void*) 1000));
+    assert(2 == res_stack_xpush(stack1, 2000, (void*) 1000));
+    for (i=0; i<1000; i++)
+      assert((void*) i == res_stack_get(stack1, i));
+    printf("Good!\n");
+
+   /*shrinks by half once only a quarter is used, no lower than it started*/
+    printf("\tshrinking as it drains... ");
+    for (i=999; i>250; i--)
+      assert((void*) i == res_stack_pop(stack1));
+    assert(999 == res_stack_get_size(stack1));
+    assert((void*) 250 == res_stack_pop(stack1));
+    assert(499 == res_stack_get_size(stack1));
+    assert(0 == res_stack_push(stack1, (void*) 250));  /*hysteresis - no growing straight back*/
+    assert(499 == res_stack_get_size(stack1));
+    assert((void*) 5 == res_stack_xpop(stack1, 5));
+    for (i=250; i>5; i--)
+      assert((void*) i == res_stack_pop(stack1));
+    assert(14 == res_stack_get_size(stack1));  /*500 -> 250 -> 125 -> 62 -> 31 -> 15 entries*/
+    for (i=5; i>0; i--)
+      assert((void*) (i - 1) == res_stack_pop(stack1));
+    assert(3 == res_stack_get_size(stack1));
+    printf("Good!\n");
+
+   /*small stacks and factors still grow by at least one*/
+    printf("\tgrowing by 1%%, without shrinking... ");
+    assert(0 == res_stack_set_growth(stack1, 1, 200, 0));
+    for (i=0; i<201; i++)
+      assert(0 == res_stack_push(stack1, (void*) i));
+    assert(200 == res_stack_get_size(stack1));
+    for (i=201; i>0; i--)
+      assert((void*) (i - 1) == res_stack_pop(stack1));
+    assert(200 == res_stack_get_size(stack1));
+    printf("Good!\n");
+
+  assert(0 == res_stack_destroy(stack1));
+  return(0);
+}